@@ -9,6 +9,11 @@ BuildRequires:  cmake >= 3.16
 BuildRequires:  qt6-qtbase-devel >= 6.0.0
 BuildRequires:  gcc-c++
 BuildRequires:  make
+BuildRequires:  zlib-devel
+BuildRequires:  libarchive-devel
+BuildRequires:  xz-devel
+BuildRequires:  libzstd-devel
+BuildRequires:  liburing-devel
 Requires:       qt6-qtbase >= 6.0.0
 Requires:       rar
 Requires:       p7zip
@@ -22,7 +27,7 @@ WinRAR-like functionality by interfacing with native command-line tools
 (rar, 7zip, tar, etc.).
 
 Features:
-- Support for RAR, ZIP, 7Z, TAR, TAR.GZ, TAR.BZ2, TAR.XZ formats
+- Support for RAR, ZIP, 7Z, TAR, TAR.GZ, TAR.BZ2, TAR.XZ, TAR.ZST, TAR.LZ4 formats
 - Create, extract, view, and modify archives
 - Password protection and encryption
 - Modern dual-pane interface
@@ -1,11 +1,36 @@
 #include "ArchiveHandler.h"
 #include "ProcessManager.h"
-#include <QStandardPaths>
+#include "ListParser.h"
+#include "ToolRegistry.h"
 #include <QFileInfo>
-#include <QProcess>
+#include <QTemporaryFile>
+#include <QDir>
+#include <QThread>
+
+// Well below ARG_MAX, which also has to hold the environment
+static const int LIST_FILE_THRESHOLD = 1000;
+static const qint64 LIST_FILE_THRESHOLD_BYTES = 64 * 1024;
+// Same pace as ProcessManager's progressChanged()
+static const int PROGRESS_INTERVAL = 100;
+
+QString MemberCheck::describe(Status status) {
+    switch (status) {
+        case Ok:
+            return "OK";
+        case CrcMismatch:
+            return "CRC mismatch";
+        case Truncated:
+            return "truncated";
+        case BadHeader:
+            return "bad header";
+        case Corrupt:
+            return "corrupt data";
+    }
+    return QString();
+}
 
 ArchiveHandler::ArchiveHandler(QObject *parent)
-    : QObject(parent) {
+    : QObject(parent), expectedBytes(-1), expectedFiles(-1), listingTruncated(false), listFile(nullptr) {
     processManager = new ProcessManager(this);
     
     connect(processManager, &ProcessManager::progressUpdate,
@@ -13,18 +38,177 @@ ArchiveHandler::ArchiveHandler(QObject *parent)
         emit progress(msg, -1);
     });
     
+    connect(processManager, &ProcessManager::progressChanged,
+            this, [this](const ProgressInfo &info) {
+        if (!info.currentFile.isEmpty()) {
+            emit progress(info.currentFile, info.percentage);
+        }
+        emit progressDetail(info);
+    });
+    
     connect(processManager, &ProcessManager::errorOccurred,
             this, &ArchiveHandler::error);
 }
 
+void ArchiveHandler::cancel() {
+    processManager->requestCancel();
+}
+
+void ArchiveHandler::changeScheduling(int niceLevel, int ioClass) {
+    processManager->changeScheduling(niceLevel, ioClass);
+}
+
+void ArchiveHandler::setExpectedTotals(qint64 bytes, qint64 files) {
+    expectedBytes = bytes;
+    expectedFiles = files;
+}
+
+void ArchiveHandler::setPriority(const ProcessPriority &priority) {
+    processManager->setPriority(priority);
+}
+
+void ArchiveHandler::setCompressionOptions(const CompressionOptions &options) {
+    compressionOptions = options;
+}
+
+int ArchiveHandler::threadsFor(const ToolInfo &tool) const {
+    if (!tool.has(Multithreading)) {
+        return 0;
+    }
+    // 7za takes the same switches as 7z
+    QString name = tool.name.startsWith("7z") ? QString("7z") : tool.name;
+    return processManager->getPriority().threadsFor(name);
+}
+
+int ArchiveHandler::nativeThreads() const {
+    ProcessPriority priority = processManager->getPriority();
+    int threads = priority.threadsFor("native");
+    if (threads > 0) {
+        return threads;
+    }
+    threads = QThread::idealThreadCount();
+    if (priority.cpuMask != 0) {
+        threads = qMin(threads, qPopulationCount(priority.cpuMask));
+    }
+    return qMax(1, threads);
+}
+
 bool ArchiveHandler::checkToolAvailable(const QString &toolName) const {
-    QString program = QStandardPaths::findExecutable(toolName);
-    if (program.isEmpty()) {
-        // Try with which command
-        QProcess proc;
-        proc.start("which", QStringList() << toolName);
-        proc.waitForFinished(1000);
-        return proc.exitCode() == 0;
-    }
-    return true;
+    return ToolRegistry::instance()->tool(toolName).isValid();
+}
+
+bool ArchiveHandler::runListing(const QString &program, const QStringList &arguments,
+                                ListParser &parser, QList<ArchiveEntry> &entries) {
+    QList<ArchiveEntry> batch;
+    
+    // Parse lines as the tool produces them instead of after it exits
+    processManager->setLineMode(true);
+    QMetaObject::Connection connection = connect(processManager, &ProcessManager::lineReady,
+                                                 this, [&](const QByteArray &line) {
+        QString text = QString::fromUtf8(line);
+        if (text.endsWith('\r')) {
+            text.chop(1);
+        }
+        
+        ArchiveEntry entry;
+        if (parser.parseLine(text, entry)) {
+            entries.append(entry);
+            batch.append(entry);
+            if (batch.size() >= LIST_BATCH_SIZE) {
+                emit entriesAvailable(batch);
+                batch.clear();
+            }
+        }
+    });
+    
+    QString output, errorOutput;
+    bool success = processManager->executeWithOutput(program, arguments, output, errorOutput);
+    
+    disconnect(connection);
+    processManager->setLineMode(false);
+    listingTruncated = processManager->isOutputTruncated();
+    
+    if (!batch.isEmpty()) {
+        emit entriesAvailable(batch);
+    }
+    
+    if (!success) {
+        emit error(processManager->getLastError());
+    }
+    return success;
+}
+
+void ArchiveHandler::publishEntries(const QList<ArchiveEntry> &entries) {
+    for (int i = 0; i < entries.size(); i += LIST_BATCH_SIZE) {
+        emit entriesAvailable(entries.mid(i, LIST_BATCH_SIZE));
+    }
+}
+
+void ArchiveHandler::reportProgress(const ProgressInfo &info, bool force) {
+    if (!force && progressTimer.isValid() && progressTimer.elapsed() < PROGRESS_INTERVAL) {
+        return;
+    }
+    progressTimer.start();
+    if (!info.currentFile.isEmpty()) {
+        emit progress(info.currentFile, info.percentage);
+    }
+    emit progressDetail(info);
+}
+
+bool ArchiveHandler::isCancelRequested() const {
+    return processManager->isCancelRequested();
+}
+
+bool ArchiveHandler::runTool(const QString &program, const QStringList &arguments,
+                             ProgressParser *parser) {
+    processManager->setProgressParser(parser);
+    
+    QString output, errorOutput;
+    bool success = processManager->executeWithOutput(program, arguments, output, errorOutput);
+    
+    processManager->setProgressParser(nullptr);
+    // A list file passed on stdin is only meant for this run
+    processManager->setStandardInputFile(QString());
+    
+    if (success && parser && parser->getInfo().percentage >= 0) {
+        // Meters often stop short of 100% before the tool exits
+        ProgressInfo info = parser->getInfo();
+        info.percentage = 100;
+        if (info.bytesTotal > 0) {
+            info.bytesDone = info.bytesTotal;
+        }
+        emit progressDetail(info);
+    }
+    return success;
+}
+
+bool ArchiveHandler::needsListFile(const QStringList &files) {
+    if (files.size() > LIST_FILE_THRESHOLD) {
+        return true;
+    }
+    qint64 bytes = 0;
+    for (const QString &file : files) {
+        bytes += file.size() + 1;
+    }
+    return bytes > LIST_FILE_THRESHOLD_BYTES;
+}
+
+QString ArchiveHandler::writeListFile(const QStringList &files) {
+    delete listFile;
+    listFile = new QTemporaryFile(QDir::tempPath() + "/linrar-list-XXXXXX", this);
+    if (!listFile->open()) {
+        emit error(QString("Failed to create file list: %1").arg(listFile->errorString()));
+        return QString();
+    }
+    
+    QByteArray data;
+    for (const QString &file : files) {
+        data += file.toUtf8();
+        data += '\n';
+    }
+    if (listFile->write(data) != data.size() || !listFile->flush()) {
+        emit error(QString("Failed to write file list: %1").arg(listFile->errorString()));
+        return QString();
+    }
+    return listFile->fileName();
 }
@@ -5,18 +5,48 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
+#include <QMetaType>
+#include <QElapsedTimer>
 #include "utils/FormatDetector.h"
+#include "ProgressParser.h"
+#include "ToolRegistry.h"
+#include "ProcessPriority.h"
+#include "CompressionOptions.h"
 
 class ProcessManager;
+class ListParser;
+class QTemporaryFile;
 
 struct ArchiveEntry {
     QString name;
     QString path;
-    qint64 size;
-    qint64 compressedSize;
-    bool isDirectory;
+    qint64 size = 0;
+    qint64 compressedSize = 0;
+    bool isDirectory = false;
     QString permissions;
     QString date;
+    quint32 crc = 0;
+    // Position of the member's header in the archive file, -1 if unknown
+    qint64 offset = -1;
+};
+
+Q_DECLARE_METATYPE(ArchiveEntry)
+
+// Outcome of testing one member in-process
+struct MemberCheck {
+    enum Status {
+        Ok,
+        CrcMismatch,
+        Truncated,
+        BadHeader,
+        Corrupt
+    };
+    
+    QString name;
+    Status status = Ok;
+    
+    // Short description for reports, e.g. "CRC mismatch"
+    static QString describe(Status status);
 };
 
 class ArchiveHandler : public QObject {
@@ -39,17 +69,113 @@ public:
     virtual bool removeFiles(const QString &archivePath, const QStringList &files) = 0;
     virtual bool test(const QString &archivePath) = 0;
     virtual bool repair(const QString &archivePath) = 0;
+    // Reclaims the space that members removed in place left behind; formats
+    // updated by rewriting them never have any
+    virtual bool compact(const QString &archivePath) {
+        Q_UNUSED(archivePath);
+        return true;
+    }
     
     virtual QString getToolName() const = 0;
     virtual QStringList getSupportedExtensions() const = 0;
+    
+    // Creates a fresh handler of the same kind. Jobs call this on their worker
+    // thread so every job owns its own ProcessManager/QProcess.
+    virtual ArchiveHandler *clone() const = 0;
+    
+    // Whether create() writes archivePath faster than libarchive could,
+    // e.g. through a parallel compressor or kernel-side copies
+    virtual bool prefersToolForCreate(const QString &archivePath) const {
+        Q_UNUSED(archivePath);
+        return false;
+    }
+    
+    // Whether test() checks archivePath in-process with a per-member report,
+    // which beats testing it through libarchive
+    virtual bool testsInProcess(const QString &archivePath) const {
+        Q_UNUSED(archivePath);
+        return false;
+    }
+    // Whether list() reads archivePath faster than libarchive could, e.g.
+    // from its headers alone or through a whole volume set
+    virtual bool listsInProcess(const QString &archivePath) const {
+        Q_UNUSED(archivePath);
+        return false;
+    }
+    // Whether extract() gets files out of archivePath faster than libarchive
+    // could, e.g. by seeking to them instead of decoding what lies before
+    virtual bool extractsInProcess(const QString &archivePath, const QStringList &files) const {
+        Q_UNUSED(archivePath);
+        Q_UNUSED(files);
+        return false;
+    }
+    // Per-member results of the last test(); empty when a tool did the test
+    QList<MemberCheck> getTestReport() const { return testReport; }
+    // Whether the last listing left out lines the tool printed, because
+    // they were too long to hold
+    bool isListingTruncated() const { return listingTruncated; }
+    
+    // Thread-safe: aborts the tool currently run by this handler
+    virtual void cancel();
+    // Thread-safe: reschedules the running tool and the ones after it
+    virtual void changeScheduling(int niceLevel, int ioClass);
+    
+    // Entries handed to entriesAvailable() at a time
+    static const int LIST_BATCH_SIZE = 512;
+    
+    // Uncompressed size and member count of what the next operation will
+    // process, usually taken from the listing; -1 when unknown
+    virtual void setExpectedTotals(qint64 bytes, qint64 files);
+    
+    // Scheduling and thread counts for the tools this handler runs
+    virtual void setPriority(const ProcessPriority &priority);
+    
+    // Codec settings for archives this handler writes
+    virtual void setCompressionOptions(const CompressionOptions &options);
 
 signals:
     void progress(const QString &message, int percentage);
     void error(const QString &error);
+    // Emitted in batches by list() while the listing is still being read
+    void entriesAvailable(const QList<ArchiveEntry> &entries);
+    // Parsed progress of the running tool; percentage is -1 when unknown
+    void progressDetail(const ProgressInfo &info);
 
 protected:
     ProcessManager *processManager;
     bool checkToolAvailable(const QString &toolName) const;
+    bool runListing(const QString &program, const QStringList &arguments,
+                    ListParser &parser, QList<ArchiveEntry> &entries);
+    // Hands a listing read in-process to entriesAvailable() in batches
+    void publishEntries(const QList<ArchiveEntry> &entries);
+    // For work done in-process instead of by a tool: progress is throttled
+    // the same way as tool progress, cancellation is polled
+    void reportProgress(const ProgressInfo &info, bool force = false);
+    bool isCancelRequested() const;
+    // Runs a tool to completion, reporting its progress through parser if given
+    bool runTool(const QString &program, const QStringList &arguments,
+                 ProgressParser *parser = nullptr);
+    
+    // Selections this large go to the tool through a list file, not argv
+    static bool needsListFile(const QStringList &files);
+    // Writes one path per line to a temporary file that is kept until the
+    // next list file is written; returns its path, empty on failure
+    QString writeListFile(const QStringList &files);
+    // Configured thread count for tool, 0 when unset or not supported by it
+    int threadsFor(const ToolInfo &tool) const;
+    // Workers for in-process engines: the "native" setting, else one per
+    // CPU the affinity mask allows
+    int nativeThreads() const;
+    
+    qint64 expectedBytes;
+    qint64 expectedFiles;
+    CompressionOptions compressionOptions;
+    QList<MemberCheck> testReport;
+    bool listingTruncated;
+
+private:
+    QTemporaryFile *listFile;
+    QElapsedTimer progressTimer;
 };
 
 #endif // ARCHIVEHANDLER_H
@@ -0,0 +1,162 @@
+#include "ArchiveJob.h"
+#include "utils/ArchiveUtils.h"
+#include <QMutexLocker>
+#include <QTemporaryDir>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+ArchiveJob::ArchiveJob(Operation operation, const ArchiveHandler *handler,
+                       const QString &archivePath, QObject *parent)
+    : QObject(parent), operation(operation), prototype(handler),
+      archivePath(archivePath), compressionLevel(5),
+      expectedBytes(-1), expectedFiles(-1), listingTruncated(false), archiveExisted(false),
+      cancelled(false), worker(nullptr) {
+    // Lifetime is managed by JobManager, not by QThreadPool
+    setAutoDelete(false);
+}
+
+bool ArchiveJob::modifiesArchive() const {
+    switch (operation) {
+        case Create:
+        case AddFiles:
+        case RemoveFiles:
+        case Repair:
+        case Compact:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ArchiveJob::cancel() {
+    cancelled.store(true);
+
+    QMutexLocker locker(&workerMutex);
+    if (worker) {
+        worker->cancel();
+    }
+}
+
+void ArchiveJob::changeScheduling(int niceLevel, int ioClass) {
+    QMutexLocker locker(&workerMutex);
+    priority.niceLevel = niceLevel;
+    priority.ioClass = ioClass;
+    if (worker) {
+        worker->changeScheduling(niceLevel, ioClass);
+    }
+}
+
+void ArchiveJob::run() {
+    if (cancelled.load()) {
+        emit finished(false);
+        return;
+    }
+
+    // Created on the worker thread so its QProcess belongs to this thread
+    ArchiveHandler *handler = prototype->clone();
+    handler->setExpectedTotals(expectedBytes, expectedFiles);
+    handler->setCompressionOptions(compressionOptions);
+    connect(handler, &ArchiveHandler::progress, this, &ArchiveJob::progress);
+    connect(handler, &ArchiveHandler::progressDetail, this, &ArchiveJob::progressDetail);
+    // The tool's complaints about being killed are not worth reporting
+    connect(handler, &ArchiveHandler::error, this, [this](const QString &message) {
+        if (!cancelled.load()) {
+            emit error(message);
+        }
+    });
+    connect(handler, &ArchiveHandler::entriesAvailable, this, &ArchiveJob::entriesAvailable);
+
+    {
+        QMutexLocker locker(&workerMutex);
+        worker = handler;
+        // Under the lock, as changeScheduling() may change it
+        handler->setPriority(priority);
+        // cancel() may have raced with the clone above
+        if (cancelled.load()) {
+            handler->cancel();
+        }
+    }
+
+    prepareOutput();
+    emit started();
+    bool success = execute(handler) && !cancelled.load();
+
+    {
+        QMutexLocker locker(&workerMutex);
+        worker = nullptr;
+    }
+    delete handler;
+    finishOutput(success);
+
+    // Nothing may touch members after this: the job can be deleted from now on
+    emit finished(success);
+}
+
+bool ArchiveJob::execute(ArchiveHandler *handler) {
+    switch (operation) {
+        case List: {
+            bool success = handler->list(archivePath, entries);
+            listingTruncated = handler->isListingTruncated();
+            return success;
+        }
+        case Extract: {
+            QString target = stagingPath.isEmpty() ? destination : stagingPath;
+            if (files.isEmpty()) {
+                return handler->extractTo(archivePath, target);
+            }
+            return handler->extract(archivePath, target, files);
+        }
+        case Create:
+            return handler->create(archivePath, files, password, compressionLevel);
+        case AddFiles:
+            return handler->addFiles(archivePath, files);
+        case RemoveFiles:
+            return handler->removeFiles(archivePath, files);
+        case Test: {
+            bool success = handler->test(archivePath);
+            testReport = handler->getTestReport();
+            return success;
+        }
+        case Repair:
+            return handler->repair(archivePath);
+        case Compact:
+            return handler->compact(archivePath);
+    }
+    return false;
+}
+
+void ArchiveJob::prepareOutput() {
+    if (operation == Create) {
+        archiveExisted = QFileInfo::exists(archivePath);
+    } else if (operation == Extract) {
+        // A hidden directory inside the destination keeps the final move a
+        // rename on the same filesystem
+        QDir().mkpath(destination);
+        QTemporaryDir staging(destination + "/.linrar-extract-XXXXXX");
+        if (staging.isValid()) {
+            staging.setAutoRemove(false);
+            stagingPath = staging.path();
+        }
+    }
+}
+
+void ArchiveJob::finishOutput(bool success) {
+    bool discard = cancelled.load();
+    
+    if (!stagingPath.isEmpty()) {
+        // Files from a failed extraction may be truncated or corrupt and
+        // must not replace what the destination already holds
+        if (discard || !success) {
+            QDir(stagingPath).removeRecursively();
+        } else if (!ArchiveUtils::mergeDirectory(stagingPath, destination)) {
+            emit error(tr("Some extracted files could not be moved into %1; they were left in %2")
+                       .arg(destination, stagingPath));
+        }
+        stagingPath.clear();
+    }
+    
+    if (discard && operation == Create && !archiveExisted) {
+        QFile::remove(archivePath);
+    }
+}
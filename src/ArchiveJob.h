@@ -0,0 +1,107 @@
+#ifndef ARCHIVEJOB_H
+#define ARCHIVEJOB_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <atomic>
+#include "ArchiveHandler.h"
+
+// One archive operation executed on a JobManager worker thread.
+// The job lives in the GUI thread; its signals are delivered there as queued
+// events, so the GUI only ever sees progress and result notifications.
+class ArchiveJob : public QObject, public QRunnable {
+    Q_OBJECT
+
+public:
+    enum Operation {
+        List,
+        Extract,
+        Create,
+        AddFiles,
+        RemoveFiles,
+        Test,
+        Repair,
+        Compact
+    };
+
+    ArchiveJob(Operation operation, const ArchiveHandler *handler,
+               const QString &archivePath, QObject *parent = nullptr);
+
+    Operation getOperation() const { return operation; }
+    QString getArchivePath() const { return archivePath; }
+    const ArchiveHandler *getHandler() const { return prototype; }
+    // True for operations that rewrite the archive
+    bool modifiesArchive() const;
+
+    void setFiles(const QStringList &files) { this->files = files; }
+    QStringList getFiles() const { return files; }
+    void setDestination(const QString &destination) { this->destination = destination; }
+    QString getDestination() const { return destination; }
+    void setPassword(const QString &password) { this->password = password; }
+    void setCompressionLevel(int level) { compressionLevel = level; }
+    // Forwarded to the handler so its progress parser can compute percentages
+    void setExpectedTotals(qint64 bytes, qint64 files) { expectedBytes = bytes; expectedFiles = files; }
+    // Overrides the default scheduling for this job's tools
+    void setPriority(const ProcessPriority &priority) { this->priority = priority; }
+    // Thread-safe: as setPriority() for the nice level and I/O class, also
+    // once the job runs, e.g. to let it go flat-out or back off
+    void changeScheduling(int niceLevel, int ioClass);
+    void setCompressionOptions(const CompressionOptions &options) { compressionOptions = options; }
+
+    // Valid once finished() has been delivered
+    QList<ArchiveEntry> getEntries() const { return entries; }
+    // Per-member results of a Test job when the handler tested in-process
+    QList<MemberCheck> getTestReport() const { return testReport; }
+    // Whether a List job's tool printed lines too long to keep
+    bool isListingTruncated() const { return listingTruncated; }
+
+    // Thread-safe: drops the job if still queued, aborts its tool if running
+    void cancel();
+    bool isCancelled() const { return cancelled.load(); }
+
+    void run() override;
+
+signals:
+    void started();
+    void progress(const QString &message, int percentage);
+    void progressDetail(const ProgressInfo &info);
+    void error(const QString &error);
+    // List jobs stream entries while the tool is still running
+    void entriesAvailable(const QList<ArchiveEntry> &entries);
+    void finished(bool success);
+
+private:
+    bool execute(ArchiveHandler *handler);
+    // Set up before the tool runs so a cancelled job leaves nothing behind
+    void prepareOutput();
+    // Moves a successful extraction into place, drops a failed one
+    void finishOutput(bool success);
+
+    Operation operation;
+    const ArchiveHandler *prototype;
+    QString archivePath;
+    QStringList files;
+    QString destination;
+    QString password;
+    int compressionLevel;
+    qint64 expectedBytes;
+    qint64 expectedFiles;
+    ProcessPriority priority;
+    CompressionOptions compressionOptions;
+    QList<ArchiveEntry> entries;
+    QList<MemberCheck> testReport;
+    bool listingTruncated;
+    // Extraction goes here first and is moved into destination on completion
+    QString stagingPath;
+    bool archiveExisted;
+
+    std::atomic<bool> cancelled;
+    QMutex workerMutex;
+    ArchiveHandler *worker;
+};
+
+#endif // ARCHIVEJOB_H
@@ -5,7 +5,7 @@
 #include <QIcon>
 
 ArchiveModel::ArchiveModel(QObject *parent)
-    : QAbstractItemModel(parent), rootNode(new TreeNode) {
+    : QAbstractItemModel(parent), rootNode(new TreeNode), currentBatch(0) {
 }
 
 QModelIndex ArchiveModel::index(int row, int column, const QModelIndex &parent) const {
@@ -40,9 +40,7 @@ QModelIndex ArchiveModel::parent(const QModelIndex &index) const {
         return QModelIndex();
     }
     
-    TreeNode *grandParentNode = parentNode->parent;
-    int row = grandParentNode->children.indexOf(parentNode);
-    return createIndex(row, 0, parentNode);
+    return createIndex(parentNode->row, 0, parentNode);
 }
 
 int ArchiveModel::rowCount(const QModelIndex &parent) const {
@@ -126,6 +124,28 @@ void ArchiveModel::setEntries(const QList<ArchiveEntry> &entries) {
     endResetModel();
 }
 
+void ArchiveModel::appendEntries(const QList<ArchiveEntry> &entries) {
+    // Nodes created in this batch are invisible to views until their
+    // topmost new ancestor is inserted below an already visible parent
+    ++currentBatch;
+    QList<TreeNode*> dirtyParents;
+    for (const ArchiveEntry &entry : entries) {
+        insertEntry(entry, &dirtyParents);
+    }
+    
+    for (TreeNode *parentNode : dirtyParents) {
+        int first = parentNode->children.size();
+        int last = first + parentNode->pendingChildren.size() - 1;
+        beginInsertRows(indexForNode(parentNode), first, last);
+        for (TreeNode *child : parentNode->pendingChildren) {
+            child->row = parentNode->children.size();
+            parentNode->children.append(child);
+        }
+        parentNode->pendingChildren.clear();
+        endInsertRows();
+    }
+}
+
 void ArchiveModel::clear() {
     beginResetModel();
     delete rootNode;
@@ -148,43 +168,64 @@ QModelIndex ArchiveModel::findEntry(const QString &path) const {
         return QModelIndex();
     }
     
-    TreeNode *parentNode = node->parent;
-    int row = parentNode->children.indexOf(node);
-    return createIndex(row, 0, node);
+    return createIndex(node->row, 0, node);
+}
+
+QModelIndex ArchiveModel::indexForNode(TreeNode *node) const {
+    if (node == rootNode) {
+        return QModelIndex();
+    }
+    return createIndex(node->row, 0, node);
 }
 
 void ArchiveModel::buildTree(const QList<ArchiveEntry> &entries) {
     for (const ArchiveEntry &entry : entries) {
-        QStringList parts = entry.path.split('/', Qt::SkipEmptyParts);
-        TreeNode *current = rootNode;
+        insertEntry(entry, nullptr);
+    }
+}
+
+void ArchiveModel::insertEntry(const ArchiveEntry &entry, QList<TreeNode*> *dirtyParents) {
+    QStringList parts = entry.path.split('/', Qt::SkipEmptyParts);
+    TreeNode *current = rootNode;
+    
+    for (int i = 0; i < parts.size(); ++i) {
+        const QString &part = parts.at(i);
+        bool isLast = (i == parts.size() - 1);
         
-        for (int i = 0; i < parts.size(); ++i) {
-            QString part = parts.at(i);
-            bool isLast = (i == parts.size() - 1);
+        TreeNode *child = current->childrenByName.value(part);
+        if (!child) {
+            child = new TreeNode;
+            child->parent = current;
+            child->batch = currentBatch;
+            child->entry.name = part;
+            child->entry.path = parts.mid(0, i + 1).join('/');
+            child->entry.isDirectory = !isLast || entry.isDirectory;
+            current->childrenByName.insert(part, child);
             
-            TreeNode *child = nullptr;
-            for (TreeNode *node : current->children) {
-                if (QFileInfo(node->entry.name).fileName() == part) {
-                    child = node;
-                    break;
+            if (dirtyParents && current->batch != currentBatch) {
+                // Parent is already visible: defer until beginInsertRows()
+                if (current->pendingChildren.isEmpty()) {
+                    dirtyParents->append(current);
                 }
-            }
-            
-            if (!child) {
-                child = new TreeNode;
-                child->parent = current;
-                child->entry.name = part;
-                child->entry.path = parts.mid(0, i + 1).join('/');
-                child->entry.isDirectory = !isLast || entry.isDirectory;
+                current->pendingChildren.append(child);
+            } else {
+                child->row = current->children.size();
                 current->children.append(child);
             }
-            
-            if (isLast) {
-                child->entry = entry;
-            }
-            
+        } else if (isLast && dirtyParents && child->batch != currentBatch) {
+            // e.g. an explicit directory entry after its implicit node
+            child->entry = entry;
+            emit dataChanged(createIndex(child->row, 0, child),
+                             createIndex(child->row, ColumnCount - 1, child));
             current = child;
+            continue;
+        }
+        
+        if (isLast) {
+            child->entry = entry;
         }
+        
+        current = child;
     }
 }
 
@@ -193,15 +234,8 @@ ArchiveModel::TreeNode *ArchiveModel::findNode(const QString &path) const {
     TreeNode *current = rootNode;
     
     for (const QString &part : parts) {
-        bool found = false;
-        for (TreeNode *node : current->children) {
-            if (QFileInfo(node->entry.name).fileName() == part) {
-                current = node;
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
+        current = current->childrenByName.value(part);
+        if (!current) {
             return nullptr;
         }
     }
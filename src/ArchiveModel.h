@@ -3,6 +3,7 @@
 
 #include <QAbstractItemModel>
 #include <QList>
+#include <QHash>
 #include "ArchiveHandler.h"
 
 class ArchiveModel : public QAbstractItemModel {
@@ -19,6 +20,8 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
     
     void setEntries(const QList<ArchiveEntry> &entries);
+    // Adds entries to the existing tree, notifying views per inserted range
+    void appendEntries(const QList<ArchiveEntry> &entries);
     void clear();
     ArchiveEntry getEntry(const QModelIndex &index) const;
     QModelIndex findEntry(const QString &path) const;
@@ -28,16 +31,24 @@ private:
         ArchiveEntry entry;
         TreeNode *parent;
         QList<TreeNode*> children;
+        QHash<QString, TreeNode*> childrenByName;
+        // Children created during appendEntries(), not yet announced to views
+        QList<TreeNode*> pendingChildren;
+        int row;
+        int batch;
         
-        TreeNode() : parent(nullptr) {}
+        TreeNode() : parent(nullptr), row(0), batch(-1) {}
         ~TreeNode() {
             qDeleteAll(children);
         }
     };
     
     void buildTree(const QList<ArchiveEntry> &entries);
+    void insertEntry(const ArchiveEntry &entry, QList<TreeNode*> *dirtyParents);
+    QModelIndex indexForNode(TreeNode *node) const;
     TreeNode *findNode(const QString &path) const;
     TreeNode *rootNode;
+    int currentBatch;
     
     enum Columns {
         Name = 0,
@@ -1,4 +1,6 @@
 #include "ArchiveView.h"
+#include "ArchiveJob.h"
+#include "JobManager.h"
 #include "utils/ArchiveUtils.h"
 #include <QHeaderView>
 #include <QFileInfo>
@@ -12,7 +14,8 @@
 #include <QProcess>
 
 ArchiveView::ArchiveView(QWidget *parent)
-    : QWidget(parent), currentHandler(nullptr), contextMenu(nullptr) {
+    : QWidget(parent), currentHandler(nullptr), contextMenu(nullptr),
+      jobManager(nullptr), listJob(nullptr), totalSize(0), totalFiles(0) {
     layout = new QVBoxLayout(this);
     layout->setContentsMargins(0, 0, 0, 0);
     
@@ -53,30 +56,70 @@ void ArchiveView::setArchive(const QString &archivePath, ArchiveHandler *handler
         return;
     }
     
+    cancelListing();
+    
     currentArchivePath = archivePath;
     currentHandler = handler;
     
     QFileInfo info(archivePath);
-    archiveLabel->setText(tr("Archive: %1").arg(info.fileName()));
+    archiveLabel->setText(tr("Archive: %1 (loading...)").arg(info.fileName()));
+    model->clear();
+    totalSize = 0;
+    totalFiles = 0;
     
-    QList<ArchiveEntry> entries;
-    if (handler->list(archivePath, entries)) {
-        model->setEntries(entries);
-        treeView->expandAll();
-    } else {
-        QMessageBox::warning(this, tr("Error"), 
-                            tr("Failed to read archive."));
-        clear();
+    // Rows appear as the tool lists them instead of after it exits
+    ArchiveJob *job = new ArchiveJob(ArchiveJob::List, handler, archivePath);
+    listJob = job;
+    connect(job, &ArchiveJob::entriesAvailable, this, [this, job](const QList<ArchiveEntry> &entries) {
+        if (job == listJob) {
+            model->appendEntries(entries);
+            for (const ArchiveEntry &entry : entries) {
+                if (!entry.isDirectory) {
+                    totalSize += entry.size;
+                    ++totalFiles;
+                }
+            }
+        }
+    });
+    connect(job, &ArchiveJob::finished, this, [this, job, archivePath](bool success) {
+        if (job != listJob) {
+            return;
+        }
+        listJob = nullptr;
+        
+        if (success && job->isListingTruncated()) {
+            archiveLabel->setText(tr("Archive: %1 (listing incomplete)").arg(QFileInfo(archivePath).fileName()));
+            treeView->expandAll();
+        } else if (success) {
+            archiveLabel->setText(tr("Archive: %1").arg(QFileInfo(archivePath).fileName()));
+            treeView->expandAll();
+        } else {
+            QMessageBox::warning(this, tr("Error"), 
+                                tr("Failed to read archive."));
+            clear();
+        }
+        
+        emit archiveChanged(archivePath);
+    });
+    jobManager->enqueue(job);
+}
+
+void ArchiveView::cancelListing() {
+    if (listJob) {
+        ArchiveJob *job = listJob;
+        listJob = nullptr;
+        jobManager->cancel(job);
     }
-    
-    emit archiveChanged(archivePath);
 }
 
 void ArchiveView::clear() {
+    cancelListing();
     currentArchivePath.clear();
     currentHandler = nullptr;
     archiveLabel->setText(tr("No archive open"));
     model->clear();
+    totalSize = 0;
+    totalFiles = 0;
 }
 
 QStringList ArchiveView::getSelectedFiles() const {
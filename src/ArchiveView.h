@@ -8,16 +8,24 @@
 #include "ArchiveModel.h"
 #include "ArchiveHandler.h"
 
+class JobManager;
+class ArchiveJob;
+
 class ArchiveView : public QWidget {
     Q_OBJECT
 
 public:
     explicit ArchiveView(QWidget *parent = nullptr);
     
+    void setJobManager(JobManager *manager) { jobManager = manager; }
+    // Lists the archive in the background; archiveChanged() follows once done
     void setArchive(const QString &archivePath, ArchiveHandler *handler);
     void clear();
     QStringList getSelectedFiles() const;
     QString getCurrentArchive() const { return currentArchivePath; }
+    // Uncompressed size and file count of the listed archive
+    qint64 getTotalSize() const { return totalSize; }
+    qint64 getTotalFiles() const { return totalFiles; }
 
 signals:
     void fileSelected(const QString &filePath);
@@ -41,6 +49,7 @@ private slots:
 
 private:
     void setupContextMenu();
+    void cancelListing();
     
     QVBoxLayout *layout;
     QLabel *archiveLabel;
@@ -49,6 +58,10 @@ private:
     QString currentArchivePath;
     ArchiveHandler *currentHandler;
     QMenu *contextMenu;
+    JobManager *jobManager;
+    ArchiveJob *listJob;
+    qint64 totalSize;
+    qint64 totalFiles;
 };
 
 #endif // ARCHIVEVIEW_H
@@ -0,0 +1,25 @@
+#ifndef COMPRESSIONOPTIONS_H
+#define COMPRESSIONOPTIONS_H
+
+#include <QtGlobal>
+
+// Codec settings that the 0-9 compression level cannot express. Handlers
+// turn them into tool flags or library options when writing archives.
+struct CompressionOptions {
+    int zstdLevel = 0;             // 1..22, 0 derives it from the 0-9 level
+    bool zstdLongDistance = false; // --long: 128 MiB window for distant matches
+    bool randomAccess = false;     // xz in independent blocks, so members can
+                                   // be extracted without decoding from the start
+
+    // zstd's default of 3 sits at our default of 5; 9 is zstd's slowest
+    // level that does not need --ultra
+    int zstdLevelFor(int level) const {
+        if (zstdLevel > 0) {
+            return qMin(zstdLevel, 22);
+        }
+        static const int levels[] = { 1, 1, 2, 2, 3, 3, 6, 9, 15, 19 };
+        return levels[qBound(0, level, 9)];
+    }
+};
+
+#endif // COMPRESSIONOPTIONS_H
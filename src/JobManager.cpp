@@ -0,0 +1,119 @@
+#include "JobManager.h"
+#include "ArchiveJob.h"
+#include "ArchiveHandler.h"
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QThread>
+
+// The same archive however it is named: symlinks and relative paths are
+// resolved. An archive not created yet is named by its resolved directory.
+static QString archiveKey(const QString &path) {
+    QFileInfo info(path);
+    QString canonical = info.canonicalFilePath();
+    if (!canonical.isEmpty()) {
+        return canonical;
+    }
+    QString directory = QFileInfo(info.absolutePath()).canonicalFilePath();
+    if (directory.isEmpty()) {
+        return info.absoluteFilePath();
+    }
+    return directory + "/" + info.fileName();
+}
+
+JobManager::JobManager(QObject *parent)
+    : QObject(parent) {
+    // Entry batches cross from worker threads to the GUI thread
+    qRegisterMetaType<ArchiveEntry>("ArchiveEntry");
+    qRegisterMetaType<QList<ArchiveEntry>>("QList<ArchiveEntry>");
+    qRegisterMetaType<ProgressInfo>("ProgressInfo");
+    
+    threadPool = new QThreadPool(this);
+    // Each running job holds a worker thread plus its tool process
+    threadPool->setMaxThreadCount(QThread::idealThreadCount());
+}
+
+JobManager::~JobManager() {
+    // Workers still reference queued/running jobs, so drain the pool
+    // before the jobs (our children) are destroyed
+    cancelAll();
+    threadPool->waitForDone();
+}
+
+void JobManager::enqueue(ArchiveJob *job) {
+    job->setParent(this);
+    bool mustWait = conflicts(job);
+    jobs.append(job);
+
+    connect(job, &ArchiveJob::started, this, [this, job]() {
+        running.append(job);
+        emit jobStarted(job);
+    });
+    connect(job, &ArchiveJob::finished, this, [this, job](bool success) {
+        jobs.removeAll(job);
+        running.removeAll(job);
+        emit jobFinished(job, success);
+        job->deleteLater();
+        startHeldJobs();
+    });
+
+    if (mustWait) {
+        held.append(job);
+    } else {
+        threadPool->start(job);
+    }
+}
+
+bool JobManager::conflicts(const ArchiveJob *job) const {
+    // Only jobs enqueued before this one count, so held jobs keep their order
+    QString key = archiveKey(job->getArchivePath());
+    for (const ArchiveJob *other : jobs) {
+        if (other == job) {
+            break;
+        }
+        if ((other->modifiesArchive() || job->modifiesArchive())
+            && archiveKey(other->getArchivePath()) == key) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobManager::startHeldJobs() {
+    for (int i = 0; i < held.size(); ) {
+        ArchiveJob *job = held.at(i);
+        if (conflicts(job)) {
+            ++i;
+        } else {
+            held.removeAt(i);
+            threadPool->start(job);
+        }
+    }
+}
+
+void JobManager::cancel(ArchiveJob *job) {
+    if (!jobs.contains(job)) {
+        return;
+    }
+    job->cancel();
+    
+    // Not started yet: nothing to wait for, so don't hold a queue slot
+    if (held.removeAll(job) > 0 || threadPool->tryTake(job)) {
+        emit job->finished(false);
+    }
+}
+
+void JobManager::cancelAll() {
+    // finished() removes jobs from the list while we iterate
+    const QList<ArchiveJob*> pending = jobs;
+    for (ArchiveJob *job : pending) {
+        cancel(job);
+    }
+}
+
+int JobManager::getMaxConcurrentJobs() const {
+    return threadPool->maxThreadCount();
+}
+
+void JobManager::setMaxConcurrentJobs(int count) {
+    threadPool->setMaxThreadCount(qMax(1, count));
+}
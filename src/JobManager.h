@@ -0,0 +1,49 @@
+#ifndef JOBMANAGER_H
+#define JOBMANAGER_H
+
+#include <QObject>
+#include <QList>
+
+class QThreadPool;
+class ArchiveJob;
+
+// Queues ArchiveJobs and runs them on a private worker pool. Every job owns
+// its own handler and tool process, so up to getMaxConcurrentJobs() archives
+// are processed in parallel; a job that rewrites an archive never overlaps
+// another job on the same archive.
+class JobManager : public QObject {
+    Q_OBJECT
+
+public:
+    explicit JobManager(QObject *parent = nullptr);
+    ~JobManager();
+
+    // Takes ownership of the job; it is deleted after finished() is delivered
+    void enqueue(ArchiveJob *job);
+    // Aborts a running job; a queued or held job finishes right away
+    void cancel(ArchiveJob *job);
+    void cancelAll();
+
+    int getMaxConcurrentJobs() const;
+    void setMaxConcurrentJobs(int count);
+
+    QList<ArchiveJob*> getJobs() const { return jobs; }
+    int getRunningJobCount() const { return running.size(); }
+    bool hasPendingJobs() const { return !jobs.isEmpty(); }
+
+signals:
+    void jobStarted(ArchiveJob *job);
+    void jobFinished(ArchiveJob *job, bool success);
+
+private:
+    bool conflicts(const ArchiveJob *job) const;
+    void startHeldJobs();
+    
+    QThreadPool *threadPool;
+    QList<ArchiveJob*> jobs;
+    QList<ArchiveJob*> running;
+    // Jobs waiting for a conflicting job on the same archive to finish
+    QList<ArchiveJob*> held;
+};
+
+#endif // JOBMANAGER_H
@@ -0,0 +1,17 @@
+#ifndef LISTPARSER_H
+#define LISTPARSER_H
+
+#include <QString>
+#include "ArchiveHandler.h"
+
+// Incremental parser for a tool's textual listing. It is fed one line at a
+// time while the tool is still running, so only parser state is kept.
+class ListParser {
+public:
+    virtual ~ListParser() = default;
+    
+    // Returns true and fills entry when the line describes an archive member
+    virtual bool parseLine(const QString &line, ArchiveEntry &entry) = 0;
+};
+
+#endif // LISTPARSER_H
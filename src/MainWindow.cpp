@@ -1,26 +1,52 @@
 #include "MainWindow.h"
+#include "ProcessManager.h"
+#include "ToolRegistry.h"
 #include "utils/ArchiveUtils.h"
+#include "utils/ArchiveSource.h"
+#ifdef LINRAR_HAVE_LIBARCHIVE
+#include "handlers/LibArchiveHandler.h"
+#endif
 #include <QApplication>
 #include <QFileInfo>
 #include <QDir>
 #include <QStandardPaths>
-#include <QTimer>
 #include <QKeySequence>
 
+// Scheduling of a job whose progress dialog has "Low priority" checked
+static const int LOW_PRIORITY_NICE = 19;
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), currentHandler(nullptr) {
     setWindowTitle("LINRAR - Linux Archive Manager");
     setMinimumSize(800, 600);
     resize(1200, 800);
     
+    // Resolve and probe the archive tools in the background; handlers are
+    // served from the cache afterwards
+    ToolRegistry::instance()->refreshAsync();
+    
     // Initialize handlers
     rarHandler = new RarHandler(this);
     zipHandler = new ZipHandler(this);
     sevenZipHandler = new SevenZipHandler(this);
     tarHandler = new TarHandler(this);
+#ifdef LINRAR_HAVE_LIBARCHIVE
+    // ZIP keeps its own in-process reader, which extracts in parallel
+    for (ArchiveHandler *handler : QList<ArchiveHandler *>() << rarHandler << sevenZipHandler << tarHandler) {
+        preferredHandlers.insert(handler, new LibArchiveHandler(handler->clone(), this));
+    }
+#endif
     
     // Initialize settings
     settingsManager = new SettingsManager(this);
+    ProcessManager::setDefaultOutputLimits(settingsManager->getOutputMemoryLimit(),
+                                           settingsManager->getOutputSizeLimit());
+    
+    // Archive operations run as jobs off the GUI thread
+    jobManager = new JobManager(this);
+    jobManager->setMaxConcurrentJobs(settingsManager->getMaxConcurrentJobs());
+    connect(jobManager, &JobManager::jobStarted, this, &MainWindow::updateJobStatus);
+    connect(jobManager, &JobManager::jobFinished, this, &MainWindow::updateJobStatus);
     
     setupUI();
     setupMenus();
@@ -45,6 +71,9 @@ MainWindow::~MainWindow() {
     // Save window state
     settingsManager->setWindowGeometry(saveGeometry());
     settingsManager->setWindowState(saveState());
+    
+    // Stop running tools before the handlers they were cloned from go away
+    delete jobManager;
 }
 
 void MainWindow::setupUI() {
@@ -59,6 +88,7 @@ void MainWindow::setupUI() {
     
     // Archive view (right pane)
     archiveView = new ArchiveView(this);
+    archiveView->setJobManager(jobManager);
     splitter->addWidget(archiveView);
     
     splitter->setStretchFactor(0, 1);
@@ -137,6 +167,9 @@ void MainWindow::setupMenus() {
     repairAction = archiveMenu->addAction(tr("&Repair Archive"), this, &MainWindow::repairArchive);
     repairAction->setToolTip(tr("Attempt to repair a damaged archive"));
     
+    compactAction = archiveMenu->addAction(tr("&Compact Archive"), this, &MainWindow::compactArchive);
+    compactAction->setToolTip(tr("Reclaim the space left behind by removed files"));
+    
     // Tools menu
     toolsMenu = menuBar()->addMenu(tr("&Tools"));
     settingsAction = toolsMenu->addAction(tr("&Settings..."), this, &MainWindow::showSettings);
@@ -169,19 +202,25 @@ void MainWindow::setupToolbar() {
 
 void MainWindow::setupStatusBar() {
     statusBar()->showMessage(tr("Ready"));
+    
+    jobStatusLabel = new QLabel(this);
+    jobStatusLabel->hide();
+    statusBar()->addPermanentWidget(jobStatusLabel);
 }
 
 void MainWindow::openArchive() {
     QString lastDir = settingsManager->getLastOpenDirectory();
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open Archive"),
                                                     lastDir,
-                                                    tr("Archives (*.rar *.zip *.7z *.tar *.tar.gz *.tar.bz2 *.tar.xz);;All Files (*)"));
+                                                    tr("Archives (*.rar *.zip *.7z *.tar *.tar.gz *.tgz *.tar.bz2 *.tbz2 *.tar.xz *.txz *.tar.zst *.tzst *.tar.lz4 *.tlz4);;All Files (*)"));
     
     if (!fileName.isEmpty()) {
         settingsManager->setLastOpenDirectory(QFileInfo(fileName).absolutePath());
         settingsManager->addRecentFile(fileName);
         updateRecentFiles();
         
+        // Mapped once here; detection and the readers all share it
+        QSharedPointer<ArchiveSource> source = ArchiveSource::open(fileName);
         ArchiveHandler *handler = getHandlerForFile(fileName);
         if (handler) {
             if (!handler->isAvailable()) {
@@ -195,6 +234,7 @@ void MainWindow::openArchive() {
                 statusBar()->showMessage(tr("Tool not available: %1").arg(handler->getToolName()));
                 return;
             }
+            currentSource = source;
             archiveView->setArchive(fileName, handler);
             currentArchivePath = fileName;
             currentHandler = handler;
@@ -224,9 +264,22 @@ void MainWindow::createArchiveDialog() {
     if (lastDir.isEmpty()) {
         lastDir = settingsManager->getLastOpenDirectory();
     }
+    QStringList filters;
+    filters << tr("ZIP (*.zip)") << tr("RAR (*.rar)") << tr("7Z (*.7z)") << tr("TAR (*.tar)")
+            << tr("TAR.GZ (*.tar.gz)") << tr("TAR.BZ2 (*.tar.bz2)") << tr("TAR.XZ (*.tar.xz)")
+            << tr("TAR.ZST (*.tar.zst)") << tr("TAR.LZ4 (*.tar.lz4)");
+    // The configured default format is suggested and its filter preselected
+    QString extension = settingsManager->getDefaultArchiveExtension();
+    QString selectedFilter;
+    for (const QString &filter : filters) {
+        if (filter.endsWith("(*." + extension + ")")) {
+            selectedFilter = filter;
+        }
+    }
+    filters << tr("All Files (*)");
     QString fileName = QFileDialog::getSaveFileName(this, tr("Create Archive"),
-                                                    lastDir + "/archive.zip",
-                                                    tr("ZIP (*.zip);;RAR (*.rar);;7Z (*.7z);;TAR (*.tar);;TAR.GZ (*.tar.gz);;TAR.BZ2 (*.tar.bz2);;All Files (*)"));
+                                                    lastDir + "/archive." + extension,
+                                                    filters.join(";;"), &selectedFilter);
     
     if (fileName.isEmpty()) {
         return;
@@ -252,24 +305,18 @@ void MainWindow::createArchiveDialog() {
         return;
     }
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Creating archive..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
+    ArchiveJob *job = prepareJob(ArchiveJob::Create, handler, fileName, tr("Creating archive..."));
+    job->setFiles(files);
+    job->setPassword(password);
+    job->setCompressionLevel(settingsManager->getDefaultCompressionLevel());
     
-    connect(handler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(handler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
-    connect(handler, &ArchiveHandler::progress, this, &MainWindow::onProgress);
-    
-    // Execute in background
-    QTimer::singleShot(100, [this, handler, fileName, files, password]() {
-        bool success = handler->create(fileName, files, password, 
-                                       settingsManager->getDefaultCompressionLevel());
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job, handler, fileName](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             QMessageBox::information(this, tr("Success"), tr("Archive created successfully."));
+            currentSource = ArchiveSource::open(fileName);
             archiveView->setArchive(fileName, handler);
             currentArchivePath = fileName;
             currentHandler = handler;
@@ -279,11 +326,14 @@ void MainWindow::createArchiveDialog() {
             QMessageBox::warning(this, tr("Error"), tr("Failed to create archive."));
         }
     });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::closeArchive() {
     archiveView->clear();
     currentArchivePath.clear();
+    currentSource.reset();
     currentHandler = nullptr;
     updateActions();
     statusBar()->showMessage(tr("Ready - No archive open"));
@@ -303,19 +353,15 @@ void MainWindow::extractArchive() {
     
     settingsManager->setLastExtractDirectory(destDir);
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Extracting archive..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
-    
-    connect(currentHandler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(currentHandler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
+    ArchiveJob *job = prepareJob(ArchiveJob::Extract, currentHandler, currentArchivePath,
+                                 tr("Extracting archive..."));
+    job->setDestination(destDir);
+    job->setExpectedTotals(archiveView->getTotalSize(), archiveView->getTotalFiles());
     
-    QTimer::singleShot(100, [this, destDir]() {
-        bool success = currentHandler->extractTo(currentArchivePath, destDir);
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job, destDir](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             QMessageBox::information(this, tr("Success"), tr("Archive extracted successfully."));
             statusBar()->showMessage(tr("Extracted to: %1").arg(destDir));
@@ -323,6 +369,8 @@ void MainWindow::extractArchive() {
             QMessageBox::warning(this, tr("Error"), tr("Failed to extract archive."));
         }
     });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::extractSelected() {
@@ -346,19 +394,16 @@ void MainWindow::extractSelected() {
     
     settingsManager->setLastExtractDirectory(destDir);
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Extracting selected files..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
-    
-    connect(currentHandler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(currentHandler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
+    ArchiveJob *job = prepareJob(ArchiveJob::Extract, currentHandler, currentArchivePath,
+                                 tr("Extracting selected files..."));
+    job->setDestination(destDir);
+    job->setFiles(files);
+    job->setExpectedTotals(-1, files.size());
     
-    QTimer::singleShot(100, [this, destDir, files]() {
-        bool success = currentHandler->extract(currentArchivePath, destDir, files);
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job, destDir, files](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             QMessageBox::information(this, tr("Success"), tr("Files extracted successfully."));
             statusBar()->showMessage(tr("Extracted %1 file(s) to: %2").arg(files.size()).arg(destDir));
@@ -367,6 +412,8 @@ void MainWindow::extractSelected() {
             statusBar()->showMessage(tr("Extraction failed"));
         }
     });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::addFiles() {
@@ -381,22 +428,17 @@ void MainWindow::addFiles() {
         return;
     }
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Adding files..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
+    ArchiveJob *job = prepareJob(ArchiveJob::AddFiles, currentHandler, currentArchivePath,
+                                 tr("Adding files..."));
+    job->setFiles(files);
     
-    connect(currentHandler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(currentHandler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
-    
-    QTimer::singleShot(100, [this, files]() {
-        bool success = currentHandler->addFiles(currentArchivePath, files);
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job, files](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             // Refresh archive view
-            archiveView->setArchive(currentArchivePath, currentHandler);
+            reloadIfOpen(job->getArchivePath());
             QMessageBox::information(this, tr("Success"), tr("Files added successfully."));
             statusBar()->showMessage(tr("Added %1 file(s)").arg(files.size()));
         } else {
@@ -405,6 +447,8 @@ void MainWindow::addFiles() {
             statusBar()->showMessage(tr("Failed to add files"));
         }
     });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::removeFiles() {
@@ -427,22 +471,17 @@ void MainWindow::removeFiles() {
         return;
     }
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Removing files..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
-    
-    connect(currentHandler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(currentHandler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
+    ArchiveJob *job = prepareJob(ArchiveJob::RemoveFiles, currentHandler, currentArchivePath,
+                                 tr("Removing files..."));
+    job->setFiles(files);
     
-    QTimer::singleShot(100, [this, files]() {
-        bool success = currentHandler->removeFiles(currentArchivePath, files);
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job, files](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             // Refresh archive view
-            archiveView->setArchive(currentArchivePath, currentHandler);
+            reloadIfOpen(job->getArchivePath());
             QMessageBox::information(this, tr("Success"), tr("Files removed successfully."));
             statusBar()->showMessage(tr("Removed %1 file(s)").arg(files.size()));
         } else {
@@ -450,6 +489,8 @@ void MainWindow::removeFiles() {
             statusBar()->showMessage(tr("Failed to remove files"));
         }
     });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::testArchive() {
@@ -457,26 +498,40 @@ void MainWindow::testArchive() {
         return;
     }
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Testing archive..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
-    
-    connect(currentHandler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(currentHandler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
+    ArchiveJob *job = prepareJob(ArchiveJob::Test, currentHandler, currentArchivePath,
+                                 tr("Testing archive..."));
+    job->setExpectedTotals(archiveView->getTotalSize(), archiveView->getTotalFiles());
     
-    QTimer::singleShot(100, [this]() {
-        bool success = currentHandler->test(currentArchivePath);
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             QMessageBox::information(this, tr("Test Result"), tr("Archive is valid."));
             statusBar()->showMessage(tr("Archive test passed"));
-        } else {
+            return;
+        }
+        
+        // In-process tests name the damaged members
+        QStringList damaged;
+        for (const MemberCheck &check : job->getTestReport()) {
+            if (check.status != MemberCheck::Ok) {
+                damaged.append(QString("%1: %2").arg(check.name, MemberCheck::describe(check.status)));
+            }
+        }
+        if (damaged.isEmpty()) {
             QMessageBox::warning(this, tr("Test Result"), tr("Archive test failed."));
+            return;
         }
+        QMessageBox box(QMessageBox::Warning, tr("Test Result"),
+                        tr("Archive test failed: %n damaged member(s).", nullptr, damaged.size()),
+                        QMessageBox::Ok, this);
+        box.setDetailedText(damaged.join('\n'));
+        box.exec();
+        statusBar()->showMessage(tr("Archive test failed"));
     });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::repairArchive() {
@@ -492,29 +547,49 @@ void MainWindow::repairArchive() {
         return;
     }
     
-    progressDialog = new ProgressDialog(this);
-    progressDialog->setMessage(tr("Repairing archive..."));
-    progressDialog->setIndeterminate(true);
-    progressDialog->show();
-    
-    connect(currentHandler, &ArchiveHandler::progress, progressDialog, &ProgressDialog::setMessage);
-    connect(currentHandler, &ArchiveHandler::error, this, &MainWindow::onArchiveError);
+    ArchiveJob *job = prepareJob(ArchiveJob::Repair, currentHandler, currentArchivePath,
+                                 tr("Repairing archive..."));
     
-    QTimer::singleShot(100, [this]() {
-        bool success = currentHandler->repair(currentArchivePath);
-        progressDialog->close();
-        progressDialog->deleteLater();
-        
+    connect(job, &ArchiveJob::finished, this, [this, job](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
         if (success) {
             QMessageBox::information(this, tr("Success"), tr("Archive repaired successfully."));
             statusBar()->showMessage(tr("Archive repair completed"));
             // Refresh archive view
-            archiveView->setArchive(currentArchivePath, currentHandler);
+            reloadIfOpen(job->getArchivePath());
         } else {
             QMessageBox::warning(this, tr("Error"), tr("Failed to repair archive."));
             statusBar()->showMessage(tr("Archive repair failed"));
         }
     });
+    
+    jobManager->enqueue(job);
+}
+
+void MainWindow::compactArchive() {
+    if (currentArchivePath.isEmpty() || !currentHandler) {
+        return;
+    }
+    
+    ArchiveJob *job = prepareJob(ArchiveJob::Compact, currentHandler, currentArchivePath,
+                                 tr("Compacting archive..."));
+    
+    connect(job, &ArchiveJob::finished, this, [this, job](bool success) {
+        if (job->isCancelled()) {
+            return;
+        }
+        if (success) {
+            statusBar()->showMessage(tr("Archive compacted"));
+        } else {
+            QMessageBox::warning(this, tr("Error"), tr("Failed to compact archive."));
+            statusBar()->showMessage(tr("Archive compaction failed"));
+        }
+        reloadIfOpen(job->getArchivePath());
+    });
+    
+    jobManager->enqueue(job);
 }
 
 void MainWindow::showSettings() {
@@ -528,6 +603,82 @@ void MainWindow::showSettings() {
         settingsManager->setDefaultCompressionLevel(level);
     }
     
+    QStringList formats = SettingsManager::archiveExtensions();
+    QString format = QInputDialog::getItem(this, tr("Settings"),
+                                           tr("Default format for new archives:"), formats,
+                                           qMax(0, formats.indexOf(settingsManager->getDefaultArchiveExtension())),
+                                           false, &ok);
+    if (ok) {
+        settingsManager->setDefaultArchiveExtension(format);
+    }
+    
+    int zstdLevel = QInputDialog::getInt(this, tr("Settings"),
+                                        tr("zstd compression level (1-22, 0 = follow the default level):"),
+                                        settingsManager->getZstdLevel(),
+                                        0, 22, 1, &ok);
+    if (ok) {
+        settingsManager->setZstdLevel(zstdLevel);
+    }
+    
+    bool longDistance = QMessageBox::question(this, tr("Settings"),
+                                              tr("Use zstd long-distance matching? Better compression of "
+                                                 "large archives with repeated content, at 128 MB of memory."),
+                                              QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
+    settingsManager->setZstdLongDistance(longDistance);
+    
+    bool randomAccess = QMessageBox::question(this, tr("Settings"),
+                                              tr("Write tar.xz archives in blocks, so single files can be "
+                                                 "extracted without decompressing everything before them?"),
+                                              QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
+    settingsManager->setRandomAccessCompression(randomAccess);
+    
+    int maxJobs = QInputDialog::getInt(this, tr("Settings"),
+                                      tr("Maximum concurrent operations:"),
+                                      settingsManager->getMaxConcurrentJobs(),
+                                      1, 256, 1, &ok);
+    if (ok) {
+        settingsManager->setMaxConcurrentJobs(maxJobs);
+        jobManager->setMaxConcurrentJobs(maxJobs);
+    }
+    
+    int niceLevel = QInputDialog::getInt(this, tr("Settings"),
+                                        tr("Priority of archive operations (nice level, 0-19):"),
+                                        qMax(0, settingsManager->getNiceLevel()),
+                                        0, 19, 1, &ok);
+    if (ok) {
+        settingsManager->setNiceLevel(niceLevel);
+    }
+    
+    QStringList ioClasses;
+    ioClasses << tr("Normal") << tr("Best effort") << tr("Idle disk time only");
+    const int ioClassValues[] = {IoPriorityDefault, IoPriorityBestEffort, IoPriorityIdle};
+    int ioIndex = 0;
+    for (int i = 0; i < ioClasses.size(); ++i) {
+        if (ioClassValues[i] == settingsManager->getIoPriorityClass()) {
+            ioIndex = i;
+        }
+    }
+    QString ioClass = QInputDialog::getItem(this, tr("Settings"),
+                                            tr("Disk priority of archive operations:"), ioClasses,
+                                            ioIndex, false, &ok);
+    if (ok) {
+        settingsManager->setIoPriorityClass(ioClassValues[ioClasses.indexOf(ioClass)]);
+    }
+    
+    // One prompt per tool, as their thread switches are independent;
+    // cancelling one keeps the rest as they are
+    for (const QString &tool : SettingsManager::threadedTools()) {
+        QString name = tool == "native" ? tr("built-in engines") : tool;
+        int threads = QInputDialog::getInt(this, tr("Settings"),
+                                          tr("Threads for %1 (0 = default):").arg(name),
+                                          settingsManager->getToolThreads(tool),
+                                          0, 256, 1, &ok);
+        if (!ok) {
+            break;
+        }
+        settingsManager->setToolThreads(tool, threads);
+    }
+    
     bool showHidden = QMessageBox::question(this, tr("Settings"),
                                             tr("Show hidden files?"),
                                             QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes;
@@ -560,8 +711,10 @@ void MainWindow::openRecentFile() {
     if (action) {
         QString fileName = action->data().toString();
         if (QFileInfo::exists(fileName)) {
+            QSharedPointer<ArchiveSource> source = ArchiveSource::open(fileName);
             ArchiveHandler *handler = getHandlerForFile(fileName);
             if (handler) {
+                currentSource = source;
                 archiveView->setArchive(fileName, handler);
                 currentArchivePath = fileName;
                 currentHandler = handler;
@@ -577,6 +730,13 @@ void MainWindow::openRecentFile() {
     }
 }
 
+void MainWindow::reloadIfOpen(const QString &archivePath) {
+    // Another archive may have been opened while the job ran
+    if (archivePath == currentArchivePath && currentHandler) {
+        archiveView->setArchive(currentArchivePath, currentHandler);
+    }
+}
+
 void MainWindow::refreshArchive() {
     if (!currentArchivePath.isEmpty() && currentHandler) {
         archiveView->setArchive(currentArchivePath, currentHandler);
@@ -595,42 +755,95 @@ void MainWindow::onArchiveChanged(const QString &archivePath) {
     }
 }
 
-void MainWindow::onProgress(const QString &message, int percentage) {
-    Q_UNUSED(percentage);
-    if (progressDialog) {
-        progressDialog->setMessage(message);
-    }
-}
-
 void MainWindow::onArchiveError(const QString &error) {
     QMessageBox::warning(this, tr("Error"), error);
-    if (progressDialog) {
-        progressDialog->close();
-    }
 }
 
-void MainWindow::onOperationFinished() {
-    if (progressDialog) {
-        progressDialog->close();
+void MainWindow::updateJobStatus() {
+    int running = jobManager->getRunningJobCount();
+    int queued = jobManager->getJobs().size() - running;
+    if (running + queued == 0) {
+        jobStatusLabel->hide();
+        return;
+    }
+    
+    QString text = tr("%1 running").arg(running);
+    if (queued > 0) {
+        text += tr(", %1 queued").arg(queued);
     }
+    jobStatusLabel->setText(text);
+    jobStatusLabel->show();
+}
+
+ArchiveJob* MainWindow::prepareJob(ArchiveJob::Operation operation, ArchiveHandler *handler,
+                                   const QString &archivePath, const QString &message) {
+    // One dialog per job; not modal, so further operations can be started
+    // while this one runs
+    ProgressDialog *dialog = new ProgressDialog(this);
+    dialog->setModal(false);
+    dialog->setWindowTitle(QFileInfo(archivePath).fileName());
+    dialog->setMessage(message);
+    dialog->setIndeterminate(true);
+    dialog->show();
+    
+    ArchiveJob *job = new ArchiveJob(operation, handler, archivePath);
+    // Listings in the archive view keep the default priority; these run in
+    // the background and follow the configured policy, which the dialog
+    // can switch between polite and flat-out for this job alone
+    ProcessPriority priority = settingsManager->getProcessPriority();
+    job->setPriority(priority);
+    dialog->setLowPriority(priority.niceLevel > 0 || priority.ioClass == IoPriorityIdle);
+    connect(dialog, &ProgressDialog::lowPriorityChanged, job, [job](bool low) {
+        job->changeScheduling(low ? LOW_PRIORITY_NICE : 0, low ? IoPriorityIdle : IoPriorityDefault);
+    });
+    job->setCompressionOptions(settingsManager->getCompressionOptions());
+    connect(job, &ArchiveJob::progress, dialog, [dialog](const QString &text, int percentage) {
+        Q_UNUSED(percentage);
+        // Percentages arrive through setProgressInfo()
+        if (!text.isEmpty()) {
+            dialog->setMessage(text);
+        }
+    });
+    connect(job, &ArchiveJob::progressDetail, dialog, &ProgressDialog::setProgressInfo);
+    connect(job, &ArchiveJob::error, this, &MainWindow::onArchiveError);
+    connect(dialog, &ProgressDialog::cancelled, this, [this, job]() {
+        jobManager->cancel(job);
+    });
+    // Connected first so the dialog is gone before any result message box
+    connect(job, &ArchiveJob::finished, dialog, [this, job, dialog]() {
+        if (job->isCancelled()) {
+            statusBar()->showMessage(tr("Operation cancelled"));
+        }
+        dialog->close();
+        dialog->deleteLater();
+    });
+    return job;
 }
 
 ArchiveHandler* MainWindow::getHandlerForFormat(ArchiveFormat format) {
+    ArchiveHandler *handler = nullptr;
     switch (format) {
         case ArchiveFormat::RAR:
-            return rarHandler;
+            handler = rarHandler;
+            break;
         case ArchiveFormat::ZIP:
-            return zipHandler;
+            handler = zipHandler;
+            break;
         case ArchiveFormat::SevenZip:
-            return sevenZipHandler;
+            handler = sevenZipHandler;
+            break;
         case ArchiveFormat::Tar:
         case ArchiveFormat::TarGz:
         case ArchiveFormat::TarBz2:
         case ArchiveFormat::TarXz:
-            return tarHandler;
+        case ArchiveFormat::TarZst:
+        case ArchiveFormat::TarLz4:
+            handler = tarHandler;
+            break;
         default:
             return nullptr;
     }
+    return preferredHandlers.value(handler, handler);
 }
 
 ArchiveHandler* MainWindow::getHandlerForFile(const QString &filePath) {
@@ -648,4 +861,6 @@ void MainWindow::updateActions() {
     removeAction->setEnabled(hasArchive);
     testAction->setEnabled(hasArchive);
     repairAction->setEnabled(hasArchive);
+    // Only ZIP archives are updated in place, leaving space to reclaim
+    compactAction->setEnabled(hasArchive && currentHandler->getFormat() == ArchiveFormat::ZIP);
 }
@@ -10,6 +10,8 @@
 #include <QFileDialog>
 #include <QInputDialog>
 #include <QMessageBox>
+#include <QHash>
+#include <QSharedPointer>
 #include "FileBrowser.h"
 #include "ArchiveView.h"
 #include "ArchiveHandler.h"
@@ -20,8 +22,12 @@
 #include "SettingsManager.h"
 #include "ProgressDialog.h"
 #include "AboutDialog.h"
+#include "ArchiveJob.h"
+#include "JobManager.h"
 #include "utils/FormatDetector.h"
 
+class ArchiveSource;
+
 class MainWindow : public QMainWindow {
     Q_OBJECT
 
@@ -39,14 +45,14 @@ private slots:
     void removeFiles();
     void testArchive();
     void repairArchive();
+    void compactArchive();
     void showSettings();
     void updateRecentFiles();
     void openRecentFile();
     void refreshArchive();
     void onArchiveChanged(const QString &archivePath);
-    void onProgress(const QString &message, int percentage);
     void onArchiveError(const QString &error);
-    void onOperationFinished();
+    void updateJobStatus();
 
 private:
     void setupUI();
@@ -57,6 +63,10 @@ private:
     ArchiveHandler* getHandlerForFormat(ArchiveFormat format);
     ArchiveHandler* getHandlerForFile(const QString &filePath);
     void updateActions();
+    ArchiveJob* prepareJob(ArchiveJob::Operation operation, ArchiveHandler *handler,
+                           const QString &archivePath, const QString &message);
+    // Reloads the view after a job changed archivePath, if it is still open
+    void reloadIfOpen(const QString &archivePath);
     
     QSplitter *splitter;
     FileBrowser *fileBrowser;
@@ -69,6 +79,7 @@ private:
     QMenu *recentMenu;
     
     QToolBar *mainToolbar;
+    QLabel *jobStatusLabel;
     
     QAction *openAction;
     QAction *newAction;
@@ -79,6 +90,7 @@ private:
     QAction *removeAction;
     QAction *testAction;
     QAction *repairAction;
+    QAction *compactAction;
     QAction *exitAction;
     QAction *settingsAction;
     
@@ -86,11 +98,15 @@ private:
     ZipHandler *zipHandler;
     SevenZipHandler *sevenZipHandler;
     TarHandler *tarHandler;
+    // In-process handler to use instead of each tool handler, if any
+    QHash<ArchiveHandler *, ArchiveHandler *> preferredHandlers;
     
     SettingsManager *settingsManager;
-    ProgressDialog *progressDialog;
+    JobManager *jobManager;
     
     QString currentArchivePath;
+    // Keeps the archive mapped while it is open, for every job to share
+    QSharedPointer<ArchiveSource> currentSource;
     ArchiveHandler *currentHandler;
 };
 
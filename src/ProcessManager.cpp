@@ -1,10 +1,90 @@
 #include "ProcessManager.h"
 #include <QDebug>
 #include <QFileInfo>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+std::atomic<qint64> ProcessManager::defaultMemoryLimit(8 * 1024 * 1024);
+std::atomic<qint64> ProcessManager::defaultMaximumSize(256 * 1024 * 1024);
+
+static const int PROGRESS_INTERVAL = 100;
+// A progress "line" longer than this is not progress output; drop it
+static const int MAX_PROGRESS_LINE = 64 * 1024;
+// Longer lines in line mode are dropped and the output marked truncated
+static const int MAX_LINE = 4 * 1024 * 1024;
+// Time the tool gets to exit after SIGTERM before the group is killed
+static const int TERMINATE_GRACE = 1000;
+
+// From linux/ioprio.h, which is not always installed
+static const int IOPRIO_CLASS_SHIFT = 13;
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_WHO_PGRP = 2;
+
+// ioprio_set(2) value for a class; the default class lets the I/O priority
+// follow the nice level again
+static int ioPriorityValue(int ioClass, int ioLevel) {
+    if (ioClass == IoPriorityDefault) {
+        return 0;
+    }
+    int level = ioClass == IoPriorityIdle ? 0 : qBound(0, ioLevel, 7);
+    return (ioClass << IOPRIO_CLASS_SHIFT) | level;
+}
+
+// Runs in the forked child before exec: only async-signal-safe calls here.
+// Every tool leads its own process group, so cancelling also reaches the
+// compressors tar pipes through and any other helper it spawns.
+static void setupChild(const ProcessPriority &priority) {
+    ::setpgid(0, 0);
+    
+    if (priority.niceLevel != 0) {
+        ::setpriority(PRIO_PROCESS, 0, priority.niceLevel);
+    }
+    if (priority.ioClass != IoPriorityDefault) {
+        ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioPriorityValue(priority.ioClass, priority.ioLevel));
+    }
+    if (priority.cpuMask != 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; ++cpu) {
+            if (priority.cpuMask & (quint64(1) << cpu)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        ::sched_setaffinity(0, sizeof(set), &set);
+    }
+}
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+// Qt 5 only offers the child setup hook through subclassing
+class PriorityProcess : public QProcess {
+public:
+    explicit PriorityProcess(QObject *parent) : QProcess(parent) {}
+    
+    ProcessPriority priority;
+
+protected:
+    void setupChildProcess() override {
+        setupChild(priority);
+    }
+};
+#endif
 
 ProcessManager::ProcessManager(QObject *parent)
-    : QObject(parent), process(nullptr), lastExitCode(0) {
+    : QObject(parent), process(nullptr), lastExitCode(0),
+      outputBuffer(defaultMemoryLimit.load(), defaultMaximumSize.load()),
+      errorBuffer(defaultMemoryLimit.load(), defaultMaximumSize.load()),
+      lineMode(false), skippingLine(false), linesDropped(false), progressParser(nullptr),
+      lastReportedPercentage(-1),
+      cancelRequested(false), runningGroup(0), schedulingChanged(false), niceOverride(0),
+      ioClassOverride(IoPriorityDefault), environment(QProcessEnvironment::systemEnvironment()) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     process = new QProcess(this);
+#else
+    process = new PriorityProcess(this);
+#endif
     
     connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
             this, &ProcessManager::onProcessFinished);
@@ -18,8 +98,7 @@ ProcessManager::ProcessManager(QObject *parent)
 
 ProcessManager::~ProcessManager() {
     if (process && process->state() != QProcess::NotRunning) {
-        process->kill();
-        process->waitForFinished(3000);
+        terminateProcessGroup();
     }
 }
 
@@ -30,14 +109,40 @@ bool ProcessManager::execute(const QString &program, const QStringList &argument
         return false;
     }
     
+    if (cancelRequested.load()) {
+        lastError = "Operation cancelled";
+        return false;
+    }
+    
     lastError.clear();
     outputBuffer.clear();
     errorBuffer.clear();
+    pendingLine.clear();
+    skippingLine = false;
+    linesDropped = false;
+    pendingProgressOutput.clear();
+    pendingProgressError.clear();
+    progressTimer.invalidate();
+    lastReportedPercentage = -1;
     lastProgram = program;
     
     if (!workingDir.isEmpty()) {
         process->setWorkingDirectory(workingDir);
     }
+    process->setStandardInputFile(inputFile);
+    process->setProcessEnvironment(environment);
+    ProcessPriority childPriority = priority;
+    if (schedulingChanged.load()) {
+        childPriority.niceLevel = niceOverride.load();
+        childPriority.ioClass = ioClassOverride.load();
+    }
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    process->setChildProcessModifier([childPriority]() {
+        setupChild(childPriority);
+    });
+#else
+    static_cast<PriorityProcess *>(process)->priority = childPriority;
+#endif
     
     process->start(program, arguments);
     
@@ -45,10 +150,26 @@ bool ProcessManager::execute(const QString &program, const QStringList &argument
         lastError = QString("Failed to start %1: %2").arg(program, process->errorString());
         return false;
     }
+    runningGroup.store(process->processId());
     
     return true;
 }
 
+void ProcessManager::changeScheduling(int niceLevel, int ioClass) {
+    niceOverride.store(niceLevel);
+    ioClassOverride.store(ioClass);
+    schedulingChanged.store(true);
+    
+    qint64 group = runningGroup.load();
+    if (group <= 0) {
+        return;
+    }
+    // Best effort: raising the priority again needs CAP_SYS_NICE, and the
+    // group may have exited in the meantime
+    ::setpriority(PRIO_PGRP, id_t(group), niceLevel);
+    ::syscall(SYS_ioprio_set, IOPRIO_WHO_PGRP, int(group), ioPriorityValue(ioClass, ProcessPriority().ioLevel));
+}
+
 bool ProcessManager::executeWithOutput(const QString &program, const QStringList &arguments,
                                        QString &output, QString &error,
                                        const QString &workingDir) {
@@ -56,22 +177,81 @@ bool ProcessManager::executeWithOutput(const QString &program, const QStringList
         return false;
     }
     
-    if (!process->waitForFinished(-1)) {
-        lastError = "Process did not finish";
+    // Wait in short slices so a cancel request from another thread is noticed
+    while (!process->waitForFinished(100)) {
+        if (cancelRequested.load()) {
+            terminateProcessGroup();
+            lastError = "Operation cancelled";
+            return false;
+        }
+        if (process->state() == QProcess::NotRunning) {
+            break;
+        }
+    }
+    
+    if (cancelRequested.load()) {
+        lastError = "Operation cancelled";
         return false;
     }
     
-    output = outputBuffer;
-    error = errorBuffer;
+    // Decoded once, after the tool has exited
+    output = outputBuffer.toString();
+    error = errorBuffer.toString();
     
     return lastExitCode == 0;
 }
 
 void ProcessManager::cancel() {
     if (process && isRunning()) {
+        terminateProcessGroup();
+    }
+}
+
+void ProcessManager::terminateProcessGroup() {
+    qint64 pid = process->processId();
+    if (pid <= 0) {
+        process->kill();
+        process->waitForFinished(3000);
+        return;
+    }
+    
+    // SIGTERM first so tools can remove their own temporary files
+    ::kill(-static_cast<pid_t>(pid), SIGTERM);
+    if (!process->waitForFinished(TERMINATE_GRACE)) {
         process->kill();
         process->waitForFinished(3000);
     }
+    // Helpers that ignored SIGTERM or outlived the leader
+    ::kill(-static_cast<pid_t>(pid), SIGKILL);
+}
+
+void ProcessManager::setDefaultOutputLimits(qint64 memoryLimit, qint64 maximumSize) {
+    defaultMemoryLimit.store(memoryLimit);
+    defaultMaximumSize.store(maximumSize);
+}
+
+void ProcessManager::setEnvironmentVariable(const QString &name, const QString &value) {
+    if (value.isEmpty()) {
+        environment.remove(name);
+    } else {
+        environment.insert(name, value);
+    }
+}
+
+void ProcessManager::setLineMode(bool enabled) {
+    lineMode = enabled;
+    pendingLine.clear();
+    skippingLine = false;
+}
+
+void ProcessManager::setProgressParser(ProgressParser *parser) {
+    progressParser = parser;
+    pendingProgressOutput.clear();
+    pendingProgressError.clear();
+}
+
+void ProcessManager::requestCancel() {
+    cancelRequested.store(true);
 }
 
 bool ProcessManager::isRunning() const {
@@ -80,6 +260,13 @@ bool ProcessManager::isRunning() const {
 
 void ProcessManager::onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus) {
     lastExitCode = exitCode;
+    runningGroup.store(0);
+    
+    // Output without a trailing newline
+    if (lineMode && !pendingLine.isEmpty()) {
+        emit lineReady(pendingLine);
+        pendingLine.clear();
+    }
     
     if (exitStatus == QProcess::CrashExit) {
         lastError = "Process crashed";
@@ -122,17 +309,105 @@ void ProcessManager::onProcessError(QProcess::ProcessError error) {
 
 void ProcessManager::onReadyReadStandardOutput() {
     QByteArray data = process->readAllStandardOutput();
-    QString text = QString::fromUtf8(data);
-    outputBuffer += text;
-    emit outputReady(text);
+    if (lineMode) {
+        emitLines(data);
+        return;
+    }
+    
+    outputBuffer.append(data);
+    emit outputReady(data);
+    
+    if (progressParser) {
+        // The parser reports the current file; the raw line may be full of
+        // backspaces and carriage returns
+        feedProgress(data, pendingProgressOutput);
+        return;
+    }
     
-    // Try to extract progress information
-    emit progressUpdate(text);
+    // Only the last line is shown as progress, so only that one is decoded
+    int end = data.size();
+    while (end > 0 && (data.at(end - 1) == '\n' || data.at(end - 1) == '\r')) {
+        --end;
+    }
+    if (end > 0) {
+        int start = data.lastIndexOf('\n', end - 1) + 1;
+        emit progressUpdate(QString::fromUtf8(data.constData() + start, end - start).trimmed());
+    }
 }
 
 void ProcessManager::onReadyReadStandardError() {
     QByteArray data = process->readAllStandardError();
-    QString text = QString::fromUtf8(data);
-    errorBuffer += text;
-    emit outputReady(text);
+    errorBuffer.append(data);
+    emit outputReady(data);
+    
+    // tar writes its checkpoints to stderr
+    if (progressParser) {
+        feedProgress(data, pendingProgressError);
+    }
+}
+
+void ProcessManager::emitLines(const QByteArray &data) {
+    // Only the trailing partial line is kept between chunks
+    int start = 0;
+    int newline;
+    while ((newline = data.indexOf('\n', start)) != -1) {
+        if (skippingLine) {
+            skippingLine = false;
+        } else if (pendingLine.isEmpty()) {
+            emit lineReady(data.mid(start, newline - start));
+        } else if (pendingLine.size() + (newline - start) > MAX_LINE) {
+            pendingLine.clear();
+            linesDropped = true;
+        } else {
+            pendingLine.append(data.constData() + start, newline - start);
+            emit lineReady(pendingLine);
+            pendingLine.clear();
+        }
+        start = newline + 1;
+    }
+    if (skippingLine) {
+        return;
+    }
+    // A line that never ends would otherwise be held in full
+    if (pendingLine.size() + (data.size() - start) > MAX_LINE) {
+        pendingLine.clear();
+        skippingLine = true;
+        linesDropped = true;
+        return;
+    }
+    pendingLine.append(data.constData() + start, data.size() - start);
+}
+
+void ProcessManager::feedProgress(const QByteArray &data, QByteArray &pending) {
+    // Progress meters redraw in place, so \r and backspaces end a line too
+    bool changed = false;
+    int start = 0;
+    for (int i = 0; i < data.size(); ++i) {
+        char c = data.at(i);
+        if (c != '\n' && c != '\r' && c != '\b') {
+            continue;
+        }
+        pending.append(data.constData() + start, i - start);
+        start = i + 1;
+        if (!pending.trimmed().isEmpty()) {
+            changed |= progressParser->parseLine(QString::fromUtf8(pending));
+        }
+        pending.clear();
+    }
+    pending.append(data.constData() + start, data.size() - start);
+    if (pending.size() > MAX_PROGRESS_LINE) {
+        pending.clear();
+    }
+    
+    if (!changed) {
+        return;
+    }
+    
+    const ProgressInfo &info = progressParser->getInfo();
+    if (info.percentage != lastReportedPercentage || !progressTimer.isValid()
+        || progressTimer.elapsed() >= PROGRESS_INTERVAL) {
+        lastReportedPercentage = info.percentage;
+        progressTimer.start();
+        emit progressChanged(info);
+    }
 }
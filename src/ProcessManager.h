@@ -5,6 +5,11 @@
 #include <QProcess>
 #include <QString>
 #include <QStringList>
+#include <QElapsedTimer>
+#include <atomic>
+#include "utils/OutputBuffer.h"
+#include "ProgressParser.h"
+#include "ProcessPriority.h"
 
 class ProcessManager : public QObject {
     Q_OBJECT
@@ -19,20 +24,57 @@ public:
                           QString &output, QString &error, 
                           const QString &workingDir = QString());
     
+    // Connects the tool's stdin to a file for the following runs; an empty
+    // path restores the default
+    void setStandardInputFile(const QString &path) { inputFile = path; }
+    
+    // Scheduling applied to every tool started from now on
+    void setPriority(const ProcessPriority &priority) { this->priority = priority; }
+    ProcessPriority getPriority() const { return priority; }
+    // Thread-safe: moves the running tool's process group, and the tools
+    // started after it, to niceLevel and ioClass. Without CAP_SYS_NICE a
+    // nice level once raised cannot be lowered again.
+    void changeScheduling(int niceLevel, int ioClass);
+    // Set in the environment of the following runs; an empty value unsets it
+    void setEnvironmentVariable(const QString &name, const QString &value);
+    
+    // In line mode stdout is not buffered; each complete line is emitted
+    // through lineReady() as soon as it arrives
+    void setLineMode(bool enabled);
+    
+    // While set, stdout and stderr are also fed to the parser and
+    // progressChanged() reports what it extracted. Not owned.
+    void setProgressParser(ProgressParser *parser);
+    
+    // Process-wide limits for captured output: memoryLimit bytes are kept in
+    // RAM before spilling to a temp file, output beyond maximumSize is dropped
+    static void setDefaultOutputLimits(qint64 memoryLimit, qint64 maximumSize);
+    
+    // Terminates the tool together with everything it spawned
     void cancel();
+    // Thread-safe: may be called from any thread while a job runs
+    void requestCancel();
+    bool isCancelRequested() const { return cancelRequested.load(); }
     bool isRunning() const;
     
     QString getLastError() const { return lastError; }
     int getLastExitCode() const { return lastExitCode; }
     QString getLastProgram() const { return lastProgram; }
-    QString getLastOutput() const { return outputBuffer; }
-    QString getLastErrorOutput() const { return errorBuffer; }
+    QString getLastOutput() const { return outputBuffer.toString(); }
+    QString getLastErrorOutput() const { return errorBuffer.toString(); }
+    // Also set when line mode dropped an overlong line
+    bool isOutputTruncated() const { return outputBuffer.isTruncated() || linesDropped; }
 
 signals:
     void finished(int exitCode);
     void errorOccurred(const QString &error);
-    void outputReady(const QString &output);
+    // Raw chunk as read from the pipe; shares data with the buffer
+    void outputReady(const QByteArray &output);
+    // Last line of the latest stdout chunk
     void progressUpdate(const QString &message);
+    void lineReady(const QByteArray &line);
+    // Throttled: emitted when the percentage moves or every PROGRESS_INTERVAL ms
+    void progressChanged(const ProgressInfo &info);
 
 private slots:
     void onProcessFinished(int exitCode, QProcess::ExitStatus exitStatus);
@@ -41,12 +83,36 @@ private slots:
     void onReadyReadStandardError();
 
 private:
+    void emitLines(const QByteArray &data);
+    void terminateProcessGroup();
+    void feedProgress(const QByteArray &data, QByteArray &pending);
+    
     QProcess *process;
     QString lastError;
     int lastExitCode;
     QString lastProgram;
-    QString outputBuffer;
-    QString errorBuffer;
+    QString inputFile;
+    ProcessPriority priority;
+    OutputBuffer outputBuffer;
+    OutputBuffer errorBuffer;
+    bool lineMode;
+    QByteArray pendingLine;
+    bool skippingLine;      // the rest of an overlong line is being dropped
+    bool linesDropped;
+    ProgressParser *progressParser;
+    QByteArray pendingProgressOutput;
+    QByteArray pendingProgressError;
+    QElapsedTimer progressTimer;
+    int lastReportedPercentage;
+    std::atomic<bool> cancelRequested;
+    std::atomic<qint64> runningGroup;   // the running tool's pid, 0 when none
+    std::atomic<bool> schedulingChanged;
+    std::atomic<int> niceOverride;
+    std::atomic<int> ioClassOverride;
+    QProcessEnvironment environment;
+    
+    static std::atomic<qint64> defaultMemoryLimit;
+    static std::atomic<qint64> defaultMaximumSize;
 };
 
 #endif // PROCESSMANAGER_H
@@ -0,0 +1,29 @@
+#ifndef PROCESSPRIORITY_H
+#define PROCESSPRIORITY_H
+
+#include <QString>
+#include <QHash>
+
+// I/O scheduling classes as understood by ioprio_set(2) and ionice(1)
+enum IoPriorityClass {
+    IoPriorityDefault = 0,
+    IoPriorityRealtime = 1,
+    IoPriorityBestEffort = 2,
+    IoPriorityIdle = 3
+};
+
+// How a tool process competes with the rest of the host. The scheduling
+// fields are applied to the child between fork and exec; thread counts are
+// turned into tool flags by the handlers.
+struct ProcessPriority {
+    int niceLevel = 0;           // -20..19, 0 leaves it alone
+    int ioClass = IoPriorityDefault;
+    int ioLevel = 4;             // 0 (highest)..7, for realtime and best-effort
+    quint64 cpuMask = 0;         // bit n allows CPU n; 0 allows all
+    QHash<QString, int> threads; // per tool name, e.g. "7z", "xz", or "native"
+                                 // for in-process engines; 0 = default
+
+    int threadsFor(const QString &tool) const { return threads.value(tool, 0); }
+};
+
+#endif // PROCESSPRIORITY_H
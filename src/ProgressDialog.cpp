@@ -1,6 +1,21 @@
 #include "ProgressDialog.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
+#include <QSignalBlocker>
+#include "utils/ArchiveUtils.h"
+
+// Estimates before this much time has passed are mostly noise
+static const qint64 ETA_MIN_ELAPSED = 2000;
+
+static QString formatDuration(qint64 msecs) {
+    qint64 seconds = (msecs + 999) / 1000;
+    if (seconds >= 3600) {
+        return QString("%1:%2:%3").arg(seconds / 3600)
+                                  .arg((seconds / 60) % 60, 2, 10, QChar('0'))
+                                  .arg(seconds % 60, 2, 10, QChar('0'));
+    }
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+}
 
 ProgressDialog::ProgressDialog(QWidget *parent)
     : QDialog(parent), cancelledFlag(false) {
@@ -18,7 +33,14 @@ ProgressDialog::ProgressDialog(QWidget *parent)
     progressBar->setValue(0);
     layout->addWidget(progressBar);
     
+    detailLabel = new QLabel(this);
+    layout->addWidget(detailLabel);
+    
     QHBoxLayout *buttonLayout = new QHBoxLayout;
+    lowPriorityBox = new QCheckBox(tr("Low priority"), this);
+    lowPriorityBox->setToolTip(tr("Leave the CPU and disk to other programs while this runs"));
+    connect(lowPriorityBox, &QCheckBox::toggled, this, &ProgressDialog::lowPriorityChanged);
+    buttonLayout->addWidget(lowPriorityBox);
     buttonLayout->addStretch();
     
     cancelButton = new QPushButton(tr("Cancel"), this);
@@ -26,6 +48,8 @@ ProgressDialog::ProgressDialog(QWidget *parent)
     buttonLayout->addWidget(cancelButton);
     
     layout->addLayout(buttonLayout);
+    
+    elapsed.start();
 }
 
 void ProgressDialog::setMessage(const QString &message) {
@@ -46,6 +70,46 @@ void ProgressDialog::setIndeterminate(bool indeterminate) {
     }
 }
 
+void ProgressDialog::setLowPriority(bool low) {
+    QSignalBlocker blocker(lowPriorityBox);
+    lowPriorityBox->setChecked(low);
+}
+
+void ProgressDialog::setProgressInfo(const ProgressInfo &info) {
+    if (info.percentage < 0) {
+        return;
+    }
+    
+    if (progressBar->maximum() == 0) {
+        setIndeterminate(false);
+    }
+    setProgress(info.percentage);
+    
+    QStringList details;
+    if (info.bytesTotal > 0 && info.bytesDone >= 0) {
+        details << tr("%1 of %2").arg(ArchiveUtils::formatFileSizeString(info.bytesDone),
+                                      ArchiveUtils::formatFileSizeString(info.bytesTotal));
+    }
+    if (info.filesTotal > 0 && info.filesDone >= 0) {
+        details << tr("%1 of %2 files").arg(info.filesDone).arg(info.filesTotal);
+    } else if (info.filesDone > 0) {
+        details << tr("%1 files").arg(info.filesDone);
+    }
+    
+    // Byte counts are finer grained than the integer percentage
+    double fraction = info.percentage / 100.0;
+    if (info.bytesTotal > 0 && info.bytesDone > 0) {
+        fraction = double(info.bytesDone) / info.bytesTotal;
+    }
+    qint64 msecs = elapsed.elapsed();
+    if (msecs >= ETA_MIN_ELAPSED && fraction > 0.0 && fraction < 1.0) {
+        qint64 remaining = qint64(msecs * (1.0 - fraction) / fraction);
+        details << tr("%1 remaining").arg(formatDuration(remaining));
+    }
+    
+    detailLabel->setText(details.join(" - "));
+}
+
 void ProgressDialog::onCancel() {
     cancelledFlag = true;
     emit cancelled();
@@ -2,9 +2,12 @@
 #define PROGRESSDIALOG_H
 
 #include <QDialog>
+#include <QCheckBox>
 #include <QLabel>
 #include <QProgressBar>
 #include <QPushButton>
+#include <QElapsedTimer>
+#include "ProgressParser.h"
 
 class ProgressDialog : public QDialog {
     Q_OBJECT
@@ -15,18 +18,27 @@ public:
     void setMessage(const QString &message);
     void setProgress(int percentage);
     void setIndeterminate(bool indeterminate);
+    // Checks the low priority box without emitting lowPriorityChanged()
+    void setLowPriority(bool low);
 
 public slots:
+    // Switches to a determinate bar and shows counts and time remaining
+    void setProgressInfo(const ProgressInfo &info);
     void onCancel();
 
 signals:
     void cancelled();
+    // The user wants the operation to run politely, or flat-out again
+    void lowPriorityChanged(bool low);
 
 private:
     QLabel *messageLabel;
+    QLabel *detailLabel;
     QProgressBar *progressBar;
+    QCheckBox *lowPriorityBox;
     QPushButton *cancelButton;
     bool cancelledFlag;
+    QElapsedTimer elapsed;
 };
 
 #endif // PROGRESSDIALOG_H
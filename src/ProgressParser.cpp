@@ -0,0 +1,93 @@
+#include "ProgressParser.h"
+#include <QStringList>
+
+// tar reports a checkpoint every CHECKPOINT_RECORDS records of 10 KiB
+// (the default blocking factor of 20 x 512 bytes)
+static const int CHECKPOINT_RECORDS = 100;
+static const qint64 TAR_RECORD_SIZE = 20 * 512;
+
+void ProgressParser::setTotals(qint64 bytes, qint64 files) {
+    info.bytesTotal = bytes > 0 ? bytes : -1;
+    info.filesTotal = files > 0 ? files : -1;
+}
+
+void ProgressParser::updatePercentage() {
+    int percentage = -1;
+    if (info.bytesTotal > 0 && info.bytesDone >= 0) {
+        percentage = static_cast<int>(info.bytesDone * 100 / info.bytesTotal);
+    } else if (info.filesTotal > 0 && info.filesDone >= 0) {
+        percentage = static_cast<int>(info.filesDone * 100 / info.filesTotal);
+    }
+    
+    if (percentage >= 0) {
+        info.percentage = qBound(0, percentage, 100);
+    }
+}
+
+PercentProgressParser::PercentProgressParser()
+    : regex(R"((\d{1,3})%(?:\s+(\d+))?(?:\s+[-+U=]\s+(.+))?)") {
+}
+
+bool PercentProgressParser::parseLine(const QString &line) {
+    QRegularExpressionMatch match = regex.match(line);
+    if (!match.hasMatch()) {
+        return false;
+    }
+    
+    int percentage = qBound(0, match.captured(1).toInt(), 100);
+    if (percentage < info.percentage) {
+        // rar also prints per-file percentages; keep the overall one monotonic
+        return false;
+    }
+    
+    info.percentage = percentage;
+    if (!match.captured(2).isEmpty()) {
+        info.filesDone = match.captured(2).toLongLong();
+    }
+    if (!match.captured(3).isEmpty()) {
+        info.currentFile = match.captured(3).trimmed();
+    }
+    if (info.bytesTotal > 0) {
+        info.bytesDone = info.bytesTotal * percentage / 100;
+    }
+    return true;
+}
+
+FileCountProgressParser::FileCountProgressParser(const QString &pattern)
+    : regex(pattern) {
+}
+
+bool FileCountProgressParser::parseLine(const QString &line) {
+    QRegularExpressionMatch match = regex.match(line);
+    if (!match.hasMatch()) {
+        return false;
+    }
+    
+    info.filesDone = qMax<qint64>(info.filesDone, 0) + 1;
+    info.currentFile = match.captured(1).trimmed();
+    updatePercentage();
+    return true;
+}
+
+TarCheckpointProgressParser::TarCheckpointProgressParser()
+    : regex(R"(LINRAR-CHECKPOINT (\d+))") {
+}
+
+bool TarCheckpointProgressParser::parseLine(const QString &line) {
+    QRegularExpressionMatch match = regex.match(line);
+    if (!match.hasMatch()) {
+        return false;
+    }
+    
+    info.bytesDone = match.captured(1).toLongLong() * CHECKPOINT_RECORDS * TAR_RECORD_SIZE;
+    if (info.bytesTotal > 0) {
+        info.bytesDone = qMin(info.bytesDone, info.bytesTotal);
+    }
+    updatePercentage();
+    return true;
+}
+
+QStringList TarCheckpointProgressParser::arguments() {
+    return QStringList() << "--checkpoint=" + QString::number(CHECKPOINT_RECORDS)
+                         << "--checkpoint-action=echo=LINRAR-CHECKPOINT %u";
+}
@@ -0,0 +1,72 @@
+#ifndef PROGRESSPARSER_H
+#define PROGRESSPARSER_H
+
+#include <QString>
+#include <QRegularExpression>
+#include <QMetaType>
+
+struct ProgressInfo {
+    int percentage = -1;
+    qint64 bytesDone = -1;
+    qint64 bytesTotal = -1;
+    qint64 filesDone = -1;
+    qint64 filesTotal = -1;
+    QString currentFile;
+};
+
+Q_DECLARE_METATYPE(ProgressInfo)
+
+// Turns a tool's progress output into ProgressInfo. ProcessManager feeds it
+// one terminal line at a time, splitting on \n, \r and backspaces.
+class ProgressParser {
+public:
+    virtual ~ProgressParser() = default;
+    
+    // Totals known up front (e.g. from the listing); -1 when unknown
+    void setTotals(qint64 bytes, qint64 files);
+    const ProgressInfo &getInfo() const { return info; }
+    
+    // Returns true when the line advanced the progress
+    virtual bool parseLine(const QString &line) = 0;
+
+protected:
+    void updatePercentage();
+    
+    ProgressInfo info;
+};
+
+// Tools printing an overall percentage: 7z -bsp1 ("45% 12 - name") and rar
+class PercentProgressParser : public ProgressParser {
+public:
+    PercentProgressParser();
+    bool parseLine(const QString &line) override;
+
+private:
+    QRegularExpression regex;
+};
+
+// Tools printing one line per processed member (unzip, zip); progress is
+// the member count against the expected total
+class FileCountProgressParser : public ProgressParser {
+public:
+    // pattern must capture the member name in group 1
+    explicit FileCountProgressParser(const QString &pattern);
+    bool parseLine(const QString &line) override;
+
+private:
+    QRegularExpression regex;
+};
+
+// GNU tar --checkpoint output produced with TarCheckpointProgressParser::arguments()
+class TarCheckpointProgressParser : public ProgressParser {
+public:
+    TarCheckpointProgressParser();
+    bool parseLine(const QString &line) override;
+    
+    static QStringList arguments();
+
+private:
+    QRegularExpression regex;
+};
+
+#endif // PROGRESSPARSER_H
@@ -1,6 +1,7 @@
 #include "SettingsManager.h"
 #include <QStandardPaths>
 #include <QDir>
+#include <QThread>
 
 SettingsManager::SettingsManager(QObject *parent)
     : QObject(parent) {
@@ -78,6 +79,56 @@ void SettingsManager::setDefaultCompressionLevel(int level) {
     settings->sync();
 }
 
+QString SettingsManager::getDefaultArchiveExtension() const {
+    QString extension = settings->value("defaultArchiveExtension", "zip").toString();
+    return archiveExtensions().contains(extension) ? extension : QString("zip");
+}
+
+void SettingsManager::setDefaultArchiveExtension(const QString &extension) {
+    settings->setValue("defaultArchiveExtension", extension);
+    settings->sync();
+}
+
+QStringList SettingsManager::archiveExtensions() {
+    return QStringList() << "zip" << "7z" << "rar" << "tar" << "tar.zst" << "tar.gz"
+                         << "tar.bz2" << "tar.xz" << "tar.lz4";
+}
+
+int SettingsManager::getZstdLevel() const {
+    return settings->value("zstdLevel", 0).toInt();
+}
+
+void SettingsManager::setZstdLevel(int level) {
+    settings->setValue("zstdLevel", level);
+    settings->sync();
+}
+
+bool SettingsManager::getZstdLongDistance() const {
+    return settings->value("zstdLongDistance", false).toBool();
+}
+
+void SettingsManager::setZstdLongDistance(bool enabled) {
+    settings->setValue("zstdLongDistance", enabled);
+    settings->sync();
+}
+
+bool SettingsManager::getRandomAccessCompression() const {
+    return settings->value("randomAccessCompression", false).toBool();
+}
+
+void SettingsManager::setRandomAccessCompression(bool enabled) {
+    settings->setValue("randomAccessCompression", enabled);
+    settings->sync();
+}
+
+CompressionOptions SettingsManager::getCompressionOptions() const {
+    CompressionOptions options;
+    options.zstdLevel = getZstdLevel();
+    options.zstdLongDistance = getZstdLongDistance();
+    options.randomAccess = getRandomAccessCompression();
+    return options;
+}
+
 bool SettingsManager::getShowHiddenFiles() const {
     return settings->value("showHiddenFiles", false).toBool();
 }
@@ -87,6 +138,88 @@ void SettingsManager::setShowHiddenFiles(bool show) {
     settings->sync();
 }
 
+qint64 SettingsManager::getOutputMemoryLimit() const {
+    return settings->value("outputMemoryLimit", 8LL * 1024 * 1024).toLongLong();
+}
+
+void SettingsManager::setOutputMemoryLimit(qint64 bytes) {
+    settings->setValue("outputMemoryLimit", bytes);
+    settings->sync();
+}
+
+qint64 SettingsManager::getOutputSizeLimit() const {
+    return settings->value("outputSizeLimit", 256LL * 1024 * 1024).toLongLong();
+}
+
+void SettingsManager::setOutputSizeLimit(qint64 bytes) {
+    settings->setValue("outputSizeLimit", bytes);
+    settings->sync();
+}
+
+int SettingsManager::getMaxConcurrentJobs() const {
+    return settings->value("maxConcurrentJobs", QThread::idealThreadCount()).toInt();
+}
+
+void SettingsManager::setMaxConcurrentJobs(int count) {
+    settings->setValue("maxConcurrentJobs", count);
+    settings->sync();
+}
+
+int SettingsManager::getNiceLevel() const {
+    return settings->value("niceLevel", 0).toInt();
+}
+
+void SettingsManager::setNiceLevel(int level) {
+    settings->setValue("niceLevel", level);
+    settings->sync();
+}
+
+int SettingsManager::getIoPriorityClass() const {
+    return settings->value("ioPriorityClass", IoPriorityDefault).toInt();
+}
+
+void SettingsManager::setIoPriorityClass(int ioClass) {
+    settings->setValue("ioPriorityClass", ioClass);
+    settings->sync();
+}
+
+quint64 SettingsManager::getCpuAffinityMask() const {
+    return settings->value("cpuAffinityMask", 0).toULongLong();
+}
+
+void SettingsManager::setCpuAffinityMask(quint64 mask) {
+    settings->setValue("cpuAffinityMask", mask);
+    settings->sync();
+}
+
+int SettingsManager::getToolThreads(const QString &tool) const {
+    return settings->value("threads/" + tool, 0).toInt();
+}
+
+void SettingsManager::setToolThreads(const QString &tool, int threads) {
+    settings->setValue("threads/" + tool, threads);
+    settings->sync();
+}
+
+QStringList SettingsManager::threadedTools() {
+    return QStringList() << "7z" << "rar" << "xz" << "zstd" << "pigz" << "pbzip2"
+                         << "lbzip2" << "pixz" << "native";
+}
+
+ProcessPriority SettingsManager::getProcessPriority() const {
+    ProcessPriority priority;
+    priority.niceLevel = getNiceLevel();
+    priority.ioClass = getIoPriorityClass();
+    priority.cpuMask = getCpuAffinityMask();
+    for (const QString &tool : threadedTools()) {
+        int threads = getToolThreads(tool);
+        if (threads > 0) {
+            priority.threads.insert(tool, threads);
+        }
+    }
+    return priority;
+}
+
 QByteArray SettingsManager::getWindowGeometry() const {
     return settings->value("windowGeometry").toByteArray();
 }
@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QSettings>
 #include <QStringList>
+#include "ProcessPriority.h"
+#include "CompressionOptions.h"
 
 class SettingsManager : public QObject {
     Q_OBJECT
@@ -30,9 +32,51 @@ public:
     int getDefaultCompressionLevel() const;
     void setDefaultCompressionLevel(int level);
     
+    // Extension suggested for new archives, one of archiveExtensions()
+    QString getDefaultArchiveExtension() const;
+    void setDefaultArchiveExtension(const QString &extension);
+    static QStringList archiveExtensions();
+    
+    // zstd level (0 = mapped from the default level) and long-distance mode
+    int getZstdLevel() const;
+    void setZstdLevel(int level);
+    bool getZstdLongDistance() const;
+    void setZstdLongDistance(bool enabled);
+    // Write tar.xz in independent blocks for quick single-file extraction
+    bool getRandomAccessCompression() const;
+    void setRandomAccessCompression(bool enabled);
+    // The above combined for ArchiveJob::setCompressionOptions()
+    CompressionOptions getCompressionOptions() const;
+    
     bool getShowHiddenFiles() const;
     void setShowHiddenFiles(bool show);
     
+    // Captured tool output: kept in memory up to the first limit, spilled
+    // to a temp file beyond it and cut off at the second (0 = unlimited)
+    qint64 getOutputMemoryLimit() const;
+    void setOutputMemoryLimit(qint64 bytes);
+    qint64 getOutputSizeLimit() const;
+    void setOutputSizeLimit(qint64 bytes);
+    
+    // Archive operations allowed to run at the same time
+    int getMaxConcurrentJobs() const;
+    void setMaxConcurrentJobs(int count);
+    
+    // Scheduling of background operations: nice level, ionice class,
+    // CPU affinity mask (0 = all CPUs) and thread counts per tool (0 = default)
+    int getNiceLevel() const;
+    void setNiceLevel(int level);
+    int getIoPriorityClass() const;
+    void setIoPriorityClass(int ioClass);
+    quint64 getCpuAffinityMask() const;
+    void setCpuAffinityMask(quint64 mask);
+    int getToolThreads(const QString &tool) const;
+    void setToolThreads(const QString &tool, int threads);
+    // Tools with a thread setting; "native" is the in-process engines
+    static QStringList threadedTools();
+    // All of the above combined for ArchiveJob::setPriority()
+    ProcessPriority getProcessPriority() const;
+    
     QByteArray getWindowGeometry() const;
     void setWindowGeometry(const QByteArray &geometry);
     
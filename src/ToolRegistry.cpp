@@ -0,0 +1,143 @@
+#include "ToolRegistry.h"
+#include <QStandardPaths>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QThreadPool>
+#include <QMutexLocker>
+
+// A version banner that takes longer than this is treated as unknown
+static const int PROBE_TIMEOUT = 3000;
+
+static QStringList versionArguments(const QString &name) {
+    // 7z, rar and unrar print their banner when run without arguments
+    if (name.startsWith("7z") || name == "rar" || name == "unrar") {
+        return QStringList();
+    }
+    if (name == "zip" || name == "unzip") {
+        return QStringList() << "-v";
+    }
+    // pixz has no --version and would start compressing stdin
+    if (name == "pixz") {
+        return QStringList() << "-h";
+    }
+    return QStringList() << "--version";
+}
+
+static bool versionAtLeast(const QString &version, int major, int minor) {
+    QStringList parts = version.split('.');
+    int foundMajor = parts.value(0).toInt();
+    int foundMinor = parts.value(1).toInt();
+    return foundMajor > major || (foundMajor == major && foundMinor >= minor);
+}
+
+ToolRegistry *ToolRegistry::instance() {
+    static ToolRegistry registry;
+    return &registry;
+}
+
+QStringList ToolRegistry::knownTools() {
+    return QStringList() << "7z" << "7za" << "rar" << "unrar" << "zip" << "unzip"
+                         << "tar" << "gzip" << "bzip2" << "xz" << "zstd" << "lz4"
+                         << "pigz" << "pbzip2" << "lbzip2" << "pixz";
+}
+
+void ToolRegistry::refreshAsync() {
+    invalidate();
+    QThreadPool::globalInstance()->start([this]() {
+        for (const QString &name : knownTools()) {
+            tool(name);
+        }
+    });
+}
+
+void ToolRegistry::invalidate() {
+    QMutexLocker locker(&mutex);
+    tools.clear();
+}
+
+ToolInfo ToolRegistry::tool(const QString &name) {
+    QMutexLocker locker(&mutex);
+    QByteArray path = qgetenv("PATH");
+    if (path != resolvedPath) {
+        tools.clear();
+        resolvedPath = path;
+    }
+    
+    // The startup refresh may be probing this tool already
+    while (probing.contains(name)) {
+        probed.wait(&mutex);
+    }
+    
+    auto it = tools.constFind(name);
+    if (it != tools.constEnd()) {
+        return it.value();
+    }
+    
+    // Probed without the lock, the version banner can take a while
+    probing.insert(name);
+    locker.unlock();
+    ToolInfo info = probe(name);
+    locker.relock();
+    
+    probing.remove(name);
+    tools.insert(name, info);
+    probed.wakeAll();
+    return info;
+}
+
+ToolInfo ToolRegistry::firstAvailable(const QStringList &names) {
+    for (const QString &name : names) {
+        ToolInfo info = tool(name);
+        if (info.isValid()) {
+            return info;
+        }
+    }
+    return ToolInfo();
+}
+
+ToolInfo ToolRegistry::probe(const QString &name) {
+    ToolInfo info;
+    info.name = name;
+    info.path = QStandardPaths::findExecutable(name);
+    if (info.path.isEmpty()) {
+        return info;
+    }
+    
+    QProcess process;
+    process.setProcessChannelMode(QProcess::MergedChannels);
+    process.start(info.path, versionArguments(name));
+    if (!process.waitForStarted(PROBE_TIMEOUT)) {
+        return info;
+    }
+    // Tools that fall back to reading stdin see EOF instead of blocking
+    process.closeWriteChannel();
+    if (!process.waitForFinished(PROBE_TIMEOUT)) {
+        process.kill();
+        process.waitForFinished(PROBE_TIMEOUT);
+    }
+    
+    // The banner is within the first few lines
+    QString banner = QString::fromUtf8(process.readAll()).section('\n', 0, 5);
+    QRegularExpressionMatch match = QRegularExpression(R"((\d+)\.(\d+)(?:\.(\d+))?)").match(banner);
+    if (match.hasMatch()) {
+        info.version = match.captured(0);
+    }
+    
+    if (name.startsWith("7z") || name == "rar") {
+        info.capabilities |= Multithreading;
+    } else if (name == "xz" && versionAtLeast(info.version, 5, 2)) {
+        info.capabilities |= Multithreading;
+    } else if (name == "zstd" || name == "pigz" || name == "pbzip2" || name == "lbzip2"
+               || name == "pixz") {
+        info.capabilities |= Multithreading;
+    } else if (name == "tar" && banner.contains("GNU tar")) {
+        // bsdtar has neither; its -I means --files-from
+        info.capabilities |= Checkpoints;
+        // Arguments inside the compressor command need 1.27
+        if (versionAtLeast(info.version, 1, 27)) {
+            info.capabilities |= ExternalCompressor;
+        }
+    }
+    
+    return info;
+}
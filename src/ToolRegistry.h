@@ -0,0 +1,60 @@
+#ifndef TOOLREGISTRY_H
+#define TOOLREGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSet>
+
+enum ToolCapability {
+    NoCapabilities = 0x0,
+    Multithreading = 0x1,      // 7z -mmt, rar -mt, xz/zstd -T, pigz & co.
+    ExternalCompressor = 0x2,  // tar --use-compress-program with arguments
+    Checkpoints = 0x4          // tar --checkpoint
+};
+
+// A command line tool as found on PATH, probed once for version and capabilities
+struct ToolInfo {
+    QString name;
+    QString path;
+    QString version;
+    int capabilities = NoCapabilities;
+    
+    bool isValid() const { return !path.isEmpty(); }
+    bool has(ToolCapability capability) const { return (capabilities & capability) != 0; }
+};
+
+// Process-wide cache of resolved tools. Lookups are thread-safe; the cache
+// is dropped whenever PATH changes.
+class ToolRegistry {
+public:
+    static ToolRegistry *instance();
+    
+    // Resolves and probes every known tool on the global thread pool, so
+    // later lookups from handlers are served from the cache
+    void refreshAsync();
+    void invalidate();
+    
+    // Resolves and probes the tool on first use; invalid if not installed
+    ToolInfo tool(const QString &name);
+    // First installed tool out of several alternatives, e.g. 7z and 7za
+    ToolInfo firstAvailable(const QStringList &names);
+    
+    static QStringList knownTools();
+
+private:
+    ToolRegistry() = default;
+    
+    static ToolInfo probe(const QString &name);
+    
+    QMutex mutex;
+    QWaitCondition probed;
+    QHash<QString, ToolInfo> tools;
+    // Tools being probed right now; other callers wait instead of probing twice
+    QSet<QString> probing;
+    QByteArray resolvedPath;
+};
+
+#endif // TOOLREGISTRY_H
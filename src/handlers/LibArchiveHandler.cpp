@@ -0,0 +1,588 @@
+#include "LibArchiveHandler.h"
+#include "../ProcessManager.h"
+#include "../utils/ArchiveUtils.h"
+#include "../utils/FormatDetector.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <archive.h>
+#include <archive_entry.h>
+
+// Read size handed to libarchive when opening archives
+static const size_t READ_BLOCK_SIZE = 1024 * 1024;
+// File data copied into new archives per write
+static const int WRITE_BUFFER_SIZE = 1024 * 1024;
+// Restores times and permissions like tar does, but refuses ".." members
+// and writing through symlinks planted by earlier members
+static const int EXTRACT_FLAGS = ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM
+                                 | ARCHIVE_EXTRACT_SECURE_NODOTDOT
+                                 | ARCHIVE_EXTRACT_SECURE_SYMLINKS;
+
+static QString errorString(struct archive *handle) {
+    const char *message = archive_error_string(handle);
+    return message ? QString::fromLocal8Bit(message) : QString("Unknown libarchive error");
+}
+
+static QString entryName(struct archive_entry *entry) {
+    const char *utf8 = archive_entry_pathname_utf8(entry);
+    if (utf8) {
+        return QString::fromUtf8(utf8);
+    }
+    const char *local = archive_entry_pathname(entry);
+    return local ? QFile::decodeName(local) : QString();
+}
+
+static ArchiveEntry toArchiveEntry(struct archive_entry *entry) {
+    ArchiveEntry result;
+    result.name = entryName(entry);
+    result.path = result.name;
+    result.size = archive_entry_size_is_set(entry) ? qint64(archive_entry_size(entry)) : 0;
+    result.compressedSize = result.size; // libarchive has no packed sizes
+    result.isDirectory = archive_entry_filetype(entry) == AE_IFDIR;
+    result.permissions = ArchiveUtils::formatPermissions(quint32(archive_entry_mode(entry)));
+    if (archive_entry_mtime_is_set(entry)) {
+        result.date = QDateTime::fromSecsSinceEpoch(archive_entry_mtime(entry)).toString("yyyy-MM-dd hh:mm");
+    }
+    return result;
+}
+
+// Progress by position in the archive file, which works for every format
+// and compression alike
+static void updateProgress(struct archive *reader, ProgressInfo &info) {
+    info.bytesDone = qint64(archive_filter_bytes(reader, -1));
+    if (info.bytesTotal > 0) {
+        info.percentage = int(qMin<qint64>(100, info.bytesDone * 100 / info.bytesTotal));
+    }
+}
+
+LibArchiveHandler::LibArchiveHandler(ArchiveHandler *fallback, QObject *parent)
+    : ArchiveHandler(parent), fallback(fallback) {
+    fallback->setParent(this);
+    connect(fallback, &ArchiveHandler::progress, this, &ArchiveHandler::progress);
+    connect(fallback, &ArchiveHandler::error, this, &ArchiveHandler::error);
+    connect(fallback, &ArchiveHandler::entriesAvailable, this, &ArchiveHandler::entriesAvailable);
+    connect(fallback, &ArchiveHandler::progressDetail, this, &ArchiveHandler::progressDetail);
+}
+
+void LibArchiveHandler::cancel() {
+    ArchiveHandler::cancel();
+    fallback->cancel();
+}
+
+void LibArchiveHandler::changeScheduling(int niceLevel, int ioClass) {
+    ArchiveHandler::changeScheduling(niceLevel, ioClass);
+    fallback->changeScheduling(niceLevel, ioClass);
+}
+
+void LibArchiveHandler::setExpectedTotals(qint64 bytes, qint64 files) {
+    ArchiveHandler::setExpectedTotals(bytes, files);
+    fallback->setExpectedTotals(bytes, files);
+}
+
+void LibArchiveHandler::setPriority(const ProcessPriority &priority) {
+    ArchiveHandler::setPriority(priority);
+    fallback->setPriority(priority);
+}
+
+void LibArchiveHandler::setCompressionOptions(const CompressionOptions &options) {
+    ArchiveHandler::setCompressionOptions(options);
+    fallback->setCompressionOptions(options);
+}
+
+bool LibArchiveHandler::list(const QString &archivePath, QList<ArchiveEntry> &entries) {
+    if (fallback->listsInProcess(archivePath)) {
+        return fallback->list(archivePath, entries);
+    }
+    
+    QString errorMessage;
+    struct archive *reader = openReader(archivePath, errorMessage);
+    if (!reader) {
+        return fallback->list(archivePath, entries);
+    }
+
+    int first = entries.size();
+    QList<ArchiveEntry> batch;
+    bool success = true;
+    struct archive_entry *entry;
+    while (true) {
+        if (isCancelRequested()) {
+            success = false;
+            break;
+        }
+        int status = archive_read_next_header(reader, &entry);
+        if (status == ARCHIVE_EOF) {
+            break;
+        }
+        if (status == ARCHIVE_RETRY) {
+            continue;
+        }
+        if (status < ARCHIVE_WARN) {
+            errorMessage = errorString(reader);
+            success = false;
+            break;
+        }
+
+        batch.append(toArchiveEntry(entry));
+        if (batch.size() >= LIST_BATCH_SIZE) {
+            entries.append(batch);
+            publishEntries(batch);
+            batch.clear();
+        }
+    }
+    entries.append(batch);
+    publishEntries(batch);
+    archive_read_free(reader);
+
+    if (!success && !isCancelRequested()) {
+        // Not a format libarchive knows after all
+        if (entries.size() == first && fallback->isAvailable()) {
+            return fallback->list(archivePath, entries);
+        }
+        emit error(errorMessage);
+    }
+    return success;
+}
+
+bool LibArchiveHandler::extract(const QString &archivePath, const QString &destination,
+                                const QStringList &files) {
+    if (fallback->extractsInProcess(archivePath, files)) {
+        return fallback->extract(archivePath, destination, files);
+    }
+    
+    bool started = false;
+    QString errorMessage;
+    if (readArchive(archivePath, destination, files, started, errorMessage)) {
+        return true;
+    }
+    if (isCancelRequested()) {
+        return false;
+    }
+    if (!started && fallback->isAvailable()) {
+        return fallback->extract(archivePath, destination, files);
+    }
+    emit error(errorMessage);
+    return false;
+}
+
+bool LibArchiveHandler::extractTo(const QString &archivePath, const QString &destination) {
+    return extract(archivePath, destination);
+}
+
+bool LibArchiveHandler::create(const QString &archivePath, const QStringList &files,
+                               const QString &password, int compressionLevel) {
+    // Encryption is left to the tools, which support it for every format,
+    // and so is anything the fallback does faster
+    struct archive *writer = nullptr;
+    if (password.isEmpty() && !fallback->prefersToolForCreate(archivePath)) {
+        writer = createWriter(archivePath, compressionLevel);
+    }
+    if (!writer) {
+        return fallback->create(archivePath, files, password, compressionLevel);
+    }
+
+    QString errorMessage;
+    bool success = archive_write_open_filename(writer, QFile::encodeName(archivePath).constData()) == ARCHIVE_OK;
+    if (!success) {
+        errorMessage = errorString(writer);
+    } else {
+        success = writeFiles(writer, files, errorMessage);
+    }
+    // 7z writes its headers on close, so failures can still show up here
+    if (archive_write_close(writer) < ARCHIVE_WARN && success) {
+        errorMessage = errorString(writer);
+        success = false;
+    }
+    archive_write_free(writer);
+
+    if (!success) {
+        QFile::remove(archivePath);
+        if (!isCancelRequested()) {
+            emit error(errorMessage);
+        }
+    }
+    return success;
+}
+
+bool LibArchiveHandler::addFiles(const QString &archivePath, const QStringList &files) {
+    // libarchive only writes whole archives
+    return fallback->addFiles(archivePath, files);
+}
+
+bool LibArchiveHandler::removeFiles(const QString &archivePath, const QStringList &files) {
+    return fallback->removeFiles(archivePath, files);
+}
+
+bool LibArchiveHandler::test(const QString &archivePath) {
+    // The fallback's own engine tests in parallel and says which members
+    // are damaged
+    if (fallback->testsInProcess(archivePath)) {
+        bool success = fallback->test(archivePath);
+        testReport = fallback->getTestReport();
+        return success;
+    }
+    
+    bool started = false;
+    QString errorMessage;
+    if (readArchive(archivePath, QString(), QStringList(), started, errorMessage)) {
+        return true;
+    }
+    if (isCancelRequested()) {
+        return false;
+    }
+    if (!started && fallback->isAvailable()) {
+        return fallback->test(archivePath);
+    }
+    emit error(errorMessage);
+    return false;
+}
+
+bool LibArchiveHandler::testsInProcess(const QString &archivePath) const {
+    return fallback->testsInProcess(archivePath);
+}
+
+bool LibArchiveHandler::listsInProcess(const QString &archivePath) const {
+    return fallback->listsInProcess(archivePath);
+}
+
+bool LibArchiveHandler::extractsInProcess(const QString &archivePath, const QStringList &files) const {
+    return fallback->extractsInProcess(archivePath, files);
+}
+
+bool LibArchiveHandler::repair(const QString &archivePath) {
+    return fallback->repair(archivePath);
+}
+
+bool LibArchiveHandler::compact(const QString &archivePath) {
+    return fallback->compact(archivePath);
+}
+
+struct archive *LibArchiveHandler::openReader(const QString &archivePath, QString &errorMessage) {
+    struct archive *reader = archive_read_new();
+    archive_read_support_filter_all(reader);
+    archive_read_support_format_all(reader);
+    if (archive_read_open_filename(reader, QFile::encodeName(archivePath).constData(),
+                                   READ_BLOCK_SIZE) != ARCHIVE_OK) {
+        errorMessage = errorString(reader);
+        archive_read_free(reader);
+        return nullptr;
+    }
+    return reader;
+}
+
+bool LibArchiveHandler::readArchive(const QString &archivePath, const QString &destination,
+                                    const QStringList &files, bool &started, QString &errorMessage) {
+    started = false;
+    struct archive *reader = openReader(archivePath, errorMessage);
+    if (!reader) {
+        return false;
+    }
+
+    struct archive *disk = nullptr;
+    QString root;
+    if (!destination.isEmpty()) {
+        QDir().mkpath(destination);
+        // SECURE_SYMLINKS checks every component of the paths given to it,
+        // so a destination reached through a symlink would refuse them all
+        root = QFileInfo(destination).canonicalFilePath();
+        if (root.isEmpty()) {
+            root = destination;
+        }
+        disk = archive_write_disk_new();
+        archive_write_disk_set_options(disk, EXTRACT_FLAGS);
+        archive_write_disk_set_standard_lookup(disk);
+    }
+
+    QSet<QString> requested;
+    for (const QString &file : files) {
+        requested.insert(ArchiveUtils::normalizeMemberName(file));
+    }
+
+    ProgressInfo info;
+    qint64 archiveSize = QFileInfo(archivePath).size();
+    info.bytesDone = 0;
+    info.bytesTotal = archiveSize > 0 ? archiveSize : -1;
+    info.filesDone = 0;
+    info.filesTotal = requested.isEmpty() ? expectedFiles : -1;
+
+    QSet<QString> found;
+    bool success = true;
+    struct archive_entry *entry;
+    while (success) {
+        if (isCancelRequested()) {
+            success = false;
+            break;
+        }
+        int status = archive_read_next_header(reader, &entry);
+        if (status == ARCHIVE_EOF) {
+            break;
+        }
+        if (status == ARCHIVE_RETRY) {
+            continue;
+        }
+        if (status < ARCHIVE_WARN) {
+            errorMessage = errorString(reader);
+            success = false;
+            break;
+        }
+
+        QString name = ArchiveUtils::normalizeMemberName(entryName(entry));
+        QString selector = requested.isEmpty() ? name : ArchiveUtils::selectedBy(name, requested);
+        if (name.isEmpty() || selector.isEmpty()) {
+            continue;
+        }
+        found.insert(selector);
+        if (archive_entry_is_encrypted(entry)) {
+            errorMessage = QString("%1 is encrypted").arg(name);
+            success = false;
+            break;
+        }
+        info.currentFile = name;
+
+        if (disk) {
+            // Members are rewritten to absolute paths below root;
+            // unsafe ones are dropped the way tar drops them
+            QString relative = ArchiveUtils::safeRelativePath(name);
+            if (relative.isEmpty()) {
+                continue;
+            }
+            archive_entry_copy_pathname(entry, QFile::encodeName(root + "/" + relative).constData());
+            const char *hardlink = archive_entry_hardlink(entry);
+            if (hardlink) {
+                QString linkRelative = ArchiveUtils::safeRelativePath(
+                    ArchiveUtils::normalizeMemberName(QFile::decodeName(hardlink)));
+                if (linkRelative.isEmpty()) {
+                    continue;
+                }
+                archive_entry_copy_hardlink(entry, QFile::encodeName(root + "/" + linkRelative).constData());
+            }
+
+            if (archive_write_header(disk, entry) < ARCHIVE_WARN) {
+                errorMessage = errorString(disk);
+                success = false;
+                break;
+            }
+        }
+        started = true;
+
+        success = copyData(reader, disk, info, errorMessage);
+        if (disk && archive_write_finish_entry(disk) < ARCHIVE_WARN && success) {
+            errorMessage = errorString(disk);
+            success = false;
+        }
+        ++info.filesDone;
+        reportProgress(info);
+    }
+
+    if (success && found.size() < requested.size()) {
+        errorMessage = "Some selected files were not found in the archive";
+        success = false;
+    }
+    if (disk) {
+        // Directory times and permissions are only applied on close
+        if (archive_write_close(disk) < ARCHIVE_WARN && success) {
+            errorMessage = errorString(disk);
+            success = false;
+        }
+        archive_write_free(disk);
+    }
+    archive_read_free(reader);
+
+    if (success) {
+        info.percentage = 100;
+        reportProgress(info, true);
+    }
+    return success;
+}
+
+bool LibArchiveHandler::copyData(struct archive *reader, struct archive *disk, ProgressInfo &info,
+                                 QString &errorMessage) {
+    const void *block;
+    size_t size;
+    la_int64_t offset;
+    while (true) {
+        if (isCancelRequested()) {
+            return false;
+        }
+        int status = archive_read_data_block(reader, &block, &size, &offset);
+        if (status == ARCHIVE_EOF) {
+            return true;
+        }
+        if (status < ARCHIVE_WARN) {
+            errorMessage = QString("%1: %2").arg(info.currentFile, errorString(reader));
+            return false;
+        }
+        if (disk && archive_write_data_block(disk, block, size, offset) < ARCHIVE_WARN) {
+            errorMessage = errorString(disk);
+            return false;
+        }
+        updateProgress(reader, info);
+        reportProgress(info);
+    }
+}
+
+struct archive *LibArchiveHandler::createWriter(const QString &archivePath, int compressionLevel) {
+    ArchiveFormat format = FormatDetector::detectFormat(archivePath);
+    struct archive *writer = archive_write_new();
+
+    // Filters that fall back to an external program report ARCHIVE_WARN
+    bool ok = false;
+    switch (format) {
+        case ArchiveFormat::Tar:
+            ok = archive_write_set_format_pax_restricted(writer) == ARCHIVE_OK;
+            break;
+        case ArchiveFormat::TarGz:
+            ok = archive_write_set_format_pax_restricted(writer) == ARCHIVE_OK
+                 && archive_write_add_filter_gzip(writer) >= ARCHIVE_WARN;
+            break;
+        case ArchiveFormat::TarBz2:
+            ok = archive_write_set_format_pax_restricted(writer) == ARCHIVE_OK
+                 && archive_write_add_filter_bzip2(writer) >= ARCHIVE_WARN;
+            break;
+        case ArchiveFormat::TarXz:
+            ok = archive_write_set_format_pax_restricted(writer) == ARCHIVE_OK
+                 && archive_write_add_filter_xz(writer) >= ARCHIVE_WARN;
+            break;
+        case ArchiveFormat::TarZst:
+            ok = archive_write_set_format_pax_restricted(writer) == ARCHIVE_OK
+                 && archive_write_add_filter_zstd(writer) >= ARCHIVE_WARN;
+            break;
+        case ArchiveFormat::TarLz4:
+            ok = archive_write_set_format_pax_restricted(writer) == ARCHIVE_OK
+                 && archive_write_add_filter_lz4(writer) >= ARCHIVE_WARN;
+            break;
+        case ArchiveFormat::ZIP:
+            ok = archive_write_set_format_zip(writer) == ARCHIVE_OK;
+            break;
+        case ArchiveFormat::SevenZip:
+            ok = archive_write_set_format_7zip(writer) == ARCHIVE_OK;
+            break;
+        default:
+            break;
+    }
+    if (!ok) {
+        archive_write_free(writer);
+        return nullptr;
+    }
+
+    // Modules without a compression level simply ignore it
+    QByteArray level = "compression-level=" + QByteArray::number(qBound(0, compressionLevel, 9));
+    archive_write_set_options(writer, level.constData());
+    int threads = processManager->getPriority().threadsFor("xz");
+    if (format == ArchiveFormat::TarXz && threads > 0) {
+        archive_write_set_filter_option(writer, "xz", "threads", QByteArray::number(threads).constData());
+    }
+    if (format == ArchiveFormat::TarZst) {
+        // zstd's levels go well beyond 9; older libarchive lacks the
+        // threads and long options and just warns
+        QByteArray zstdLevel = QByteArray::number(compressionOptions.zstdLevelFor(compressionLevel));
+        archive_write_set_filter_option(writer, "zstd", "compression-level", zstdLevel.constData());
+        threads = processManager->getPriority().threadsFor("zstd");
+        archive_write_set_filter_option(writer, "zstd", "threads", QByteArray::number(threads).constData());
+        if (compressionOptions.zstdLongDistance) {
+            archive_write_set_filter_option(writer, "zstd", "long", "27");
+        }
+    }
+    return writer;
+}
+
+bool LibArchiveHandler::writeFiles(struct archive *writer, const QStringList &files,
+                                   QString &errorMessage) {
+    ProgressInfo info;
+    qint64 inputFiles = 0;
+    info.bytesDone = 0;
+    info.bytesTotal = ArchiveUtils::totalSize(files, &inputFiles);
+    info.filesDone = 0;
+    info.filesTotal = inputFiles;
+
+    struct archive *disk = archive_read_disk_new();
+    archive_read_disk_set_standard_lookup(disk);
+    // Links are stored as links, like tar does by default
+    archive_read_disk_set_symlink_physical(disk);
+    QByteArray buffer(WRITE_BUFFER_SIZE, Qt::Uninitialized);
+
+    bool success = true;
+    for (const QString &file : files) {
+        if (archive_read_disk_open(disk, QFile::encodeName(file).constData()) != ARCHIVE_OK) {
+            errorMessage = errorString(disk);
+            success = false;
+            break;
+        }
+
+        while (success) {
+            if (isCancelRequested()) {
+                success = false;
+                break;
+            }
+            struct archive_entry *entry = archive_entry_new();
+            int status = archive_read_next_header2(disk, entry);
+            if (status == ARCHIVE_EOF) {
+                archive_entry_free(entry);
+                break;
+            }
+            if (status < ARCHIVE_WARN) {
+                errorMessage = errorString(disk);
+                archive_entry_free(entry);
+                success = false;
+                break;
+            }
+            archive_read_disk_descend(disk);
+
+            // Named the way tar and zip name them: the path as given,
+            // without the leading slash
+            QString name = QFile::decodeName(archive_entry_pathname(entry));
+            while (name.startsWith('/')) {
+                name.remove(0, 1);
+            }
+            archive_entry_copy_pathname(entry, QFile::encodeName(name).constData());
+            info.currentFile = name;
+
+            if (archive_write_header(writer, entry) < ARCHIVE_WARN) {
+                errorMessage = errorString(writer);
+                success = false;
+            }
+            bool regular = archive_entry_filetype(entry) == AE_IFREG;
+            while (success && regular) {
+                if (isCancelRequested()) {
+                    success = false;
+                    break;
+                }
+                la_ssize_t count = archive_read_data(disk, buffer.data(), size_t(buffer.size()));
+                if (count == 0) {
+                    break;
+                }
+                if (count < 0) {
+                    errorMessage = errorString(disk);
+                    success = false;
+                    break;
+                }
+                if (archive_write_data(writer, buffer.constData(), size_t(count)) != count) {
+                    errorMessage = errorString(writer);
+                    success = false;
+                    break;
+                }
+                info.bytesDone += count;
+                if (info.bytesTotal > 0) {
+                    info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+                }
+                reportProgress(info);
+            }
+            if (regular) {
+                ++info.filesDone;
+            }
+            archive_entry_free(entry);
+        }
+        archive_read_close(disk);
+        if (!success) {
+            break;
+        }
+    }
+    archive_read_free(disk);
+
+    if (success) {
+        info.percentage = 100;
+        reportProgress(info, true);
+    }
+    return success;
+}
@@ -0,0 +1,70 @@
+#ifndef LIBARCHIVEHANDLER_H
+#define LIBARCHIVEHANDLER_H
+
+#include "../ArchiveHandler.h"
+
+struct archive;
+struct archive_entry;
+
+// Lists, extracts, tests and creates archives in-process through libarchive:
+// tar with any compression it knows, 7z, ZIP, and RAR for reading. Anything
+// libarchive cannot do (RAR creation, passwords, updating or repairing
+// archives) or fails to open is passed on to the tool-based handler it wraps.
+class LibArchiveHandler : public ArchiveHandler {
+    Q_OBJECT
+
+public:
+    // Takes ownership of fallback
+    explicit LibArchiveHandler(ArchiveHandler *fallback, QObject *parent = nullptr);
+
+    // Reading needs nothing installed; the fallback reports its own tools
+    bool isAvailable() const override { return true; }
+    ArchiveFormat getFormat() const override { return fallback->getFormat(); }
+
+    bool list(const QString &archivePath, QList<ArchiveEntry> &entries) override;
+    bool extract(const QString &archivePath, const QString &destination,
+                const QStringList &files = QStringList()) override;
+    bool extractTo(const QString &archivePath, const QString &destination) override;
+    bool create(const QString &archivePath, const QStringList &files,
+               const QString &password = QString(), int compressionLevel = 5) override;
+    bool addFiles(const QString &archivePath, const QStringList &files) override;
+    bool removeFiles(const QString &archivePath, const QStringList &files) override;
+    bool test(const QString &archivePath) override;
+    bool testsInProcess(const QString &archivePath) const override;
+    bool listsInProcess(const QString &archivePath) const override;
+    bool extractsInProcess(const QString &archivePath, const QStringList &files) const override;
+    bool repair(const QString &archivePath) override;
+    bool compact(const QString &archivePath) override;
+
+    QString getToolName() const override { return fallback->getToolName(); }
+    QStringList getSupportedExtensions() const override { return fallback->getSupportedExtensions(); }
+    ArchiveHandler *clone() const override { return new LibArchiveHandler(fallback->clone()); }
+
+    void cancel() override;
+    void changeScheduling(int niceLevel, int ioClass) override;
+    void setExpectedTotals(qint64 bytes, qint64 files) override;
+    void setPriority(const ProcessPriority &priority) override;
+    void setCompressionOptions(const CompressionOptions &options) override;
+
+private:
+    // Reader with every filter and format enabled, nullptr if libarchive
+    // does not recognize the file
+    struct archive *openReader(const QString &archivePath, QString &errorMessage);
+    // Walks the archive, writing selected members below destination, or
+    // only decoding them (which verifies their checksums) when destination
+    // is empty. started tells whether any member was reached before a
+    // failure, after which handing over to the tool is no longer clean.
+    bool readArchive(const QString &archivePath, const QString &destination,
+                     const QStringList &files, bool &started, QString &errorMessage);
+    // Decodes the current member, writing it to disk unless that is nullptr
+    bool copyData(struct archive *reader, struct archive *disk, ProgressInfo &info,
+                  QString &errorMessage);
+    // Writer for the format archivePath asks for, nullptr if libarchive
+    // cannot write it
+    struct archive *createWriter(const QString &archivePath, int compressionLevel);
+    bool writeFiles(struct archive *writer, const QStringList &files, QString &errorMessage);
+
+    ArchiveHandler *fallback;
+};
+
+#endif // LIBARCHIVEHANDLER_H
@@ -1,87 +1,103 @@
 #include "RarHandler.h"
 #include "../ProcessManager.h"
-#include <QStandardPaths>
-#include <QProcess>
+#include "../ListParser.h"
+#include "../native/RarReader.h"
 #include <QRegularExpression>
 #include <QDir>
 
+// Parses `rar l -v` output: Attributes Size Packed Ratio Date Time Name
+class RarListParser : public ListParser {
+public:
+    RarListParser()
+        : inFileList(false),
+          fileRegex(R"(^\s*(\S+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\S+\s+\S+)\s+(.+)$)") {
+    }
+    
+    bool parseLine(const QString &line, ArchiveEntry &entry) override {
+        if (line.contains("Name") && line.contains("Size")) {
+            inFileList = true;
+            return false;
+        }
+        
+        if (!inFileList) {
+            return false;
+        }
+        
+        QRegularExpressionMatch match = fileRegex.match(line);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        
+        entry.name = match.captured(6).trimmed();
+        entry.path = entry.name;
+        entry.size = match.captured(2).toLongLong();
+        entry.compressedSize = match.captured(3).toLongLong();
+        entry.isDirectory = entry.name.endsWith('/');
+        entry.date = match.captured(5);
+        return true;
+    }
+
+private:
+    bool inFileList;
+    QRegularExpression fileRegex;
+};
+
+// rar compresses with -mt<threads>; unrar has no such switch
+static QStringList threadArguments(int threads) {
+    if (threads <= 0) {
+        return QStringList();
+    }
+    return QStringList() << "-mt" + QString::number(threads);
+}
+
 RarHandler::RarHandler(QObject *parent)
     : ArchiveHandler(parent) {
 }
 
 bool RarHandler::isAvailable() const {
-    return !findRarTool().isEmpty();
+    // Listing needs no tool; the other operations report a missing one
+    return true;
 }
 
-QString RarHandler::findRarTool() const {
+ToolInfo RarHandler::findRarTool() const {
     // Try rar first (for creating), then unrar (for extracting)
-    QString rar = QStandardPaths::findExecutable("rar");
-    if (!rar.isEmpty()) return rar;
-    
-    QString unrar = QStandardPaths::findExecutable("unrar");
-    if (!unrar.isEmpty()) return unrar;
-    
-    return QString();
+    return ToolRegistry::instance()->firstAvailable(QStringList() << "rar" << "unrar");
+}
+
+bool RarHandler::listsInProcess(const QString &archivePath) const {
+    // Only the header walk follows a volume set past its first file
+    return RarReader(archivePath).canRead();
 }
 
 bool RarHandler::list(const QString &archivePath, QList<ArchiveEntry> &entries) {
-    QString tool = findRarTool();
-    if (tool.isEmpty()) {
+    // The headers hold everything the listing needs; unrar is only asked
+    // about archives the reader cannot walk, such as encrypted headers
+    if (listNative(archivePath, entries)) {
+        return true;
+    }
+    
+    ToolInfo tool = findRarTool();
+    if (!tool.isValid()) {
         emit error("RAR tool not found. Please install rar or unrar.");
         return false;
     }
     
-    QString output, errorOutput;
     QStringList args;
     
-    if (tool.contains("unrar")) {
+    if (tool.name == "unrar") {
         args << "l" << "-v" << archivePath;
     } else {
         args << "l" << "-v" << archivePath;
     }
     
-    if (!processManager->executeWithOutput(tool, args, output, errorOutput)) {
-        emit error(processManager->getLastError());
-        return false;
-    }
-    
-    return parseListOutput(output, entries);
-}
-
-bool RarHandler::parseListOutput(const QString &output, QList<ArchiveEntry> &entries) {
-    QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-    bool inFileList = false;
-    
-    QRegularExpression fileRegex(R"(^\s*(\S+)\s+(\d+)\s+(\d+)\s+(\d+)\s+(\S+\s+\S+)\s+(.+)$)");
-    
-    for (const QString &line : lines) {
-        if (line.contains("Name") && line.contains("Size")) {
-            inFileList = true;
-            continue;
-        }
-        
-        if (inFileList) {
-            QRegularExpressionMatch match = fileRegex.match(line);
-            if (match.hasMatch()) {
-                ArchiveEntry entry;
-                entry.name = match.captured(6).trimmed();
-                entry.path = entry.name;
-                entry.size = match.captured(2).toLongLong();
-                entry.compressedSize = match.captured(3).toLongLong();
-                entry.isDirectory = entry.name.endsWith('/');
-                entry.date = match.captured(5);
-                entries.append(entry);
-            }
-        }
-    }
-    
-    return true;
+    RarListParser parser;
+    return runListing(tool.path, args, parser, entries);
 }
 
 bool RarHandler::extract(const QString &archivePath, const QString &destination,
                         const QStringList &files) {
-    QString tool = findRarTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findRarTool();
+    if (!tool.isValid()) {
         emit error("RAR tool not found");
         return false;
     }
@@ -89,18 +105,19 @@ bool RarHandler::extract(const QString &archivePath, const QString &destination,
     QDir().mkpath(destination);
     
     QStringList args;
-    if (tool.contains("unrar")) {
+    if (tool.name == "unrar") {
         args << "x" << "-o+" << archivePath << destination + "/";
     } else {
         args << "x" << "-o+" << archivePath << destination + "/";
     }
     
-    if (!files.isEmpty()) {
-        args << files;
+    if (!appendFileArguments(files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    parser.setTotals(expectedBytes, expectedFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool RarHandler::extractTo(const QString &archivePath, const QString &destination) {
@@ -109,8 +126,8 @@ bool RarHandler::extractTo(const QString &archivePath, const QString &destinatio
 
 bool RarHandler::create(const QString &archivePath, const QStringList &files,
                        const QString &password, int compressionLevel) {
-    QString tool = QStandardPaths::findExecutable("rar");
-    if (tool.isEmpty()) {
+    ToolInfo tool = ToolRegistry::instance()->tool("rar");
+    if (!tool.isValid()) {
         emit error("rar tool not found. unrar can only extract, not create archives.");
         return false;
     }
@@ -123,62 +140,72 @@ bool RarHandler::create(const QString &archivePath, const QStringList &files,
     }
     
     args << "-m" + QString::number(compressionLevel);
+    args << threadArguments(threadsFor(tool));
     args << archivePath;
-    args << files;
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
 }
 
 bool RarHandler::addFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = QStandardPaths::findExecutable("rar");
-    if (tool.isEmpty()) {
+    ToolInfo tool = ToolRegistry::instance()->tool("rar");
+    if (!tool.isValid()) {
         emit error("rar tool not found");
         return false;
     }
     
     QStringList args;
-    args << "a" << archivePath << files;
+    args << "a" << threadArguments(threadsFor(tool)) << archivePath;
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
 }
 
 bool RarHandler::removeFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = QStandardPaths::findExecutable("rar");
-    if (tool.isEmpty()) {
+    ToolInfo tool = ToolRegistry::instance()->tool("rar");
+    if (!tool.isValid()) {
         emit error("rar tool not found");
         return false;
     }
     
     QStringList args;
-    args << "d" << archivePath << files;
+    args << "d" << archivePath;
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
 }
 
 bool RarHandler::test(const QString &archivePath) {
-    QString tool = findRarTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findRarTool();
+    if (!tool.isValid()) {
         emit error("RAR tool not found");
         return false;
     }
     
     QStringList args;
-    if (tool.contains("unrar")) {
+    if (tool.name == "unrar") {
         args << "t" << archivePath;
     } else {
         args << "t" << archivePath;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    parser.setTotals(expectedBytes, expectedFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool RarHandler::repair(const QString &archivePath) {
-    QString tool = QStandardPaths::findExecutable("rar");
-    if (tool.isEmpty()) {
+    ToolInfo tool = ToolRegistry::instance()->tool("rar");
+    if (!tool.isValid()) {
         emit error("rar tool not found");
         return false;
     }
@@ -186,6 +213,50 @@ bool RarHandler::repair(const QString &archivePath) {
     QStringList args;
     args << "r" << archivePath;
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
+}
+
+bool RarHandler::appendFileArguments(const QStringList &files, QStringList &args) {
+    if (!needsListFile(files)) {
+        args << files;
+        return true;
+    }
+    
+    QString listPath = writeListFile(files);
+    if (listPath.isEmpty()) {
+        return false;
+    }
+    // -scfl: the list file is UTF-8
+    args << "-scfl" << "@" + listPath;
+    return true;
+}
+
+bool RarHandler::listNative(const QString &archivePath, QList<ArchiveEntry> &entries) {
+    RarReader reader(archivePath);
+    if (!reader.open()) {
+        return false;
+    }
+    
+    const QVector<RarEntry> &members = reader.getEntries();
+    entries.reserve(entries.size() + members.size());
+    int first = entries.size();
+    for (const RarEntry &member : members) {
+        ArchiveEntry entry;
+        entry.name = member.name;
+        entry.path = member.name;
+        entry.size = qMax<qint64>(0, member.size);
+        entry.compressedSize = member.packedSize;
+        entry.isDirectory = member.directory;
+        entry.permissions = member.permissions();
+        entry.date = member.modified.toString("yyyy-MM-dd hh:mm");
+        entry.crc = member.crc32;
+        if (member.firstVolume == 0) {
+            entry.offset = member.headerOffset;
+        }
+        entries.append(entry);
+    }
+    
+    publishEntries(entries.mid(first));
+    return true;
 }
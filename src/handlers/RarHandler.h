@@ -27,10 +27,15 @@ public:
     QStringList getSupportedExtensions() const override {
         return QStringList() << "rar" << "r00" << "r01";
     }
+    ArchiveHandler *clone() const override { return new RarHandler; }
+    bool listsInProcess(const QString &archivePath) const override;
 
 private:
-    QString findRarTool() const;
-    bool parseListOutput(const QString &output, QList<ArchiveEntry> &entries);
+    ToolInfo findRarTool() const;
+    // Walks the block headers in-process; false if they cannot be read
+    bool listNative(const QString &archivePath, QList<ArchiveEntry> &entries);
+    // Adds files to args, or a list file for them when the selection is large
+    bool appendFileArguments(const QStringList &files, QStringList &args);
 };
 
 #endif // RARHANDLER_H
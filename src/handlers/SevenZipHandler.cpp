@@ -1,30 +1,77 @@
 #include "SevenZipHandler.h"
 #include "../ProcessManager.h"
-#include <QStandardPaths>
+#include "../ListParser.h"
 #include <QRegularExpression>
 #include <QDir>
 
+// Parses `7z l` output: Date Time Attr Size Compressed Name. The member
+// table sits between the two dashed separator lines.
+class SevenZipListParser : public ListParser {
+public:
+    SevenZipListParser()
+        : seenHeader(false), inFileList(false),
+          regex(R"(^\s*(\S+\s+\S+)\s+(\S+)\s+(\d+)\s+(\d+)\s+(.+)$)") {
+    }
+    
+    bool parseLine(const QString &line, ArchiveEntry &entry) override {
+        if (line.contains("Date") && line.contains("Name")) {
+            seenHeader = true;
+            return false;
+        }
+        
+        if (seenHeader && line.startsWith("----")) {
+            // First separator opens the table, second one closes it
+            inFileList = !inFileList;
+            return false;
+        }
+        
+        if (!inFileList) {
+            return false;
+        }
+        
+        QRegularExpressionMatch match = regex.match(line);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        
+        entry.name = match.captured(5).trimmed();
+        entry.path = entry.name;
+        entry.size = match.captured(3).toLongLong();
+        entry.compressedSize = match.captured(4).toLongLong();
+        entry.isDirectory = match.captured(2).startsWith('D');
+        entry.date = match.captured(1);
+        return true;
+    }
+
+private:
+    bool seenHeader;
+    bool inFileList;
+    QRegularExpression regex;
+};
+
+// 7z multithreading switch for a configured thread count
+static QStringList threadArguments(int threads) {
+    if (threads <= 0) {
+        return QStringList();
+    }
+    return QStringList() << "-mmt=" + QString::number(threads);
+}
+
 SevenZipHandler::SevenZipHandler(QObject *parent)
     : ArchiveHandler(parent) {
 }
 
 bool SevenZipHandler::isAvailable() const {
-    return !findSevenZipTool().isEmpty();
+    return findSevenZipTool().isValid();
 }
 
-QString SevenZipHandler::findSevenZipTool() const {
-    QString sevenz = QStandardPaths::findExecutable("7z");
-    if (!sevenz.isEmpty()) return sevenz;
-    
-    QString sevenza = QStandardPaths::findExecutable("7za");
-    if (!sevenza.isEmpty()) return sevenza;
-    
-    return QString();
+ToolInfo SevenZipHandler::findSevenZipTool() const {
+    return ToolRegistry::instance()->firstAvailable(QStringList() << "7z" << "7za");
 }
 
 bool SevenZipHandler::list(const QString &archivePath, QList<ArchiveEntry> &entries) {
-    QString tool = findSevenZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findSevenZipTool();
+    if (!tool.isValid()) {
         emit error("7z tool not found. Please install p7zip.");
         return false;
     }
@@ -32,49 +79,14 @@ bool SevenZipHandler::list(const QString &archivePath, QList<ArchiveEntry> &entr
     QStringList args;
     args << "l" << archivePath;
     
-    QString output, errorOutput;
-    if (!processManager->executeWithOutput(tool, args, output, errorOutput)) {
-        emit error(processManager->getLastError());
-        return false;
-    }
-    
-    return parseListOutput(output, entries);
-}
-
-bool SevenZipHandler::parseListOutput(const QString &output, QList<ArchiveEntry> &entries) {
-    QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-    bool inFileList = false;
-    
-    for (const QString &line : lines) {
-        if (line.contains("----") && line.contains("Name")) {
-            inFileList = true;
-            continue;
-        }
-        
-        if (inFileList) {
-            // 7z output format: Date Time Attr Size Compressed Name
-            QRegularExpression regex(R"(^\s*(\S+\s+\S+)\s+(\S+)\s+(\d+)\s+(\d+)\s+(.+)$)");
-            QRegularExpressionMatch match = regex.match(line);
-            if (match.hasMatch()) {
-                ArchiveEntry entry;
-                entry.name = match.captured(5).trimmed();
-                entry.path = entry.name;
-                entry.size = match.captured(3).toLongLong();
-                entry.compressedSize = match.captured(4).toLongLong();
-                entry.isDirectory = match.captured(2).startsWith('D');
-                entry.date = match.captured(1);
-                entries.append(entry);
-            }
-        }
-    }
-    
-    return true;
+    SevenZipListParser parser;
+    return runListing(tool.path, args, parser, entries);
 }
 
 bool SevenZipHandler::extract(const QString &archivePath, const QString &destination,
                              const QStringList &files) {
-    QString tool = findSevenZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findSevenZipTool();
+    if (!tool.isValid()) {
         emit error("7z tool not found");
         return false;
     }
@@ -82,14 +94,17 @@ bool SevenZipHandler::extract(const QString &archivePath, const QString &destina
     QDir().mkpath(destination);
     
     QStringList args;
-    args << "x" << archivePath << "-o" + destination;
+    args << "x" << "-bsp1" << threadArguments(threadsFor(tool));
+    args << archivePath << "-o" + destination;
     
-    if (!files.isEmpty()) {
-        args << files;
+    if (!appendFileArguments(files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    // -bsp1 sends the percentage meter to stdout
+    PercentProgressParser parser;
+    parser.setTotals(expectedBytes, expectedFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool SevenZipHandler::extractTo(const QString &archivePath, const QString &destination) {
@@ -98,66 +113,77 @@ bool SevenZipHandler::extractTo(const QString &archivePath, const QString &desti
 
 bool SevenZipHandler::create(const QString &archivePath, const QStringList &files,
                             const QString &password, int compressionLevel) {
-    QString tool = findSevenZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findSevenZipTool();
+    if (!tool.isValid()) {
         emit error("7z tool not found");
         return false;
     }
     
     QStringList args;
-    args << "a" << "-t7z";
+    args << "a" << "-bsp1" << "-t7z";
     
     if (!password.isEmpty()) {
         args << "-p" + password;
     }
     
     args << "-mx=" + QString::number(compressionLevel);
-    args << archivePath << files;
+    args << threadArguments(threadsFor(tool));
+    args << archivePath;
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
 }
 
 bool SevenZipHandler::addFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = findSevenZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findSevenZipTool();
+    if (!tool.isValid()) {
         emit error("7z tool not found");
         return false;
     }
     
     QStringList args;
-    args << "a" << archivePath << files;
+    args << "a" << "-bsp1" << threadArguments(threadsFor(tool)) << archivePath;
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
 }
 
 bool SevenZipHandler::removeFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = findSevenZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findSevenZipTool();
+    if (!tool.isValid()) {
         emit error("7z tool not found");
         return false;
     }
     
     QStringList args;
-    args << "d" << archivePath << files;
+    args << "d" << "-bsp1" << archivePath;
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    return runTool(tool.path, args, &parser);
 }
 
 bool SevenZipHandler::test(const QString &archivePath) {
-    QString tool = findSevenZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findSevenZipTool();
+    if (!tool.isValid()) {
         emit error("7z tool not found");
         return false;
     }
     
     QStringList args;
-    args << "t" << archivePath;
+    args << "t" << "-bsp1" << archivePath;
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    PercentProgressParser parser;
+    parser.setTotals(expectedBytes, expectedFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool SevenZipHandler::repair(const QString &archivePath) {
@@ -165,3 +191,17 @@ bool SevenZipHandler::repair(const QString &archivePath) {
     emit error("7z format does not support repair. Try extracting and recreating the archive.");
     return false;
 }
+
+bool SevenZipHandler::appendFileArguments(const QStringList &files, QStringList &args) {
+    if (!needsListFile(files)) {
+        args << files;
+        return true;
+    }
+    
+    QString listPath = writeListFile(files);
+    if (listPath.isEmpty()) {
+        return false;
+    }
+    args << "-scsUTF-8" << "@" + listPath;
+    return true;
+}
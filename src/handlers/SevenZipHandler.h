@@ -27,10 +27,12 @@ public:
     QStringList getSupportedExtensions() const override {
         return QStringList() << "7z" << "7zip";
     }
+    ArchiveHandler *clone() const override { return new SevenZipHandler; }
 
 private:
-    QString findSevenZipTool() const;
-    bool parseListOutput(const QString &output, QList<ArchiveEntry> &entries);
+    ToolInfo findSevenZipTool() const;
+    // Adds files to args, or a list file for them when the selection is large
+    bool appendFileArguments(const QStringList &files, QStringList &args);
 };
 
 #endif // SEVENZIPHANDLER_H
@@ -1,17 +1,103 @@
 #include "TarHandler.h"
 #include "../ProcessManager.h"
+#include "../ListParser.h"
 #include "../utils/FormatDetector.h"
-#include <QStandardPaths>
+#include "../utils/ArchiveUtils.h"
+#include "../native/TarReader.h"
+#include "../native/TarWriter.h"
+#include "../native/TarEditor.h"
+#include "../native/ExtractionSink.h"
+#include "../native/BlockSource.h"
+#ifdef LINRAR_HAVE_ZLIB
+#include "../native/GzipIndex.h"
+#endif
+#ifdef LINRAR_HAVE_LZMA
+#include "../native/XzBlockSource.h"
+#endif
+#ifdef LINRAR_HAVE_ZSTD
+#include "../native/ZstdBlockSource.h"
+#endif
+#include <QScopedPointer>
 #include <QFileInfo>
 #include <QRegularExpression>
 #include <QDir>
+#include <QSet>
+#include <QHash>
+#include <QDateTime>
+
+// Each member costs at least one 512-byte header in the tar stream
+static const qint64 TAR_HEADER_SIZE = 512;
+// Payload copied per read during native extraction
+static const qint64 COPY_BUFFER_SIZE = 1024 * 1024;
+// xz block size when writing for random access: small enough that reaching
+// a member decodes little, large enough to cost next to no compression
+static const char XZ_BLOCK_SIZE[] = "--block-size=16MiB";
+
+// Thread switch of each parallel compressor; 0 threads means every core,
+// which is what they all do by default except xz and zstd
+static QStringList compressorThreadArguments(const ToolInfo &compressor, int threads) {
+    if (compressor.name == "xz" || compressor.name == "zstd") {
+        return QStringList() << "-T" + QString::number(qMax(0, threads));
+    }
+    if (threads <= 0) {
+        return QStringList();
+    }
+    if (compressor.name == "pbzip2") {
+        return QStringList() << "-p" + QString::number(threads);
+    }
+    if (compressor.name == "lbzip2") {
+        return QStringList() << "-n" << QString::number(threads);
+    }
+    // pigz, pixz
+    return QStringList() << "-p" << QString::number(threads);
+}
+
+static ArchiveEntry toArchiveEntry(const TarMember &member) {
+    ArchiveEntry entry;
+    entry.name = member.name;
+    entry.path = member.name;
+    entry.size = member.size;
+    entry.compressedSize = member.size;
+    entry.isDirectory = member.isDirectory();
+    entry.permissions = ArchiveUtils::formatPermissions(member.fullMode());
+    entry.date = QDateTime::fromSecsSinceEpoch(member.mtime).toString("yyyy-MM-dd hh:mm");
+    entry.offset = member.headerOffset;
+    return entry;
+}
+
+// Parses `tar -tv` output: permissions owner size date time name
+class TarListParser : public ListParser {
+public:
+    TarListParser()
+        : regex(R"(^([dlcbps-][rwxsStT-]{9}\S*)\s+(\S+)\s+(\d+)\s+(\S+\s+\S+)\s+(.+)$)") {
+    }
+    
+    bool parseLine(const QString &line, ArchiveEntry &entry) override {
+        QRegularExpressionMatch match = regex.match(line);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        
+        entry.permissions = match.captured(1);
+        entry.size = match.captured(3).toLongLong();
+        entry.date = match.captured(4);
+        entry.name = match.captured(5).trimmed();
+        entry.path = entry.name;
+        entry.isDirectory = entry.permissions.startsWith('d') || entry.name.endsWith('/');
+        entry.compressedSize = entry.size; // tar doesn't show compressed size separately
+        return true;
+    }
+
+private:
+    QRegularExpression regex;
+};
 
 TarHandler::TarHandler(QObject *parent)
     : ArchiveHandler(parent) {
 }
 
 bool TarHandler::isAvailable() const {
-    return !findTarTool().isEmpty();
+    return findTarTool().isValid();
 }
 
 ArchiveFormat TarHandler::getFormat() const {
@@ -20,27 +106,41 @@ ArchiveFormat TarHandler::getFormat() const {
 }
 
 ArchiveFormat TarHandler::detectTarFormat(const QString &archivePath) const {
-    QFileInfo info(archivePath);
-    QString ext = info.suffix().toLower();
-    QString baseName = info.completeBaseName();
-    
-    if (ext == "tar") {
-        return ArchiveFormat::Tar;
-    } else if (ext == "gz" && baseName.endsWith(".tar")) {
-        return ArchiveFormat::TarGz;
-    } else if (ext == "bz2" && baseName.endsWith(".tar")) {
-        return ArchiveFormat::TarBz2;
-    } else if (ext == "xz" && baseName.endsWith(".tar")) {
-        return ArchiveFormat::TarXz;
-    } else if (ext == "tgz") {
-        return ArchiveFormat::TarGz;
-    } else if (ext == "tbz2") {
-        return ArchiveFormat::TarBz2;
-    } else if (ext == "txz") {
-        return ArchiveFormat::TarXz;
+    // Magic bytes first, so a mislabelled archive still gets the right
+    // decompressor; archives about to be created go by their name
+    ArchiveFormat format = FormatDetector::detectFormat(archivePath);
+    switch (format) {
+        case ArchiveFormat::TarGz:
+        case ArchiveFormat::TarBz2:
+        case ArchiveFormat::TarXz:
+        case ArchiveFormat::TarZst:
+        case ArchiveFormat::TarLz4:
+            return format;
+        default:
+            return ArchiveFormat::Tar;
+    }
+}
+
+void TarHandler::applyCompressorThreads(const QString &archivePath, bool writing) {
+    // tar runs the compressor itself, so the thread count travels in the
+    // environment
+    ArchiveFormat format = detectTarFormat(archivePath);
+    if (format == ArchiveFormat::TarXz) {
+        QStringList options;
+        int threads = threadsFor(ToolRegistry::instance()->tool("xz"));
+        if (threads > 0) {
+            options << "-T" + QString::number(threads);
+        }
+        if (writing && compressionOptions.randomAccess) {
+            options << XZ_BLOCK_SIZE;
+        }
+        processManager->setEnvironmentVariable("XZ_OPT", options.join(' '));
+    } else if (format == ArchiveFormat::TarZst) {
+        int threads = threadsFor(ToolRegistry::instance()->tool("zstd"));
+        if (threads > 0) {
+            processManager->setEnvironmentVariable("ZSTD_NBTHREADS", QString::number(threads));
+        }
     }
-    
-    return ArchiveFormat::Tar;
 }
 
 QString TarHandler::getCompressionFlag(const QString &archivePath) const {
@@ -48,80 +148,107 @@ QString TarHandler::getCompressionFlag(const QString &archivePath) const {
     
     switch (format) {
         case ArchiveFormat::TarGz:
-            return "z";
+            return "-z";
         case ArchiveFormat::TarBz2:
-            return "j";
+            return "-j";
         case ArchiveFormat::TarXz:
-            return "J";
+            return "-J";
+        // --zstd only exists since tar 1.31; a bare program name works in
+        // every version
+        case ArchiveFormat::TarZst:
+            return "--use-compress-program=zstd";
+        case ArchiveFormat::TarLz4:
+            return "--use-compress-program=lz4";
         default:
             return "";
     }
 }
 
 bool TarHandler::list(const QString &archivePath, QList<ArchiveEntry> &entries) {
-    QString tool = findTarTool();
-    if (tool.isEmpty()) {
+    // Uncompressed: hop from header to header instead of reading everything
+    ArchiveFormat format = detectTarFormat(archivePath);
+    if (format == ArchiveFormat::Tar) {
+        bool handled = false;
+        bool success = listNative(archivePath, entries, handled);
+        if (handled) {
+            return success;
+        }
+    }
+#ifdef LINRAR_HAVE_ZLIB
+    // gzip: from the cached index, or building it while listing
+    if (format == ArchiveFormat::TarGz) {
+        bool handled = false;
+        bool success = listIndexed(archivePath, entries, handled);
+        if (handled) {
+            return success;
+        }
+    }
+#endif
+    
+    ToolInfo tool = findTarTool();
+    if (!tool.isValid()) {
         emit error("tar tool not found");
         return false;
     }
     
-    QString compFlag = getCompressionFlag(archivePath);
     QStringList args;
-    args << "-t" + compFlag + "v" << "-f" << archivePath;
+    args << "-tv" << compressionArguments(tool, archivePath) << "-f" << archivePath;
     
-    QString output, errorOutput;
-    if (!processManager->executeWithOutput(tool, args, output, errorOutput)) {
-        emit error(processManager->getLastError());
-        return false;
-    }
-    
-    return parseListOutput(output, entries);
+    TarListParser parser;
+    return runListing(tool.path, args, parser, entries);
 }
 
-bool TarHandler::parseListOutput(const QString &output, QList<ArchiveEntry> &entries) {
-    QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-    
-    // tar -tv output: permissions size date time name
-    QRegularExpression regex(R"(^([rwx-]+)\s+(\S+)\s+(\S+)\s+(\S+\s+\S+)\s+(.+)$)");
-    
-    for (const QString &line : lines) {
-        QRegularExpressionMatch match = regex.match(line);
-        if (match.hasMatch()) {
-            ArchiveEntry entry;
-            entry.permissions = match.captured(1);
-            entry.size = match.captured(2).toLongLong();
-            entry.date = match.captured(4);
-            entry.name = match.captured(5).trimmed();
-            entry.path = entry.name;
-            entry.isDirectory = entry.permissions.startsWith('d') || entry.name.endsWith('/');
-            entry.compressedSize = entry.size; // tar doesn't show compressed size separately
-            entries.append(entry);
+bool TarHandler::extract(const QString &archivePath, const QString &destination,
+                        const QStringList &files) {
+    // Selected members of an uncompressed archive are read at their offsets
+    ArchiveFormat format = detectTarFormat(archivePath);
+    if (!files.isEmpty() && format == ArchiveFormat::Tar) {
+        bool handled = false;
+        bool success = extractNative(archivePath, destination, files, handled);
+        if (handled) {
+            return success;
+        }
+    }
+#ifdef LINRAR_HAVE_ZLIB
+    // and those of an indexed .tar.gz from the nearest checkpoint
+    if (!files.isEmpty() && format == ArchiveFormat::TarGz) {
+        bool handled = false;
+        bool success = extractIndexed(archivePath, destination, files, handled);
+        if (handled) {
+            return success;
+        }
+    }
+#endif
+    // and those of multi-block xz or seekable zstd from the blocks holding them
+    if (!files.isEmpty() && (format == ArchiveFormat::TarXz || format == ArchiveFormat::TarZst)) {
+        bool handled = false;
+        bool success = extractBlocks(archivePath, format, destination, files, handled);
+        if (handled) {
+            return success;
         }
     }
     
-    return true;
-}
-
-bool TarHandler::extract(const QString &archivePath, const QString &destination,
-                        const QStringList &files) {
-    QString tool = findTarTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findTarTool();
+    if (!tool.isValid()) {
         emit error("tar tool not found");
         return false;
     }
     
     QDir().mkpath(destination);
     
-    QString compFlag = getCompressionFlag(archivePath);
     QStringList args;
-    args << "-x" + compFlag << "-f" << archivePath << "-C" << destination;
+    args << "-x" << compressionArguments(tool, archivePath) << "-f" << archivePath << "-C" << destination;
+    if (tool.has(Checkpoints)) {
+        args << TarCheckpointProgressParser::arguments();
+    }
     
-    if (!files.isEmpty()) {
-        args << files;
+    if (!appendFileArguments(files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    TarCheckpointProgressParser parser;
+    parser.setTotals(expectedStreamSize(archivePath), expectedFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool TarHandler::extractTo(const QString &archivePath, const QString &destination) {
@@ -133,55 +260,123 @@ bool TarHandler::create(const QString &archivePath, const QStringList &files,
     // tar doesn't support passwords
     Q_UNUSED(password);
     
-    QString tool = findTarTool();
-    if (tool.isEmpty()) {
+    if (detectTarFormat(archivePath) == ArchiveFormat::Tar) {
+        bool handled = false;
+        bool success = createNative(archivePath, files, handled);
+        if (handled) {
+            return success;
+        }
+    }
+    
+    ToolInfo tool = findTarTool();
+    if (!tool.isValid()) {
         emit error("tar tool not found");
         return false;
     }
     
-    QString compFlag = getCompressionFlag(archivePath);
     QStringList args;
-    args << "-c" + compFlag << "-f" << archivePath << files;
+    args << "-c" << compressionArguments(tool, archivePath, compressionLevel) << "-f" << archivePath;
+    if (tool.has(Checkpoints)) {
+        args << TarCheckpointProgressParser::arguments();
+    }
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    qint64 inputFiles = 0;
+    qint64 inputBytes = ArchiveUtils::totalSize(files, &inputFiles);
+    
+    TarCheckpointProgressParser parser;
+    parser.setTotals(inputBytes + inputFiles * TAR_HEADER_SIZE, inputFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool TarHandler::addFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = findTarTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findTarTool();
+    if (!tool.isValid()) {
         emit error("tar tool not found");
         return false;
     }
     
-    QString compFlag = getCompressionFlag(archivePath);
     QStringList args;
-    args << "-r" + compFlag << "-f" << archivePath << files;
+    args << "-r" << compressionArguments(tool, archivePath) << "-f" << archivePath;
+    if (tool.has(Checkpoints)) {
+        args << TarCheckpointProgressParser::arguments();
+    }
+    if (!appendFileArguments(files, args)) {
+        return false;
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    qint64 inputFiles = 0;
+    qint64 inputBytes = ArchiveUtils::totalSize(files, &inputFiles);
+    
+    TarCheckpointProgressParser parser;
+    // Appending reads through the existing archive before writing
+    parser.setTotals(QFileInfo(archivePath).size() + inputBytes + inputFiles * TAR_HEADER_SIZE,
+                     inputFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool TarHandler::removeFiles(const QString &archivePath, const QStringList &files) {
-    // tar doesn't support removing files directly
-    // Would need to extract, remove, and recreate
-    emit error("tar format does not support removing files. Extract, modify, and recreate the archive.");
-    return false;
+    // tar --delete only handles uncompressed archives and rewrites them in
+    // place, so an interrupted run leaves a damaged archive; this copies
+    // the members that stay into a new one instead
+    TarEditor editor(archivePath);
+    if (detectTarFormat(archivePath) != ArchiveFormat::Tar) {
+        QStringList decompress;
+        QStringList compress;
+        if (!recompressionCommands(archivePath, decompress, compress)) {
+            emit error(QString("No compressor found for %1").arg(QFileInfo(archivePath).fileName()));
+            return false;
+        }
+        editor.setCompression(decompress, compress);
+    }
+    
+    ProgressInfo info;
+    info.bytesTotal = expectedStreamSize(archivePath);
+    info.filesTotal = expectedFiles;
+    editor.setProgressCallback([this, &editor, &info](qint64 bytesDone) {
+        info.bytesDone = bytesDone;
+        info.filesDone = editor.filesDone();
+        info.currentFile = editor.currentFile();
+        if (info.bytesTotal > 0) {
+            info.percentage = int(qMin<qint64>(info.bytesDone * 100 / info.bytesTotal, 100));
+        } else if (info.filesTotal > 0) {
+            info.percentage = int(qMin<qint64>(info.filesDone * 100 / info.filesTotal, 100));
+        }
+        reportProgress(info);
+        return !isCancelRequested();
+    });
+    
+    if (!editor.remove(files)) {
+        if (!isCancelRequested()) {
+            emit error(editor.getLastError());
+        }
+        return false;
+    }
+    
+    info.filesDone = editor.filesDone();
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
 }
 
 bool TarHandler::test(const QString &archivePath) {
-    QString tool = findTarTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findTarTool();
+    if (!tool.isValid()) {
         emit error("tar tool not found");
         return false;
     }
     
-    QString compFlag = getCompressionFlag(archivePath);
     QStringList args;
-    args << "-t" + compFlag << "-f" << archivePath;
+    args << "-t" << compressionArguments(tool, archivePath) << "-f" << archivePath;
+    if (tool.has(Checkpoints)) {
+        args << TarCheckpointProgressParser::arguments();
+    }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    TarCheckpointProgressParser parser;
+    parser.setTotals(expectedStreamSize(archivePath), expectedFiles);
+    return runTool(tool.path, args, &parser);
 }
 
 bool TarHandler::repair(const QString &archivePath) {
@@ -189,6 +384,626 @@ bool TarHandler::repair(const QString &archivePath) {
     return false;
 }
 
-QString TarHandler::findTarTool() const {
-    return QStandardPaths::findExecutable("tar");
+qint64 TarHandler::expectedStreamSize(const QString &archivePath) const {
+    // Checkpoints count records of the uncompressed tar stream
+    if (getCompressionFlag(archivePath).isEmpty()) {
+        return QFileInfo(archivePath).size();
+    }
+    if (expectedBytes <= 0) {
+        return -1;
+    }
+    return expectedBytes + qMax<qint64>(expectedFiles, 0) * TAR_HEADER_SIZE;
+}
+
+bool TarHandler::prefersToolForCreate(const QString &archivePath) const {
+    // Plain tar goes to createNative(), which leaves payloads to the kernel
+    if (detectTarFormat(archivePath) == ArchiveFormat::Tar) {
+        return true;
+    }
+    return findTarTool().has(ExternalCompressor) && findParallelCompressor(archivePath).isValid();
+}
+
+bool TarHandler::listsInProcess(const QString &archivePath) const {
+    // Header hopping for plain tar; for gzip, the index built while listing
+    // is what later makes extracting single members cheap
+    ArchiveFormat format = detectTarFormat(archivePath);
+#ifdef LINRAR_HAVE_ZLIB
+    if (format == ArchiveFormat::TarGz) {
+        return true;
+    }
+#endif
+    return format == ArchiveFormat::Tar;
+}
+
+bool TarHandler::extractsInProcess(const QString &archivePath, const QStringList &files) const {
+    // Whole archives are decoded from the start either way
+    if (files.isEmpty()) {
+        return false;
+    }
+    switch (detectTarFormat(archivePath)) {
+        case ArchiveFormat::Tar:
+            return true;
+#ifdef LINRAR_HAVE_ZLIB
+        case ArchiveFormat::TarGz: {
+            GzipIndex index(archivePath);
+            return index.load();
+        }
+#endif
+        // Single-block archives go to tar after all
+        case ArchiveFormat::TarXz:
+#ifdef LINRAR_HAVE_LZMA
+            return findTarTool().isValid();
+#else
+            return false;
+#endif
+        case ArchiveFormat::TarZst:
+#ifdef LINRAR_HAVE_ZSTD
+            return findTarTool().isValid();
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+ToolInfo TarHandler::findParallelCompressor(const QString &archivePath) const {
+    QStringList candidates;
+    switch (detectTarFormat(archivePath)) {
+        case ArchiveFormat::TarGz:
+            candidates << "pigz";
+            break;
+        case ArchiveFormat::TarBz2:
+            candidates << "lbzip2" << "pbzip2";
+            break;
+        case ArchiveFormat::TarXz:
+            // xz itself is threaded since 5.2; pixz for older systems
+            candidates << "xz" << "pixz";
+            break;
+        case ArchiveFormat::TarZst:
+            candidates << "zstd";
+            break;
+        default:
+            return ToolInfo();
+    }
+    
+    for (const QString &name : candidates) {
+        ToolInfo compressor = ToolRegistry::instance()->tool(name);
+        if (compressor.isValid() && compressor.has(Multithreading)) {
+            return compressor;
+        }
+    }
+    return ToolInfo();
+}
+
+bool TarHandler::recompressionCommands(const QString &archivePath, QStringList &decompress,
+                                       QStringList &compress) {
+    ArchiveFormat format = detectTarFormat(archivePath);
+    ToolInfo compressor = findParallelCompressor(archivePath);
+    QStringList threadArguments;
+    if (compressor.isValid()) {
+        threadArguments = compressorThreadArguments(compressor, threadsFor(compressor));
+    } else {
+        QString name;
+        switch (format) {
+            case ArchiveFormat::TarGz:
+                name = "gzip";
+                break;
+            case ArchiveFormat::TarBz2:
+                name = "bzip2";
+                break;
+            case ArchiveFormat::TarXz:
+                name = "xz";
+                break;
+            case ArchiveFormat::TarZst:
+                name = "zstd";
+                break;
+            case ArchiveFormat::TarLz4:
+                name = "lz4";
+                break;
+            default:
+                return false;
+        }
+        compressor = ToolRegistry::instance()->tool(name);
+        if (!compressor.isValid()) {
+            return false;
+        }
+    }
+    
+    // pixz has no -c; given no files it filters stdin to stdout
+    QStringList toStdout;
+    if (compressor.name != "pixz") {
+        toStdout << "-c";
+    }
+    decompress << compressor.path << "-d" << toStdout << threadArguments;
+    // The original level is not recorded anywhere, so the tool's default
+    compress << compressor.path << toStdout << threadArguments;
+    if (format == ArchiveFormat::TarZst) {
+        decompress << zstdArguments(-1);
+        if (compressionOptions.zstdLongDistance) {
+            compress << "--long";
+        }
+    } else if (compressor.name == "xz" && compressionOptions.randomAccess) {
+        compress << XZ_BLOCK_SIZE;
+    }
+    return true;
+}
+
+QStringList TarHandler::compressionArguments(const ToolInfo &tar, const QString &archivePath,
+                                             int level) {
+    QString flag = getCompressionFlag(archivePath);
+    if (flag.isEmpty()) {
+        return QStringList();
+    }
+    
+    ToolInfo compressor = tar.has(ExternalCompressor) ? findParallelCompressor(archivePath) : ToolInfo();
+    if (!compressor.isValid()) {
+        applyCompressorThreads(archivePath, level >= 0);
+        return QStringList() << flag;
+    }
+    
+    ArchiveFormat format = detectTarFormat(archivePath);
+    int threads = threadsFor(compressor);
+    // tar adds -d itself when reading
+    QStringList command;
+    command << (compressor.path.contains(' ') ? '"' + compressor.path + '"' : compressor.path);
+    command << compressorThreadArguments(compressor, threads);
+    if (format == ArchiveFormat::TarZst) {
+        command << zstdArguments(level);
+    } else if (level >= 0) {
+        // bzip2 has no level 0
+        int minimum = format == ArchiveFormat::TarBz2 ? 1 : 0;
+        command << "-" + QString::number(qBound(minimum, level, 9));
+        // pixz always writes blocks and an index
+        if (compressor.name == "xz" && compressionOptions.randomAccess) {
+            command << XZ_BLOCK_SIZE;
+        }
+    }
+    
+    QString description = threads > 0 ? QString("%1 (%2 threads)").arg(compressor.name).arg(threads)
+                                       : QString("%1 (all cores)").arg(compressor.name);
+    qInfo("tar: %s uses %s", qPrintable(QFileInfo(archivePath).fileName()), qPrintable(description));
+    emit progress(QString("Using %1").arg(description), -1);
+    return QStringList() << "--use-compress-program=" + command.join(' ');
+}
+
+QStringList TarHandler::zstdArguments(int level) const {
+    QStringList args;
+    if (level < 0) {
+        // Lifts the decoder's 128 MiB window limit, which archives written
+        // with --long may exceed
+        args << "--long=31";
+        return args;
+    }
+    int zstdLevel = compressionOptions.zstdLevelFor(level);
+    if (zstdLevel > 19) {
+        args << "--ultra";
+    }
+    args << "-" + QString::number(zstdLevel);
+    if (compressionOptions.zstdLongDistance) {
+        args << "--long";
+    }
+    return args;
+}
+
+ToolInfo TarHandler::findTarTool() const {
+    return ToolRegistry::instance()->tool("tar");
+}
+
+bool TarHandler::appendFileArguments(const QStringList &files, QStringList &args) {
+    if (!needsListFile(files)) {
+        args << files;
+        return true;
+    }
+    
+    QString listPath = writeListFile(files);
+    if (listPath.isEmpty()) {
+        return false;
+    }
+    args << "-T" << listPath;
+    return true;
+}
+
+bool TarHandler::listNative(const QString &archivePath, QList<ArchiveEntry> &entries,
+                            bool &handled) {
+    handled = false;
+    TarReader reader(archivePath);
+    if (!reader.open()) {
+        return false;
+    }
+    QVector<TarMember> members;
+    return listMembers(reader, entries, members, handled);
+}
+
+bool TarHandler::listMembers(TarReader &reader, QList<ArchiveEntry> &entries,
+                             QVector<TarMember> &members, bool &handled) {
+    handled = false;
+    QList<ArchiveEntry> batch;
+    TarMember member;
+    while (reader.readNext(member)) {
+        // Once a header parsed, tar would not get further than we do
+        handled = true;
+        if (isCancelRequested()) {
+            return false;
+        }
+        
+        ArchiveEntry entry = toArchiveEntry(member);
+        entries.append(entry);
+        members.append(member);
+        batch.append(entry);
+        if (batch.size() >= LIST_BATCH_SIZE) {
+            publishEntries(batch);
+            batch.clear();
+        }
+    }
+    publishEntries(batch);
+    
+    if (reader.hasError()) {
+        // A cancelled job must not start the tool instead
+        if (isCancelRequested()) {
+            handled = true;
+        } else if (handled) {
+            emit error(reader.getLastError());
+        }
+        return false;
+    }
+    handled = true;
+    return true;
+}
+
+bool TarHandler::createNative(const QString &archivePath, const QStringList &files, bool &handled) {
+    handled = false;
+    TarWriter writer(archivePath);
+    // tar reports unreadable inputs in its own words
+    if (!writer.addFiles(files) || writer.totalFiles() == 0) {
+        return false;
+    }
+    handled = true;
+    
+    ProgressInfo info;
+    info.bytesTotal = writer.totalBytes() > 0 ? writer.totalBytes() : -1;
+    info.filesTotal = writer.totalFiles();
+    writer.setProgressCallback([this, &writer, &info](qint64 bytesDone) {
+        info.bytesDone = bytesDone;
+        info.filesDone = writer.filesDone();
+        info.currentFile = writer.currentFile();
+        if (info.bytesTotal > 0) {
+            info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+        } else if (info.filesTotal > 0) {
+            info.percentage = int(info.filesDone * 100 / info.filesTotal);
+        }
+        reportProgress(info);
+        return !isCancelRequested();
+    });
+    
+    if (!writer.write()) {
+        if (!isCancelRequested()) {
+            emit error(writer.getLastError());
+        }
+        return false;
+    }
+    
+    info.filesDone = writer.filesDone();
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
+}
+
+bool TarHandler::extractNative(const QString &archivePath, const QString &destination,
+                               const QStringList &files, bool &handled) {
+    handled = false;
+    TarReader reader(archivePath);
+    if (!reader.open()) {
+        return false;
+    }
+    
+    QVector<TarMember> members;
+    TarMember member;
+    while (reader.readNext(member)) {
+        members.append(member);
+    }
+    if (reader.hasError()) {
+        return false;
+    }
+    return extractMembers(reader, members, destination, files, handled);
+}
+
+bool TarHandler::extractBlocks(const QString &archivePath, ArchiveFormat format,
+                               const QString &destination, const QStringList &files,
+                               bool &handled) {
+    handled = false;
+    QScopedPointer<BlockSource> source;
+#ifdef LINRAR_HAVE_LZMA
+    if (format == ArchiveFormat::TarXz) {
+        source.reset(new XzBlockSource(archivePath));
+    }
+#endif
+#ifdef LINRAR_HAVE_ZSTD
+    if (format == ArchiveFormat::TarZst) {
+        source.reset(new ZstdBlockSource(archivePath));
+    }
+#endif
+    if (!source) {
+        return false;
+    }
+    source->setProgressCallback([this](qint64) { return !isCancelRequested(); });
+    TarReader reader(source.data());
+    // One block gets decoded from the start either way, and tar's
+    // decompressor may use more threads for it
+    if (!reader.open() || source->blockCount() < 2) {
+        return false;
+    }
+    
+    // Hopping over member data skips whole blocks, so this only decodes
+    // the blocks that hold headers
+    QVector<TarMember> members;
+    TarMember member;
+    while (reader.readNext(member)) {
+        members.append(member);
+    }
+    if (reader.hasError()) {
+        // A cancelled job must not start the tool instead
+        handled = isCancelRequested();
+        return false;
+    }
+    return extractMembers(reader, members, destination, files, handled);
+}
+
+#ifdef LINRAR_HAVE_ZLIB
+bool TarHandler::listIndexed(const QString &archivePath, QList<ArchiveEntry> &entries,
+                             bool &handled) {
+    handled = false;
+    GzipIndex index(archivePath);
+    if (index.load()) {
+        handled = true;
+        QList<ArchiveEntry> batch;
+        for (const TarMember &member : index.getMembers()) {
+            ArchiveEntry entry = toArchiveEntry(member);
+            entries.append(entry);
+            batch.append(entry);
+            if (batch.size() >= LIST_BATCH_SIZE) {
+                publishEntries(batch);
+                batch.clear();
+            }
+        }
+        publishEntries(batch);
+        return true;
+    }
+    
+    // Read through once like tar would, taking checkpoints on the way
+    GzipSource source(archivePath, &index);
+    ProgressInfo info;
+    info.bytesDone = 0;
+    info.bytesTotal = QFileInfo(archivePath).size();
+    source.setProgressCallback([this, &info](qint64 offset) {
+        info.bytesDone = offset;
+        if (info.bytesTotal > 0) {
+            info.percentage = int(offset * 100 / info.bytesTotal);
+        }
+        reportProgress(info);
+        return !isCancelRequested();
+    });
+    TarReader reader(&source);
+    if (!reader.open()) {
+        return false;
+    }
+    
+    QVector<TarMember> members;
+    if (!listMembers(reader, entries, members, handled)) {
+        return false;
+    }
+    index.setMembers(members);
+    if (!index.save()) {
+        qWarning("tar: cannot cache the index of %s", qPrintable(archivePath));
+    }
+    return true;
+}
+
+bool TarHandler::extractIndexed(const QString &archivePath, const QString &destination,
+                                const QStringList &files, bool &handled) {
+    handled = false;
+    // Without an index tar is just as fast, it has to read everything
+    GzipIndex index(archivePath);
+    if (!index.load()) {
+        return false;
+    }
+    GzipSource source(archivePath, &index);
+    source.setProgressCallback([this](qint64) { return !isCancelRequested(); });
+    TarReader reader(&source);
+    if (!reader.open()) {
+        return false;
+    }
+    return extractMembers(reader, index.getMembers(), destination, files, handled);
+}
+#endif
+
+bool TarHandler::extractMembers(TarReader &reader, const QVector<TarMember> &members,
+                                const QString &destination, const QStringList &files,
+                                bool &handled) {
+    handled = false;
+    QSet<QString> requested;
+    for (const QString &file : files) {
+        requested.insert(ArchiveUtils::normalizeMemberName(file));
+    }
+    
+    // Headers only: decide up front, so tar can take over before anything
+    // is written if a member needs more than we support
+    QList<TarMember> selected;
+    QStringList relatives;
+    QStringList targets;
+    QSet<QString> found;
+    qint64 totalBytes = 0;
+    for (const TarMember &member : members) {
+        QString name = ArchiveUtils::normalizeMemberName(member.name);
+        QString selector = ArchiveUtils::selectedBy(name, requested);
+        if (selector.isEmpty()) {
+            continue;
+        }
+        QString relative = ArchiveUtils::safeRelativePath(name);
+        if (relative.isEmpty()
+            || !(member.isRegularFile() || member.isDirectory() || member.isSymLink())) {
+            return false;
+        }
+        found.insert(selector);
+        selected.append(member);
+        relatives.append(relative);
+        targets.append(destination + "/" + relative);
+        totalBytes += member.isRegularFile() ? member.size : 0;
+    }
+    // Unknown names get tar's own error message
+    if (found.size() < requested.size()) {
+        return false;
+    }
+    handled = true;
+    
+    ProgressInfo info;
+    info.bytesDone = 0;
+    info.bytesTotal = totalBytes > 0 ? totalBytes : -1;
+    info.filesDone = 0;
+    info.filesTotal = selected.size();
+    QByteArray buffer(COPY_BUFFER_SIZE, Qt::Uninitialized);
+    // Everything is read front to back; a few members are better fetched
+    // on their own
+    if (requested.isEmpty()) {
+        reader.advise(ArchiveSource::Sequential);
+    }
+    // Small files are written in batches behind our back, in no particular
+    // order, so a member that overwrites an earlier one rules that out
+    QScopedPointer<ExtractionSink> sink;
+    if (QSet<QString>(targets.begin(), targets.end()).size() == targets.size()) {
+        sink.reset(new ExtractionSink(nativeThreads()));
+    }
+    // Symbolic links are made once everything else is out, as GNU tar
+    // does, so no member can be written through one; a link is dropped if
+    // a later member takes its place
+    QHash<QString, int> lastMember;
+    for (int i = 0; i < targets.size(); ++i) {
+        lastMember.insert(targets.at(i), i);
+    }
+    QVector<int> links;
+    QSet<QString> checkedPaths;
+    
+    for (int i = 0; i < selected.size(); ++i) {
+        const TarMember &current = selected.at(i);
+        const QString &target = targets.at(i);
+        info.currentFile = current.name;
+        
+        if (current.isSymLink()) {
+            if (lastMember.value(target) == i) {
+                links.append(i);
+            }
+            ++info.filesDone;
+            continue;
+        }
+        // Only real directories are made until the links, so a path checked
+        // once stays good
+        QString relative = relatives.at(i);
+        if (ArchiveUtils::passesSymLink(destination, current.isDirectory() ? relative
+                                                                          : QFileInfo(relative).path(),
+                                        &checkedPaths)) {
+            emit error(QString("Refusing to extract through the symbolic link in %1").arg(relative));
+            return false;
+        }
+        
+        if (current.isDirectory()) {
+            // Permissions come last, or a read-only directory would keep
+            // its own members out
+            QDir().mkpath(target);
+        } else if (sink && current.size <= ExtractionSink::SMALL_FILE_LIMIT) {
+            if (isCancelRequested()) {
+                return false;
+            }
+            QDir().mkpath(QFileInfo(target).path());
+            QByteArray content(int(current.size), Qt::Uninitialized);
+            qint64 done = 0;
+            while (done < current.size) {
+                qint64 count = reader.readData(current, done, content.data() + done, current.size - done);
+                if (count <= 0) {
+                    emit error(count < 0 ? reader.getLastError()
+                                         : QString("Unexpected end of archive in %1").arg(current.name));
+                    return false;
+                }
+                done += count;
+            }
+            reader.release(current);
+            if (!sink->writeFile(target, content, current.mode & 0777, current.mtime)) {
+                emit error(sink->getLastError());
+                return false;
+            }
+            info.bytesDone += current.size;
+            if (info.bytesTotal > 0) {
+                info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+            }
+        } else {
+            QDir().mkpath(QFileInfo(target).path());
+            QFile out(target);
+            if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                emit error(QString("Cannot write %1: %2").arg(target, out.errorString()));
+                return false;
+            }
+            
+            qint64 done = 0;
+            while (done < current.size) {
+                if (isCancelRequested()) {
+                    return false;
+                }
+                qint64 count = reader.readData(current, done, buffer.data(), buffer.size());
+                if (count <= 0) {
+                    emit error(count < 0 ? reader.getLastError()
+                                         : QString("Unexpected end of archive in %1").arg(current.name));
+                    return false;
+                }
+                if (out.write(buffer.constData(), count) != count) {
+                    emit error(QString("Cannot write %1: %2").arg(target, out.errorString()));
+                    return false;
+                }
+                done += count;
+                info.bytesDone += count;
+                if (info.bytesTotal > 0) {
+                    info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+                }
+                reportProgress(info);
+            }
+            
+            // Flushed first, or closing would move the timestamp again
+            out.flush();
+            out.setFileTime(QDateTime::fromSecsSinceEpoch(current.mtime),
+                            QFileDevice::FileModificationTime);
+            out.setPermissions(ArchiveUtils::toPermissions(current.mode));
+            reader.release(current);
+        }
+        
+        ++info.filesDone;
+        if (info.bytesTotal <= 0) {
+            info.percentage = int(info.filesDone * 100 / info.filesTotal);
+        }
+        reportProgress(info);
+    }
+    
+    if (sink && !sink->finish()) {
+        emit error(sink->getLastError());
+        return false;
+    }
+    for (int i : links) {
+        // Checked afresh: an earlier link may sit on the way to this one
+        const QString &target = targets.at(i);
+        if (ArchiveUtils::passesSymLink(destination, QFileInfo(relatives.at(i)).path())) {
+            emit error(QString("Refusing to extract through the symbolic link in %1").arg(relatives.at(i)));
+            return false;
+        }
+        QDir().mkpath(QFileInfo(target).path());
+        QFile::remove(target);
+        if (!QFile::link(selected.at(i).linkTarget, target)) {
+            emit error(QString("Cannot create link %1").arg(target));
+            return false;
+        }
+    }
+    for (int i = 0; i < selected.size(); ++i) {
+        if (selected.at(i).isDirectory()) {
+            QFile::setPermissions(targets.at(i), ArchiveUtils::toPermissions(selected.at(i).mode));
+        }
+    }
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
 }
@@ -2,6 +2,10 @@
 #define TARHANDLER_H
 
 #include "../ArchiveHandler.h"
+#include <QVector>
+
+class TarReader;
+struct TarMember;
 
 class TarHandler : public ArchiveHandler {
     Q_OBJECT
@@ -25,14 +29,58 @@ public:
     
     QString getToolName() const override { return "tar"; }
     QStringList getSupportedExtensions() const override {
-        return QStringList() << "tar" << "tar.gz" << "tgz" << "tar.bz2" << "tbz2" << "tar.xz" << "txz";
+        return QStringList() << "tar" << "tar.gz" << "tgz" << "tar.bz2" << "tbz2" << "tar.xz" << "txz"
+                             << "tar.zst" << "tzst" << "tar.lz4" << "tlz4";
     }
+    ArchiveHandler *clone() const override { return new TarHandler; }
+    bool prefersToolForCreate(const QString &archivePath) const override;
+    bool listsInProcess(const QString &archivePath) const override;
+    bool extractsInProcess(const QString &archivePath, const QStringList &files) const override;
 
 private:
-    QString findTarTool() const;
+    ToolInfo findTarTool() const;
+    // In-process paths for uncompressed archives; handled is false when the
+    // tool has to do the job instead
+    bool createNative(const QString &archivePath, const QStringList &files, bool &handled);
+    bool listNative(const QString &archivePath, QList<ArchiveEntry> &entries, bool &handled);
+    bool extractNative(const QString &archivePath, const QString &destination,
+                       const QStringList &files, bool &handled);
+#ifdef LINRAR_HAVE_ZLIB
+    // .tar.gz through a checkpoint index: listing builds and caches it,
+    // extracting selected members needs it cached already
+    bool listIndexed(const QString &archivePath, QList<ArchiveEntry> &entries, bool &handled);
+    bool extractIndexed(const QString &archivePath, const QString &destination,
+                        const QStringList &files, bool &handled);
+#endif
+    // Selected members of multi-block .tar.xz or seekable .tar.zst; needs
+    // liblzma or libzstd, handled is false without them
+    bool extractBlocks(const QString &archivePath, ArchiveFormat format, const QString &destination,
+                       const QStringList &files, bool &handled);
+    bool listMembers(TarReader &reader, QList<ArchiveEntry> &entries,
+                     QVector<TarMember> &members, bool &handled);
+    // Writes the members selected by files, read through reader
+    bool extractMembers(TarReader &reader, const QVector<TarMember> &members,
+                        const QString &destination, const QStringList &files, bool &handled);
+    // Adds files to args, or a list file for them when the selection is large
+    bool appendFileArguments(const QStringList &files, QStringList &args);
     QString getCompressionFlag(const QString &archivePath) const;
-    bool parseListOutput(const QString &output, QList<ArchiveEntry> &entries);
+    // Parallel compressor for the archive's compression, invalid if none
+    // is installed or tar cannot run one
+    ToolInfo findParallelCompressor(const QString &archivePath) const;
+    // Commands decompressing the archive to stdout and compressing stdin
+    // the same way, program first; false if no compressor is installed
+    bool recompressionCommands(const QString &archivePath, QStringList &decompress,
+                               QStringList &compress);
+    // tar switches selecting the compression: a parallel compressor through
+    // --use-compress-program when possible, else the plain flag. level is
+    // only passed when writing, -1 otherwise.
+    QStringList compressionArguments(const ToolInfo &tar, const QString &archivePath, int level = -1);
+    // zstd flags for a 0-9 level, or for reading when level is -1
+    QStringList zstdArguments(int level) const;
+    // Settings for the compressor tar runs itself, through its environment
+    void applyCompressorThreads(const QString &archivePath, bool writing);
     ArchiveFormat detectTarFormat(const QString &archivePath) const;
+    qint64 expectedStreamSize(const QString &archivePath) const;
 };
 
 #endif // TARHANDLER_H
@@ -1,122 +1,189 @@
 #include "ZipHandler.h"
 #include "../ProcessManager.h"
-#include <QStandardPaths>
+#include "../ListParser.h"
+#include "../native/ZipReader.h"
+#include "../utils/ArchiveUtils.h"
+#ifdef LINRAR_HAVE_ZLIB
+#include "../native/ZipExtractor.h"
+#include "../native/ZipWriter.h"
+#include "../native/ZipEditor.h"
+#include "../native/ZipVerifier.h"
+#endif
 #include <QRegularExpression>
 #include <QDir>
+#include <QSet>
+#include <memory>
+
+// Parses `unzip -l` output: Length   Date   Time   Name
+class ZipListParser : public ListParser {
+public:
+    ZipListParser()
+        : inFileList(false),
+          regex(R"(^\s*(\d+)\s+(\S+\s+\S+\s+\S+)\s+(.+)$)") {
+    }
+    
+    bool parseLine(const QString &line, ArchiveEntry &entry) override {
+        if (line.contains("Length") && line.contains("Name")) {
+            inFileList = true;
+            return false;
+        }
+        
+        if (!inFileList || line.startsWith("------")) {
+            return false;
+        }
+        
+        QRegularExpressionMatch match = regex.match(line);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        
+        entry.name = match.captured(3).trimmed();
+        entry.path = entry.name;
+        entry.size = match.captured(1).toLongLong();
+        entry.compressedSize = entry.size; // unzip -l doesn't show compressed size
+        entry.isDirectory = entry.name.endsWith('/');
+        entry.date = match.captured(2);
+        return true;
+    }
+
+private:
+    bool inFileList;
+    QRegularExpression regex;
+};
+
+// Info-ZIP progress: one line per member, matched against these patterns
+static const char *EXTRACT_PATTERN =
+    R"(^\s*(?:inflating|extracting|creating|linking|exploding|unshrinking|unreducing):\s+(.+?)(?:\s+->.*)?$)";
+static const char *TEST_PATTERN = R"(^\s*testing:\s+(.+?)\s+OK$)";
+static const char *ADD_PATTERN = R"(^\s*(?:adding|updating):\s+(.+?)\s+\()";
+static const char *DELETE_PATTERN = R"(^\s*deleting:\s+(.+)$)";
+
+// How often native extraction reports progress and checks for cancellation
+static const int NATIVE_POLL_INTERVAL = 100;
+// Level of members added to an existing archive, zip's own default
+static const int DEFAULT_LEVEL = 6;
+
+// Thread switch for the 7z fallback; Info-ZIP is single threaded
+static QStringList threadArguments(int threads) {
+    if (threads <= 0) {
+        return QStringList();
+    }
+    return QStringList() << "-mmt=" + QString::number(threads);
+}
+
+static std::unique_ptr<ProgressParser> createProgressParser(const ToolInfo &tool,
+                                                            const char *memberPattern) {
+    // The 7z fallback runs with -bsp1 and reports a percentage instead
+    if (tool.name == "7z") {
+        return std::unique_ptr<ProgressParser>(new PercentProgressParser);
+    }
+    return std::unique_ptr<ProgressParser>(new FileCountProgressParser(QString::fromLatin1(memberPattern)));
+}
+
+#ifdef LINRAR_HAVE_ZLIB
+static MemberCheck::Status toMemberStatus(ZipVerifier::Status status) {
+    switch (status) {
+        case ZipVerifier::Ok:
+            return MemberCheck::Ok;
+        case ZipVerifier::CrcMismatch:
+            return MemberCheck::CrcMismatch;
+        case ZipVerifier::Truncated:
+            return MemberCheck::Truncated;
+        case ZipVerifier::BadHeader:
+            return MemberCheck::BadHeader;
+        case ZipVerifier::Corrupt:
+            return MemberCheck::Corrupt;
+    }
+    return MemberCheck::Corrupt;
+}
+#endif
 
 ZipHandler::ZipHandler(QObject *parent)
     : ArchiveHandler(parent) {
 }
 
 bool ZipHandler::isAvailable() const {
-    return !findZipTool().isEmpty() && !findUnzipTool().isEmpty();
+#ifdef LINRAR_HAVE_ZLIB
+    // Listing, extraction, tests and creation run in-process; the other
+    // operations report a missing tool
+    return true;
+#else
+    return findZipTool().isValid() && findUnzipTool().isValid();
+#endif
 }
 
-QString ZipHandler::findZipTool() const {
-    QString zip = QStandardPaths::findExecutable("zip");
-    if (!zip.isEmpty()) return zip;
-    
-    // Try 7z as fallback
-    QString sevenz = QStandardPaths::findExecutable("7z");
-    if (!sevenz.isEmpty()) return sevenz;
-    
-    return QString();
+ToolInfo ZipHandler::findZipTool() const {
+    // 7z is the fallback
+    return ToolRegistry::instance()->firstAvailable(QStringList() << "zip" << "7z");
 }
 
-QString ZipHandler::findUnzipTool() const {
-    QString unzip = QStandardPaths::findExecutable("unzip");
-    if (!unzip.isEmpty()) return unzip;
-    
-    // Try 7z as fallback
-    QString sevenz = QStandardPaths::findExecutable("7z");
-    if (!sevenz.isEmpty()) return sevenz;
-    
-    return QString();
+ToolInfo ZipHandler::findUnzipTool() const {
+    return ToolRegistry::instance()->firstAvailable(QStringList() << "unzip" << "7z");
 }
 
 bool ZipHandler::list(const QString &archivePath, QList<ArchiveEntry> &entries) {
-    QString tool = findUnzipTool();
-    if (tool.isEmpty()) {
+    // The central directory has everything the listing needs, and more
+    // than unzip -l prints; the tool is only a fallback for damaged archives
+    if (listNative(archivePath, entries)) {
+        return true;
+    }
+    
+    ToolInfo tool = findUnzipTool();
+    if (!tool.isValid()) {
         emit error("unzip tool not found");
         return false;
     }
     
-    QString output, errorOutput;
     QStringList args;
     
-    if (tool.contains("7z")) {
+    if (tool.name == "7z") {
         args << "l" << archivePath;
     } else {
         args << "-l" << archivePath;
     }
     
-    if (!processManager->executeWithOutput(tool, args, output, errorOutput)) {
-        emit error(processManager->getLastError());
-        return false;
-    }
-    
-    return parseListOutput(output, entries);
-}
-
-bool ZipHandler::parseListOutput(const QString &output, QList<ArchiveEntry> &entries) {
-    QStringList lines = output.split('\n', Qt::SkipEmptyParts);
-    bool inFileList = false;
-    
-    for (const QString &line : lines) {
-        if (line.contains("Length") && line.contains("Name")) {
-            inFileList = true;
-            continue;
-        }
-        
-        if (inFileList && line.startsWith("------")) {
-            continue;
-        }
-        
-        if (inFileList) {
-            // Parse: Length   Date   Time   Name
-            QRegularExpression regex(R"(^\s*(\d+)\s+(\S+\s+\S+\s+\S+)\s+(.+)$)");
-            QRegularExpressionMatch match = regex.match(line);
-            if (match.hasMatch()) {
-                ArchiveEntry entry;
-                entry.name = match.captured(3).trimmed();
-                entry.path = entry.name;
-                entry.size = match.captured(1).toLongLong();
-                entry.compressedSize = entry.size; // unzip -l doesn't show compressed size
-                entry.isDirectory = entry.name.endsWith('/');
-                entry.date = match.captured(2);
-                entries.append(entry);
-            }
-        }
-    }
-    
-    return true;
+    ZipListParser parser;
+    return runListing(tool.path, args, parser, entries);
 }
 
 bool ZipHandler::extract(const QString &archivePath, const QString &destination,
                         const QStringList &files) {
-    QString tool = findUnzipTool();
-    if (tool.isEmpty()) {
+    bool handled = false;
+    bool success = extractNative(archivePath, destination, files, handled);
+    if (handled) {
+        return success;
+    }
+    
+    ToolInfo tool = findUnzipTool();
+    if (!tool.isValid()) {
         emit error("unzip tool not found");
         return false;
     }
     
+    // unzip cannot read member names from a file, 7z can
+    if (tool.name == "unzip" && needsListFile(files)) {
+        ToolInfo sevenZip = ToolRegistry::instance()->tool("7z");
+        if (sevenZip.isValid()) {
+            tool = sevenZip;
+        }
+    }
+    
     QDir().mkpath(destination);
     
     QStringList args;
-    if (tool.contains("7z")) {
-        args << "x" << archivePath << "-o" + destination;
-        if (!files.isEmpty()) {
-            args << files;
-        }
+    if (tool.name == "7z") {
+        args << "x" << "-bsp1" << threadArguments(threadsFor(tool));
+        args << archivePath << "-o" + destination;
     } else {
         args << "-o" + destination << archivePath;
-        if (!files.isEmpty()) {
-            args << files;
-        }
+    }
+    if (!appendFileArguments(tool, files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    std::unique_ptr<ProgressParser> parser = createProgressParser(tool, EXTRACT_PATTERN);
+    parser->setTotals(expectedBytes, expectedFiles);
+    return runTool(tool.path, args, parser.get());
 }
 
 bool ZipHandler::extractTo(const QString &archivePath, const QString &destination) {
@@ -125,95 +192,146 @@ bool ZipHandler::extractTo(const QString &archivePath, const QString &destinatio
 
 bool ZipHandler::create(const QString &archivePath, const QStringList &files,
                        const QString &password, int compressionLevel) {
-    QString tool = findZipTool();
-    if (tool.isEmpty()) {
+    // zip's traditional encryption is left to the tools
+    if (password.isEmpty()) {
+        bool handled = false;
+        bool success = createNative(archivePath, files, compressionLevel, handled);
+        if (handled) {
+            return success;
+        }
+    }
+    
+    ToolInfo tool = findZipTool();
+    if (!tool.isValid()) {
         emit error("zip tool not found");
         return false;
     }
     
     QStringList args;
-    if (tool.contains("7z")) {
-        args << "a" << "-tzip";
+    if (tool.name == "7z") {
+        args << "a" << "-bsp1" << "-tzip";
         if (!password.isEmpty()) {
             args << "-p" + password;
         }
         args << "-mx=" + QString::number(compressionLevel);
-        args << archivePath << files;
+        args << threadArguments(threadsFor(tool));
+        args << archivePath;
     } else {
         args << "-" + QString::number(compressionLevel);
         if (!password.isEmpty()) {
             args << "-P" + password;
         }
-        args << archivePath << files;
+        args << archivePath;
+    }
+    if (!appendFileArguments(tool, files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    std::unique_ptr<ProgressParser> parser = createProgressParser(tool, ADD_PATTERN);
+    parser->setTotals(-1, files.size());
+    return runTool(tool.path, args, parser.get());
 }
 
 bool ZipHandler::addFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = findZipTool();
-    if (tool.isEmpty()) {
+    bool handled = false;
+    bool success = updateNative(archivePath, files, QStringList(), handled);
+    if (handled) {
+        return success;
+    }
+    
+    ToolInfo tool = findZipTool();
+    if (!tool.isValid()) {
         emit error("zip tool not found");
         return false;
     }
     
     QStringList args;
-    if (tool.contains("7z")) {
-        args << "a" << "-tzip" << archivePath << files;
+    if (tool.name == "7z") {
+        args << "a" << "-bsp1" << "-tzip" << threadArguments(threadsFor(tool)) << archivePath;
     } else {
-        args << archivePath << files;
+        args << archivePath;
+    }
+    if (!appendFileArguments(tool, files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    std::unique_ptr<ProgressParser> parser = createProgressParser(tool, ADD_PATTERN);
+    parser->setTotals(-1, files.size());
+    return runTool(tool.path, args, parser.get());
 }
 
 bool ZipHandler::removeFiles(const QString &archivePath, const QStringList &files) {
-    QString tool = findZipTool();
-    if (tool.isEmpty()) {
+    bool handled = false;
+    bool success = updateNative(archivePath, QStringList(), files, handled);
+    if (handled) {
+        return success;
+    }
+    
+    ToolInfo tool = findZipTool();
+    if (!tool.isValid()) {
         emit error("zip tool not found");
         return false;
     }
     
     QStringList args;
-    if (tool.contains("7z")) {
-        args << "d" << "-tzip" << archivePath << files;
+    if (tool.name == "7z") {
+        args << "d" << "-bsp1" << "-tzip" << archivePath;
     } else {
-        args << "-d" << archivePath << files;
+        args << "-d" << archivePath;
+    }
+    if (!appendFileArguments(tool, files, args)) {
+        return false;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    std::unique_ptr<ProgressParser> parser = createProgressParser(tool, DELETE_PATTERN);
+    parser->setTotals(-1, files.size());
+    return runTool(tool.path, args, parser.get());
 }
 
 bool ZipHandler::test(const QString &archivePath) {
-    QString tool = findUnzipTool();
-    if (tool.isEmpty()) {
+    testReport.clear();
+    bool handled = false;
+    bool success = testNative(archivePath, handled);
+    if (handled) {
+        return success;
+    }
+    
+    ToolInfo tool = findUnzipTool();
+    if (!tool.isValid()) {
         emit error("unzip tool not found");
         return false;
     }
     
     QStringList args;
-    if (tool.contains("7z")) {
-        args << "t" << archivePath;
+    if (tool.name == "7z") {
+        args << "t" << "-bsp1" << archivePath;
     } else {
         args << "-t" << archivePath;
     }
     
-    QString output, errorOutput;
-    return processManager->executeWithOutput(tool, args, output, errorOutput);
+    std::unique_ptr<ProgressParser> parser = createProgressParser(tool, TEST_PATTERN);
+    parser->setTotals(expectedBytes, expectedFiles);
+    return runTool(tool.path, args, parser.get());
+}
+
+bool ZipHandler::testsInProcess(const QString &archivePath) const {
+    Q_UNUSED(archivePath);
+#ifdef LINRAR_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
 }
 
 bool ZipHandler::repair(const QString &archivePath) {
     // ZIP repair is limited, try zip -F
-    QString tool = findZipTool();
-    if (tool.isEmpty()) {
+    ToolInfo tool = findZipTool();
+    if (!tool.isValid()) {
         emit error("zip tool not found");
         return false;
     }
     
-    if (tool.contains("7z")) {
+    if (tool.name == "7z") {
         emit error("7z does not support ZIP repair");
         return false;
     }
@@ -222,7 +340,374 @@ bool ZipHandler::repair(const QString &archivePath) {
     args << "-F" << archivePath << "--out" << archivePath + ".fixed";
     
     QString output, errorOutput;
-    bool result = processManager->executeWithOutput(tool, args, output, errorOutput);
+    bool result = processManager->executeWithOutput(tool.path, args, output, errorOutput);
     // Note: User would need to manually replace the file
     return result;
 }
+
+bool ZipHandler::compact(const QString &archivePath) {
+#ifdef LINRAR_HAVE_ZLIB
+    ZipEditor editor(archivePath);
+    if (!editor.open()) {
+        emit error(editor.getLastError());
+        return false;
+    }
+    if (editor.reclaimableBytes() == 0) {
+        return true;
+    }
+    
+    ProgressInfo info;
+    info.bytesTotal = editor.bytesToMove();
+    info.filesTotal = -1;
+    bool compacted = editor.compact([this, &info](qint64 moved) {
+        info.bytesDone = moved;
+        if (info.bytesTotal > 0) {
+            info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+        }
+        reportProgress(info);
+        return !isCancelRequested();
+    });
+    
+    // The old directory is stale once anything moved, so the new one is
+    // written even after cancellation or an error
+    ZipWriter writer(archivePath, DEFAULT_LEVEL);
+    editor.prepare(writer);
+    writer.start(1);
+    writer.wait(-1);
+    if (writer.hasFailed()) {
+        emit error(writer.getLastError());
+        return false;
+    }
+    if (!compacted) {
+        if (!isCancelRequested()) {
+            emit error(editor.getLastError());
+        }
+        return false;
+    }
+    
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
+#else
+    // Only the in-process updates leave holes behind
+    Q_UNUSED(archivePath);
+    return true;
+#endif
+}
+
+bool ZipHandler::appendFileArguments(const ToolInfo &tool, const QStringList &files,
+                                     QStringList &args) {
+    // unzip has no list file mode; extract() prefers 7z for large selections
+    if (!needsListFile(files) || tool.name == "unzip") {
+        args << files;
+        return true;
+    }
+    
+    QString listPath = writeListFile(files);
+    if (listPath.isEmpty()) {
+        return false;
+    }
+    
+    if (tool.name == "7z") {
+        args << "-scsUTF-8" << "@" + listPath;
+    } else {
+        // zip -@ reads the names from stdin
+        args << "-@";
+        processManager->setStandardInputFile(listPath);
+    }
+    return true;
+}
+
+bool ZipHandler::listNative(const QString &archivePath, QList<ArchiveEntry> &entries) {
+    ZipReader reader(archivePath);
+    if (!reader.open()) {
+        return false;
+    }
+    
+    const QVector<ZipEntry> &members = reader.getEntries();
+    entries.reserve(entries.size() + members.size());
+    int first = entries.size();
+    for (const ZipEntry &member : members) {
+        ArchiveEntry entry;
+        entry.name = member.name;
+        entry.path = member.name;
+        entry.size = qint64(member.uncompressedSize);
+        entry.compressedSize = qint64(member.compressedSize);
+        entry.isDirectory = member.isDirectory();
+        entry.permissions = member.permissions();
+        entry.date = member.modified().toString("yyyy-MM-dd hh:mm");
+        entry.crc = member.crc32;
+        entry.offset = qint64(member.localHeaderOffset) + reader.getBaseOffset();
+        entries.append(entry);
+    }
+    
+    publishEntries(entries.mid(first));
+    return true;
+}
+
+bool ZipHandler::createNative(const QString &archivePath, const QStringList &files,
+                              int compressionLevel, bool &handled) {
+    handled = false;
+#ifdef LINRAR_HAVE_ZLIB
+    ZipWriter writer(archivePath, compressionLevel);
+    // zip reports unreadable inputs in its own words
+    if (!writer.addFiles(files) || writer.totalFiles() == 0) {
+        return false;
+    }
+    handled = true;
+    return runWriter(writer);
+#else
+    Q_UNUSED(archivePath);
+    Q_UNUSED(files);
+    Q_UNUSED(compressionLevel);
+    return false;
+#endif
+}
+
+bool ZipHandler::updateNative(const QString &archivePath, const QStringList &added,
+                              const QStringList &removed, bool &handled) {
+    handled = false;
+#ifdef LINRAR_HAVE_ZLIB
+    ZipEditor editor(archivePath);
+    if (!editor.open()) {
+        return false;
+    }
+    QSet<QString> requested;
+    for (const QString &name : removed) {
+        requested.insert(ArchiveUtils::normalizeMemberName(name));
+    }
+    // Unknown names get zip's own error message
+    if (editor.remove(removed).size() < requested.size()) {
+        return false;
+    }
+    ZipWriter writer(archivePath, DEFAULT_LEVEL);
+    if (!writer.addFiles(added)) {
+        return false;
+    }
+    handled = true;
+    
+    editor.prepare(writer);
+    if (runWriter(writer)) {
+        return true;
+    }
+    if (!editor.restore()) {
+        emit error(editor.getLastError());
+    }
+    return false;
+#else
+    Q_UNUSED(archivePath);
+    Q_UNUSED(added);
+    Q_UNUSED(removed);
+    return false;
+#endif
+}
+
+#ifdef LINRAR_HAVE_ZLIB
+bool ZipHandler::runWriter(ZipWriter &writer) {
+    writer.start(nativeThreads());
+    
+    ProgressInfo info;
+    info.bytesTotal = writer.totalBytes() > 0 ? writer.totalBytes() : -1;
+    info.filesTotal = writer.totalFiles();
+    while (!writer.wait(NATIVE_POLL_INTERVAL)) {
+        if (isCancelRequested()) {
+            writer.cancel();
+        }
+        info.bytesDone = writer.bytesDone();
+        info.filesDone = writer.filesDone();
+        info.currentFile = writer.currentFile();
+        if (info.bytesTotal > 0) {
+            info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+        } else if (info.filesTotal > 0) {
+            info.percentage = int(info.filesDone * 100 / info.filesTotal);
+        }
+        reportProgress(info);
+    }
+    
+    if (isCancelRequested()) {
+        return false;
+    }
+    if (writer.hasFailed()) {
+        emit error(writer.getLastError());
+        return false;
+    }
+    
+    info.bytesDone = writer.bytesDone();
+    info.filesDone = writer.filesDone();
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
+}
+#endif
+
+bool ZipHandler::extractNative(const QString &archivePath, const QString &destination,
+                               const QStringList &files, bool &handled) {
+    handled = false;
+#ifdef LINRAR_HAVE_ZLIB
+    ZipReader reader(archivePath);
+    if (!reader.open()) {
+        return false;
+    }
+    
+    QSet<QString> requested;
+    for (const QString &file : files) {
+        requested.insert(ArchiveUtils::normalizeMemberName(file));
+    }
+    
+    // Decided from the central directory alone, so unzip can still take
+    // over before anything is written
+    const QVector<ZipEntry> &members = reader.getEntries();
+    QVector<int> selected;
+    QSet<QString> targets;
+    QSet<QString> found;
+    qint64 totalBytes = 0;
+    for (int i = 0; i < members.size(); ++i) {
+        const ZipEntry &member = members.at(i);
+        QString name = ArchiveUtils::normalizeMemberName(member.name);
+        if (name.isEmpty() && member.isDirectory()) {
+            continue;
+        }
+        QString selector = requested.isEmpty() ? name : ArchiveUtils::selectedBy(name, requested);
+        if (selector.isEmpty()) {
+            continue;
+        }
+        // Backslashes and duplicates are left to unzip, which knows what
+        // to make of them; two workers must never share an output file
+        QString relative = ArchiveUtils::safeRelativePath(name);
+        if (relative.isEmpty() || name.contains('\\') || !ZipExtractor::canExtract(member)
+            || targets.contains(relative)) {
+            return false;
+        }
+        targets.insert(relative);
+        found.insert(selector);
+        selected.append(i);
+        totalBytes += qint64(member.uncompressedSize);
+    }
+    // Unknown names get unzip's own error message
+    if (found.size() < requested.size()) {
+        return false;
+    }
+    handled = true;
+    
+    QDir().mkpath(destination);
+    // A partial extraction hops between members; a full one reads them all
+    if (requested.isEmpty()) {
+        reader.advise(ArchiveSource::Sequential);
+    }
+    ZipExtractor extractor(reader, destination);
+    extractor.start(selected, nativeThreads());
+    
+    ProgressInfo info;
+    info.bytesTotal = totalBytes > 0 ? totalBytes : -1;
+    info.filesTotal = selected.size();
+    while (!extractor.wait(NATIVE_POLL_INTERVAL)) {
+        if (isCancelRequested()) {
+            extractor.cancel();
+        }
+        info.bytesDone = extractor.bytesDone();
+        info.filesDone = extractor.filesDone();
+        info.currentFile = extractor.currentFile();
+        if (info.bytesTotal > 0) {
+            info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+        } else if (info.filesTotal > 0) {
+            info.percentage = int(info.filesDone * 100 / info.filesTotal);
+        }
+        reportProgress(info);
+    }
+    
+    if (isCancelRequested()) {
+        return false;
+    }
+    if (extractor.hasFailed()) {
+        emit error(extractor.getLastError());
+        return false;
+    }
+    
+    info.bytesDone = extractor.bytesDone();
+    info.filesDone = extractor.filesDone();
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
+#else
+    Q_UNUSED(archivePath);
+    Q_UNUSED(destination);
+    Q_UNUSED(files);
+    return false;
+#endif
+}
+
+bool ZipHandler::testNative(const QString &archivePath, bool &handled) {
+    handled = false;
+#ifdef LINRAR_HAVE_ZLIB
+    // An archive without a readable central directory gets unzip's verdict
+    ZipReader reader(archivePath);
+    if (!reader.open()) {
+        return false;
+    }
+    const QVector<ZipEntry> &members = reader.getEntries();
+    qint64 totalBytes = 0;
+    for (const ZipEntry &member : members) {
+        if (!ZipVerifier::canVerify(member)) {
+            return false;
+        }
+        totalBytes += qint64(member.uncompressedSize);
+    }
+    handled = true;
+    
+    reader.advise(ArchiveSource::Sequential);
+    ZipVerifier verifier(reader);
+    verifier.start(nativeThreads());
+    
+    ProgressInfo info;
+    info.bytesTotal = totalBytes > 0 ? totalBytes : -1;
+    info.filesTotal = members.size();
+    while (!verifier.wait(NATIVE_POLL_INTERVAL)) {
+        if (isCancelRequested()) {
+            verifier.cancel();
+        }
+        info.bytesDone = verifier.bytesDone();
+        info.filesDone = verifier.filesDone();
+        info.currentFile = verifier.currentFile();
+        if (info.bytesTotal > 0) {
+            info.percentage = int(info.bytesDone * 100 / info.bytesTotal);
+        } else if (info.filesTotal > 0) {
+            info.percentage = int(info.filesDone * 100 / info.filesTotal);
+        }
+        reportProgress(info);
+    }
+    
+    if (isCancelRequested()) {
+        return false;
+    }
+    if (verifier.hasFailed()) {
+        emit error(verifier.getLastError());
+        return false;
+    }
+    
+    int damaged = 0;
+    const QVector<ZipVerifier::Status> &results = verifier.getResults();
+    for (int i = 0; i < members.size(); ++i) {
+        MemberCheck check;
+        check.name = members.at(i).name;
+        check.status = toMemberStatus(results.at(i));
+        testReport.append(check);
+        if (check.status != MemberCheck::Ok) {
+            ++damaged;
+        }
+    }
+    // The report names the damaged members; an error on top of it would
+    // show the user a second dialog
+    if (damaged > 0) {
+        return false;
+    }
+    
+    info.bytesDone = verifier.bytesDone();
+    info.filesDone = verifier.filesDone();
+    info.percentage = 100;
+    reportProgress(info, true);
+    return true;
+#else
+    Q_UNUSED(archivePath);
+    return false;
+#endif
+}
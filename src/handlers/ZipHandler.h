@@ -3,6 +3,8 @@
 
 #include "../ArchiveHandler.h"
 
+class ZipWriter;
+
 class ZipHandler : public ArchiveHandler {
     Q_OBJECT
 
@@ -22,16 +24,44 @@ public:
     bool removeFiles(const QString &archivePath, const QStringList &files) override;
     bool test(const QString &archivePath) override;
     bool repair(const QString &archivePath) override;
+    bool compact(const QString &archivePath) override;
+    bool testsInProcess(const QString &archivePath) const override;
     
     QString getToolName() const override { return "zip"; }
     QStringList getSupportedExtensions() const override {
         return QStringList() << "zip" << "jar" << "war";
     }
+    ArchiveHandler *clone() const override { return new ZipHandler; }
 
 private:
-    QString findZipTool() const;
-    QString findUnzipTool() const;
-    bool parseListOutput(const QString &output, QList<ArchiveEntry> &entries);
+    ToolInfo findZipTool() const;
+    ToolInfo findUnzipTool() const;
+    // Reads the central directory in-process; false if it cannot be parsed
+    bool listNative(const QString &archivePath, QList<ArchiveEntry> &entries);
+    // Extracts stored and deflated members in parallel without a tool.
+    // handled is false when the archive needs unzip instead (encryption,
+    // other methods, odd names); nothing has been written then.
+    bool extractNative(const QString &archivePath, const QString &destination,
+                       const QStringList &files, bool &handled);
+    // Tests stored and deflated members in parallel without a tool, filling
+    // testReport. handled is false when unzip has to do it instead.
+    bool testNative(const QString &archivePath, bool &handled);
+    // Writes the archive in-process, deflating members in parallel.
+    // handled is false when zip has to do it instead (encryption, or
+    // inputs that cannot be read); nothing has been written then.
+    bool createNative(const QString &archivePath, const QStringList &files,
+                      int compressionLevel, bool &handled);
+    // Adds and removes members in place, rewriting only what follows the
+    // last member that stays. handled is false when zip has to do it
+    // instead (unknown names, unreadable inputs, self-extractors).
+    bool updateNative(const QString &archivePath, const QStringList &added,
+                      const QStringList &removed, bool &handled);
+#ifdef LINRAR_HAVE_ZLIB
+    // Runs writer to completion, reporting progress
+    bool runWriter(ZipWriter &writer);
+#endif
+    // Adds files to args, or a list file for them when the selection is large
+    bool appendFileArguments(const ToolInfo &tool, const QStringList &files, QStringList &args);
 };
 
 #endif // ZIPHANDLER_H
@@ -0,0 +1,134 @@
+#include "BlockSource.h"
+#include <algorithm>
+
+// Output thrown away per call while skipping inside a block
+static const int SKIP_BUFFER_SIZE = 256 * 1024;
+
+BlockSource::BlockSource(const QString &archivePath)
+    : file(archivePath), current(-1), position(0), inputPosition(0) {
+}
+
+bool BlockSource::fail(const QString &message) {
+    lastError = message;
+    return false;
+}
+
+bool BlockSource::open() {
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(file.errorString());
+    }
+    if (!readIndex()) {
+        return false;
+    }
+    if (blocks.isEmpty()) {
+        return fail("Empty compressed stream");
+    }
+    return enterBlock(0);
+}
+
+bool BlockSource::enterBlock(int index) {
+    current = index;
+    const Block &block = blocks.at(index);
+    position = block.out;
+    inputPosition = block.in;
+    if (!file.seek(block.in)) {
+        return fail(file.errorString());
+    }
+    return startBlock(block);
+}
+
+qint64 BlockSource::readInput(char *buffer, qint64 size) {
+    const Block &block = blocks.at(current);
+    qint64 count = qMin(size, block.in + block.packedSize - inputPosition);
+    if (count <= 0) {
+        return 0;
+    }
+    if (progressCallback && !progressCallback(inputPosition)) {
+        fail("Cancelled");
+        return -1;
+    }
+    count = file.read(buffer, count);
+    if (count < 0) {
+        fail(file.errorString());
+        return -1;
+    }
+    inputPosition += count;
+    return count;
+}
+
+qint64 BlockSource::read(char *buffer, qint64 size) {
+    qint64 done = 0;
+    while (done < size && current < blocks.size()) {
+        char *target;
+        qint64 wanted = size - done;
+        if (buffer) {
+            target = buffer + done;
+        } else {
+            if (scratch.isEmpty()) {
+                scratch.resize(SKIP_BUFFER_SIZE);
+            }
+            target = scratch.data();
+            wanted = qMin<qint64>(wanted, scratch.size());
+        }
+
+        qint64 count = decode(target, wanted);
+        if (count < 0) {
+            return -1;
+        }
+        if (count > 0) {
+            done += count;
+            position += count;
+            continue;
+        }
+
+        const Block &block = blocks.at(current);
+        if (position != block.out + block.size) {
+            fail(QString("Block at offset %1 does not match the index").arg(block.in));
+            return -1;
+        }
+        if (current + 1 == blocks.size()) {
+            current = blocks.size();
+            break;
+        }
+        if (!enterBlock(current + 1)) {
+            return -1;
+        }
+    }
+    return done;
+}
+
+bool BlockSource::seek(qint64 offset) {
+    if (offset == position) {
+        return true;
+    }
+    // The very end, where a tar without end-of-archive blocks stops
+    const Block &last = blocks.last();
+    if (offset == last.out + last.size) {
+        current = blocks.size();
+        position = offset;
+        return true;
+    }
+    auto next = std::upper_bound(blocks.cbegin(), blocks.cend(), offset,
+                                 [](qint64 value, const Block &block) {
+        return value < block.out;
+    });
+    int index = int(next - blocks.cbegin()) - 1;
+    if (index < 0) {
+        return fail(QString("Cannot seek to %1").arg(offset));
+    }
+    // Backwards or into another block: start decoding that block
+    if (offset < position || index != current) {
+        if (!enterBlock(index)) {
+            return false;
+        }
+    }
+    qint64 gap = offset - position;
+    qint64 skipped = read(nullptr, gap);
+    if (skipped < 0) {
+        return false;
+    }
+    if (skipped != gap) {
+        return fail("Unexpected end of compressed data");
+    }
+    return true;
+}
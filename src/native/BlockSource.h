@@ -0,0 +1,65 @@
+#ifndef BLOCKSOURCE_H
+#define BLOCKSOURCE_H
+
+#include "TarReader.h"
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QFile>
+#include <functional>
+
+// The decompressed stream of a tarball whose compressor wrote independent
+// blocks and an index of them: multi-block xz, or zstd with a seek table.
+// Seeking decodes nothing but the block holding the target, so TarReader
+// hopping over member data only decodes the blocks with headers in them.
+class BlockSource : public TarSource {
+public:
+    struct Block {
+        qint64 in = 0;         // compressed offset, headers included
+        qint64 packedSize = 0;
+        qint64 out = 0;        // uncompressed offset
+        qint64 size = 0;
+    };
+
+    explicit BlockSource(const QString &archivePath);
+    ~BlockSource() override = default;
+
+    // Opens the file and reads the index; fails for archives without one
+    bool open() override;
+    bool seek(qint64 offset) override;
+    qint64 read(char *buffer, qint64 size) override;
+    QString errorString() const override { return lastError; }
+
+    int blockCount() const { return blocks.size(); }
+    // Called as compressed input is read with the current offset;
+    // returning false aborts the read or seek in progress
+    void setProgressCallback(const std::function<bool(qint64)> &callback) { progressCallback = callback; }
+
+protected:
+    // Fills blocks, in order
+    virtual bool readIndex() = 0;
+    // Resets the decoder for block; input comes from readInput()
+    virtual bool startBlock(const Block &block) = 0;
+    // Decodes up to size bytes of the current block; 0 once it is done,
+    // -1 on error
+    virtual qint64 decode(char *buffer, qint64 size) = 0;
+
+    bool fail(const QString &message);
+    // Compressed bytes of the current block, in order; 0 at its end
+    qint64 readInput(char *buffer, qint64 size);
+
+    QFile file;
+    QVector<Block> blocks;
+    QString lastError;
+
+private:
+    bool enterBlock(int index);
+
+    int current;
+    qint64 position;
+    qint64 inputPosition;
+    QByteArray scratch;
+    std::function<bool(qint64)> progressCallback;
+};
+
+#endif // BLOCKSOURCE_H
@@ -0,0 +1,196 @@
+#include "Crc32.h"
+#include <cstring>
+#include <zlib.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL
+#endif
+#if defined(__aarch64__) && defined(__GNUC__) && defined(__linux__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#define CRC32_HAVE_ARMV8
+#endif
+
+// zlib counts in uInt
+static const qint64 ZLIB_CHUNK = 1 << 30;
+
+static quint32 zlibUpdate(quint32 crc, const uchar *data, qint64 size) {
+    while (size > 0) {
+        uInt count = uInt(qMin(size, ZLIB_CHUNK));
+        crc = quint32(crc32(crc, data, count));
+        data += count;
+        size -= count;
+    }
+    return crc;
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+// Folding constants for the reflected polynomial 0xEDB88320, as in Intel's
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ" paper
+alignas(16) static const quint64 K1K2[] = {0x0154442bd4, 0x01c6e41596};
+alignas(16) static const quint64 K3K4[] = {0x01751997d0, 0x00ccaa009e};
+alignas(16) static const quint64 K5K0[] = {0x0163cd6124, 0x0000000000};
+alignas(16) static const quint64 POLY[] = {0x01db710641, 0x01f7011641};
+
+// x folded over 128 bits onto next
+__attribute__((target("pclmul,sse4.1")))
+static inline __m128i foldInto(__m128i x, __m128i next, __m128i k) {
+    __m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(high, next), low);
+}
+
+// Folds four 128-bit lanes at a time; size is at least 64 and a multiple
+// of 16. crc is the inverted register, not a zlib-style value.
+__attribute__((target("pclmul,sse4.1")))
+static quint32 pclmulFold(quint32 crc, const uchar *data, qint64 size) {
+    const __m128i *in = reinterpret_cast<const __m128i *>(data);
+    __m128i x1 = _mm_loadu_si128(in + 0);
+    __m128i x2 = _mm_loadu_si128(in + 1);
+    __m128i x3 = _mm_loadu_si128(in + 2);
+    __m128i x4 = _mm_loadu_si128(in + 3);
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(K1K2));
+    in += 4;
+    size -= 64;
+
+    while (size >= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(in + 0));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(in + 1));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(in + 2));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(in + 3));
+        in += 4;
+        size -= 64;
+    }
+
+    // Four lanes into one, then whatever 16-byte blocks are left
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(K3K4));
+    x1 = foldInto(x1, x2, k);
+    x1 = foldInto(x1, x3, k);
+    x1 = foldInto(x1, x4, k);
+    while (size >= 16) {
+        x1 = foldInto(x1, _mm_loadu_si128(in), k);
+        ++in;
+        size -= 16;
+    }
+
+    // 128 bits to 64
+    __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), _mm_clmulepi64_si128(x1, k, 0x10));
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(K5K0));
+    __m128i high = _mm_srli_si128(x1, 4);
+    x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+    x1 = _mm_xor_si128(x1, high);
+
+    // Barrett reduction to 32 bits
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(POLY));
+    __m128i t = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+    t = _mm_clmulepi64_si128(_mm_and_si128(t, mask), k, 0x00);
+    x1 = _mm_xor_si128(x1, t);
+    return quint32(_mm_extract_epi32(x1, 1));
+}
+
+static quint32 pclmulUpdate(quint32 crc, const uchar *data, qint64 size) {
+    if (size >= 64) {
+        qint64 folded = size & ~qint64(15);
+        crc = ~pclmulFold(~crc, data, folded);
+        data += folded;
+        size -= folded;
+    }
+    return zlibUpdate(crc, data, size);
+}
+#endif
+
+#ifdef CRC32_HAVE_ARMV8
+// The ARMv8 CRC32 instructions use the ZIP polynomial (the CRC32C ones
+// do not)
+__attribute__((target("+crc")))
+static quint32 armv8Update(quint32 crc, const uchar *data, qint64 size) {
+    crc = ~crc;
+    while (size >= 8) {
+        quint64 word;
+        std::memcpy(&word, data, sizeof(word));
+        crc = __crc32d(crc, word);
+        data += 8;
+        size -= 8;
+    }
+    while (size > 0) {
+        crc = __crc32b(crc, *data++);
+        --size;
+    }
+    return ~crc;
+}
+#endif
+
+typedef quint32 (*UpdateFunction)(quint32, const uchar *, qint64);
+
+struct Implementation {
+    UpdateFunction update;
+    const char *name;
+};
+
+// Whether update agrees with zlib on every length up to past the folding
+// threshold, from unaligned starts and carried on from an earlier value.
+// A mistake in the folding constants would otherwise only show as every
+// archive failing its checks.
+static bool matchesZlib(UpdateFunction update) {
+    static const int MAX_LENGTH = 200;
+    static const int MAX_SHIFT = 16;
+    uchar buffer[MAX_LENGTH + MAX_SHIFT];
+    quint32 value = 0x12345678;
+    for (uchar &byte : buffer) {
+        value = value * 1103515245 + 12345;
+        byte = uchar(value >> 16);
+    }
+    for (int shift = 0; shift < MAX_SHIFT; ++shift) {
+        const uchar *data = buffer + shift;
+        for (int length = 0; length <= MAX_LENGTH; ++length) {
+            if (update(0, data, length) != zlibUpdate(0, data, length)) {
+                return false;
+            }
+            quint32 seed = zlibUpdate(0, buffer, shift + 1);
+            if (update(seed, data, length) != zlibUpdate(seed, data, length)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static Implementation detect() {
+#ifdef CRC32_HAVE_PCLMUL
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")
+        && matchesZlib(pclmulUpdate)) {
+        return {pclmulUpdate, "pclmul"};
+    }
+#endif
+#ifdef CRC32_HAVE_ARMV8
+    if ((getauxval(AT_HWCAP) & HWCAP_CRC32) && matchesZlib(armv8Update)) {
+        return {armv8Update, "armv8-crc"};
+    }
+#endif
+    return {zlibUpdate, "zlib"};
+}
+
+static const Implementation &selected() {
+    static const Implementation implementation = detect();
+    return implementation;
+}
+
+quint32 Crc32::update(quint32 crc, const uchar *data, qint64 size) {
+    return selected().update(crc, data, size);
+}
+
+const char *Crc32::implementation() {
+    return selected().name;
+}
@@ -0,0 +1,18 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <QtGlobal>
+
+// CRC-32 as used by ZIP and gzip, with zlib's conventions: start from 0
+// and pass the result of one call into the next. Uses carry-less
+// multiplication on x86-64 (PCLMULQDQ) and the CRC32 instructions on
+// ARMv8 when the CPU has them and they agree with zlib on a self-check
+// at first use, zlib's table-driven code otherwise.
+class Crc32 {
+public:
+    static quint32 update(quint32 crc, const uchar *data, qint64 size);
+    // Name of the implementation in use, for diagnostics
+    static const char *implementation();
+};
+
+#endif // CRC32_H
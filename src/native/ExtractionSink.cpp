@@ -0,0 +1,343 @@
+#include "ExtractionSink.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef LINRAR_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+// A batch goes to the pool once it reaches either limit
+static const int BATCH_FILES = 64;
+static const qint64 BATCH_BYTES = 4 * 1024 * 1024;
+// writeFile blocks while more than this waits to be written
+static const qint64 MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+static const int OPEN_FLAGS = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#ifdef LINRAR_HAVE_LIBURING
+// Each stage of a batch fits the ring in one go
+static const unsigned RING_ENTRIES = BATCH_FILES;
+
+// One ring per pool thread, set up on its first batch and released when
+// the thread ends
+struct Ring {
+    io_uring ring;
+    bool ready;
+
+    Ring() { ready = io_uring_queue_init(RING_ENTRIES, &ring, 0) == 0; }
+    ~Ring() { close(); }
+    void close() {
+        if (ready) {
+            io_uring_queue_exit(&ring);
+            ready = false;
+        }
+    }
+};
+
+// liburing may be there while the kernel is too old for these operations,
+// or a seccomp filter (as in many containers) refuses io_uring outright
+static bool ringUsable() {
+    static const bool usable = []() {
+        io_uring ring;
+        if (io_uring_queue_init(4, &ring, 0) != 0) {
+            return false;
+        }
+        bool supported = false;
+        io_uring_probe *probe = io_uring_get_probe_ring(&ring);
+        if (probe) {
+            supported = io_uring_opcode_supported(probe, IORING_OP_OPENAT)
+                && io_uring_opcode_supported(probe, IORING_OP_WRITE)
+                && io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+            io_uring_free_probe(probe);
+        }
+        io_uring_queue_exit(&ring);
+        return supported;
+    }();
+    return usable;
+}
+
+static io_uring_sqe *nextEntry(io_uring &ring, int index) {
+    io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(quintptr(index)));
+    return sqe;
+}
+
+// Submits the count entries queued and hands each completion to handle
+// with its index; 0, or -errno if the ring itself failed
+template <typename Handler>
+static int submitAndReap(io_uring &ring, int count, Handler handle) {
+    if (count == 0) {
+        return 0;
+    }
+    int submitted = io_uring_submit_and_wait(&ring, unsigned(count));
+    if (submitted < 0) {
+        return submitted;
+    }
+    for (int i = 0; i < submitted; ++i) {
+        io_uring_cqe *cqe = nullptr;
+        int status;
+        do {
+            status = io_uring_wait_cqe(&ring, &cqe);
+        } while (status == -EINTR);
+        if (status < 0) {
+            return status;
+        }
+        handle(int(reinterpret_cast<quintptr>(io_uring_cqe_get_data(cqe))), cqe->res);
+        io_uring_cqe_seen(&ring, cqe);
+    }
+    return submitted == count ? 0 : -EAGAIN;
+}
+#endif
+
+static bool writeAll(int fd, const QByteArray &data, qint64 pos) {
+    while (pos < data.size()) {
+        ssize_t count = pwrite(fd, data.constData() + pos, size_t(data.size() - pos), off_t(pos));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            if (count == 0) {
+                errno = EIO;
+            }
+            return false;
+        }
+        pos += count;
+    }
+    return true;
+}
+
+ExtractionSink::ExtractionSink(int threads)
+    : useRing(false), pendingBytes(0), queuedBytes(0), cancelled(false), failed(false) {
+#ifdef LINRAR_HAVE_LIBURING
+    useRing = ringUsable();
+#endif
+    // A ring keeps the disk busy on its own; a second covers the time the
+    // first spends waiting for its batch to complete
+    int workers = useRing ? qMin(threads, 2) : threads;
+    pool.setMaxThreadCount(qMax(1, workers));
+}
+
+ExtractionSink::~ExtractionSink() {
+    cancel();
+    pool.waitForDone();
+}
+
+const char *ExtractionSink::backend() const {
+    return useRing ? "io_uring" : "threads";
+}
+
+QString ExtractionSink::getLastError() const {
+    QMutexLocker locker(&mutex);
+    return lastError;
+}
+
+void ExtractionSink::fail(const File &file, int error) {
+    QMutexLocker locker(&mutex);
+    if (lastError.isEmpty()) {
+        lastError = QString("Cannot write %1: %2")
+            .arg(QFile::decodeName(file.path), QString::fromLocal8Bit(std::strerror(error)));
+    }
+    failed.store(true);
+    drained.wakeAll();
+}
+
+bool ExtractionSink::writeFile(const QString &path, const QByteArray &data, quint32 mode, qint64 mtime) {
+    File file;
+    file.path = QFile::encodeName(path);
+    file.data = data;
+    file.mode = mode;
+    file.mtime = mtime;
+
+    QMutexLocker locker(&mutex);
+    while (queuedBytes > MAX_QUEUED_BYTES && !isStopping()) {
+        drained.wait(&mutex);
+    }
+    if (isStopping()) {
+        return false;
+    }
+    pending.append(file);
+    pendingBytes += data.size();
+    queuedBytes += data.size();
+    if (pending.size() >= BATCH_FILES || pendingBytes >= BATCH_BYTES) {
+        dispatch();
+    }
+    return true;
+}
+
+bool ExtractionSink::finish() {
+    {
+        QMutexLocker locker(&mutex);
+        if (!pending.isEmpty() && !isStopping()) {
+            dispatch();
+        }
+    }
+    pool.waitForDone();
+    return !isStopping();
+}
+
+void ExtractionSink::cancel() {
+    QMutexLocker locker(&mutex);
+    cancelled.store(true);
+    pending.clear();
+    queuedBytes -= pendingBytes;
+    pendingBytes = 0;
+    drained.wakeAll();
+}
+
+void ExtractionSink::dispatch() {
+    Batch batch;
+    batch.swap(pending);
+    qint64 bytes = pendingBytes;
+    pendingBytes = 0;
+    pool.start(QRunnable::create([this, batch, bytes]() {
+        if (!isStopping()) {
+            writeBatch(batch);
+        }
+        QMutexLocker locker(&mutex);
+        queuedBytes -= bytes;
+        drained.wakeAll();
+    }));
+}
+
+void ExtractionSink::writeBatch(const Batch &batch) {
+#ifdef LINRAR_HAVE_LIBURING
+    if (useRing && writeWithRing(batch)) {
+        return;
+    }
+#endif
+    writeWithCalls(batch);
+}
+
+bool ExtractionSink::completeFile(int fd, const File &file, qint64 pos) {
+    if (!writeAll(fd, file.data, pos)) {
+        fail(file, errno);
+        return false;
+    }
+    if (file.mode != 0 && fchmod(fd, mode_t(file.mode & 0777)) != 0) {
+        fail(file, errno);
+        return false;
+    }
+    // Last, as every write moves the time again
+    if (file.mtime != NO_TIME) {
+        struct timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = time_t(file.mtime);
+        times[1].tv_nsec = 0;
+        if (futimens(fd, times) != 0) {
+            fail(file, errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ExtractionSink::writeWithCalls(const Batch &batch) {
+    for (const File &file : batch) {
+        if (isStopping()) {
+            return;
+        }
+        int fd = ::open(file.path.constData(), OPEN_FLAGS, 0666);
+        if (fd < 0) {
+            fail(file, errno);
+            return;
+        }
+        bool written = completeFile(fd, file, 0);
+        if (::close(fd) != 0 && written) {
+            fail(file, errno);
+            return;
+        }
+        if (!written) {
+            return;
+        }
+    }
+}
+
+bool ExtractionSink::writeWithRing(const Batch &batch) {
+#ifdef LINRAR_HAVE_LIBURING
+    static thread_local Ring local;
+    if (!local.ready) {
+        return false;
+    }
+    io_uring &ring = local.ring;
+    int count = batch.size();
+    QVector<int> fds(count, -1);
+    QVector<qint64> written(count, 0);
+    QVector<bool> usable(count, false);
+
+    // Opens, then writes, then closes, a whole batch per submission.
+    // io_uring has no chmod or utimes, so those are made between the
+    // writes and the closes, along with any short write left over.
+    for (int i = 0; i < count; ++i) {
+        io_uring_prep_openat(nextEntry(ring, i), AT_FDCWD, batch.at(i).path.constData(), OPEN_FLAGS, 0666);
+    }
+    int status = submitAndReap(ring, count, [&](int i, int result) {
+        if (result < 0) {
+            fail(batch.at(i), -result);
+        } else {
+            fds[i] = result;
+            usable[i] = true;
+        }
+    });
+
+    if (status == 0) {
+        int writes = 0;
+        for (int i = 0; i < count; ++i) {
+            const QByteArray &data = batch.at(i).data;
+            if (usable.at(i) && !data.isEmpty()) {
+                io_uring_prep_write(nextEntry(ring, i), fds.at(i), data.constData(), unsigned(data.size()), 0);
+                ++writes;
+            }
+        }
+        status = submitAndReap(ring, writes, [&](int i, int result) {
+            if (result < 0) {
+                fail(batch.at(i), -result);
+                usable[i] = false;
+            } else {
+                written[i] = result;
+            }
+        });
+    }
+
+    if (status == 0) {
+        int closes = 0;
+        for (int i = 0; i < count; ++i) {
+            if (fds.at(i) < 0) {
+                continue;
+            }
+            if (usable.at(i) && !isStopping()) {
+                completeFile(fds.at(i), batch.at(i), written.at(i));
+            }
+            io_uring_prep_close(nextEntry(ring, i), fds.at(i));
+            ++closes;
+        }
+        status = submitAndReap(ring, closes, [&](int i, int result) {
+            fds[i] = -1;
+            if (result < 0) {
+                fail(batch.at(i), -result);
+            }
+        });
+    }
+
+    if (status == 0) {
+        return true;
+    }
+    // The ring itself broke down: whatever it did not get to is closed
+    // here, and the batch is written again from the start without it,
+    // which the truncating opens make safe
+    for (int fd : fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    local.close();
+    return false;
+#else
+    Q_UNUSED(batch);
+    return false;
+#endif
+}
@@ -0,0 +1,82 @@
+#ifndef EXTRACTIONSINK_H
+#define EXTRACTIONSINK_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <limits>
+
+// Writes small extracted files in batches, away from the threads that
+// decode them. A member is handed over whole, with its mode and time, and
+// the caller moves on. With io_uring the opens, writes and closes of a
+// batch each go to the kernel in one submission; otherwise worker threads
+// write the files with plain system calls. Large members are not worth
+// holding in memory, so callers write those themselves.
+//
+// Batches may be written in any order, so no two files queued on one sink
+// may share a path.
+class ExtractionSink {
+public:
+    // Members up to this size go through the sink
+    static constexpr qint64 SMALL_FILE_LIMIT = 256 * 1024;
+    // Modification time that leaves the file's own alone
+    static constexpr qint64 NO_TIME = std::numeric_limits<qint64>::min();
+
+    // threads is the most the thread backend uses; io_uring needs fewer
+    explicit ExtractionSink(int threads);
+    ~ExtractionSink();
+
+    // Queues path to be created or truncated and filled with data, then
+    // given mode (permission bits, 0 keeps the default) and mtime (seconds
+    // since the epoch). Blocks while too much is waiting to be written.
+    // Thread-safe; false once the sink has failed or been cancelled.
+    bool writeFile(const QString &path, const QByteArray &data, quint32 mode, qint64 mtime);
+    // Writes what is still queued and waits for every batch; false if any
+    // file could not be written
+    bool finish();
+    // Thread-safe: whatever is still queued is dropped
+    void cancel();
+
+    bool hasFailed() const { return failed.load(); }
+    QString getLastError() const;
+    // "io_uring" or "threads"
+    const char *backend() const;
+
+private:
+    struct File {
+        QByteArray path;   // encoded for the file system
+        QByteArray data;
+        quint32 mode;
+        qint64 mtime;
+    };
+    typedef QVector<File> Batch;
+
+    // Hands pending to the pool; mutex held
+    void dispatch();
+    void writeBatch(const Batch &batch);
+    void writeWithCalls(const Batch &batch);
+    bool writeWithRing(const Batch &batch);
+    // Writes what is left after pos, then applies mode and time
+    bool completeFile(int fd, const File &file, qint64 pos);
+    bool isStopping() const { return cancelled.load() || failed.load(); }
+    void fail(const File &file, int error);
+
+    QThreadPool pool;
+    bool useRing;
+
+    mutable QMutex mutex;
+    QWaitCondition drained;
+    Batch pending;
+    qint64 pendingBytes;
+    qint64 queuedBytes;     // pending plus handed to the pool, not yet written
+    QString lastError;
+
+    std::atomic<bool> cancelled;
+    std::atomic<bool> failed;
+};
+
+#endif // EXTRACTIONSINK_H
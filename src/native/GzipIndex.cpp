@@ -0,0 +1,381 @@
+#include "GzipIndex.h"
+#include <QDataStream>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// Deflate refers back at most this far
+static const int WINDOW_SIZE = 32768;
+static const qint64 INPUT_SIZE = 256 * 1024;
+// Checkpoints cost up to 32 KiB each, so the span grows with the archive
+// to keep huge ones at around a thousand checkpoints per compressed ratio
+static const qint64 MIN_SPAN = 4 * 1024 * 1024;
+static const qint64 SPAN_DIVISOR = 1024;
+// windowBits for zlib: gzip or zlib header, detected
+static const int AUTO_HEADER = 15 + 32;
+
+static const quint32 INDEX_MAGIC = 0x4C475A49; // "LGZI"
+static const quint32 INDEX_VERSION = 1;
+
+GzipIndex::GzipIndex(const QString &archivePath)
+    : span(MIN_SPAN), complete(false) {
+    cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                     + "/linrar/index";
+    struct stat info;
+    if (::stat(QFile::encodeName(archivePath).constData(), &info) != 0) {
+        return;
+    }
+    span = qMax(MIN_SPAN, qint64(info.st_size) / SPAN_DIVISOR);
+    cachePrefix = QString("%1-%2-").arg(quint64(info.st_dev), 0, 16).arg(quint64(info.st_ino), 0, 16);
+    cacheName = cachePrefix + QString("%1-%2.%3.gzi")
+                                  .arg(quint64(info.st_size), 0, 16)
+                                  .arg(quint64(info.st_mtim.tv_sec), 0, 16)
+                                  .arg(quint64(info.st_mtim.tv_nsec), 0, 16);
+}
+
+bool GzipIndex::load() {
+    if (cacheName.isEmpty()) {
+        return false;
+    }
+    QFile file(cacheDirectory + "/" + cacheName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        return false;
+    }
+
+    qint64 storedSpan = 0;
+    qint32 checkpointCount = 0;
+    stream >> storedSpan >> checkpointCount;
+    QVector<GzipCheckpoint> storedCheckpoints;
+    for (qint32 i = 0; i < checkpointCount && stream.status() == QDataStream::Ok; ++i) {
+        GzipCheckpoint checkpoint;
+        qint32 bits = 0;
+        stream >> checkpoint.out >> checkpoint.in >> bits >> checkpoint.memberStart >> checkpoint.window;
+        checkpoint.bits = bits;
+        storedCheckpoints.append(checkpoint);
+    }
+
+    qint32 memberCount = 0;
+    stream >> memberCount;
+    QVector<TarMember> storedMembers;
+    for (qint32 i = 0; i < memberCount && stream.status() == QDataStream::Ok; ++i) {
+        TarMember member;
+        qint8 type = 0;
+        stream >> member.name >> member.linkTarget >> member.size >> member.mode >> member.mtime
+               >> type >> member.headerOffset >> member.dataOffset;
+        member.type = char(type);
+        storedMembers.append(member);
+    }
+    if (stream.status() != QDataStream::Ok || storedSpan <= 0) {
+        return false;
+    }
+
+    span = storedSpan;
+    checkpoints = storedCheckpoints;
+    members = storedMembers;
+    complete = true;
+    return true;
+}
+
+bool GzipIndex::save() const {
+    if (cacheName.isEmpty() || !complete || !QDir().mkpath(cacheDirectory)) {
+        return false;
+    }
+    QDir directory(cacheDirectory);
+    for (const QString &stale : directory.entryList(QStringList() << cachePrefix + "*", QDir::Files)) {
+        directory.remove(stale);
+    }
+
+    QSaveFile file(cacheDirectory + "/" + cacheName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << INDEX_MAGIC << INDEX_VERSION << span << qint32(checkpoints.size());
+    for (const GzipCheckpoint &checkpoint : checkpoints) {
+        stream << checkpoint.out << checkpoint.in << qint32(checkpoint.bits)
+               << checkpoint.memberStart << checkpoint.window;
+    }
+    stream << qint32(members.size());
+    for (const TarMember &member : members) {
+        stream << member.name << member.linkTarget << member.size << member.mode << member.mtime
+               << qint8(member.type) << member.headerOffset << member.dataOffset;
+    }
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+const GzipCheckpoint *GzipIndex::checkpointFor(qint64 offset) const {
+    auto next = std::upper_bound(checkpoints.cbegin(), checkpoints.cend(), offset,
+                                 [](qint64 value, const GzipCheckpoint &checkpoint) {
+        return value < checkpoint.out;
+    });
+    if (next == checkpoints.cbegin()) {
+        return nullptr;
+    }
+    return &*(next - 1);
+}
+
+qint64 GzipIndex::coveredUntil() const {
+    return checkpoints.isEmpty() ? 0 : checkpoints.last().out;
+}
+
+void GzipIndex::addCheckpoint(const GzipCheckpoint &checkpoint) {
+    checkpoints.append(checkpoint);
+}
+
+void GzipIndex::setMembers(const QVector<TarMember> &members) {
+    this->members = members;
+    complete = true;
+}
+
+GzipSource::GzipSource(const QString &archivePath, GzipIndex *index)
+    : file(archivePath), index(index), stream(nullptr), inputEnd(0),
+      windowPos(0), windowWrapped(false), pendingStart(0), pendingCount(0),
+      outOffset(0), raw(false), ended(false) {
+}
+
+GzipSource::~GzipSource() {
+    if (stream) {
+        inflateEnd(stream);
+        delete stream;
+    }
+}
+
+bool GzipSource::fail(const QString &message) {
+    lastError = message;
+    return false;
+}
+
+bool GzipSource::open() {
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(file.errorString());
+    }
+    stream = new z_stream;
+    std::memset(stream, 0, sizeof(z_stream));
+    if (inflateInit2(stream, AUTO_HEADER) != Z_OK) {
+        delete stream;
+        stream = nullptr;
+        return fail("Cannot initialize decompressor");
+    }
+    input.resize(int(INPUT_SIZE));
+    window.resize(WINDOW_SIZE);
+    return restart(nullptr);
+}
+
+qint64 GzipSource::compressedOffset() const {
+    return inputEnd - qint64(stream ? stream->avail_in : 0);
+}
+
+bool GzipSource::restart(const GzipCheckpoint *checkpoint) {
+    windowPos = 0;
+    windowWrapped = false;
+    pendingStart = 0;
+    pendingCount = 0;
+    ended = false;
+    stream->avail_in = 0;
+
+    raw = checkpoint && !checkpoint->memberStart;
+    inflateReset2(stream, raw ? -MAX_WBITS : AUTO_HEADER);
+    qint64 start = checkpoint ? checkpoint->in : 0;
+    // A partly consumed byte is read again and its remaining bits primed
+    if (raw && checkpoint->bits > 0) {
+        --start;
+    }
+    if (!file.seek(start)) {
+        return fail(file.errorString());
+    }
+    inputEnd = start;
+    outOffset = checkpoint ? checkpoint->out : 0;
+    if (!raw) {
+        return true;
+    }
+
+    if (checkpoint->bits > 0) {
+        if (!fillInput() || stream->avail_in == 0) {
+            return fail("Unexpected end of compressed data");
+        }
+        int byte = *stream->next_in;
+        ++stream->next_in;
+        --stream->avail_in;
+        inflatePrime(stream, checkpoint->bits, byte >> (8 - checkpoint->bits));
+    }
+    QByteArray history = qUncompress(checkpoint->window);
+    if (history.size() > WINDOW_SIZE
+        || inflateSetDictionary(stream, reinterpret_cast<const Bytef *>(history.constData()),
+                                uInt(history.size())) != Z_OK) {
+        return fail("Damaged archive index");
+    }
+    // Later checkpoints need the history too
+    std::memcpy(window.data(), history.constData(), size_t(history.size()));
+    windowPos = history.size();
+    return true;
+}
+
+bool GzipSource::fillInput() {
+    if (stream->avail_in > 0) {
+        return true;
+    }
+    if (progressCallback && !progressCallback(inputEnd)) {
+        return fail("Cancelled");
+    }
+    qint64 count = file.read(input.data(), input.size());
+    if (count < 0) {
+        return fail(file.errorString());
+    }
+    inputEnd += count;
+    stream->next_in = reinterpret_cast<Bytef *>(input.data());
+    stream->avail_in = uInt(count);
+    return true;
+}
+
+bool GzipSource::skipInput(qint64 count) {
+    while (count > 0) {
+        if (!fillInput()) {
+            return false;
+        }
+        if (stream->avail_in == 0) {
+            return fail("Unexpected end of compressed data");
+        }
+        uInt step = uInt(qMin<qint64>(count, stream->avail_in));
+        stream->next_in += step;
+        stream->avail_in -= step;
+        count -= step;
+    }
+    return true;
+}
+
+bool GzipSource::inflateMore() {
+    if (windowPos == WINDOW_SIZE) {
+        windowPos = 0;
+        windowWrapped = true;
+    }
+    if (!fillInput()) {
+        return false;
+    }
+    if (stream->avail_in == 0) {
+        return fail("Unexpected end of compressed data");
+    }
+
+    uInt room = uInt(WINDOW_SIZE - windowPos);
+    stream->next_out = reinterpret_cast<Bytef *>(window.data() + windowPos);
+    stream->avail_out = room;
+    // Z_BLOCK stops at every deflate block boundary, where checkpoints go
+    int status = inflate(stream, Z_BLOCK);
+    if (status == Z_MEM_ERROR) {
+        return fail("Out of memory");
+    }
+    if (status == Z_NEED_DICT || status == Z_DATA_ERROR || status == Z_STREAM_ERROR) {
+        return fail("Corrupt compressed data");
+    }
+
+    int produced = int(room - stream->avail_out);
+    pendingStart = windowPos;
+    pendingCount = produced;
+    windowPos += produced;
+    outOffset += produced;
+
+    if (status == Z_STREAM_END) {
+        return startNextMember();
+    }
+    // Bit 7: at a block boundary; bit 6: after the last block
+    if ((stream->data_type & 128) && !(stream->data_type & 64)) {
+        takeCheckpoint(false);
+    }
+    return true;
+}
+
+bool GzipSource::startNextMember() {
+    // Raw inflate stops in front of the CRC and size trailer
+    if (raw && !skipInput(8)) {
+        return false;
+    }
+    if (!fillInput()) {
+        return false;
+    }
+    // Anything but another gzip member is padding, which gzip ignores too
+    if (stream->avail_in == 0 || stream->next_in[0] != 0x1f) {
+        ended = true;
+        return true;
+    }
+    raw = false;
+    inflateReset2(stream, AUTO_HEADER);
+    takeCheckpoint(true);
+    return true;
+}
+
+void GzipSource::takeCheckpoint(bool memberStart) {
+    if (!index || index->isComplete() || outOffset < index->coveredUntil() + index->getSpan()) {
+        return;
+    }
+    GzipCheckpoint checkpoint;
+    checkpoint.out = outOffset;
+    checkpoint.in = compressedOffset();
+    checkpoint.memberStart = memberStart;
+    if (!memberStart) {
+        checkpoint.bits = stream->data_type & 7;
+        QByteArray history = windowWrapped ? window.mid(windowPos) + window.left(windowPos)
+                                           : window.left(windowPos);
+        checkpoint.window = qCompress(history);
+    }
+    index->addCheckpoint(checkpoint);
+}
+
+qint64 GzipSource::read(char *buffer, qint64 size) {
+    qint64 done = 0;
+    while (done < size) {
+        if (pendingCount == 0) {
+            if (ended) {
+                break;
+            }
+            if (!inflateMore()) {
+                return -1;
+            }
+            continue;
+        }
+        int count = int(qMin<qint64>(pendingCount, size - done));
+        // No buffer: skipping forward
+        if (buffer) {
+            std::memcpy(buffer + done, window.constData() + pendingStart, size_t(count));
+        }
+        pendingStart += count;
+        pendingCount -= count;
+        done += count;
+    }
+    return done;
+}
+
+bool GzipSource::seek(qint64 offset) {
+    if (offset == position()) {
+        return true;
+    }
+    const GzipCheckpoint *checkpoint = index ? index->checkpointFor(offset) : nullptr;
+    // Backwards, or past a checkpoint: resuming there beats decompressing
+    // everything in between
+    if (offset < position() || (checkpoint && checkpoint->out > position())) {
+        if (!restart(checkpoint)) {
+            return false;
+        }
+    }
+    qint64 gap = offset - position();
+    qint64 skipped = read(nullptr, gap);
+    if (skipped < 0) {
+        return false;
+    }
+    if (skipped != gap) {
+        return fail("Unexpected end of compressed data");
+    }
+    return true;
+}
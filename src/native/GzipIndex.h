@@ -0,0 +1,111 @@
+#ifndef GZIPINDEX_H
+#define GZIPINDEX_H
+
+#include "TarReader.h"
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QFile>
+#include <functional>
+
+struct z_stream_s;
+
+// A place in a gzip stream where decompression can resume: the deflate
+// block boundary at uncompressed offset out, and the 32 KiB of output
+// before it that the following blocks may refer back to
+struct GzipCheckpoint {
+    qint64 out = 0;
+    qint64 in = 0;           // first compressed byte not fully consumed
+    int bits = 0;            // bits of the byte before in still unread, 0-7
+    bool memberStart = false; // a new gzip member starts at in, no window needed
+    QByteArray window;       // qCompress()ed
+};
+
+// Random access into a .tar.gz, in the manner of zlib's zran example:
+// checkpoints taken every span bytes while the archive is first read, plus
+// the tar members found on the way. Kept in the user's cache directory,
+// keyed by device, inode, size and mtime, so a changed archive never gets
+// a stale index.
+class GzipIndex {
+public:
+    explicit GzipIndex(const QString &archivePath);
+
+    // Reads the cached index; false if there is none for this exact file
+    bool load();
+    // Writes the index to the cache, replacing those of older versions
+    // of the file
+    bool save() const;
+
+    qint64 getSpan() const { return span; }
+    // Last checkpoint at or before offset, nullptr to start from the top
+    const GzipCheckpoint *checkpointFor(qint64 offset) const;
+    // Uncompressed offset up to which checkpoints have been taken
+    qint64 coveredUntil() const;
+    void addCheckpoint(const GzipCheckpoint &checkpoint);
+
+    // Complete once the listing that built it got through the whole archive
+    bool isComplete() const { return complete; }
+    const QVector<TarMember> &getMembers() const { return members; }
+    void setMembers(const QVector<TarMember> &members);
+
+private:
+    QString cacheDirectory;
+    QString cacheName;   // empty when the file cannot be identified
+    QString cachePrefix; // shared by all versions of the same file
+    qint64 span;
+    bool complete;
+    QVector<GzipCheckpoint> checkpoints;
+    QVector<TarMember> members;
+};
+
+// The decompressed stream of a .tar.gz for TarReader. Seeking jumps to the
+// nearest checkpoint of index and decompresses only from there; reading
+// beyond what the index covers adds checkpoints to it.
+class GzipSource : public TarSource {
+public:
+    GzipSource(const QString &archivePath, GzipIndex *index);
+    ~GzipSource() override;
+
+    bool open() override;
+    bool seek(qint64 offset) override;
+    qint64 read(char *buffer, qint64 size) override;
+    QString errorString() const override { return lastError; }
+
+    // Compressed bytes consumed so far
+    qint64 compressedOffset() const;
+    // Called as input is consumed with compressedOffset(); returning false
+    // aborts the read or seek in progress
+    void setProgressCallback(const std::function<bool(qint64)> &callback) { progressCallback = callback; }
+
+private:
+    bool fail(const QString &message);
+    qint64 position() const { return outOffset - pendingCount; }
+    // Resets the decompressor to checkpoint, or to the start for nullptr
+    bool restart(const GzipCheckpoint *checkpoint);
+    bool fillInput();
+    bool skipInput(qint64 count);
+    // Decompresses the next piece into the window; sets ended at the end
+    bool inflateMore();
+    bool startNextMember();
+    void takeCheckpoint(bool memberStart);
+
+    QFile file;
+    GzipIndex *index;
+    z_stream_s *stream;
+    QByteArray input;
+    qint64 inputEnd;      // compressed offset just past the buffered input
+    // The last 32 KiB of output, written in a circle; fresh output waits
+    // in it at pendingStart until read
+    QByteArray window;
+    int windowPos;
+    bool windowWrapped;
+    int pendingStart;
+    int pendingCount;
+    qint64 outOffset;
+    bool raw;             // resumed mid-member: no gzip header or trailer handling
+    bool ended;
+    std::function<bool(qint64)> progressCallback;
+    QString lastError;
+};
+
+#endif // GZIPINDEX_H
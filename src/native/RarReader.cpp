@@ -0,0 +1,573 @@
+#include "RarReader.h"
+#include "../utils/ArchiveUtils.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegularExpression>
+#include <QtEndian>
+
+// Common to both versions; the byte after it tells them apart
+static const char SIGNATURE_PREFIX[] = "Rar!\x1a\x07";
+static const int SIGNATURE_PREFIX_SIZE = 6;
+static const int RAR4_SIGNATURE_SIZE = 7;
+static const int RAR5_SIGNATURE_SIZE = 8;
+// Self-extracting archives have the stub in front of the signature
+static const qint64 MAX_SFX_SIZE = 1024 * 1024;
+
+// RAR 4.x block types and flags
+static const uchar HEAD4_MAIN = 0x73;
+static const uchar HEAD4_FILE = 0x74;
+static const uchar HEAD4_ENDARC = 0x7b;
+static const quint16 LONG_BLOCK = 0x8000;
+static const quint16 MHD_VOLUME = 0x0001;
+static const quint16 MHD_SOLID = 0x0008;
+static const quint16 MHD_NEWNUMBERING = 0x0010;
+static const quint16 MHD_PASSWORD = 0x0080;
+static const quint16 LHD_SPLIT_BEFORE = 0x0001;
+static const quint16 LHD_SPLIT_AFTER = 0x0002;
+static const quint16 LHD_PASSWORD = 0x0004;
+static const quint16 LHD_SOLID = 0x0010;
+static const quint16 LHD_WINDOWMASK = 0x00e0;
+static const quint16 LHD_DIRECTORY = 0x00e0;
+static const quint16 LHD_LARGE = 0x0100;
+static const quint16 LHD_UNICODE = 0x0200;
+static const quint16 EARC_NEXT_VOLUME = 0x0001;
+static const int RAR4_BASE_SIZE = 7;
+static const int RAR4_FILE_SIZE = 32;
+static const int RAR4_HOST_UNIX = 3;
+
+// RAR5 header types and flags
+static const quint64 HEAD5_MAIN = 1;
+static const quint64 HEAD5_FILE = 2;
+static const quint64 HEAD5_CRYPT = 4;
+static const quint64 HEAD5_ENDARC = 5;
+static const quint64 HFL_EXTRA = 0x0001;
+static const quint64 HFL_DATA = 0x0002;
+static const quint64 HFL_SPLIT_BEFORE = 0x0008;
+static const quint64 HFL_SPLIT_AFTER = 0x0010;
+static const quint64 MHFL_VOLUME = 0x0001;
+static const quint64 MHFL_SOLID = 0x0004;
+static const quint64 FHFL_DIRECTORY = 0x0001;
+static const quint64 FHFL_UTIME = 0x0002;
+static const quint64 FHFL_CRC32 = 0x0004;
+static const quint64 FHFL_UNPUNKNOWN = 0x0008;
+static const quint64 FCI_SOLID = 0x0040;
+static const quint64 FHEXTRA_CRYPT = 1;
+static const quint64 FHEXTRA_HTIME = 3;
+static const quint64 FHEXTRA_HTIME_UNIXTIME = 0x0001;
+static const quint64 FHEXTRA_HTIME_MTIME = 0x0002;
+static const quint64 EHFL_NEXTVOLUME = 0x0001;
+static const quint64 RAR5_HOST_UNIX = 1;
+// The format caps headers at 2 MB, which also bounds the size field
+static const quint64 MAX_RAR5_HEADER_SIZE = 2 * 1024 * 1024;
+static const int MAX_VINT_SIZE = 10;
+// Seconds between 1601-01-01 (Windows FILETIME) and the Unix epoch
+static const qint64 FILETIME_EPOCH_OFFSET = 11644473600LL;
+
+static inline quint16 read16(const uchar *p) { return qFromLittleEndian<quint16>(p); }
+static inline quint32 read32(const uchar *p) { return qFromLittleEndian<quint32>(p); }
+static inline quint64 read64(const uchar *p) { return qFromLittleEndian<quint64>(p); }
+
+// RAR5 variable-length integer: 7 bits per byte, high bit means more follow
+static bool readVint(const uchar *data, int size, int &pos, quint64 &value) {
+    value = 0;
+    for (int shift = 0; shift < 7 * MAX_VINT_SIZE && pos < size; shift += 7) {
+        uchar byte = data[pos++];
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const qint64 NO_SIGNATURE = -1;
+static const qint64 UNSUPPORTED_VERSION = -2;
+
+// Offset of the first header, just past the signature, or one of the two
+// codes above; a self-extracting stub may precede the signature
+static qint64 findHeaders(const ArchiveSource &source, bool &isRar5) {
+    QByteArray head = source.span(0, MAX_SFX_SIZE).bytes();
+    int start = head.indexOf(QByteArray(SIGNATURE_PREFIX, SIGNATURE_PREFIX_SIZE));
+    if (start < 0 || start + RAR4_SIGNATURE_SIZE > head.size()) {
+        return NO_SIGNATURE;
+    }
+    char version = head.at(start + SIGNATURE_PREFIX_SIZE);
+    if (version == 1 && start + RAR5_SIGNATURE_SIZE <= head.size()
+        && head.at(start + RAR4_SIGNATURE_SIZE) == 0) {
+        isRar5 = true;
+        return start + RAR5_SIGNATURE_SIZE;
+    }
+    if (version != 0) {
+        return UNSUPPORTED_VERSION;
+    }
+    isRar5 = false;
+    return start + RAR4_SIGNATURE_SIZE;
+}
+
+static QDateTime fromDosTime(quint32 value) {
+    QDate date(1980 + int(value >> 25), (value >> 21) & 0xf, (value >> 16) & 0x1f);
+    QTime time((value >> 11) & 0x1f, (value >> 5) & 0x3f, (value & 0x1f) * 2);
+    return QDateTime(date, time);
+}
+
+// RAR 4.x names without the Unicode flag are in the creator's OEM or ANSI
+// codepage; Unix builds write UTF-8, anything else is taken as Latin-1
+static QString decodeLegacyName(const QByteArray &name) {
+    QString decoded = QString::fromUtf8(name);
+    if (decoded.contains(QChar::ReplacementCharacter)) {
+        return QString::fromLatin1(name);
+    }
+    return decoded;
+}
+
+// With the Unicode flag the name is either plain UTF-8, or an 8-bit name,
+// a zero byte and a compact UTF-16 encoding that refers back to it
+static QString decodeRar4Name(const uchar *data, int size, bool unicode) {
+    int length = int(qstrnlen(reinterpret_cast<const char *>(data), size));
+    QByteArray plain(reinterpret_cast<const char *>(data), length);
+    if (!unicode) {
+        return decodeLegacyName(plain);
+    }
+    if (length + 1 >= size) {
+        return QString::fromUtf8(plain);
+    }
+
+    const uchar *encoded = data + length + 1;
+    int encodedSize = size - length - 1;
+    int pos = 0;
+    QString result;
+    uchar highByte = encoded[pos++];
+    uchar flags = 0;
+    int flagBits = 0;
+    while (pos < encodedSize) {
+        if (flagBits == 0) {
+            flags = encoded[pos++];
+            flagBits = 8;
+            if (pos >= encodedSize) {
+                break;
+            }
+        }
+        switch (flags >> 6) {
+            case 0:
+                result += QChar(ushort(encoded[pos++]));
+                break;
+            case 1:
+                result += QChar(ushort(encoded[pos++] | (highByte << 8)));
+                break;
+            case 2:
+                if (pos + 1 >= encodedSize) {
+                    return result;
+                }
+                result += QChar(ushort(encoded[pos] | (encoded[pos + 1] << 8)));
+                pos += 2;
+                break;
+            default: {
+                // A run copied from the 8-bit name, optionally shifted
+                int count = encoded[pos++];
+                if (count & 0x80) {
+                    if (pos >= encodedSize) {
+                        return result;
+                    }
+                    uchar correction = encoded[pos++];
+                    for (count = (count & 0x7f) + 2; count > 0 && result.size() < length; --count) {
+                        uchar byte = uchar(plain.at(result.size()));
+                        result += QChar(ushort(((byte + correction) & 0xff) | (highByte << 8)));
+                    }
+                } else {
+                    for (count += 2; count > 0 && result.size() < length; --count) {
+                        result += QChar(ushort(uchar(plain.at(result.size()))));
+                    }
+                }
+                break;
+            }
+        }
+        flags <<= 2;
+        flagBits -= 2;
+    }
+    return result;
+}
+
+QString RarEntry::permissions() const {
+    if (!unixHost) {
+        return QString();
+    }
+    return ArchiveUtils::formatPermissions(attributes);
+}
+
+RarReader::RarReader(const QString &archivePath)
+    : archivePath(archivePath), rar5(false), solid(false), multiVolume(false), newNumbering(false) {
+}
+
+bool RarReader::fail(const QString &message) {
+    lastError = message;
+    return false;
+}
+
+bool RarReader::open() {
+    entries.clear();
+    volumes.clear();
+    lastError.clear();
+    rar5 = false;
+    solid = false;
+    multiVolume = false;
+    newNumbering = false;
+
+    QString path = archivePath;
+    for (int volume = 0; ; ++volume) {
+        // A missing volume ends the listing; extraction will name it
+        if (volume > 0 && !QFile::exists(path)) {
+            break;
+        }
+        bool hasNext = false;
+        if (!readVolume(path, volume, hasNext)) {
+            return false;
+        }
+        volumes.append(path);
+        if (!hasNext || !multiVolume) {
+            break;
+        }
+        path = nextVolumeName(path);
+        if (path.isEmpty()) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool RarReader::canRead() const {
+    QSharedPointer<ArchiveSource> source = ArchiveSource::open(archivePath);
+    if (!source) {
+        return false;
+    }
+    bool isRar5 = false;
+    qint64 pos = findHeaders(*source, isRar5);
+    if (pos < 0) {
+        return false;
+    }
+    if (isRar5) {
+        // An encryption header, if any, comes first and hides everything after it
+        ArchiveSpan prefix = source->span(pos, 4 + 3 + MAX_VINT_SIZE);
+        int offset = 4;
+        quint64 headerSize = 0;
+        quint64 type = 0;
+        return readVint(prefix.data, int(prefix.size), offset, headerSize)
+            && readVint(prefix.data, int(prefix.size), offset, type)
+            && type != HEAD5_CRYPT;
+    }
+    // The main header comes first and says whether the headers are encrypted
+    ArchiveSpan header = source->span(pos, RAR4_BASE_SIZE);
+    return header.size == RAR4_BASE_SIZE && header.data[2] == HEAD4_MAIN
+        && !(read16(header.data + 3) & MHD_PASSWORD);
+}
+
+bool RarReader::readVolume(const QString &path, int volume, bool &hasNext) {
+    QString error;
+    QSharedPointer<ArchiveSource> source = ArchiveSource::open(path, &error);
+    if (!source) {
+        return fail(error);
+    }
+    // Listing hops from header to header over the packed data
+    source->advise(ArchiveSource::Random);
+
+    bool isRar5 = false;
+    qint64 pos = findHeaders(*source, isRar5);
+    if (pos == NO_SIGNATURE) {
+        return fail(volume == 0 ? QString("Not a RAR archive")
+                                : QString("%1 is not a RAR volume").arg(path));
+    }
+    if (pos == UNSUPPORTED_VERSION) {
+        return fail("Unsupported RAR version");
+    }
+    if (volume == 0) {
+        rar5 = isRar5;
+    } else if (isRar5 != rar5) {
+        return fail(QString("%1 does not belong to this archive").arg(path));
+    }
+
+    return rar5 ? readRar5Headers(*source, pos, volume, hasNext)
+                : readRar4Headers(*source, pos, volume, hasNext);
+}
+
+bool RarReader::readRar4Headers(const ArchiveSource &source, qint64 pos, int volume, bool &hasNext) {
+    bool sawEnd = false;
+    while (true) {
+        ArchiveSpan header = source.span(pos, RAR4_BASE_SIZE);
+        // Archives from old versions simply stop without an end block
+        if (header.size < RAR4_BASE_SIZE) {
+            break;
+        }
+        const uchar *base = header.data;
+        uchar type = base[2];
+        quint16 flags = read16(base + 3);
+        int headSize = read16(base + 5);
+        if (headSize < RAR4_BASE_SIZE) {
+            return fail(QString("Damaged block header at offset %1").arg(pos));
+        }
+        header = source.span(pos, headSize);
+        if (header.size < headSize) {
+            return fail(QString("Truncated block header at offset %1").arg(pos));
+        }
+        const uchar *h = header.data;
+
+        qint64 dataSize = 0;
+        if (flags & LONG_BLOCK) {
+            if (headSize < RAR4_BASE_SIZE + 4) {
+                return fail(QString("Damaged block header at offset %1").arg(pos));
+            }
+            dataSize = read32(h + RAR4_BASE_SIZE);
+        }
+
+        if (type == HEAD4_MAIN) {
+            if (flags & MHD_PASSWORD) {
+                return fail("Archive headers are encrypted");
+            }
+            multiVolume = multiVolume || (flags & MHD_VOLUME);
+            solid = solid || (flags & MHD_SOLID);
+            if (volume == 0) {
+                newNumbering = flags & MHD_NEWNUMBERING;
+            }
+        } else if (type == HEAD4_FILE) {
+            if (headSize < RAR4_FILE_SIZE) {
+                return fail(QString("Damaged file header at offset %1").arg(pos));
+            }
+            qint64 unpacked = read32(h + 11);
+            int nameOffset = RAR4_FILE_SIZE;
+            if (flags & LHD_LARGE) {
+                if (headSize < RAR4_FILE_SIZE + 8) {
+                    return fail(QString("Damaged file header at offset %1").arg(pos));
+                }
+                dataSize = qint64(quint64(dataSize) | quint64(read32(h + 32)) << 32);
+                unpacked = qint64(quint64(unpacked) | quint64(read32(h + 36)) << 32);
+                nameOffset += 8;
+            }
+            int nameSize = read16(h + 26);
+            if (nameOffset + nameSize > headSize) {
+                return fail(QString("Damaged file header at offset %1").arg(pos));
+            }
+
+            RarEntry entry;
+            entry.unixHost = h[15] == RAR4_HOST_UNIX;
+            entry.name = decodeRar4Name(h + nameOffset, nameSize, flags & LHD_UNICODE);
+            if (!entry.unixHost) {
+                entry.name.replace('\\', '/');
+            }
+            entry.size = unpacked;
+            entry.packedSize = dataSize;
+            entry.crc32 = read32(h + 16);
+            entry.modified = fromDosTime(read32(h + 20));
+            entry.attributes = read32(h + 28);
+            entry.directory = (flags & LHD_WINDOWMASK) == LHD_DIRECTORY;
+            entry.encrypted = flags & LHD_PASSWORD;
+            entry.solid = flags & LHD_SOLID;
+            entry.splitBefore = flags & LHD_SPLIT_BEFORE;
+            entry.splitAfter = flags & LHD_SPLIT_AFTER;
+            entry.firstVolume = volume;
+            entry.lastVolume = volume;
+            entry.headerOffset = pos;
+            addEntry(entry);
+        } else if (type == HEAD4_ENDARC) {
+            sawEnd = true;
+            hasNext = flags & EARC_NEXT_VOLUME;
+            break;
+        }
+
+        // Packed data never runs past the end of its volume
+        if (dataSize < 0 || dataSize > source.size() - pos - headSize) {
+            return fail(QString("Damaged block header at offset %1").arg(pos));
+        }
+        pos += headSize + dataSize;
+    }
+
+    // Volumes written before end blocks existed give no hint; keep going
+    // while the next one is there
+    if (!sawEnd) {
+        hasNext = multiVolume;
+    }
+    return true;
+}
+
+bool RarReader::readRar5Headers(const ArchiveSource &source, qint64 pos, int volume, bool &hasNext) {
+    newNumbering = true;
+    while (true) {
+        // CRC32 and the header size, which takes at most three bytes
+        ArchiveSpan prefix = source.span(pos, 4 + 3);
+        if (prefix.isEmpty()) {
+            break;
+        }
+        int offset = 4;
+        quint64 headerSize = 0;
+        if (!readVint(prefix.data, int(prefix.size), offset, headerSize)
+            || headerSize == 0 || headerSize > MAX_RAR5_HEADER_SIZE) {
+            return fail(QString("Damaged header at offset %1").arg(pos));
+        }
+        qint64 headerStart = pos + offset;
+        ArchiveSpan header = source.span(headerStart, qint64(headerSize));
+        if (header.size != qint64(headerSize)) {
+            return fail(QString("Truncated header at offset %1").arg(pos));
+        }
+
+        const uchar *h = header.data;
+        int size = int(header.size);
+        int hp = 0;
+        quint64 type = 0;
+        quint64 flags = 0;
+        quint64 extraSize = 0;
+        quint64 dataSize = 0;
+        qint64 dataStart = headerStart + qint64(headerSize);
+        // Packed data never runs past the end of its volume
+        if (!readVint(h, size, hp, type) || !readVint(h, size, hp, flags)
+            || ((flags & HFL_EXTRA) && !readVint(h, size, hp, extraSize))
+            || ((flags & HFL_DATA) && !readVint(h, size, hp, dataSize))
+            || extraSize > quint64(size - hp) || dataSize > quint64(source.size() - dataStart)) {
+            return fail(QString("Damaged header at offset %1").arg(pos));
+        }
+        // Type-specific fields end where the extra area starts
+        int extraStart = size - int(extraSize);
+
+        if (type == HEAD5_MAIN) {
+            quint64 archiveFlags = 0;
+            if (!readVint(h, extraStart, hp, archiveFlags)) {
+                return fail(QString("Damaged main header at offset %1").arg(pos));
+            }
+            multiVolume = multiVolume || (archiveFlags & MHFL_VOLUME);
+            solid = solid || (archiveFlags & MHFL_SOLID);
+        } else if (type == HEAD5_CRYPT) {
+            return fail("Archive headers are encrypted");
+        } else if (type == HEAD5_FILE) {
+            quint64 fileFlags = 0;
+            quint64 unpacked = 0;
+            quint64 attributes = 0;
+            if (!readVint(h, extraStart, hp, fileFlags) || !readVint(h, extraStart, hp, unpacked)
+                || !readVint(h, extraStart, hp, attributes)) {
+                return fail(QString("Damaged file header at offset %1").arg(pos));
+            }
+
+            RarEntry entry;
+            if (fileFlags & FHFL_UTIME) {
+                if (hp + 4 > extraStart) {
+                    return fail(QString("Damaged file header at offset %1").arg(pos));
+                }
+                entry.modified = QDateTime::fromSecsSinceEpoch(read32(h + hp));
+                hp += 4;
+            }
+            if (fileFlags & FHFL_CRC32) {
+                if (hp + 4 > extraStart) {
+                    return fail(QString("Damaged file header at offset %1").arg(pos));
+                }
+                entry.crc32 = read32(h + hp);
+                hp += 4;
+            }
+            quint64 compression = 0;
+            quint64 host = 0;
+            quint64 nameLength = 0;
+            if (!readVint(h, extraStart, hp, compression) || !readVint(h, extraStart, hp, host)
+                || !readVint(h, extraStart, hp, nameLength) || nameLength > quint64(extraStart - hp)) {
+                return fail(QString("Damaged file header at offset %1").arg(pos));
+            }
+            entry.name = QString::fromUtf8(reinterpret_cast<const char *>(h + hp), int(nameLength));
+            entry.size = (fileFlags & FHFL_UNPUNKNOWN) ? -1 : qint64(unpacked);
+            entry.packedSize = qint64(dataSize);
+            entry.attributes = quint32(attributes);
+            entry.unixHost = host == RAR5_HOST_UNIX;
+            entry.directory = fileFlags & FHFL_DIRECTORY;
+            entry.solid = compression & FCI_SOLID;
+            entry.splitBefore = flags & HFL_SPLIT_BEFORE;
+            entry.splitAfter = flags & HFL_SPLIT_AFTER;
+            entry.firstVolume = volume;
+            entry.lastVolume = volume;
+            entry.headerOffset = pos;
+
+            // Extra records: encryption, and the modification time when it
+            // is not in the header itself
+            int ep = extraStart;
+            while (ep < size) {
+                quint64 recordSize = 0;
+                quint64 recordType = 0;
+                if (!readVint(h, size, ep, recordSize) || recordSize > quint64(size - ep)) {
+                    break;
+                }
+                int recordEnd = ep + int(recordSize);
+                if (!readVint(h, recordEnd, ep, recordType)) {
+                    break;
+                }
+                if (recordType == FHEXTRA_CRYPT) {
+                    entry.encrypted = true;
+                } else if (recordType == FHEXTRA_HTIME) {
+                    quint64 timeFlags = 0;
+                    if (readVint(h, recordEnd, ep, timeFlags) && (timeFlags & FHEXTRA_HTIME_MTIME)) {
+                        if ((timeFlags & FHEXTRA_HTIME_UNIXTIME) && ep + 4 <= recordEnd) {
+                            entry.modified = QDateTime::fromSecsSinceEpoch(read32(h + ep));
+                        } else if (!(timeFlags & FHEXTRA_HTIME_UNIXTIME) && ep + 8 <= recordEnd) {
+                            qint64 seconds = qint64(read64(h + ep) / 10000000) - FILETIME_EPOCH_OFFSET;
+                            entry.modified = QDateTime::fromSecsSinceEpoch(seconds);
+                        }
+                    }
+                }
+                ep = recordEnd;
+            }
+            addEntry(entry);
+        } else if (type == HEAD5_ENDARC) {
+            quint64 endFlags = 0;
+            readVint(h, extraStart, hp, endFlags);
+            hasNext = endFlags & EHFL_NEXTVOLUME;
+            return true;
+        }
+
+        pos = dataStart + qint64(dataSize);
+    }
+
+    hasNext = multiVolume;
+    return true;
+}
+
+void RarReader::addEntry(const RarEntry &entry) {
+    if (entry.splitBefore && !entries.isEmpty() && entries.last().name == entry.name) {
+        RarEntry &first = entries.last();
+        first.packedSize += entry.packedSize;
+        first.splitAfter = entry.splitAfter;
+        first.lastVolume = entry.lastVolume;
+        // The CRC of the whole file is in the last part
+        if (!entry.splitAfter) {
+            first.crc32 = entry.crc32;
+        }
+        return;
+    }
+    entries.append(entry);
+}
+
+QString RarReader::nextVolumeName(const QString &path) const {
+    QFileInfo info(path);
+    QString name = info.fileName();
+
+    if (newNumbering) {
+        // name.part01.rar -> name.part02.rar, keeping the width
+        static const QRegularExpression number(R"((\d+)(\.[^.]+)$)");
+        QRegularExpressionMatch match = number.match(name);
+        if (!match.hasMatch()) {
+            return QString();
+        }
+        QString digits = match.captured(1);
+        QString next = QString::number(digits.toLongLong() + 1).rightJustified(digits.size(), '0');
+        name.replace(match.capturedStart(1), digits.size(), next);
+        return info.dir().filePath(name);
+    }
+
+    // name.rar -> name.r00 ... name.r99 -> name.s00
+    QString suffix = info.suffix();
+    QString stem = name.left(name.size() - suffix.size());
+    if (suffix.compare("rar", Qt::CaseInsensitive) == 0) {
+        return info.dir().filePath(stem + (suffix.at(0).isUpper() ? "R00" : "r00"));
+    }
+    bool ok = false;
+    int counter = suffix.mid(1).toInt(&ok);
+    if (suffix.size() != 3 || !ok) {
+        return QString();
+    }
+    QChar letter = suffix.at(0);
+    if (++counter > 99) {
+        counter = 0;
+        letter = QChar(ushort(letter.unicode() + 1));
+    }
+    return info.dir().filePath(stem + letter + QString::number(counter).rightJustified(2, '0'));
+}
@@ -0,0 +1,75 @@
+#ifndef RARREADER_H
+#define RARREADER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QDateTime>
+#include "../utils/ArchiveSource.h"
+
+// One file or directory of a RAR archive, merged across volumes
+struct RarEntry {
+    QString name;
+    qint64 size = 0;         // -1 when the archive does not know it
+    qint64 packedSize = 0;   // summed over every volume holding a part
+    quint32 attributes = 0;  // st_mode for Unix hosts, DOS attributes otherwise
+    quint32 crc32 = 0;
+    QDateTime modified;
+    bool unixHost = false;
+    bool directory = false;
+    bool encrypted = false;
+    bool solid = false;      // needs the preceding members to be decoded
+    bool splitBefore = false;
+    bool splitAfter = false; // continues in the next volume
+    int firstVolume = 0;
+    int lastVolume = 0;
+    qint64 headerOffset = 0; // in the first volume holding it
+
+    // ls-style mode string for Unix hosts, empty otherwise
+    QString permissions() const;
+};
+
+// Walks the block headers of RAR 4.x and RAR5 archives without decompressing
+// anything, following multi-volume sets through all of their volumes. Only
+// headers are read, from each volume's shared mapping, skipping over packed
+// data, so listing touches a few pages per member however large the set is.
+// Archives with encrypted headers, and the pre-2.9 format, cannot be read
+// this way.
+class RarReader {
+public:
+    explicit RarReader(const QString &archivePath);
+
+    bool open();
+    // Whether open() can walk the headers; cheap, as it only looks at the
+    // signature and first header of the first volume
+    bool canRead() const;
+
+    QString getLastError() const { return lastError; }
+    const QVector<RarEntry> &getEntries() const { return entries; }
+    bool isRar5() const { return rar5; }
+    bool isSolid() const { return solid; }
+    bool isMultiVolume() const { return multiVolume; }
+    // Volumes actually read; a set can end early if a volume is missing
+    QStringList getVolumes() const { return volumes; }
+
+private:
+    bool fail(const QString &message);
+    bool readVolume(const QString &path, int volume, bool &hasNext);
+    // Both start at pos, just past the signature
+    bool readRar4Headers(const ArchiveSource &source, qint64 pos, int volume, bool &hasNext);
+    bool readRar5Headers(const ArchiveSource &source, qint64 pos, int volume, bool &hasNext);
+    // Adds entry, or merges it into the member it continues
+    void addEntry(const RarEntry &entry);
+    QString nextVolumeName(const QString &path) const;
+
+    QString archivePath;
+    QVector<RarEntry> entries;
+    QStringList volumes;
+    QString lastError;
+    bool rar5;
+    bool solid;
+    bool multiVolume;
+    bool newNumbering;
+};
+
+#endif // RARREADER_H
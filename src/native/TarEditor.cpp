@@ -0,0 +1,481 @@
+#include "TarEditor.h"
+#include "TarReader.h"
+#include "../utils/ArchiveUtils.h"
+#include <QFile>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QSet>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const qint64 BLOCK_SIZE = 512;
+// tar pads archives to whole records of 20 blocks
+static const qint64 RECORD_SIZE = 20 * BLOCK_SIZE;
+// Payloads up to this size are read into the pending output behind their
+// headers; larger ones are left to the kernel
+static const qint64 SMALL_PAYLOAD_SIZE = 64 * 1024;
+// Pending output is written once it grows past this
+static const qint64 PENDING_SIZE = 1024 * 1024;
+// Bytes per kernel-side copy call, so progress and cancellation keep up
+static const qint64 KERNEL_CHUNK = 64 * 1024 * 1024;
+static const qint64 BUFFER_SIZE = 1024 * 1024;
+// How long to wait on a tool before checking for cancellation
+static const int POLL_INTERVAL = 100;
+
+static qint64 roundToBlock(qint64 size) {
+    return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+static QString systemError() {
+    return QString::fromLocal8Bit(std::strerror(errno));
+}
+
+// The global PAX headers among those of a removed member, which still
+// apply to the members after it. The headers were checked by TarReader.
+static QByteArray globalHeaders(const QByteArray &headers) {
+    QByteArray kept;
+    int pos = 0;
+    while (pos + BLOCK_SIZE <= headers.size()) {
+        const char *header = headers.constData() + pos;
+        char type = header[156];
+        // The member's own header comes last
+        if (type != 'L' && type != 'K' && type != 'x' && type != 'g') {
+            break;
+        }
+        QByteArray sizeField(header + 124, int(qstrnlen(header + 124, 12)));
+        int length = int(BLOCK_SIZE + roundToBlock(sizeField.trimmed().toLongLong(nullptr, 8)));
+        if (type == 'g') {
+            kept += headers.mid(pos, length);
+        }
+        pos += length;
+    }
+    return kept;
+}
+
+// The tar stream as TarReader sees it. TarReader only moves forward, and
+// everything it reads or skips passes through the editor: bytes before the
+// boundary are payload of the member last read, to be copied or dropped,
+// bytes after it the headers of the next member, held until it is known
+// whether that one stays.
+class TarEditor::Stream : public TarSource {
+public:
+    explicit Stream(TarEditor *editor) : editor(editor) {}
+
+    bool open() override { return true; }
+    bool seek(qint64 offset) override { return editor->skipTo(offset); }
+    qint64 read(char *buffer, qint64 size) override { return editor->readHeaders(buffer, size); }
+    QString errorString() const override { return editor->lastError; }
+
+private:
+    TarEditor *editor;
+};
+
+TarEditor::TarEditor(const QString &archivePath)
+    : archivePath(archivePath), input(-1), output(-1), inputSize(-1), position(0), boundary(0),
+      keeping(false), outputSize(0), copyFileRange(true), membersRead(0) {
+}
+
+TarEditor::~TarEditor() {
+    for (QProcess *process : {decompressor.data(), compressor.data()}) {
+        if (process && process->state() != QProcess::NotRunning) {
+            process->kill();
+            process->waitForFinished();
+        }
+    }
+    if (input >= 0) {
+        ::close(input);
+    }
+    if (output >= 0) {
+        ::close(output);
+    }
+    if (!temporaryPath.isEmpty()) {
+        ::unlink(QFile::encodeName(temporaryPath).constData());
+    }
+}
+
+void TarEditor::setCompression(const QStringList &decompressCommand, const QStringList &compressCommand) {
+    this->decompressCommand = decompressCommand;
+    this->compressCommand = compressCommand;
+}
+
+bool TarEditor::fail(const QString &message) {
+    // The first error is the one worth reporting
+    if (lastError.isEmpty()) {
+        lastError = message;
+    }
+    return false;
+}
+
+bool TarEditor::remove(const QStringList &names) {
+    QSet<QString> requested;
+    for (const QString &name : names) {
+        requested.insert(ArchiveUtils::normalizeMemberName(name));
+    }
+    if (!begin()) {
+        return false;
+    }
+
+    Stream stream(this);
+    TarReader reader(&stream);
+    if (!reader.open()) {
+        return fail(reader.getLastError());
+    }
+    QSet<QString> found;
+    QSet<QString> removed;
+    TarMember member;
+    while (reader.readNext(member)) {
+        current = member.name;
+        QString name = ArchiveUtils::normalizeMemberName(member.name);
+        QString selector = ArchiveUtils::selectedBy(name, requested);
+        keeping = selector.isEmpty();
+        if (keeping) {
+            // tar would extract the link as an empty file, if at all
+            if (member.isHardLink() && removed.contains(ArchiveUtils::normalizeMemberName(member.linkTarget))) {
+                return fail(QString("%1 is a hard link to %2, which is being removed")
+                            .arg(member.name, member.linkTarget));
+            }
+            queue(headers);
+        } else {
+            found.insert(selector);
+            removed.insert(name);
+            queue(globalHeaders(headers));
+        }
+        headers.clear();
+        boundary = reader.nextHeaderOffset();
+        ++membersRead;
+        if (pending.size() >= PENDING_SIZE && !flushPending()) {
+            return false;
+        }
+    }
+    if (reader.hasError()) {
+        return fail(reader.getLastError());
+    }
+    for (const QString &name : requested) {
+        if (!found.contains(name)) {
+            return fail(QString("%1: Not found in archive").arg(name));
+        }
+    }
+    return finish();
+}
+
+bool TarEditor::begin() {
+    struct stat status;
+    if (::stat(QFile::encodeName(archivePath).constData(), &status) != 0) {
+        return fail(QString("Cannot read %1: %2").arg(archivePath, systemError()));
+    }
+    // Next to the archive, so the final rename stays on one filesystem
+    while (output < 0) {
+        temporaryPath = archivePath + QString(".%1").arg(QRandomGenerator::global()->generate(), 8, 16, QChar('0'));
+        output = ::open(QFile::encodeName(temporaryPath).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (output < 0 && errno != EEXIST) {
+            temporaryPath.clear();
+            return fail(QString("Cannot create %1: %2").arg(archivePath, systemError()));
+        }
+    }
+    // The new archive takes the place of the old one, permissions included
+    if (fchmod(output, status.st_mode & 07777) != 0) {
+        return fail(QString("Cannot create %1: %2").arg(archivePath, systemError()));
+    }
+
+    if (decompressCommand.isEmpty()) {
+        input = ::open(QFile::encodeName(archivePath).constData(), O_RDONLY | O_CLOEXEC);
+        if (input < 0) {
+            return fail(QString("Cannot read %1: %2").arg(archivePath, systemError()));
+        }
+        inputSize = qint64(status.st_size);
+        return true;
+    }
+
+    // The compressor writes the file itself
+    ::close(output);
+    output = -1;
+    decompressor.reset(new QProcess);
+    decompressor->setStandardInputFile(archivePath);
+    compressor.reset(new QProcess);
+    compressor->setStandardOutputFile(temporaryPath);
+    return startTool(*decompressor, decompressCommand) && startTool(*compressor, compressCommand);
+}
+
+bool TarEditor::finish() {
+    // Two empty blocks end the archive, then it is padded to a whole record
+    qint64 end = (outputSize + 2 * BLOCK_SIZE + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+    queue(QByteArray(int(end - outputSize), '\0'));
+    if (!flushPending()) {
+        return false;
+    }
+
+    if (decompressor) {
+        // Reading up to the end lets the decompressor check the trailer
+        if (buffer.isEmpty()) {
+            buffer.resize(int(BUFFER_SIZE));
+        }
+        qint64 count;
+        while ((count = readInput(buffer.data(), BUFFER_SIZE)) > 0) {
+        }
+        if (count < 0 || !finishTool(*decompressor, decompressCommand)) {
+            return false;
+        }
+        compressor->closeWriteChannel();
+        if (!finishTool(*compressor, compressCommand)) {
+            return false;
+        }
+    } else {
+        int closing = output;
+        output = -1;
+        if (::close(closing) != 0) {
+            return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+        }
+    }
+
+    if (::rename(QFile::encodeName(temporaryPath).constData(), QFile::encodeName(archivePath).constData()) != 0) {
+        return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+    }
+    temporaryPath.clear();
+    return true;
+}
+
+bool TarEditor::startTool(QProcess &process, const QStringList &command) {
+    process.start(command.first(), command.mid(1));
+    if (!process.waitForStarted()) {
+        return fail(QString("Cannot run %1: %2").arg(command.first(), process.errorString()));
+    }
+    return true;
+}
+
+bool TarEditor::finishTool(QProcess &process, const QStringList &command) {
+    while (!process.waitForFinished(POLL_INTERVAL)) {
+        if (process.state() == QProcess::NotRunning) {
+            break;
+        }
+        if (!reportProgress()) {
+            return false;
+        }
+    }
+    if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+        QString message = QString::fromLocal8Bit(process.readAllStandardError()).trimmed();
+        if (message.isEmpty()) {
+            message = QString("exit code %1").arg(process.exitCode());
+        }
+        return fail(QString("%1 failed: %2").arg(command.first(), message));
+    }
+    return true;
+}
+
+qint64 TarEditor::readInput(char *data, qint64 size) {
+    qint64 done = 0;
+    while (done < size) {
+        qint64 count;
+        if (decompressor) {
+            count = decompressor->read(data + done, size - done);
+            if (count == 0) {
+                if (decompressor->waitForReadyRead(POLL_INTERVAL)) {
+                    continue;
+                }
+                // Everything it wrote is read before it counts as finished
+                if (decompressor->state() == QProcess::NotRunning && decompressor->bytesAvailable() == 0) {
+                    break;
+                }
+                if (!reportProgress()) {
+                    return -1;
+                }
+                continue;
+            }
+        } else {
+            count = pread(input, data + done, size_t(size - done), position + done);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count == 0) {
+                break;
+            }
+        }
+        if (count < 0) {
+            fail(QString("Cannot read %1: %2").arg(archivePath,
+                                                    decompressor ? decompressor->errorString() : systemError()));
+            return -1;
+        }
+        done += count;
+    }
+    position += done;
+    if (!reportProgress()) {
+        return -1;
+    }
+    return done;
+}
+
+qint64 TarEditor::readHeaders(char *data, qint64 size) {
+    qint64 count = readInput(data, size);
+    if (count > 0) {
+        headers.append(data, int(count));
+    }
+    return count;
+}
+
+bool TarEditor::skipTo(qint64 target) {
+    if (target < position) {
+        return fail(QString("Cannot seek back in %1").arg(archivePath));
+    }
+    qint64 payload = qMin(target, boundary) - position;
+    if (payload > 0 && !passPayload(payload)) {
+        return false;
+    }
+    // Padding after extended headers belongs to the headers
+    while (position < target) {
+        int size = headers.size();
+        qint64 length = qMin(target - position, BUFFER_SIZE);
+        headers.resize(size + int(length));
+        qint64 count = readInput(headers.data() + size, length);
+        headers.resize(size + int(qMax<qint64>(count, 0)));
+        if (count < 0) {
+            return false;
+        }
+        if (count < length) {
+            return fail(QString("Unexpected end of %1").arg(archivePath));
+        }
+    }
+    return true;
+}
+
+bool TarEditor::passPayload(qint64 length) {
+    if (!decompressor) {
+        if (position + length > inputSize) {
+            return fail(QString("Unexpected end of %1").arg(archivePath));
+        }
+        if (!keeping) {
+            position += length;
+            return reportProgress();
+        }
+        if (length > SMALL_PAYLOAD_SIZE) {
+            return copyPayload(length);
+        }
+    }
+
+    if (buffer.isEmpty()) {
+        buffer.resize(int(BUFFER_SIZE));
+    }
+    while (length > 0) {
+        qint64 chunk = qMin(length, BUFFER_SIZE);
+        qint64 count = readInput(buffer.data(), chunk);
+        if (count < 0) {
+            return false;
+        }
+        if (count < chunk) {
+            return fail(QString("Unexpected end of %1").arg(archivePath));
+        }
+        if (keeping) {
+            queue(QByteArray::fromRawData(buffer.constData(), int(count)));
+            if (pending.size() >= PENDING_SIZE && !flushPending()) {
+                return false;
+            }
+        }
+        length -= count;
+    }
+    return true;
+}
+
+bool TarEditor::copyPayload(qint64 length) {
+    // Kernel copies go to the file directly, behind what is pending
+    if (!flushPending()) {
+        return false;
+    }
+    while (length > 0 && copyFileRange) {
+        loff_t from = position;
+        ssize_t count = copy_file_range(input, &from, output, nullptr, size_t(qMin(length, KERNEL_CHUNK)), 0);
+        if (count < 0) {
+            // Unsupported for this pair of files, or at all; the buffered
+            // copy below takes over
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP) {
+                copyFileRange = false;
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+        }
+        if (count == 0) {
+            return fail(QString("Unexpected end of %1").arg(archivePath));
+        }
+        position += count;
+        outputSize += count;
+        length -= count;
+        if (!reportProgress()) {
+            return false;
+        }
+    }
+    if (length == 0) {
+        return true;
+    }
+    if (buffer.isEmpty()) {
+        buffer.resize(int(BUFFER_SIZE));
+    }
+    while (length > 0) {
+        qint64 chunk = qMin(length, BUFFER_SIZE);
+        qint64 count = readInput(buffer.data(), chunk);
+        if (count < 0) {
+            return false;
+        }
+        if (count < chunk) {
+            return fail(QString("Unexpected end of %1").arg(archivePath));
+        }
+        queue(QByteArray::fromRawData(buffer.constData(), int(count)));
+        if (!flushPending()) {
+            return false;
+        }
+        length -= count;
+    }
+    return true;
+}
+
+void TarEditor::queue(const QByteArray &data) {
+    pending += data;
+    outputSize += data.size();
+}
+
+bool TarEditor::flushPending() {
+    if (compressor) {
+        compressor->write(pending);
+        pending.clear();
+        // Drained before going on, or the write buffer would grow with
+        // the archive
+        while (compressor->bytesToWrite() > 0) {
+            if (compressor->waitForBytesWritten(POLL_INTERVAL)) {
+                continue;
+            }
+            if (compressor->state() == QProcess::NotRunning) {
+                return finishTool(*compressor, compressCommand)
+                    && fail(QString("%1 exited early").arg(compressCommand.first()));
+            }
+            if (!reportProgress()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const char *data = pending.constData();
+    qint64 size = pending.size();
+    while (size > 0) {
+        ssize_t count = ::write(output, data, size_t(size));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+        }
+        data += count;
+        size -= count;
+    }
+    pending.clear();
+    return true;
+}
+
+bool TarEditor::reportProgress() {
+    if (progressCallback && !progressCallback(position)) {
+        return fail("Cancelled");
+    }
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef TAREDITOR_H
+#define TAREDITOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QScopedPointer>
+#include <functional>
+
+class QProcess;
+
+// Removes members from a tar archive by copying the others into a new one
+// in a single pass, their headers and payloads byte for byte. Nothing is
+// extracted and memory use does not grow with the archive: payloads of an
+// uncompressed archive are copied by the kernel, a compressed one streams
+// from a decompressor through to a compressor. The new archive replaces
+// the old one only once it is complete.
+class TarEditor {
+public:
+    explicit TarEditor(const QString &archivePath);
+    ~TarEditor();
+
+    // For compressed archives: a decompressor writing the tar stream to
+    // stdout and a compressor reading it from stdin, each as the program
+    // followed by its arguments
+    void setCompression(const QStringList &decompressCommand, const QStringList &compressCommand);
+
+    // Writes the archive without the members selected by names, a
+    // directory selecting everything below it. Fails and leaves the archive
+    // alone if a name selects nothing or a member that stays is a hard link
+    // to one removed.
+    bool remove(const QStringList &names);
+
+    // Called with the bytes of the tar stream read so far; returning false
+    // cancels
+    void setProgressCallback(const std::function<bool(qint64)> &callback) { progressCallback = callback; }
+    qint64 filesDone() const { return membersRead; }
+    QString currentFile() const { return current; }
+    QString getLastError() const { return lastError; }
+
+private:
+    class Stream;
+
+    bool fail(const QString &message);
+    bool begin();
+    bool finish();
+    bool startTool(QProcess &process, const QStringList &command);
+    // Waits for the tool to exit and checks how it went
+    bool finishTool(QProcess &process, const QStringList &command);
+    // Raw bytes of the tar stream at position; short only at its end,
+    // -1 on error
+    qint64 readInput(char *data, qint64 size);
+    // What TarReader reads and skips
+    qint64 readHeaders(char *data, qint64 size);
+    bool skipTo(qint64 target);
+    // Copies or drops payload bytes of the member last read
+    bool passPayload(qint64 length);
+    bool copyPayload(qint64 length);
+    void queue(const QByteArray &data);
+    bool flushPending();
+    bool reportProgress();
+
+    QString archivePath;
+    QString temporaryPath;
+    QStringList decompressCommand;
+    QStringList compressCommand;
+    QScopedPointer<QProcess> decompressor;
+    QScopedPointer<QProcess> compressor;
+    int input;               // uncompressed archives only
+    int output;
+    qint64 inputSize;
+
+    qint64 position;         // in the tar stream read
+    qint64 boundary;         // end of the payload of the member last read
+    bool keeping;            // whether that member stays
+    QByteArray headers;      // read since the boundary
+    QByteArray pending;      // output not yet written
+    qint64 outputSize;       // of the tar stream written, pending included
+    QByteArray buffer;
+    bool copyFileRange;
+
+    qint64 membersRead;
+    QString current;
+    QString lastError;
+    std::function<bool(qint64)> progressCallback;
+};
+
+#endif // TAREDITOR_H
@@ -0,0 +1,274 @@
+#include "TarReader.h"
+#include <QByteArray>
+#include <cstring>
+#include <limits>
+
+static const qint64 BLOCK_SIZE = 512;
+// Far beyond any real member, and small enough that offsets cannot overflow
+static const qint64 MAX_MEMBER_SIZE = qint64(1) << 60;
+// Long names and PAX records beyond this are not something we want in memory
+static const qint64 MAX_METADATA_SIZE = 1024 * 1024;
+
+static qint64 roundToBlock(qint64 size) {
+    return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+// Octal, or base-256 when the high bit of the first byte is set (GNU);
+// -1 for a base-256 value too large to hold
+static qint64 parseNumber(const char *field, int length) {
+    const uchar *bytes = reinterpret_cast<const uchar *>(field);
+    if (bytes[0] & 0x80) {
+        qint64 value = bytes[0] & 0x3F;
+        for (int i = 1; i < length; ++i) {
+            if (value > (std::numeric_limits<qint64>::max() >> 8)) {
+                return -1;
+            }
+            value = (value << 8) | bytes[i];
+        }
+        return (bytes[0] & 0x40) ? -value : value;
+    }
+
+    qint64 value = 0;
+    for (int i = 0; i < length; ++i) {
+        char c = field[i];
+        if (c >= '0' && c <= '7') {
+            value = value * 8 + (c - '0');
+        } else if (c != ' ' || value != 0) {
+            break;
+        }
+    }
+    return value;
+}
+
+static QString parseString(const char *field, int length) {
+    return QString::fromUtf8(field, int(qstrnlen(field, length)));
+}
+
+static bool verifyChecksum(const char *header) {
+    qint64 stored = parseNumber(header + 148, 8);
+    qint64 unsignedSum = 0;
+    qint64 signedSum = 0;
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        // The checksum field itself counts as spaces
+        char c = (i >= 148 && i < 156) ? ' ' : header[i];
+        unsignedSum += uchar(c);
+        signedSum += static_cast<signed char>(c);
+    }
+    return stored == unsignedSum || stored == signedSum;
+}
+
+// "<length> <key>=<value>\n" records
+static void parsePax(const QByteArray &data, QHash<QString, QString> &records) {
+    int pos = 0;
+    while (pos < data.size()) {
+        int space = data.indexOf(' ', pos);
+        if (space < 0) {
+            return;
+        }
+        int length = data.mid(pos, space - pos).toInt();
+        if (length <= 0 || pos + length > data.size()) {
+            return;
+        }
+        QByteArray record = data.mid(space + 1, pos + length - space - 2);
+        int equals = record.indexOf('=');
+        if (equals > 0) {
+            records.insert(QString::fromUtf8(record.left(equals)),
+                           QString::fromUtf8(record.mid(equals + 1)));
+        }
+        pos += length;
+    }
+}
+
+// Reads the archive file through its shared mapping
+class TarFileSource : public TarSource {
+public:
+    explicit TarFileSource(const QString &path) : path(path), position(0) {}
+
+    bool open() override {
+        position = 0;
+        mapping = ArchiveSource::open(path, &error);
+        if (!mapping) {
+            return false;
+        }
+        // Listing jumps from header to header over the member data
+        mapping->advise(ArchiveSource::Random);
+        return true;
+    }
+    bool seek(qint64 offset) override {
+        if (offset < 0) {
+            error = "Invalid position";
+            return false;
+        }
+        position = offset;
+        return true;
+    }
+    qint64 read(char *buffer, qint64 size) override {
+        ArchiveSpan span = mapping->span(position, size);
+        if (!span.isEmpty()) {
+            std::memcpy(buffer, span.data, size_t(span.size));
+        }
+        position += span.size;
+        return span.size;
+    }
+    QString errorString() const override { return error; }
+    void advise(ArchiveSource::Access access) override { mapping->advise(access); }
+    void release(qint64 offset, qint64 size) override { mapping->release(offset, size); }
+
+private:
+    QString path;
+    QSharedPointer<ArchiveSource> mapping;
+    qint64 position;
+    QString error;
+};
+
+quint32 TarMember::fullMode() const {
+    quint32 permissions = mode & 07777;
+    if (isDirectory()) {
+        return permissions | 0040000;
+    }
+    if (isSymLink()) {
+        return permissions | 0120000;
+    }
+    return permissions | 0100000;
+}
+
+TarReader::TarReader(const QString &archivePath)
+    : ownSource(new TarFileSource(archivePath)), source(ownSource.data()), position(0) {
+}
+
+TarReader::TarReader(TarSource *source)
+    : source(source), position(0) {
+}
+
+bool TarReader::fail(const QString &message) {
+    lastError = message;
+    return false;
+}
+
+bool TarReader::open() {
+    position = 0;
+    globalPax.clear();
+    lastError.clear();
+    if (!source->open()) {
+        return fail(source->errorString());
+    }
+    return true;
+}
+
+bool TarReader::readNext(TarMember &member) {
+    QString longName;
+    QString longLink;
+    QHash<QString, QString> pax = globalPax;
+    qint64 firstHeader = position;
+
+    while (true) {
+        char header[BLOCK_SIZE];
+        if (!source->seek(position)) {
+            return fail(source->errorString());
+        }
+        qint64 count = source->read(header, BLOCK_SIZE);
+        if (count < 0) {
+            return fail(source->errorString());
+        }
+        if (count == 0) {
+            // Missing end-of-archive blocks are common and harmless
+            return false;
+        }
+        if (count != BLOCK_SIZE) {
+            return fail(QString("Truncated header at offset %1").arg(position));
+        }
+
+        bool empty = true;
+        for (int i = 0; i < BLOCK_SIZE && empty; ++i) {
+            empty = header[i] == 0;
+        }
+        if (empty) {
+            return false;
+        }
+        if (!verifyChecksum(header)) {
+            return fail(QString("Damaged header at offset %1").arg(position));
+        }
+
+        char type = header[156];
+        qint64 size = parseNumber(header + 124, 12);
+        if (size < 0 || size > MAX_MEMBER_SIZE) {
+            return fail(QString("Invalid member size at offset %1").arg(position));
+        }
+        qint64 dataOffset = position + BLOCK_SIZE;
+
+        // Metadata for the header that follows
+        if (type == 'L' || type == 'K' || type == 'x' || type == 'g') {
+            if (size > MAX_METADATA_SIZE) {
+                return fail(QString("Oversized extended header at offset %1").arg(position));
+            }
+            QByteArray data(int(size), Qt::Uninitialized);
+            if (source->read(data.data(), size) != size) {
+                return fail(QString("Truncated extended header at offset %1").arg(position));
+            }
+            if (type == 'L') {
+                longName = parseString(data.constData(), data.size());
+            } else if (type == 'K') {
+                longLink = parseString(data.constData(), data.size());
+            } else if (type == 'x') {
+                parsePax(data, pax);
+            } else {
+                parsePax(data, globalPax);
+                parsePax(data, pax);
+            }
+            position = dataOffset + roundToBlock(size);
+            continue;
+        }
+
+        QString name = parseString(header, 100);
+        bool ustar = qstrncmp(header + 257, "ustar", 5) == 0;
+        // The prefix field only exists in POSIX ustar; GNU uses the space
+        if (ustar && header[262] == '\0' && header[345] != '\0') {
+            name = parseString(header + 345, 155) + "/" + name;
+        }
+        if (!longName.isEmpty()) {
+            name = longName;
+        }
+        if (pax.contains("path")) {
+            name = pax.value("path");
+        }
+
+        member.name = name;
+        member.linkTarget = pax.value("linkpath", longLink.isEmpty() ? parseString(header + 157, 100) : longLink);
+        member.mode = quint32(parseNumber(header + 100, 8));
+        member.mtime = pax.contains("mtime") ? qint64(pax.value("mtime").toDouble())
+                                             : parseNumber(header + 136, 12);
+        member.type = type;
+        member.size = size;
+        if (pax.contains("size")) {
+            bool ok = false;
+            member.size = pax.value("size").toLongLong(&ok);
+            // A negative size would send the walk back over this header
+            if (!ok || member.size < 0 || member.size > MAX_MEMBER_SIZE) {
+                return fail(QString("Invalid member size at offset %1").arg(firstHeader));
+            }
+        }
+        member.headerOffset = firstHeader;
+        member.dataOffset = dataOffset;
+
+        // Links, devices, directories and FIFOs carry no payload
+        qint64 payload = (type >= '2' && type <= '6') ? 0 : member.size;
+        position = dataOffset + roundToBlock(payload);
+        return true;
+    }
+}
+
+qint64 TarReader::readData(const TarMember &member, qint64 from, char *buffer, qint64 maxSize) {
+    qint64 length = qMin(maxSize, member.size - from);
+    if (length <= 0) {
+        return 0;
+    }
+    if (!source->seek(member.dataOffset + from)) {
+        fail(source->errorString());
+        return -1;
+    }
+    qint64 count = source->read(buffer, length);
+    if (count < 0) {
+        fail(source->errorString());
+    }
+    return count;
+}
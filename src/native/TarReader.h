@@ -0,0 +1,79 @@
+#ifndef TARREADER_H
+#define TARREADER_H
+
+#include <QString>
+#include <QHash>
+#include <QScopedPointer>
+#include "../utils/ArchiveSource.h"
+
+// One member of a tar archive, with long names and PAX overrides applied
+struct TarMember {
+    QString name;
+    QString linkTarget;
+    qint64 size = 0;
+    quint32 mode = 0;
+    qint64 mtime = 0;
+    char type = '0';
+    qint64 headerOffset = 0;  // first header belonging to the member
+    qint64 dataOffset = 0;    // payload, directly after the last header
+
+    bool isDirectory() const { return type == '5' || name.endsWith('/'); }
+    bool isRegularFile() const { return type == '0' || type == '\0' || type == '7'; }
+    bool isSymLink() const { return type == '2'; }
+    bool isHardLink() const { return type == '1'; }
+    // st_mode including the file type bits, which tar keeps in the type flag
+    quint32 fullMode() const;
+};
+
+// Where TarReader gets the tar stream from: the archive file itself, or a
+// decompressor that can seek
+class TarSource {
+public:
+    virtual ~TarSource() = default;
+    virtual bool open() = 0;
+    virtual bool seek(qint64 offset) = 0;
+    // Fewer bytes than asked for only at the end of the stream, -1 on error
+    virtual qint64 read(char *buffer, qint64 size) = 0;
+    virtual QString errorString() const = 0;
+    // Access hint and release of consumed bytes, for sources that map the
+    // archive; the rest have nothing to tune
+    virtual void advise(ArchiveSource::Access) {}
+    virtual void release(qint64, qint64) {}
+};
+
+// Walks the headers of an uncompressed tar archive (ustar, GNU long names
+// and PAX records) by seeking over member data, so listing costs one
+// 512-byte read per member regardless of the archive size.
+class TarReader {
+public:
+    explicit TarReader(const QString &archivePath);
+    // Reads the tar stream from source, which is not taken over
+    explicit TarReader(TarSource *source);
+
+    bool open();
+    // Reads the next member; false at the end of the archive or on error,
+    // in which case getLastError() is set
+    bool readNext(TarMember &member);
+    // Payload bytes of member starting at from; returns the count read
+    qint64 readData(const TarMember &member, qint64 from, char *buffer, qint64 maxSize);
+    // Where the headers of the member after the one last read start
+    qint64 nextHeaderOffset() const { return position; }
+    // Sequential before reading every member's data in turn
+    void advise(ArchiveSource::Access access) { source->advise(access); }
+    // Drops member's payload from memory once it has been read through
+    void release(const TarMember &member) { source->release(member.dataOffset, member.size); }
+
+    QString getLastError() const { return lastError; }
+    bool hasError() const { return !lastError.isEmpty(); }
+
+private:
+    bool fail(const QString &message);
+
+    QScopedPointer<TarSource> ownSource;
+    TarSource *source;
+    qint64 position;
+    QHash<QString, QString> globalPax;
+    QString lastError;
+};
+
+#endif // TARREADER_H
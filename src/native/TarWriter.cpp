@@ -0,0 +1,580 @@
+#include "TarWriter.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <grp.h>
+#include <linux/fs.h>
+#include <pwd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+static const qint64 BLOCK_SIZE = 512;
+// tar pads archives to whole records of 20 blocks
+static const qint64 RECORD_SIZE = 20 * BLOCK_SIZE;
+// Members up to this size are read into the pending output behind their header
+static const qint64 SMALL_FILE_SIZE = 64 * 1024;
+// Pending output is written once it grows past this
+static const qint64 PENDING_SIZE = 1024 * 1024;
+// Members worth aligning for a reflink; the padding costs up to a block
+static const qint64 REFLINK_MIN_SIZE = 1024 * 1024;
+// Bytes per kernel-side copy call, so progress and cancellation keep up
+static const qint64 KERNEL_CHUNK = 64 * 1024 * 1024;
+static const qint64 BUFFER_SIZE = 1024 * 1024;
+// Largest values of the 7- and 11-digit octal header fields
+static const qint64 MAX_OCTAL_7 = 07777777;
+static const qint64 MAX_OCTAL_11 = 077777777777LL;
+// Shortest PAX comment record: "12 comment=\n" plus one byte of filler
+static const int MIN_COMMENT_SIZE = 13;
+
+static qint64 roundToBlock(qint64 size) {
+    return (size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+}
+
+static QString systemError() {
+    return QString::fromLocal8Bit(std::strerror(errno));
+}
+
+// Zero-padded octal filling a field but its terminating NUL
+static void putOctal(char *field, int length, qint64 value) {
+    QByteArray digits = QByteArray::number(value, 8).rightJustified(length - 1, '0');
+    std::memcpy(field, digits.constData(), size_t(length - 1));
+    field[length - 1] = '\0';
+}
+
+static void putString(char *field, int length, const QByteArray &value) {
+    std::memcpy(field, value.constData(), size_t(qMin(length, value.size())));
+}
+
+// "<length> <key>=<value>\n", the length counting its own digits
+static QByteArray paxRecord(const QByteArray &key, const QByteArray &value) {
+    int base = key.size() + value.size() + 3;
+    int digits = QByteArray::number(base).size();
+    int length = base + digits;
+    if (QByteArray::number(length).size() > digits) {
+        ++length;
+    }
+    return QByteArray::number(length) + ' ' + key + '=' + value + '\n';
+}
+
+static void setChecksum(char *block) {
+    std::memset(block + 148, ' ', 8);
+    qint64 sum = 0;
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        sum += uchar(block[i]);
+    }
+    putOctal(block + 148, 7, sum);
+}
+
+TarWriter::TarWriter(const QString &archivePath)
+    : archivePath(archivePath), fd(-1), archiveDevice(0), blockSize(BLOCK_SIZE), offset(0),
+      inputBytes(0), reflinks(true), copyFileRange(true), sendFile(true),
+      bytesWritten(0), filesWritten(0) {
+}
+
+TarWriter::~TarWriter() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!temporaryPath.isEmpty()) {
+        ::unlink(QFile::encodeName(temporaryPath).constData());
+    }
+}
+
+bool TarWriter::fail(const QString &message) {
+    lastError = message;
+    return false;
+}
+
+bool TarWriter::addFiles(const QStringList &files) {
+    for (const QString &file : files) {
+        if (!addMember(file)) {
+            return false;
+        }
+        QFileInfo info(file);
+        if (info.isDir() && !info.isSymLink()) {
+            QDirIterator it(file, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                if (!addMember(it.next())) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool TarWriter::addMember(const QString &path) {
+    QByteArray localPath = QFile::encodeName(path);
+    struct stat status;
+    if (lstat(localPath.constData(), &status) != 0) {
+        return fail(QString("Cannot read %1: %2").arg(path, systemError()));
+    }
+    // tar ignores sockets as well
+    if (S_ISSOCK(status.st_mode)) {
+        return true;
+    }
+
+    QString name = QDir::cleanPath(path);
+    while (name.startsWith('/')) {
+        name.remove(0, 1);
+    }
+    while (name.startsWith("../")) {
+        name.remove(0, 3);
+    }
+    if (name.isEmpty() || name == "." || name == "..") {
+        return true;
+    }
+
+    Member member;
+    member.path = path;
+    member.name = QFile::encodeName(name);
+    member.mode = quint32(status.st_mode);
+    member.uid = quint32(status.st_uid);
+    member.gid = quint32(status.st_gid);
+    member.mtime = qint64(status.st_mtime);
+    member.device = quint64(status.st_dev);
+
+    if (S_ISDIR(status.st_mode)) {
+        member.type = '5';
+        member.name += '/';
+    } else if (S_ISLNK(status.st_mode)) {
+        member.type = '2';
+        char target[PATH_MAX];
+        ssize_t length = readlink(localPath.constData(), target, sizeof(target));
+        if (length < 0) {
+            return fail(QString("Cannot read link %1: %2").arg(path, systemError()));
+        }
+        member.linkTarget = QByteArray(target, int(length));
+    } else if (S_ISCHR(status.st_mode) || S_ISBLK(status.st_mode)) {
+        member.type = S_ISCHR(status.st_mode) ? '3' : '4';
+        member.deviceMajor = major(status.st_rdev);
+        member.deviceMinor = minor(status.st_rdev);
+    } else if (S_ISFIFO(status.st_mode)) {
+        member.type = '6';
+    } else if (status.st_nlink > 1) {
+        // Later names of a multiply linked file become hard links to the first
+        QPair<quint64, quint64> key(quint64(status.st_dev), quint64(status.st_ino));
+        auto first = linked.constFind(key);
+        if (first != linked.constEnd()) {
+            member.type = '1';
+            member.linkTarget = first.value();
+        } else {
+            linked.insert(key, member.name);
+            member.size = qint64(status.st_size);
+        }
+    } else {
+        member.size = qint64(status.st_size);
+    }
+
+    if (names.contains(member.name)) {
+        return true;
+    }
+    names.insert(member.name);
+    inputBytes += member.size;
+    members.append(member);
+    return true;
+}
+
+bool TarWriter::write() {
+    // Next to the archive, so the final rename stays on one filesystem
+    while (fd < 0) {
+        temporaryPath = archivePath + QString(".%1").arg(QRandomGenerator::global()->generate(), 8, 16, QChar('0'));
+        fd = ::open(QFile::encodeName(temporaryPath).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd < 0 && errno != EEXIST) {
+            temporaryPath.clear();
+            return fail(QString("Cannot create %1: %2").arg(archivePath, systemError()));
+        }
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        return fail(QString("Cannot create %1: %2").arg(archivePath, systemError()));
+    }
+    archiveDevice = quint64(status.st_dev);
+    if (status.st_blksize > BLOCK_SIZE && status.st_blksize % BLOCK_SIZE == 0) {
+        blockSize = qint64(status.st_blksize);
+    }
+
+    for (const Member &member : members) {
+        current = member.path;
+        if (!writeMember(member)) {
+            return false;
+        }
+        ++filesWritten;
+    }
+
+    // Two empty blocks end the archive, then it is padded to a whole record
+    qint64 end = (offset + 2 * BLOCK_SIZE + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+    queue(QByteArray(int(end - offset), '\0'));
+    if (!flushPending()) {
+        return false;
+    }
+    int closing = fd;
+    fd = -1;
+    if (::close(closing) != 0) {
+        return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+    }
+    if (::rename(QFile::encodeName(temporaryPath).constData(), QFile::encodeName(archivePath).constData()) != 0) {
+        return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+    }
+    temporaryPath.clear();
+    return true;
+}
+
+void TarWriter::queue(const QByteArray &data) {
+    pending += data;
+    offset += data.size();
+}
+
+bool TarWriter::writeMember(const Member &member) {
+    if (member.size == 0 || member.type != '0') {
+        queue(header(member, false));
+        return pending.size() < PENDING_SIZE || flushPending();
+    }
+
+    int source = ::open(QFile::encodeName(member.path).constData(), O_RDONLY | O_CLOEXEC);
+    if (source < 0) {
+        return fail(QString("Cannot read %1: %2").arg(member.path, systemError()));
+    }
+    bool success;
+    if (member.size <= SMALL_FILE_SIZE) {
+        queue(header(member, false));
+        // Read straight into the output, zero padding included
+        int start = pending.size();
+        qint64 padded = roundToBlock(member.size);
+        pending.resize(start + int(padded));
+        std::memset(pending.data() + start + member.size, 0, size_t(padded - member.size));
+        qint64 done = 0;
+        success = true;
+        while (done < member.size) {
+            ssize_t count = ::read(source, pending.data() + start + done, size_t(member.size - done));
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                success = fail(count < 0 ? QString("Cannot read %1: %2").arg(member.path, systemError())
+                                         : QString("%1 shrank while being read").arg(member.path));
+                break;
+            }
+            done += count;
+        }
+        offset += padded;
+        bytesWritten += member.size;
+        success = success && (pending.size() < PENDING_SIZE || flushPending()) && reportProgress();
+    } else {
+        bool aligned = reflinks && member.device == archiveDevice && member.size >= REFLINK_MIN_SIZE;
+        queue(header(member, aligned));
+        success = flushPending() && copyPayload(member, source);
+    }
+    ::close(source);
+    return success;
+}
+
+QByteArray TarWriter::header(const Member &member, bool aligned) {
+    QByteArray records;
+    QByteArray name = member.name;
+    QByteArray prefix;
+    if (name.size() > 100) {
+        // ustar splits long names at a slash: up to 155 bytes of prefix
+        // and 100 of name; anything longer goes into a PAX record
+        bool split = false;
+        for (int slash = qMin(155, name.size() - 2); slash > 0 && !split; --slash) {
+            if (name.at(slash) == '/' && name.size() - slash - 1 <= 100) {
+                prefix = name.left(slash);
+                name = name.mid(slash + 1);
+                split = true;
+            }
+        }
+        if (!split) {
+            records += paxRecord("path", member.name);
+            name = member.name.left(100);
+        }
+    }
+    if (member.linkTarget.size() > 100) {
+        records += paxRecord("linkpath", member.linkTarget);
+    }
+    if (member.size > MAX_OCTAL_11) {
+        records += paxRecord("size", QByteArray::number(member.size));
+    }
+    if (member.uid > MAX_OCTAL_7) {
+        records += paxRecord("uid", QByteArray::number(member.uid));
+    }
+    if (member.gid > MAX_OCTAL_7) {
+        records += paxRecord("gid", QByteArray::number(member.gid));
+    }
+    if (member.mtime < 0 || member.mtime > MAX_OCTAL_11) {
+        records += paxRecord("mtime", QByteArray::number(member.mtime));
+    }
+
+    // A comment record sizes the PAX data so the payload starts on a
+    // filesystem block, which reflinks need; readers skip comments
+    if (aligned && blockSize > BLOCK_SIZE
+        && (!records.isEmpty() || (offset + BLOCK_SIZE) % blockSize != 0)) {
+        qint64 size = (blockSize - (offset + 2 * BLOCK_SIZE) % blockSize) % blockSize;
+        while (size < records.size() + MIN_COMMENT_SIZE) {
+            size += blockSize;
+        }
+        int length = int(size - records.size());
+        int filler = length - QByteArray::number(length).size() - 10;
+        records += QByteArray::number(length) + " comment=" + QByteArray(filler, ' ') + '\n';
+    }
+
+    QByteArray blocks;
+    qint64 mtime = qBound<qint64>(0, member.mtime, MAX_OCTAL_11);
+    if (!records.isEmpty()) {
+        char block[BLOCK_SIZE] = {};
+        QByteArray baseName = member.name;
+        if (baseName.endsWith('/')) {
+            baseName.chop(1);
+        }
+        baseName = baseName.mid(baseName.lastIndexOf('/') + 1);
+        putString(block, 100, "PaxHeaders/" + baseName);
+        putOctal(block + 100, 8, 0644);
+        putOctal(block + 108, 8, qMin<qint64>(member.uid, MAX_OCTAL_7));
+        putOctal(block + 116, 8, qMin<qint64>(member.gid, MAX_OCTAL_7));
+        putOctal(block + 124, 12, records.size());
+        putOctal(block + 136, 12, mtime);
+        block[156] = 'x';
+        std::memcpy(block + 257, "ustar", 6);
+        std::memcpy(block + 263, "00", 2);
+        setChecksum(block);
+        blocks.append(block, BLOCK_SIZE);
+        blocks += records;
+        blocks += QByteArray(int(roundToBlock(records.size()) - records.size()), '\0');
+    }
+
+    char block[BLOCK_SIZE] = {};
+    putString(block, 100, name);
+    putOctal(block + 100, 8, member.mode & 07777);
+    putOctal(block + 108, 8, qMin<qint64>(member.uid, MAX_OCTAL_7));
+    putOctal(block + 116, 8, qMin<qint64>(member.gid, MAX_OCTAL_7));
+    // Oversized values are in the PAX records
+    putOctal(block + 124, 12, member.size > MAX_OCTAL_11 ? 0 : member.size);
+    putOctal(block + 136, 12, mtime);
+    block[156] = member.type;
+    putString(block + 157, 100, member.linkTarget);
+    std::memcpy(block + 257, "ustar", 6);
+    std::memcpy(block + 263, "00", 2);
+    putString(block + 265, 32, userName(member.uid));
+    putString(block + 297, 32, groupName(member.gid));
+    if (member.type == '3' || member.type == '4') {
+        putOctal(block + 329, 8, qMin<qint64>(member.deviceMajor, MAX_OCTAL_7));
+        putOctal(block + 337, 8, qMin<qint64>(member.deviceMinor, MAX_OCTAL_7));
+    }
+    putString(block + 345, 155, prefix);
+    setChecksum(block);
+    blocks.append(block, BLOCK_SIZE);
+    return blocks;
+}
+
+bool TarWriter::copyPayload(const Member &member, int source) {
+    qint64 copied = 0;
+    if (reflinks && member.device == archiveDevice && member.size >= REFLINK_MIN_SIZE
+        && offset % blockSize == 0) {
+        copied = cloneRange(source, member.size);
+        if (copied < 0) {
+            return false;
+        }
+    }
+    if (copied < member.size) {
+        copied = kernelCopy(source, member.size);
+        if (copied < 0) {
+            return false;
+        }
+    }
+    if (copied < member.size && !bufferedCopy(member, source, copied)) {
+        return false;
+    }
+    qint64 padding = roundToBlock(member.size) - member.size;
+    if (padding > 0) {
+        queue(QByteArray(int(padding), '\0'));
+    }
+    return true;
+}
+
+qint64 TarWriter::cloneRange(int source, qint64 size) {
+#ifdef FICLONERANGE
+    struct file_clone_range range;
+    range.src_fd = source;
+    range.src_offset = 0;
+    range.src_length = quint64(size);
+    range.dest_offset = quint64(offset);
+    if (ioctl(fd, FICLONERANGE, &range) != 0) {
+        // EINVAL is about this file, e.g. it changed size; anything else
+        // means the filesystem does not share extents
+        if (errno != EINVAL) {
+            reflinks = false;
+        }
+        return 0;
+    }
+    // The clone leaves the file offset where it was
+    offset += size;
+    if (lseek(fd, offset, SEEK_SET) < 0) {
+        fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+        return -1;
+    }
+    bytesWritten += size;
+    return reportProgress() ? size : -1;
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(size);
+    reflinks = false;
+    return 0;
+#endif
+}
+
+qint64 TarWriter::kernelCopy(int source, qint64 size) {
+    qint64 copied = 0;
+    while (copied < size && copyFileRange) {
+        ssize_t count = copy_file_range(source, nullptr, fd, nullptr, size_t(qMin(size - copied, KERNEL_CHUNK)), 0);
+        if (count < 0) {
+            // Unsupported for this pair of files (older kernels refuse to
+            // cross filesystems), or at all when ENOSYS
+            if (copied == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                if (errno == ENOSYS) {
+                    copyFileRange = false;
+                }
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+            return -1;
+        }
+        // The file shrank; the buffered copy reports it
+        if (count == 0) {
+            return copied;
+        }
+        copied += count;
+        offset += count;
+        bytesWritten += count;
+        if (!reportProgress()) {
+            return -1;
+        }
+    }
+    while (copied < size && sendFile) {
+        ssize_t count = sendfile(fd, source, nullptr, size_t(qMin(size - copied, KERNEL_CHUNK)));
+        if (count < 0) {
+            if (copied == 0 && (errno == ENOSYS || errno == EINVAL)) {
+                if (errno == ENOSYS) {
+                    sendFile = false;
+                }
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+            return -1;
+        }
+        if (count == 0) {
+            return copied;
+        }
+        copied += count;
+        offset += count;
+        bytesWritten += count;
+        if (!reportProgress()) {
+            return -1;
+        }
+    }
+    return copied;
+}
+
+bool TarWriter::bufferedCopy(const Member &member, int source, qint64 copied) {
+    if (buffer.isEmpty()) {
+        buffer.resize(int(BUFFER_SIZE));
+    }
+    while (copied < member.size) {
+        ssize_t count = ::read(source, buffer.data(), size_t(qMin(member.size - copied, BUFFER_SIZE)));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            return fail(QString("Cannot read %1: %2").arg(member.path, systemError()));
+        }
+        // The header promised more; tar pads and warns, but a short member
+        // would silently differ from the file
+        if (count == 0) {
+            return fail(QString("%1 shrank while being read").arg(member.path));
+        }
+        if (!writeOut(buffer.constData(), count)) {
+            return false;
+        }
+        copied += count;
+        offset += count;
+        bytesWritten += count;
+        if (!reportProgress()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TarWriter::writeOut(const char *data, qint64 size) {
+    while (size > 0) {
+        ssize_t count = ::write(fd, data, size_t(size));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+        }
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool TarWriter::flushPending() {
+    if (!writeOut(pending.constData(), pending.size())) {
+        return false;
+    }
+    pending.clear();
+    return true;
+}
+
+bool TarWriter::reportProgress() {
+    if (progressCallback && !progressCallback(bytesWritten)) {
+        return fail("Cancelled");
+    }
+    return true;
+}
+
+QByteArray TarWriter::userName(quint32 uid) {
+    auto cached = users.constFind(uid);
+    if (cached != users.constEnd()) {
+        return cached.value();
+    }
+    struct passwd *entry = getpwuid(uid_t(uid));
+    QByteArray name = entry ? QByteArray(entry->pw_name) : QByteArray();
+    // The field holds 31 bytes and a NUL
+    if (name.size() > 31) {
+        name.clear();
+    }
+    users.insert(uid, name);
+    return name;
+}
+
+QByteArray TarWriter::groupName(quint32 gid) {
+    auto cached = groups.constFind(gid);
+    if (cached != groups.constEnd()) {
+        return cached.value();
+    }
+    struct group *entry = getgrgid(gid_t(gid));
+    QByteArray name = entry ? QByteArray(entry->gr_name) : QByteArray();
+    if (name.size() > 31) {
+        name.clear();
+    }
+    groups.insert(gid, name);
+    return name;
+}
@@ -0,0 +1,106 @@
+#ifndef TARWRITER_H
+#define TARWRITER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QByteArray>
+#include <functional>
+
+// Writes an uncompressed tar archive in-process: ustar headers, with PAX
+// records for long names, large sizes and ids. Payloads never pass
+// through userspace when the kernel can copy them: a reflink where the
+// filesystem shares extents (the data of large members is aligned to the
+// filesystem block for that), otherwise copy_file_range, then sendfile,
+// and a buffered copy only where none of those work. Small members are
+// gathered with their headers into large writes.
+class TarWriter {
+public:
+    explicit TarWriter(const QString &archivePath);
+    ~TarWriter();
+
+    // Collects files and, recursively, directories as members named by
+    // their path without the leading '/', as tar does. False if one of
+    // them cannot be read.
+    bool addFiles(const QStringList &files);
+    qint64 totalBytes() const { return inputBytes; }
+    int totalFiles() const { return members.size(); }
+
+    // Writes the archive next to archivePath and moves it into place once
+    // complete; nothing is left behind on failure
+    bool write();
+
+    // Called as payload bytes are written, with the count so far;
+    // returning false cancels
+    void setProgressCallback(const std::function<bool(qint64)> &callback) { progressCallback = callback; }
+    qint64 filesDone() const { return filesWritten; }
+    QString currentFile() const { return current; }
+    QString getLastError() const { return lastError; }
+
+private:
+    struct Member {
+        QString path;
+        QByteArray name;       // directories end in '/'
+        QByteArray linkTarget;
+        char type = '0';
+        quint32 mode = 0;      // st_mode
+        quint32 uid = 0;
+        quint32 gid = 0;
+        qint64 size = 0;
+        qint64 mtime = 0;
+        quint32 deviceMajor = 0;
+        quint32 deviceMinor = 0;
+        quint64 device = 0;    // st_dev, to know whether a reflink may work
+    };
+
+    bool addMember(const QString &path);
+    bool fail(const QString &message);
+    bool writeMember(const Member &member);
+    // Header blocks of member, PAX header first when needed. aligned pads
+    // the PAX records so the payload starts on a filesystem block.
+    QByteArray header(const Member &member, bool aligned);
+    bool copyPayload(const Member &member, int source);
+    // Bytes reflinked, 0 where that does not work, -1 on error
+    qint64 cloneRange(int source, qint64 size);
+    // Bytes copied by copy_file_range or sendfile, -1 on error
+    qint64 kernelCopy(int source, qint64 size);
+    // The rest of the payload, after copied bytes
+    bool bufferedCopy(const Member &member, int source, qint64 copied);
+    void queue(const QByteArray &data);
+    bool writeOut(const char *data, qint64 size);
+    bool flushPending();
+    bool reportProgress();
+    QByteArray userName(quint32 uid);
+    QByteArray groupName(quint32 gid);
+
+    QString archivePath;
+    QString temporaryPath;
+    int fd;
+    quint64 archiveDevice;
+    qint64 blockSize;
+    qint64 offset;           // archive size including pending output
+    QByteArray pending;      // headers and small members not yet written
+    QByteArray buffer;
+
+    QVector<Member> members;
+    QSet<QByteArray> names;
+    // First name of each multiply linked file, by device and inode
+    QHash<QPair<quint64, quint64>, QByteArray> linked;
+    QHash<quint32, QByteArray> users;
+    QHash<quint32, QByteArray> groups;
+    qint64 inputBytes;
+
+    bool reflinks;
+    bool copyFileRange;
+    bool sendFile;
+    qint64 bytesWritten;
+    qint64 filesWritten;
+    QString current;
+    QString lastError;
+    std::function<bool(qint64)> progressCallback;
+};
+
+#endif // TARWRITER_H
@@ -0,0 +1,177 @@
+#include "XzBlockSource.h"
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+static const qint64 INPUT_SIZE = 256 * 1024;
+// The index of a sane archive is a few bytes per block
+static const qint64 MAX_INDEX_SIZE = 64 * 1024 * 1024;
+
+namespace {
+struct IndexDeleter {
+    void operator()(lzma_index *index) const { lzma_index_end(index, nullptr); }
+};
+typedef std::unique_ptr<lzma_index, IndexDeleter> IndexPointer;
+}
+
+XzBlockSource::XzBlockSource(const QString &archivePath)
+    : BlockSource(archivePath), blockEnded(false) {
+    // Equivalent to LZMA_STREAM_INIT
+    std::memset(&stream, 0, sizeof(stream));
+}
+
+XzBlockSource::~XzBlockSource() {
+    lzma_end(&stream);
+}
+
+bool XzBlockSource::readIndex() {
+    // Streams are found from the end backwards: footer, index, and the
+    // index's size leads to the stream header
+    IndexPointer combined;
+    qint64 position = file.size();
+    while (position > 0) {
+        qint64 padding = 0;
+        uint8_t footer[LZMA_STREAM_HEADER_SIZE];
+        while (true) {
+            if (position < 2 * LZMA_STREAM_HEADER_SIZE || !file.seek(position - LZMA_STREAM_HEADER_SIZE)
+                || file.read(reinterpret_cast<char *>(footer), LZMA_STREAM_HEADER_SIZE) != LZMA_STREAM_HEADER_SIZE) {
+                return fail("Not an xz file");
+            }
+            // Stream padding comes in multiples of four null bytes
+            const uint8_t *tail = footer + LZMA_STREAM_HEADER_SIZE - 4;
+            if (tail[0] || tail[1] || tail[2] || tail[3]) {
+                break;
+            }
+            position -= 4;
+            padding += 4;
+        }
+
+        lzma_stream_flags footerFlags;
+        if (lzma_stream_footer_decode(&footerFlags, footer) != LZMA_OK) {
+            return fail("Not an xz file");
+        }
+        qint64 indexSize = qint64(footerFlags.backward_size);
+        qint64 indexStart = position - LZMA_STREAM_HEADER_SIZE - indexSize;
+        if (indexSize > MAX_INDEX_SIZE || indexStart < LZMA_STREAM_HEADER_SIZE || !file.seek(indexStart)) {
+            return fail("Damaged xz index");
+        }
+        QByteArray indexData = file.read(indexSize);
+        if (indexData.size() != indexSize) {
+            return fail("Damaged xz index");
+        }
+        lzma_index *decoded = nullptr;
+        uint64_t memoryLimit = UINT64_MAX;
+        size_t inputPosition = 0;
+        if (lzma_index_buffer_decode(&decoded, &memoryLimit, nullptr,
+                                     reinterpret_cast<const uint8_t *>(indexData.constData()),
+                                     &inputPosition, size_t(indexData.size())) != LZMA_OK) {
+            return fail("Damaged xz index");
+        }
+        IndexPointer index(decoded);
+
+        qint64 streamStart = position - qint64(lzma_index_stream_size(index.get()));
+        uint8_t header[LZMA_STREAM_HEADER_SIZE];
+        lzma_stream_flags headerFlags;
+        if (streamStart < 0 || !file.seek(streamStart)
+            || file.read(reinterpret_cast<char *>(header), LZMA_STREAM_HEADER_SIZE) != LZMA_STREAM_HEADER_SIZE
+            || lzma_stream_header_decode(&headerFlags, header) != LZMA_OK
+            || lzma_stream_flags_compare(&headerFlags, &footerFlags) != LZMA_OK) {
+            return fail("Damaged xz stream header");
+        }
+        if (lzma_index_stream_flags(index.get(), &footerFlags) != LZMA_OK
+            || lzma_index_stream_padding(index.get(), lzma_vli(padding)) != LZMA_OK) {
+            return fail("Damaged xz index");
+        }
+
+        // Appending takes over the later streams' index
+        if (combined) {
+            if (lzma_index_cat(index.get(), combined.get(), nullptr) != LZMA_OK) {
+                return fail("Damaged xz index");
+            }
+            combined.release();
+        }
+        combined = std::move(index);
+        position = streamStart;
+    }
+    if (!combined) {
+        return fail("Not an xz file");
+    }
+
+    lzma_index_iter iterator;
+    lzma_index_iter_init(&iterator, combined.get());
+    while (!lzma_index_iter_next(&iterator, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+        Block block;
+        block.in = qint64(iterator.block.compressed_file_offset);
+        block.packedSize = qint64(iterator.block.total_size);
+        block.out = qint64(iterator.block.uncompressed_file_offset);
+        block.size = qint64(iterator.block.uncompressed_size);
+        blocks.append(block);
+        checks.append(int(iterator.stream.flags->check));
+    }
+    input.resize(int(INPUT_SIZE));
+    return true;
+}
+
+bool XzBlockSource::startBlock(const Block &block) {
+    blockEnded = false;
+    stream.avail_in = 0;
+
+    uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+    if (readInput(reinterpret_cast<char *>(header), 1) != 1 || header[0] == 0) {
+        return fail(QString("Damaged block header at offset %1").arg(block.in));
+    }
+    qint64 headerSize = lzma_block_header_size_decode(header[0]);
+    if (readInput(reinterpret_cast<char *>(header) + 1, headerSize - 1) != headerSize - 1) {
+        return fail(QString("Damaged block header at offset %1").arg(block.in));
+    }
+
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block options;
+    std::memset(&options, 0, sizeof(options));
+    options.version = 1;
+    options.header_size = uint32_t(headerSize);
+    options.check = lzma_check(checks.at(int(&block - blocks.constData())));
+    options.filters = filters;
+    if (lzma_block_header_decode(&options, nullptr, header) != LZMA_OK) {
+        return fail(QString("Damaged block header at offset %1").arg(block.in));
+    }
+    lzma_ret status = lzma_block_decoder(&stream, &options);
+    // The decoder keeps copies of the filter options
+    for (int i = 0; filters[i].id != LZMA_VLI_UNKNOWN; ++i) {
+        std::free(filters[i].options);
+    }
+    if (status != LZMA_OK) {
+        return fail(status == LZMA_MEM_ERROR ? QString("Out of memory")
+                                             : QString("Unsupported xz filter"));
+    }
+    return true;
+}
+
+qint64 XzBlockSource::decode(char *buffer, qint64 size) {
+    if (blockEnded) {
+        return 0;
+    }
+    stream.next_out = reinterpret_cast<uint8_t *>(buffer);
+    stream.avail_out = size_t(size);
+    while (stream.avail_out > 0) {
+        if (stream.avail_in == 0) {
+            qint64 count = readInput(input.data(), input.size());
+            if (count < 0) {
+                return -1;
+            }
+            stream.next_in = reinterpret_cast<const uint8_t *>(input.constData());
+            stream.avail_in = size_t(count);
+        }
+        lzma_ret status = lzma_code(&stream, LZMA_RUN);
+        if (status == LZMA_STREAM_END) {
+            blockEnded = true;
+            break;
+        }
+        if (status != LZMA_OK) {
+            fail(status == LZMA_BUF_ERROR ? QString("Unexpected end of compressed data")
+                                          : QString("Corrupt compressed data"));
+            return -1;
+        }
+    }
+    return size - qint64(stream.avail_out);
+}
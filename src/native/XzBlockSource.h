@@ -0,0 +1,27 @@
+#ifndef XZBLOCKSOURCE_H
+#define XZBLOCKSOURCE_H
+
+#include "BlockSource.h"
+#include <lzma.h>
+
+// Block access to .xz files through the index every xz stream ends with.
+// Concatenated streams and stream padding are handled; output of
+// multi-threaded xz, pixz or xz --block-size has many blocks.
+class XzBlockSource : public BlockSource {
+public:
+    explicit XzBlockSource(const QString &archivePath);
+    ~XzBlockSource() override;
+
+protected:
+    bool readIndex() override;
+    bool startBlock(const Block &block) override;
+    qint64 decode(char *buffer, qint64 size) override;
+
+private:
+    lzma_stream stream;
+    QVector<int> checks;  // lzma_check of each block's stream
+    QByteArray input;
+    bool blockEnded;
+};
+
+#endif // XZBLOCKSOURCE_H
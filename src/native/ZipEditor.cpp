@@ -0,0 +1,299 @@
+#include "ZipEditor.h"
+#include "ZipReader.h"
+#include "ZipWriter.h"
+#include "../utils/ArchiveUtils.h"
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const qint64 CENTRAL_HEADER_SIZE = 46;
+static const quint16 ZIP64_EXTRA_ID = 0x0001;
+static const quint32 ZIP64_MARKER = 0xFFFFFFFF;
+// Moves through a buffer, and through copy_file_range once source and
+// target are this far apart, since its ranges must not overlap
+static const qint64 BUFFER_SIZE = 1024 * 1024;
+// Bytes per kernel-side copy call, so progress and cancellation keep up
+static const qint64 KERNEL_CHUNK = 64 * 1024 * 1024;
+
+static inline quint16 read16(const char *p) { return qFromLittleEndian<quint16>(p); }
+static inline quint32 read32(const char *p) { return qFromLittleEndian<quint32>(p); }
+
+static QString systemError() {
+    return QString::fromLocal8Bit(std::strerror(errno));
+}
+
+// Rewrites the local header offset of a central directory record, in its
+// ZIP64 extra field if the 32-bit one is saturated
+static void setLocalHeaderOffset(QByteArray &record, qint64 offset) {
+    char *header = record.data();
+    if (read32(header + 42) != ZIP64_MARKER) {
+        qToLittleEndian(quint32(offset), header + 42);
+        return;
+    }
+    int nameLength = read16(header + 28);
+    int extraLength = read16(header + 30);
+    char *extra = header + CENTRAL_HEADER_SIZE + nameLength;
+    for (int pos = 0; pos + 4 <= extraLength; pos += 4 + read16(extra + pos + 2)) {
+        if (read16(extra + pos) != ZIP64_EXTRA_ID) {
+            continue;
+        }
+        // The 64-bit fields present come in this order: sizes, then offset
+        int field = pos + 4;
+        if (read32(header + 24) == ZIP64_MARKER) {
+            field += 8;
+        }
+        if (read32(header + 20) == ZIP64_MARKER) {
+            field += 8;
+        }
+        if (field + 8 <= pos + 4 + read16(extra + pos + 2)) {
+            qToLittleEndian(quint64(offset), extra + field);
+        }
+        return;
+    }
+}
+
+ZipEditor::ZipEditor(const QString &archivePath)
+    : archivePath(archivePath), directoryOffset(0), originalSize(0), copyFileRange(true) {
+}
+
+bool ZipEditor::fail(const QString &message) {
+    lastError = message;
+    return false;
+}
+
+bool ZipEditor::open() {
+    ZipReader reader(archivePath);
+    if (!reader.open()) {
+        return fail(reader.getLastError());
+    }
+    // Self-extractors and the like are left to zip, which knows their offsets
+    if (reader.getBaseOffset() != 0) {
+        return fail("Archive has data in front of it");
+    }
+
+    members.clear();
+    for (const ZipEntry &entry : reader.getEntries()) {
+        Member member;
+        member.record = reader.record(entry);
+        member.start = qint64(entry.localHeaderOffset);
+        member.end = reader.memberEnd(entry);
+        if (member.record.isEmpty() || member.end < 0) {
+            return fail(QString("Damaged local header for %1").arg(entry.name));
+        }
+        member.name = member.record.mid(int(CENTRAL_HEADER_SIZE), read16(member.record.constData() + 28));
+        members.append(member);
+    }
+    directoryOffset = reader.getDirectoryOffset();
+    comment = reader.getComment();
+    reader.close();
+
+    QFile file(archivePath);
+    originalSize = file.size();
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(directoryOffset)) {
+        return fail(file.errorString());
+    }
+    tail = file.read(originalSize - directoryOffset);
+    if (tail.size() != originalSize - directoryOffset) {
+        return fail(file.errorString());
+    }
+    return true;
+}
+
+QSet<QString> ZipEditor::remove(const QStringList &names) {
+    QSet<QString> requested;
+    for (const QString &name : names) {
+        requested.insert(ArchiveUtils::normalizeMemberName(name));
+    }
+    QSet<QString> found;
+    for (Member &member : members) {
+        // Names are compared the way ZipReader decodes them
+        QString name = QString::fromUtf8(member.name);
+        if (name.contains(QChar::ReplacementCharacter)) {
+            name = QString::fromLatin1(member.name);
+        }
+        QString selector = ArchiveUtils::selectedBy(ArchiveUtils::normalizeMemberName(name), requested);
+        if (!selector.isEmpty()) {
+            member.removed = true;
+            found.insert(selector);
+        }
+    }
+    return found;
+}
+
+void ZipEditor::prepare(ZipWriter &writer) {
+    QByteArray records;
+    qint64 count = 0;
+    qint64 end = 0;
+    qint64 referenced = 0;
+    for (Member &member : members) {
+        referenced = qMax(referenced, member.end);
+        if (writer.memberNames().contains(member.name)) {
+            member.removed = true;
+        }
+        if (member.removed) {
+            continue;
+        }
+        records += member.record;
+        ++count;
+        end = qMax(end, member.end);
+    }
+    // Members dropped by this update are still in the directory restore()
+    // puts back, so their data must survive the write. Holes that earlier
+    // updates left at the end are free to be written over.
+    if (referenced > end) {
+        end = directoryOffset;
+    }
+    writer.appendTo(end, records, count, comment);
+}
+
+bool ZipEditor::restore() {
+    QFile file(archivePath);
+    if (!file.open(QIODevice::ReadWrite) || !file.seek(directoryOffset)
+        || file.write(tail) != tail.size() || !file.flush() || !file.resize(originalSize)) {
+        return fail(QString("Cannot restore %1: %2").arg(archivePath, file.errorString()));
+    }
+    return true;
+}
+
+QVector<int> ZipEditor::liveMembers() const {
+    QVector<int> live;
+    for (int i = 0; i < members.size(); ++i) {
+        if (!members.at(i).removed) {
+            live.append(i);
+        }
+    }
+    std::sort(live.begin(), live.end(), [this](int a, int b) {
+        return members.at(a).start < members.at(b).start;
+    });
+    return live;
+}
+
+qint64 ZipEditor::reclaimableBytes() const {
+    qint64 holes = 0;
+    qint64 cursor = 0;
+    for (int index : liveMembers()) {
+        const Member &member = members.at(index);
+        holes += qMax<qint64>(0, member.start - cursor);
+        cursor = qMax(cursor, member.end);
+    }
+    return holes + qMax<qint64>(0, directoryOffset - cursor);
+}
+
+qint64 ZipEditor::bytesToMove() const {
+    qint64 bytes = 0;
+    qint64 cursor = 0;
+    bool moving = false;
+    for (int index : liveMembers()) {
+        const Member &member = members.at(index);
+        moving = moving || member.start > cursor;
+        if (moving) {
+            bytes += member.end - member.start;
+        }
+        cursor = member.end;
+    }
+    return bytes;
+}
+
+bool ZipEditor::compact(const std::function<bool(qint64)> &progress) {
+    QVector<int> live = liveMembers();
+    // Members sharing bytes cannot be moved apart; leave such archives be
+    qint64 cursor = 0;
+    for (int index : live) {
+        if (members.at(index).start < cursor) {
+            return fail("Archive members overlap");
+        }
+        cursor = members.at(index).end;
+    }
+
+    int fd = ::open(QFile::encodeName(archivePath).constData(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+    }
+    bool success = true;
+    qint64 moved = 0;
+    cursor = 0;
+    for (int index : live) {
+        Member &member = members[index];
+        qint64 length = member.end - member.start;
+        if (member.start > cursor) {
+            // Stopping halfway through a member would lose it
+            if (progress && !progress(moved)) {
+                success = fail("Cancelled");
+                break;
+            }
+            if (!move(fd, member.start, cursor, length, moved, progress)) {
+                success = false;
+                break;
+            }
+            setLocalHeaderOffset(member.record, cursor);
+            member.start = cursor;
+            member.end = cursor + length;
+        }
+        cursor = member.end;
+    }
+    if (::close(fd) != 0 && success) {
+        return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+    }
+    return success;
+}
+
+bool ZipEditor::move(int fd, qint64 from, qint64 to, qint64 length, qint64 &moved,
+                     const std::function<bool(qint64)> &progress) {
+    // Always downwards, so copying front to back never overwrites bytes
+    // still to be read
+    while (length > 0) {
+        qint64 gap = from - to;
+        ssize_t count = -1;
+        if (copyFileRange && gap >= BUFFER_SIZE) {
+            loff_t input = from;
+            loff_t output = to;
+            count = copy_file_range(fd, &input, fd, &output, size_t(qMin(qMin(length, gap), KERNEL_CHUNK)), 0);
+            if (count < 0) {
+                if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP
+                    && errno != EINTR) {
+                    return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+                }
+                if (errno != EINTR) {
+                    copyFileRange = false;
+                }
+                continue;
+            }
+        } else {
+            if (buffer.isEmpty()) {
+                buffer.resize(int(BUFFER_SIZE));
+            }
+            count = pread(fd, buffer.data(), size_t(qMin(length, BUFFER_SIZE)), from);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0) {
+                return fail(QString("Cannot read %1: %2").arg(archivePath, systemError()));
+            }
+            for (ssize_t done = 0; done < count;) {
+                ssize_t written = pwrite(fd, buffer.constData() + done, size_t(count - done), to + done);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    return fail(QString("Cannot write %1: %2").arg(archivePath, systemError()));
+                }
+                done += written;
+            }
+        }
+        if (count == 0) {
+            return fail(QString("Unexpected end of %1").arg(archivePath));
+        }
+        from += count;
+        to += count;
+        length -= count;
+        moved += count;
+        if (progress) {
+            progress(moved);
+        }
+    }
+    return true;
+}
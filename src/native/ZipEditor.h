@@ -0,0 +1,79 @@
+#ifndef ZIPEDITOR_H
+#define ZIPEDITOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QSet>
+#include <QByteArray>
+#include <functional>
+
+class ZipWriter;
+
+// Changes a ZIP archive in place instead of rewriting it. Removing members
+// only drops their central directory records: their data stays behind as
+// a hole until compact() moves the members after it down. New members are
+// written by a ZipWriter after the last member that stays, over the old
+// central directory and any holes earlier updates left at the end; members
+// dropped by the same update stay untouched, so restore() can put them
+// back. Tools reading the central directory never see the holes;
+// streaming readers that walk the local headers do, until the archive is
+// compacted.
+class ZipEditor {
+public:
+    explicit ZipEditor(const QString &archivePath);
+
+    // Reads the central directory and keeps a copy of the archive's tail
+    // for restore(). Fails for archives with data in front of them.
+    bool open();
+    QString getLastError() const { return lastError; }
+
+    // Drops the members selected by names, a directory selecting everything
+    // below it; returns the names that selected something
+    QSet<QString> remove(const QStringList &names);
+    // Sets writer up to update the archive: its members go after the last
+    // one that stays, or after the old directory while members it drops lie
+    // beyond that, replacing any of the same name; the directory after
+    // them keeps the records of the others
+    void prepare(ZipWriter &writer);
+    // Puts the original central directory back after writer failed; every
+    // member it names is still intact
+    bool restore();
+
+    // Bytes in holes left by removed members
+    qint64 reclaimableBytes() const;
+    // Moves every member after a hole down over it. progress gets the bytes
+    // moved so far; returning false stops before the next member. Either
+    // way a writer must be prepare()d afterwards, since the old directory
+    // no longer matches. Not crash-safe: a member half moved is lost.
+    bool compact(const std::function<bool(qint64)> &progress);
+    // Bytes compact() has to move
+    qint64 bytesToMove() const;
+
+private:
+    struct Member {
+        QByteArray name;      // raw, as in the record
+        QByteArray record;
+        qint64 start = 0;     // local header
+        qint64 end = 0;       // past the data and data descriptor
+        bool removed = false;
+    };
+
+    bool fail(const QString &message);
+    // Indices of the members that stay, by position in the file
+    QVector<int> liveMembers() const;
+    bool move(int fd, qint64 from, qint64 to, qint64 length, qint64 &moved,
+              const std::function<bool(qint64)> &progress);
+
+    QString archivePath;
+    QVector<Member> members;
+    qint64 directoryOffset;
+    qint64 originalSize;
+    QByteArray tail;          // central directory and end records as found
+    QByteArray comment;
+    QByteArray buffer;
+    bool copyFileRange;
+    QString lastError;
+};
+
+#endif // ZIPEDITOR_H
@@ -0,0 +1,332 @@
+#include "ZipExtractor.h"
+#include "Crc32.h"
+#include "../utils/ArchiveUtils.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <algorithm>
+#include <zlib.h>
+
+static const quint16 METHOD_STORED = 0;
+static const quint16 METHOD_DEFLATED = 8;
+// Input handed to inflate and output written per call; zlib counts in uInt
+static const qint64 CHUNK_SIZE = 1024 * 1024;
+
+ZipExtractor::ZipExtractor(const ZipReader &reader, const QString &destination)
+    : reader(reader), destination(destination), finished(false),
+      nextIndex(0), bytesWritten(0), filesWritten(0), cancelled(false), failed(false) {
+}
+
+ZipExtractor::~ZipExtractor() {
+    cancel();
+    pool.waitForDone();
+}
+
+bool ZipExtractor::canExtract(const ZipEntry &entry) {
+    if (entry.isEncrypted()) {
+        return false;
+    }
+    return entry.isDirectory() || entry.method == METHOD_STORED || entry.method == METHOD_DEFLATED;
+}
+
+void ZipExtractor::start(const QVector<int> &indices, int threads) {
+    const QVector<ZipEntry> &entries = reader.getEntries();
+    sink.reset(new ExtractionSink(threads));
+    queue = indices;
+    // Largest first, so a big member picked up last does not leave the
+    // other workers idle at the end
+    std::stable_sort(queue.begin(), queue.end(), [&entries](int a, int b) {
+        return entries.at(a).uncompressedSize > entries.at(b).uncompressedSize;
+    });
+
+    int workers = qBound(1, threads, qMax(1, queue.size()));
+    pool.setMaxThreadCount(workers);
+    for (int i = 0; i < workers; ++i) {
+        pool.start(QRunnable::create([this]() { work(); }));
+    }
+}
+
+bool ZipExtractor::wait(int msecs) {
+    if (!pool.waitForDone(msecs)) {
+        return false;
+    }
+    if (!finished) {
+        finished = true;
+        if (!isStopping() && !sink->finish()) {
+            fail(sink->getLastError());
+        }
+        if (!isStopping()) {
+            createLinks();
+        }
+        if (!isStopping()) {
+            applyDirectoryAttributes();
+        }
+    }
+    return true;
+}
+
+void ZipExtractor::cancel() {
+    cancelled.store(true);
+    if (sink) {
+        sink->cancel();
+    }
+}
+
+QString ZipExtractor::currentFile() const {
+    QMutexLocker locker(&mutex);
+    return current;
+}
+
+QString ZipExtractor::getLastError() const {
+    QMutexLocker locker(&mutex);
+    return lastError;
+}
+
+void ZipExtractor::fail(const QString &message) {
+    QMutexLocker locker(&mutex);
+    // The first error is the interesting one, the rest are often fallout
+    if (lastError.isEmpty()) {
+        lastError = message;
+    }
+    failed.store(true);
+}
+
+void ZipExtractor::work() {
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    // Negative window bits: raw deflate data, ZIP has no zlib wrapper
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        fail("Cannot initialize decompressor");
+        return;
+    }
+    QByteArray buffer(int(CHUNK_SIZE), Qt::Uninitialized);
+
+    const QVector<ZipEntry> &entries = reader.getEntries();
+    while (!isStopping()) {
+        int index = nextIndex.fetch_add(1);
+        if (index >= queue.size()) {
+            break;
+        }
+        const ZipEntry &entry = entries.at(queue.at(index));
+        {
+            QMutexLocker locker(&mutex);
+            current = entry.name;
+        }
+        if (!extractEntry(stream, entry, buffer)) {
+            break;
+        }
+        // Read once; keeps a large archive from crowding out the output
+        reader.release(entry);
+        filesWritten.fetch_add(1);
+    }
+
+    inflateEnd(&stream);
+}
+
+bool ZipExtractor::extractEntry(z_stream &stream, const ZipEntry &entry, QByteArray &buffer) {
+    QString relative = ArchiveUtils::safeRelativePath(ArchiveUtils::normalizeMemberName(entry.name));
+    if (relative.isEmpty()) {
+        fail(QString("Unsafe member name %1").arg(entry.name));
+        return false;
+    }
+    QString target = destination + "/" + relative;
+
+    if (entry.isSymLink()) {
+        QByteArray linkTarget;
+        bool decoded = decode(stream, entry, buffer, [&linkTarget](const char *data, qint64 size) {
+            linkTarget.append(data, int(size));
+            return true;
+        });
+        if (!decoded) {
+            return false;
+        }
+        QMutexLocker locker(&mutex);
+        links.append(qMakePair(relative, linkTarget));
+        return true;
+    }
+
+    if (!checkPath(entry.isDirectory() ? relative : QFileInfo(relative).path())) {
+        return false;
+    }
+    if (entry.isDirectory()) {
+        if (!QDir().mkpath(target)) {
+            fail(QString("Cannot create directory %1").arg(target));
+            return false;
+        }
+        return true;
+    }
+    // Workers race to create shared parents; mkpath tolerates that
+    QDir().mkpath(QFileInfo(target).path());
+
+    if (entry.uncompressedSize <= quint64(ExtractionSink::SMALL_FILE_LIMIT)) {
+        QByteArray content;
+        content.reserve(int(entry.uncompressedSize));
+        bool decoded = decode(stream, entry, buffer, [this, &content, &entry](const char *data, qint64 size) {
+            // The directory may understate the size; buffer no more than it claims
+            if (content.size() + size > qint64(entry.uncompressedSize)) {
+                fail(QString("CRC error in %1").arg(entry.name));
+                return false;
+            }
+            content.append(data, int(size));
+            return true;
+        });
+        if (!decoded) {
+            return false;
+        }
+        QDateTime modified = entry.modified();
+        qint64 mtime = modified.isValid() ? modified.toSecsSinceEpoch() : ExtractionSink::NO_TIME;
+        if (!sink->writeFile(target, content, entry.unixMode() & 0777, mtime)) {
+            // Cancelled, or failed on an earlier file
+            if (sink->hasFailed()) {
+                fail(sink->getLastError());
+            }
+            return false;
+        }
+        return true;
+    }
+
+    QFile out(target);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fail(QString("Cannot write %1: %2").arg(target, out.errorString()));
+        return false;
+    }
+    bool decoded = decode(stream, entry, buffer, [this, &out, &target](const char *data, qint64 size) {
+        if (out.write(data, size) != size) {
+            fail(QString("Cannot write %1: %2").arg(target, out.errorString()));
+            return false;
+        }
+        return true;
+    });
+    if (!decoded) {
+        return false;
+    }
+
+    // Flushed first, or closing would move the timestamp again
+    out.flush();
+    out.setFileTime(entry.modified(), QFileDevice::FileModificationTime);
+    if (entry.unixMode() != 0) {
+        out.setPermissions(ArchiveUtils::toPermissions(entry.unixMode()));
+    }
+    return true;
+}
+
+bool ZipExtractor::decode(z_stream &stream, const ZipEntry &entry, QByteArray &buffer,
+                          const Sink &sink) {
+    const uchar *input = reader.payload(entry);
+    if (!input) {
+        fail(QString("Damaged local header for %1").arg(entry.name));
+        return false;
+    }
+
+    quint32 crc = 0;
+    quint64 produced = 0;
+
+    if (entry.method == METHOD_STORED) {
+        // Written straight from the mapping
+        while (produced < entry.compressedSize) {
+            if (isStopping()) {
+                return false;
+            }
+            qint64 count = qint64(qMin<quint64>(entry.compressedSize - produced, CHUNK_SIZE));
+            const uchar *chunk = input + produced;
+            crc = Crc32::update(crc, chunk, count);
+            if (!sink(reinterpret_cast<const char *>(chunk), count)) {
+                return false;
+            }
+            produced += quint64(count);
+            bytesWritten.fetch_add(count);
+        }
+    } else {
+        inflateReset(&stream);
+        stream.avail_in = 0;
+        quint64 consumed = 0;
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (isStopping()) {
+                return false;
+            }
+            if (stream.avail_in == 0 && consumed < entry.compressedSize) {
+                uInt count = uInt(qMin<quint64>(entry.compressedSize - consumed, CHUNK_SIZE));
+                stream.next_in = const_cast<Bytef *>(input + consumed);
+                stream.avail_in = count;
+                consumed += count;
+            }
+            stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+            stream.avail_out = uInt(buffer.size());
+
+            status = inflate(&stream, Z_NO_FLUSH);
+            // Z_BUF_ERROR here means the input ran out before the stream ended
+            if (status != Z_OK && status != Z_STREAM_END) {
+                fail(QString("Corrupt data in %1").arg(entry.name));
+                return false;
+            }
+
+            qint64 count = buffer.size() - qint64(stream.avail_out);
+            if (count > 0) {
+                crc = Crc32::update(crc, reinterpret_cast<const uchar *>(buffer.constData()), count);
+                if (!sink(buffer.constData(), count)) {
+                    return false;
+                }
+                produced += quint64(count);
+                bytesWritten.fetch_add(count);
+            }
+        }
+    }
+
+    if (produced != entry.uncompressedSize || crc != entry.crc32) {
+        fail(QString("CRC error in %1").arg(entry.name));
+        return false;
+    }
+    return true;
+}
+
+bool ZipExtractor::checkPath(const QString &relative) {
+    bool linked;
+    {
+        // Only real directories are made while workers run, so a path
+        // checked once stays good
+        QMutexLocker locker(&mutex);
+        linked = ArchiveUtils::passesSymLink(destination, relative, &checkedPaths);
+    }
+    if (linked) {
+        fail(QString("Refusing to extract through the symbolic link in %1").arg(relative));
+        return false;
+    }
+    return true;
+}
+
+void ZipExtractor::createLinks() {
+    for (const QPair<QString, QByteArray> &link : links) {
+        // Checked afresh: an earlier link may sit on the way to this one
+        QString parent = QFileInfo(link.first).path();
+        if (ArchiveUtils::passesSymLink(destination, parent)) {
+            fail(QString("Refusing to extract through the symbolic link in %1").arg(link.first));
+            return;
+        }
+        QString target = destination + "/" + link.first;
+        QDir().mkpath(QFileInfo(target).path());
+        QFile::remove(target);
+        if (!QFile::link(QString::fromUtf8(link.second), target)) {
+            fail(QString("Cannot create link %1").arg(target));
+            return;
+        }
+    }
+}
+
+void ZipExtractor::applyDirectoryAttributes() {
+    const QVector<ZipEntry> &entries = reader.getEntries();
+    for (int index : queue) {
+        const ZipEntry &entry = entries.at(index);
+        if (!entry.isDirectory() || entry.unixMode() == 0) {
+            continue;
+        }
+        QString relative = ArchiveUtils::safeRelativePath(ArchiveUtils::normalizeMemberName(entry.name));
+        QFile::setPermissions(destination + "/" + relative, ArchiveUtils::toPermissions(entry.unixMode()));
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef ZIPEXTRACTOR_H
+#define ZIPEXTRACTOR_H
+
+#include "ZipReader.h"
+#include "ExtractionSink.h"
+#include <QThreadPool>
+#include <QScopedPointer>
+#include <QMutex>
+#include <QByteArray>
+#include <QPair>
+#include <QSet>
+#include <atomic>
+#include <functional>
+
+struct z_stream_s;
+
+// Extracts stored and deflated members of an open ZipReader on a pool of
+// worker threads. Every worker owns one inflate stream and takes the next
+// member as soon as it is done with its last, reading straight from the
+// mapped archive and writing its own output files; each member's CRC-32 is
+// checked while it is written. Small members are decoded into memory,
+// checked, and handed to an ExtractionSink that writes them in batches.
+class ZipExtractor {
+public:
+    // reader must stay open while the extractor runs
+    ZipExtractor(const ZipReader &reader, const QString &destination);
+    ~ZipExtractor();
+
+    // Whether entry can be extracted in-process; the rest needs a tool
+    static bool canExtract(const ZipEntry &entry);
+
+    // Starts extracting entries (indices into the reader's entry list) with
+    // up to threads workers and returns at once
+    void start(const QVector<int> &indices, int threads);
+    // Waits up to msecs; true once the workers are done and the sink has
+    // written everything. Symbolic links are created at that point, so no
+    // member can be written through one, and directory permissions are
+    // applied last so they cannot lock anything out.
+    bool wait(int msecs);
+    // Thread-safe: workers stop after their current chunk
+    void cancel();
+
+    qint64 bytesDone() const { return bytesWritten.load(); }
+    qint64 filesDone() const { return filesWritten.load(); }
+    // Member a worker started on most recently
+    QString currentFile() const;
+    bool hasFailed() const { return failed.load(); }
+    QString getLastError() const;
+
+private:
+    typedef std::function<bool(const char *data, qint64 size)> Sink;
+
+    void work();
+    bool extractEntry(z_stream_s &stream, const ZipEntry &entry, QByteArray &buffer);
+    // Feeds the uncompressed bytes of entry to sink and verifies them
+    bool decode(z_stream_s &stream, const ZipEntry &entry, QByteArray &buffer, const Sink &sink);
+    // Fails unless relative can be written without following a link
+    bool checkPath(const QString &relative);
+    void createLinks();
+    bool isStopping() const { return cancelled.load() || failed.load(); }
+    void fail(const QString &message);
+    void applyDirectoryAttributes();
+
+    const ZipReader &reader;
+    QString destination;
+    QVector<int> queue;
+    QThreadPool pool;
+    QScopedPointer<ExtractionSink> sink;
+    bool finished;
+
+    std::atomic<int> nextIndex;
+    std::atomic<qint64> bytesWritten;
+    std::atomic<qint64> filesWritten;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> failed;
+
+    mutable QMutex mutex;
+    QString current;
+    QString lastError;
+    QSet<QString> checkedPaths;
+    // Relative path and target of each symbolic link, made once the rest is out
+    QVector<QPair<QString, QByteArray>> links;
+};
+
+#endif // ZIPEXTRACTOR_H
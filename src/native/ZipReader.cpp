@@ -0,0 +1,308 @@
+#include "ZipReader.h"
+#include "../utils/ArchiveUtils.h"
+#include <QtEndian>
+
+static const quint32 EOCD_SIGNATURE = 0x06054b50;
+static const quint32 ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+static const quint32 ZIP64_EOCD_SIGNATURE = 0x06064b50;
+static const quint32 CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+static const quint32 LOCAL_HEADER_SIGNATURE = 0x04034b50;
+static const quint32 DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+
+static const qint64 EOCD_SIZE = 22;
+static const qint64 ZIP64_LOCATOR_SIZE = 20;
+static const qint64 ZIP64_EOCD_SIZE = 56;
+static const qint64 CENTRAL_HEADER_SIZE = 46;
+static const qint64 LOCAL_HEADER_SIZE = 30;
+static const qint64 MAX_COMMENT_SIZE = 0xFFFF;
+
+static const quint16 ZIP64_EXTRA_ID = 0x0001;
+static const quint16 DATA_DESCRIPTOR_FLAG = 0x0008;
+static const quint16 UTF8_FLAG = 0x0800;
+static const quint32 ZIP64_MARKER = 0xFFFFFFFF;
+static const quint32 DOS_DIRECTORY = 0x10;
+static const int HOST_UNIX = 3;
+
+static inline quint16 read16(const uchar *p) { return qFromLittleEndian<quint16>(p); }
+static inline quint32 read32(const uchar *p) { return qFromLittleEndian<quint32>(p); }
+static inline quint64 read64(const uchar *p) { return qFromLittleEndian<quint64>(p); }
+
+static QString decodeName(const uchar *name, int length, quint16 flags) {
+    const char *text = reinterpret_cast<const char *>(name);
+    if (flags & UTF8_FLAG) {
+        return QString::fromUtf8(text, length);
+    }
+    // No charset declared: Unix tools write UTF-8 anyway. Anything else is
+    // taken as Latin-1, Qt has no CP437 codec.
+    QString decoded = QString::fromUtf8(text, length);
+    if (decoded.contains(QChar::ReplacementCharacter)) {
+        return QString::fromLatin1(text, length);
+    }
+    return decoded;
+}
+
+// Replaces the 32-bit fields saturated at 0xFFFFFFFF with their ZIP64 values,
+// which follow in this fixed order for the fields that need them
+static void applyZip64Extra(const uchar *extra, int length, ZipEntry &entry) {
+    int pos = 0;
+    while (pos + 4 <= length) {
+        quint16 id = read16(extra + pos);
+        int size = read16(extra + pos + 2);
+        if (pos + 4 + size > length) {
+            return;
+        }
+
+        if (id == ZIP64_EXTRA_ID) {
+            const uchar *field = extra + pos + 4;
+            int offset = 0;
+            if (entry.uncompressedSize == ZIP64_MARKER && offset + 8 <= size) {
+                entry.uncompressedSize = read64(field + offset);
+                offset += 8;
+            }
+            if (entry.compressedSize == ZIP64_MARKER && offset + 8 <= size) {
+                entry.compressedSize = read64(field + offset);
+                offset += 8;
+            }
+            if (entry.localHeaderOffset == ZIP64_MARKER && offset + 8 <= size) {
+                entry.localHeaderOffset = read64(field + offset);
+            }
+            return;
+        }
+        pos += 4 + size;
+    }
+}
+
+bool ZipEntry::isDirectory() const {
+    return name.endsWith('/') || (externalAttributes & DOS_DIRECTORY);
+}
+
+QDateTime ZipEntry::modified() const {
+    QDate date(1980 + (dosDate >> 9), (dosDate >> 5) & 0xF, dosDate & 0x1F);
+    QTime time(dosTime >> 11, (dosTime >> 5) & 0x3F, (dosTime & 0x1F) * 2);
+    return QDateTime(date, time);
+}
+
+bool ZipEntry::isSymLink() const {
+    return (unixMode() & 0170000) == 0120000;
+}
+
+quint32 ZipEntry::unixMode() const {
+    // Unix hosts keep st_mode in the upper half of the external attributes
+    if ((versionMadeBy >> 8) != HOST_UNIX) {
+        return 0;
+    }
+    return externalAttributes >> 16;
+}
+
+QString ZipEntry::permissions() const {
+    quint32 mode = unixMode();
+    if (mode == 0) {
+        return QString();
+    }
+    return ArchiveUtils::formatPermissions(mode);
+}
+
+ZipReader::ZipReader(const QString &archivePath)
+    : archivePath(archivePath), data(nullptr), dataSize(0), baseOffset(0), directoryOffset(0) {
+}
+
+ZipReader::~ZipReader() {
+    close();
+}
+
+void ZipReader::close() {
+    source.reset();
+    data = nullptr;
+    dataSize = 0;
+}
+
+bool ZipReader::fail(const QString &message) {
+    lastError = message;
+    close();
+    return false;
+}
+
+bool ZipReader::open() {
+    close();
+    entries.clear();
+    baseOffset = 0;
+    directoryOffset = 0;
+    comment.clear();
+
+    QString error;
+    source = ArchiveSource::open(archivePath, &error);
+    if (!source) {
+        return fail(QString("Cannot map archive: %1").arg(error));
+    }
+    dataSize = source->size();
+    if (dataSize < EOCD_SIZE) {
+        return fail("Not a ZIP archive");
+    }
+    data = source->data();
+    // Only the end records and the directory are read here
+    source->advise(ArchiveSource::Random);
+
+    qint64 eocd = findEndOfCentralDirectory();
+    if (eocd < 0) {
+        return fail("End of central directory not found");
+    }
+
+    comment = QByteArray(reinterpret_cast<const char *>(data + eocd + EOCD_SIZE), read16(data + eocd + 20));
+    quint64 count = read16(data + eocd + 10);
+    quint64 directorySize = read32(data + eocd + 12);
+    quint64 storedOffset = read32(data + eocd + 16);
+    // Where the central directory ends in the file, right before its end record
+    qint64 directoryEnd = eocd;
+
+    qint64 locator = eocd - ZIP64_LOCATOR_SIZE;
+    if (locator >= 0 && read32(data + locator) == ZIP64_LOCATOR_SIGNATURE) {
+        quint64 recordOffset = read64(data + locator + 8);
+        // Usually right before the locator; the stored offset is off by
+        // whatever was prepended to the archive
+        qint64 record = locator - ZIP64_EOCD_SIZE;
+        if (recordOffset <= quint64(locator) && quint64(locator) - recordOffset >= quint64(ZIP64_EOCD_SIZE)
+            && read32(data + recordOffset) == ZIP64_EOCD_SIGNATURE) {
+            record = qint64(recordOffset);
+        }
+        if (record < 0 || read32(data + record) != ZIP64_EOCD_SIGNATURE) {
+            return fail("ZIP64 end of central directory not found");
+        }
+        count = read64(data + record + 32);
+        directorySize = read64(data + record + 40);
+        storedOffset = read64(data + record + 48);
+        directoryEnd = record;
+    }
+
+    if (directorySize > quint64(directoryEnd)
+        || storedOffset > quint64(directoryEnd) - directorySize) {
+        return fail("Central directory lies outside the archive");
+    }
+    baseOffset = directoryEnd - qint64(storedOffset + directorySize);
+    directoryOffset = qint64(storedOffset) + baseOffset;
+
+    return readCentralDirectory(directoryOffset, qint64(directorySize), count);
+}
+
+qint64 ZipReader::findEndOfCentralDirectory() const {
+    // The end record is followed only by the archive comment
+    qint64 lowest = qMax<qint64>(0, dataSize - EOCD_SIZE - MAX_COMMENT_SIZE);
+    for (qint64 pos = dataSize - EOCD_SIZE; pos >= lowest; --pos) {
+        if (data[pos] == 'P' && read32(data + pos) == EOCD_SIGNATURE
+            && pos + EOCD_SIZE + read16(data + pos + 20) <= dataSize) {
+            return pos;
+        }
+    }
+    return -1;
+}
+
+bool ZipReader::readCentralDirectory(qint64 offset, qint64 size, quint64 count) {
+    // The 16-bit count wraps in archives written without ZIP64 records, so
+    // the directory is walked to its end and the count is only a hint
+    entries.reserve(int(qMin<quint64>(count, quint64(size / CENTRAL_HEADER_SIZE))));
+
+    qint64 pos = offset;
+    qint64 end = offset + size;
+    while (pos < end) {
+        if (pos + CENTRAL_HEADER_SIZE > end || read32(data + pos) != CENTRAL_HEADER_SIGNATURE) {
+            return fail(QString("Damaged central directory record %1").arg(entries.size()));
+        }
+
+        const uchar *header = data + pos;
+        int nameLength = read16(header + 28);
+        int extraLength = read16(header + 30);
+        int commentLength = read16(header + 32);
+        qint64 recordSize = CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+        if (pos + recordSize > end) {
+            return fail(QString("Damaged central directory record %1").arg(entries.size()));
+        }
+
+        ZipEntry entry;
+        entry.versionMadeBy = read16(header + 4);
+        entry.flags = read16(header + 8);
+        entry.method = read16(header + 10);
+        entry.dosTime = read16(header + 12);
+        entry.dosDate = read16(header + 14);
+        entry.crc32 = read32(header + 16);
+        entry.compressedSize = read32(header + 20);
+        entry.uncompressedSize = read32(header + 24);
+        entry.externalAttributes = read32(header + 38);
+        entry.localHeaderOffset = read32(header + 42);
+        entry.name = decodeName(header + CENTRAL_HEADER_SIZE, nameLength, entry.flags);
+        entry.recordOffset = pos;
+        entry.recordSize = recordSize;
+        applyZip64Extra(header + CENTRAL_HEADER_SIZE + nameLength, extraLength, entry);
+
+        entries.append(entry);
+        pos += recordSize;
+    }
+
+    return true;
+}
+
+bool ZipReader::hasLocalHeader(const ZipEntry &entry) const {
+    qint64 header = qint64(entry.localHeaderOffset) + baseOffset;
+    return data && header >= 0 && header + LOCAL_HEADER_SIZE <= dataSize
+        && read32(data + header) == LOCAL_HEADER_SIGNATURE && read16(data + header + 8) == entry.method;
+}
+
+const uchar *ZipReader::payload(const ZipEntry &entry) const {
+    if (!data) {
+        return nullptr;
+    }
+    qint64 header = qint64(entry.localHeaderOffset) + baseOffset;
+    if (header < 0 || header + LOCAL_HEADER_SIZE > dataSize
+        || read32(data + header) != LOCAL_HEADER_SIGNATURE) {
+        return nullptr;
+    }
+    // The local name and extra field may differ from the central ones
+    qint64 start = header + LOCAL_HEADER_SIZE + read16(data + header + 26) + read16(data + header + 28);
+    if (start > dataSize || entry.compressedSize > quint64(dataSize - start)) {
+        return nullptr;
+    }
+    return data + start;
+}
+
+void ZipReader::advise(ArchiveSource::Access access) const {
+    if (source) {
+        source->advise(access);
+    }
+}
+
+void ZipReader::release(const ZipEntry &entry) const {
+    const uchar *start = payload(entry);
+    if (start) {
+        source->release(qint64(start - data), qint64(entry.compressedSize));
+    }
+}
+
+QByteArray ZipReader::record(const ZipEntry &entry) const {
+    if (!data || entry.recordOffset + entry.recordSize > dataSize) {
+        return QByteArray();
+    }
+    return QByteArray(reinterpret_cast<const char *>(data + entry.recordOffset), int(entry.recordSize));
+}
+
+qint64 ZipReader::memberEnd(const ZipEntry &entry) const {
+    const uchar *start = payload(entry);
+    if (!start) {
+        return -1;
+    }
+    qint64 end = qint64(start - data) + qint64(entry.compressedSize);
+    if (!(entry.flags & DATA_DESCRIPTOR_FLAG)) {
+        return end;
+    }
+    // CRC and sizes after the data, signature optional; the sizes are
+    // 64-bit when the local header carries a ZIP64 extra field
+    if (end + 4 <= dataSize && read32(data + end) == DATA_DESCRIPTOR_SIGNATURE) {
+        end += 4;
+    }
+    qint64 header = qint64(entry.localHeaderOffset) + baseOffset;
+    const uchar *extra = data + header + LOCAL_HEADER_SIZE + read16(data + header + 26);
+    int extraLength = read16(data + header + 28);
+    bool zip64 = false;
+    for (int pos = 0; pos + 4 <= extraLength && !zip64; pos += 4 + read16(extra + pos + 2)) {
+        zip64 = read16(extra + pos) == ZIP64_EXTRA_ID;
+    }
+    end += zip64 ? 20 : 12;
+    return end <= dataSize ? end : -1;
+}
@@ -0,0 +1,91 @@
+#ifndef ZIPREADER_H
+#define ZIPREADER_H
+
+#include <QString>
+#include <QVector>
+#include <QDateTime>
+#include <QByteArray>
+#include <QSharedPointer>
+#include "../utils/ArchiveSource.h"
+
+// One member as described by its central directory record
+struct ZipEntry {
+    QString name;
+    quint64 compressedSize = 0;
+    quint64 uncompressedSize = 0;
+    quint64 localHeaderOffset = 0;
+    quint32 crc32 = 0;
+    quint32 externalAttributes = 0;
+    quint16 versionMadeBy = 0;
+    quint16 flags = 0;
+    quint16 method = 0;
+    quint16 dosTime = 0;
+    quint16 dosDate = 0;
+    // The central directory record itself, as a file position
+    qint64 recordOffset = 0;
+    qint64 recordSize = 0;
+
+    bool isDirectory() const;
+    bool isSymLink() const;
+    bool isEncrypted() const { return (flags & 0x1) != 0; }
+    QDateTime modified() const;
+    // ls-style mode string for archives made on Unix, empty otherwise
+    QString permissions() const;
+    // Unix st_mode, 0 for archives made elsewhere
+    quint32 unixMode() const;
+};
+
+// Reads the member list of a ZIP archive straight from its central
+// directory, ZIP64 included. The file is read through its shared
+// ArchiveSource mapping; only the end records and the central directory
+// are touched, never the member data.
+class ZipReader {
+public:
+    explicit ZipReader(const QString &archivePath);
+    ~ZipReader();
+
+    bool open();
+    void close();
+
+    QString getLastError() const { return lastError; }
+    const QVector<ZipEntry> &getEntries() const { return entries; }
+    // Archives with data prepended (self-extractors) store offsets relative
+    // to the start of the ZIP part; add this to get file positions
+    qint64 getBaseOffset() const { return baseOffset; }
+    // File position of the central directory, which ends the member data
+    qint64 getDirectoryOffset() const { return directoryOffset; }
+    QByteArray getComment() const { return comment; }
+    // The raw central directory record of entry
+    QByteArray record(const ZipEntry &entry) const;
+    // File position just past entry's data and data descriptor; -1 if the
+    // local header or the data are out of bounds
+    qint64 memberEnd(const ZipEntry &entry) const;
+    // Whether entry's local header is where the central directory says and
+    // agrees with it on the compression method
+    bool hasLocalHeader(const ZipEntry &entry) const;
+    // Compressed bytes of entry inside the mapping (compressedSize long),
+    // located through its local header; nullptr if out of bounds.
+    // Thread-safe while the reader stays open.
+    const uchar *payload(const ZipEntry &entry) const;
+    // Access hint for the whole archive, Sequential before reading every member
+    void advise(ArchiveSource::Access access) const;
+    // Drops entry's data from memory once it has been read through
+    void release(const ZipEntry &entry) const;
+
+private:
+    bool fail(const QString &message);
+    qint64 findEndOfCentralDirectory() const;
+    bool readCentralDirectory(qint64 offset, qint64 size, quint64 count);
+
+    QString archivePath;
+    QSharedPointer<ArchiveSource> source;
+    const uchar *data;
+    qint64 dataSize;
+    qint64 baseOffset;
+    qint64 directoryOffset;
+    QByteArray comment;
+    QVector<ZipEntry> entries;
+    QString lastError;
+};
+
+#endif // ZIPREADER_H
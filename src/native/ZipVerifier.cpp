@@ -0,0 +1,177 @@
+#include "ZipVerifier.h"
+#include "Crc32.h"
+#include <QMutexLocker>
+#include <QRunnable>
+#include <algorithm>
+#include <zlib.h>
+
+static const quint16 METHOD_STORED = 0;
+static const quint16 METHOD_DEFLATED = 8;
+// Input handed to inflate and output thrown away per call; zlib counts in uInt
+static const qint64 CHUNK_SIZE = 1024 * 1024;
+
+ZipVerifier::ZipVerifier(const ZipReader &reader)
+    : reader(reader), resultData(nullptr),
+      nextIndex(0), bytesChecked(0), filesChecked(0), cancelled(false), failed(false) {
+}
+
+ZipVerifier::~ZipVerifier() {
+    cancel();
+    pool.waitForDone();
+}
+
+bool ZipVerifier::canVerify(const ZipEntry &entry) {
+    return !entry.isEncrypted() && (entry.method == METHOD_STORED || entry.method == METHOD_DEFLATED);
+}
+
+void ZipVerifier::start(int threads) {
+    const QVector<ZipEntry> &entries = reader.getEntries();
+    results = QVector<Status>(entries.size(), Ok);
+    resultData = results.data();
+    queue.resize(entries.size());
+    for (int i = 0; i < entries.size(); ++i) {
+        queue[i] = i;
+    }
+    // Largest first, so a big member picked up last does not leave the
+    // other workers idle at the end
+    std::stable_sort(queue.begin(), queue.end(), [&entries](int a, int b) {
+        return entries.at(a).uncompressedSize > entries.at(b).uncompressedSize;
+    });
+
+    int workers = qBound(1, threads, qMax(1, queue.size()));
+    pool.setMaxThreadCount(workers);
+    for (int i = 0; i < workers; ++i) {
+        pool.start(QRunnable::create([this]() { work(); }));
+    }
+}
+
+bool ZipVerifier::wait(int msecs) {
+    return pool.waitForDone(msecs);
+}
+
+void ZipVerifier::cancel() {
+    cancelled.store(true);
+}
+
+QString ZipVerifier::currentFile() const {
+    QMutexLocker locker(&mutex);
+    return current;
+}
+
+QString ZipVerifier::getLastError() const {
+    QMutexLocker locker(&mutex);
+    return lastError;
+}
+
+void ZipVerifier::fail(const QString &message) {
+    QMutexLocker locker(&mutex);
+    if (lastError.isEmpty()) {
+        lastError = message;
+    }
+    failed.store(true);
+}
+
+void ZipVerifier::work() {
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    stream.next_in = Z_NULL;
+    stream.avail_in = 0;
+    // Negative window bits: raw deflate data, ZIP has no zlib wrapper
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        fail("Cannot initialize decompressor");
+        return;
+    }
+    QByteArray buffer(int(CHUNK_SIZE), Qt::Uninitialized);
+
+    const QVector<ZipEntry> &entries = reader.getEntries();
+    while (!isStopping()) {
+        int index = nextIndex.fetch_add(1);
+        if (index >= queue.size()) {
+            break;
+        }
+        const ZipEntry &entry = entries.at(queue.at(index));
+        {
+            QMutexLocker locker(&mutex);
+            current = entry.name;
+        }
+        // Each slot has exactly one writer, and wait() orders it before
+        // the results are read
+        resultData[queue.at(index)] = check(stream, entry, buffer);
+        reader.release(entry);
+        filesChecked.fetch_add(1);
+    }
+
+    inflateEnd(&stream);
+}
+
+ZipVerifier::Status ZipVerifier::check(z_stream &stream, const ZipEntry &entry, QByteArray &buffer) {
+    if (!reader.hasLocalHeader(entry)) {
+        return BadHeader;
+    }
+    const uchar *input = reader.payload(entry);
+    if (!input) {
+        return Truncated;
+    }
+
+    quint32 crc = 0;
+    quint64 produced = 0;
+
+    if (entry.method == METHOD_STORED) {
+        if (entry.compressedSize != entry.uncompressedSize) {
+            return BadHeader;
+        }
+        // Checked straight from the mapping
+        while (produced < entry.compressedSize) {
+            if (isStopping()) {
+                return Ok;
+            }
+            qint64 count = qint64(qMin<quint64>(entry.compressedSize - produced, CHUNK_SIZE));
+            crc = Crc32::update(crc, input + produced, count);
+            produced += quint64(count);
+            bytesChecked.fetch_add(count);
+        }
+    } else {
+        inflateReset(&stream);
+        stream.avail_in = 0;
+        quint64 consumed = 0;
+        int status = Z_OK;
+        while (status != Z_STREAM_END) {
+            if (isStopping()) {
+                return Ok;
+            }
+            if (stream.avail_in == 0 && consumed < entry.compressedSize) {
+                uInt count = uInt(qMin<quint64>(entry.compressedSize - consumed, CHUNK_SIZE));
+                stream.next_in = const_cast<Bytef *>(input + consumed);
+                stream.avail_in = count;
+                consumed += count;
+            }
+            stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+            stream.avail_out = uInt(buffer.size());
+
+            status = inflate(&stream, Z_NO_FLUSH);
+            // Z_BUF_ERROR here means the input ran out before the stream ended
+            if (status == Z_BUF_ERROR) {
+                return Truncated;
+            }
+            if (status != Z_OK && status != Z_STREAM_END) {
+                return Corrupt;
+            }
+
+            qint64 count = buffer.size() - qint64(stream.avail_out);
+            crc = Crc32::update(crc, reinterpret_cast<const uchar *>(buffer.constData()), count);
+            produced += quint64(count);
+            bytesChecked.fetch_add(count);
+            // Not worth decoding on once past the size the directory gives
+            if (produced > entry.uncompressedSize) {
+                return CrcMismatch;
+            }
+        }
+    }
+
+    if (produced != entry.uncompressedSize || crc != entry.crc32) {
+        return CrcMismatch;
+    }
+    return Ok;
+}
@@ -0,0 +1,75 @@
+#ifndef ZIPVERIFIER_H
+#define ZIPVERIFIER_H
+
+#include "ZipReader.h"
+#include <QThreadPool>
+#include <QMutex>
+#include <QVector>
+#include <QByteArray>
+#include <atomic>
+
+struct z_stream_s;
+
+// Tests the members of an open ZipReader on a pool of worker threads, the
+// way ZipExtractor extracts them: each worker owns one inflate stream and
+// reads straight from the mapped archive, but the output goes nowhere once
+// its CRC-32 is taken. A damaged member does not stop the others; every
+// member gets a result.
+class ZipVerifier {
+public:
+    enum Status {
+        Ok,
+        CrcMismatch,    // decoded fine, but not to what the directory says
+        Truncated,      // the data ends early
+        BadHeader,      // no local header where the directory points
+        Corrupt         // the compressed data cannot be decoded
+    };
+
+    // reader must stay open while the verifier runs
+    explicit ZipVerifier(const ZipReader &reader);
+    ~ZipVerifier();
+
+    // Whether entry can be tested in-process; the rest needs a tool
+    static bool canVerify(const ZipEntry &entry);
+
+    // Starts testing every entry with up to threads workers and returns at once
+    void start(int threads);
+    // Waits up to msecs; true once the workers are done
+    bool wait(int msecs);
+    // Thread-safe: workers stop after their current chunk
+    void cancel();
+
+    qint64 bytesDone() const { return bytesChecked.load(); }
+    qint64 filesDone() const { return filesChecked.load(); }
+    // Member a worker started on most recently
+    QString currentFile() const;
+    // Indexed like the reader's entries; complete once wait() returned true
+    // unless cancelled or failed
+    const QVector<Status> &getResults() const { return results; }
+    bool hasFailed() const { return failed.load(); }
+    QString getLastError() const;
+
+private:
+    void work();
+    Status check(z_stream_s &stream, const ZipEntry &entry, QByteArray &buffer);
+    bool isStopping() const { return cancelled.load() || failed.load(); }
+    void fail(const QString &message);
+
+    const ZipReader &reader;
+    QVector<int> queue;
+    QVector<Status> results;
+    Status *resultData;      // workers write here, one slot each
+    QThreadPool pool;
+
+    std::atomic<int> nextIndex;
+    std::atomic<qint64> bytesChecked;
+    std::atomic<qint64> filesChecked;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> failed;
+
+    mutable QMutex mutex;
+    QString current;
+    QString lastError;
+};
+
+#endif // ZIPVERIFIER_H
@@ -0,0 +1,647 @@
+#include "ZipWriter.h"
+#include "Crc32.h"
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static const quint16 METHOD_STORED = 0;
+static const quint16 METHOD_DEFLATED = 8;
+// Input handed to deflate and output collected per chunk; zlib counts in uInt
+static const qint64 CHUNK_SIZE = 1024 * 1024;
+// Members up to this size are compressed in one go, and stored instead
+// when deflate does not make them any smaller
+static const qint64 SMALL_FILE_SIZE = 1024 * 1024;
+// Compressed data each worker may have waiting for the writer
+static const qint64 BUFFER_PER_WORKER = 16 * 1024 * 1024;
+static const qint64 ZIP64_LIMIT = 0xFFFFFFFFLL;
+// Members this large get a ZIP64 local header up front; whether deflate
+// keeps them below 4 GiB is only known once the header is written
+static const qint64 ZIP64_RESERVE_SIZE = 0xFF000000LL;
+static const quint16 VERSION_DEFAULT = 20;
+static const quint16 VERSION_ZIP64 = 45;
+static const quint16 MADE_BY_UNIX = 3 << 8;
+static const quint16 FLAG_UTF8 = 0x0800;
+static const int LOCAL_HEADER_SIZE = 30;
+static const int CRC_FIELD_OFFSET = 14;
+
+// Already compressed formats, stored the way zip -n would
+static const char *const STORED_SUFFIXES[] = {
+    ".zip", ".jar", ".gz", ".tgz", ".bz2", ".xz", ".txz", ".zst", ".lz4", ".7z", ".rar",
+    ".jpg", ".jpeg", ".png", ".gif", ".webp", ".mp3", ".ogg", ".flac", ".mp4", ".mkv",
+    ".webm", ".avi", ".mov"
+};
+
+namespace {
+void put16(QByteArray &out, quint16 value) {
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 2);
+}
+
+void put32(QByteArray &out, quint32 value) {
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 4);
+}
+
+void put64(QByteArray &out, quint64 value) {
+    char bytes[8];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 8);
+}
+
+// 32-bit field of a size or offset; ZIP64 ones go in the extra field
+quint32 field32(qint64 value) {
+    return value >= ZIP64_LIMIT ? quint32(ZIP64_LIMIT) : quint32(value);
+}
+
+void toDosTime(qint64 seconds, quint16 &time, quint16 &date) {
+    QDateTime local = QDateTime::fromSecsSinceEpoch(seconds);
+    QDate day = local.date();
+    // DOS dates cover 1980 to 2107
+    if (day.year() < 1980) {
+        time = 0;
+        date = (1 << 5) | 1;
+        return;
+    }
+    if (day.year() > 2107) {
+        day = QDate(2107, 12, 31);
+    }
+    QTime clock = local.time();
+    time = quint16((clock.hour() << 11) | (clock.minute() << 5) | (clock.second() / 2));
+    date = quint16(((day.year() - 1980) << 9) | (day.month() << 5) | day.day());
+}
+
+bool isCompressedAlready(const QByteArray &name) {
+    QByteArray lower = name.toLower();
+    for (const char *suffix : STORED_SUFFIXES) {
+        if (lower.endsWith(suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Bit 11 marks UTF-8 names; plain ASCII ones go without, as zip does
+quint16 nameFlags(const QByteArray &name) {
+    for (char c : name) {
+        if (uchar(c) >= 0x80) {
+            return FLAG_UTF8;
+        }
+    }
+    return 0;
+}
+
+bool needsZip64(qint64 uncompressedSize, qint64 compressedSize) {
+    return uncompressedSize >= ZIP64_LIMIT || compressedSize >= ZIP64_LIMIT;
+}
+}
+
+ZipWriter::ZipWriter(const QString &archivePath, int compressionLevel)
+    : archivePath(archivePath), level(qBound(0, compressionLevel, 9)), inputBytes(0),
+      bufferBudget(BUFFER_PER_WORKER), appending(false), appendOffset(0), keptCount(0), nextIndex(0), bytesRead(0), filesWritten(0),
+      cancelled(false), failed(false), writing(-1), buffered(0) {
+}
+
+ZipWriter::~ZipWriter() {
+    cancel();
+    pool.waitForDone();
+}
+
+bool ZipWriter::addFiles(const QStringList &files) {
+    for (const QString &file : files) {
+        if (!addMember(file)) {
+            return false;
+        }
+        QFileInfo info(file);
+        if (info.isDir() && !info.isSymLink()) {
+            QDirIterator it(file, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                if (!addMember(it.next())) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool ZipWriter::addMember(const QString &path) {
+    struct stat status;
+    if (lstat(QFile::encodeName(path).constData(), &status) != 0) {
+        lastError = QString("Cannot read %1: %2").arg(path, QString::fromLocal8Bit(std::strerror(errno)));
+        return false;
+    }
+    // Sockets, devices and FIFOs have no place in a ZIP; zip skips them too
+    if (!S_ISREG(status.st_mode) && !S_ISDIR(status.st_mode) && !S_ISLNK(status.st_mode)) {
+        return true;
+    }
+
+    QString name = QDir::cleanPath(path);
+    while (name.startsWith('/')) {
+        name.remove(0, 1);
+    }
+    while (name.startsWith("../")) {
+        name.remove(0, 3);
+    }
+    if (name.isEmpty() || name == "." || name == "..") {
+        return true;
+    }
+
+    Member member;
+    member.path = path;
+    member.name = name.toUtf8();
+    if (S_ISDIR(status.st_mode)) {
+        member.name += '/';
+    }
+    if (names.contains(member.name)) {
+        return true;
+    }
+    names.insert(member.name);
+    member.mode = quint32(status.st_mode);
+    member.size = S_ISREG(status.st_mode) ? qint64(status.st_size) : 0;
+    toDosTime(qint64(status.st_mtime), member.dosTime, member.dosDate);
+    inputBytes += member.size;
+    members.append(member);
+    return true;
+}
+
+void ZipWriter::appendTo(qint64 offset, const QByteArray &records, qint64 recordCount,
+                         const QByteArray &archiveComment) {
+    appending = true;
+    appendOffset = offset;
+    keptRecords = records;
+    keptCount = recordCount;
+    comment = archiveComment;
+}
+
+void ZipWriter::start(int threads) {
+    int workers = qBound(1, threads, qMax(1, int(members.size())));
+    bufferBudget = BUFFER_PER_WORKER * workers;
+    // One more for the writer, which must never wait for a free thread
+    pool.setMaxThreadCount(workers + 1);
+    pool.start(QRunnable::create([this]() { writeArchive(); }));
+    for (int i = 0; i < workers; ++i) {
+        pool.start(QRunnable::create([this]() { work(); }));
+    }
+}
+
+bool ZipWriter::wait(int msecs) {
+    return pool.waitForDone(msecs);
+}
+
+void ZipWriter::cancel() {
+    cancelled.store(true);
+    QMutexLocker locker(&mutex);
+    dataReady.wakeAll();
+    spaceFreed.wakeAll();
+}
+
+QString ZipWriter::currentFile() const {
+    QMutexLocker locker(&mutex);
+    return current;
+}
+
+QString ZipWriter::getLastError() const {
+    QMutexLocker locker(&mutex);
+    return lastError;
+}
+
+void ZipWriter::fail(const QString &message) {
+    QMutexLocker locker(&mutex);
+    // The first error is the interesting one, the rest are often fallout
+    if (lastError.isEmpty()) {
+        lastError = message;
+    }
+    failed.store(true);
+    dataReady.wakeAll();
+    spaceFreed.wakeAll();
+}
+
+void ZipWriter::work() {
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+    // Negative window bits: raw deflate data, ZIP has no zlib wrapper
+    if (deflateInit2(&stream, qMax(1, level), Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fail("Cannot initialize compressor");
+        return;
+    }
+    QByteArray input(int(CHUNK_SIZE), Qt::Uninitialized);
+    QByteArray output(int(CHUNK_SIZE), Qt::Uninitialized);
+
+    while (!isStopping()) {
+        int index = nextIndex.fetch_add(1);
+        if (index >= members.size()) {
+            break;
+        }
+        {
+            QMutexLocker locker(&mutex);
+            current = members.at(index).path;
+        }
+        if (!compressMember(stream, index, input, output)) {
+            break;
+        }
+    }
+
+    deflateEnd(&stream);
+}
+
+bool ZipWriter::compressMember(z_stream &stream, int index, QByteArray &input, QByteArray &output) {
+    const Member &member = members.at(index);
+    quint32 crc = 0;
+
+    if (S_ISDIR(member.mode)) {
+        finishMember(index, crc, 0, 0);
+        return true;
+    }
+    if (S_ISLNK(member.mode)) {
+        // The link text is the member's data, as zip -y stores it
+        char target[PATH_MAX];
+        ssize_t length = readlink(QFile::encodeName(member.path).constData(), target, sizeof(target));
+        if (length < 0) {
+            fail(QString("Cannot read link %1").arg(member.path));
+            return false;
+        }
+        crc = Crc32::update(crc, reinterpret_cast<const uchar *>(target), length);
+        if (!push(index, QByteArray(target, int(length)))) {
+            return false;
+        }
+        finishMember(index, crc, length, length);
+        return true;
+    }
+
+    QFile file(member.path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fail(QString("Cannot read %1: %2").arg(member.path, file.errorString()));
+        return false;
+    }
+    bool deflating = level > 0 && !isCompressedAlready(member.name);
+
+    if (member.size <= SMALL_FILE_SIZE) {
+        QByteArray data = file.readAll();
+        if (file.error() != QFileDevice::NoError) {
+            fail(QString("Cannot read %1: %2").arg(member.path, file.errorString()));
+            return false;
+        }
+        crc = Crc32::update(crc, reinterpret_cast<const uchar *>(data.constData()), data.size());
+        bytesRead.fetch_add(data.size());
+        if (deflating && !data.isEmpty()) {
+            deflateReset(&stream);
+            QByteArray packed(int(deflateBound(&stream, uLong(data.size()))), Qt::Uninitialized);
+            stream.next_in = reinterpret_cast<Bytef *>(data.data());
+            stream.avail_in = uInt(data.size());
+            stream.next_out = reinterpret_cast<Bytef *>(packed.data());
+            stream.avail_out = uInt(packed.size());
+            if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+                fail(QString("Cannot compress %1").arg(member.path));
+                return false;
+            }
+            packed.resize(int(stream.total_out));
+            if (packed.size() < data.size()) {
+                setMethod(index, METHOD_DEFLATED);
+                if (!push(index, packed)) {
+                    return false;
+                }
+                finishMember(index, crc, data.size(), packed.size());
+                return true;
+            }
+        }
+        if (!data.isEmpty() && !push(index, data)) {
+            return false;
+        }
+        finishMember(index, crc, data.size(), data.size());
+        return true;
+    }
+
+    // Larger members are streamed, so the method is settled before reading
+    setMethod(index, deflating ? METHOD_DEFLATED : METHOD_STORED);
+    if (deflating) {
+        deflateReset(&stream);
+        stream.next_out = reinterpret_cast<Bytef *>(output.data());
+        stream.avail_out = uInt(output.size());
+    }
+    qint64 consumed = 0;
+    qint64 produced = 0;
+    while (true) {
+        if (isStopping()) {
+            return false;
+        }
+        qint64 count = file.read(input.data(), input.size());
+        if (count < 0) {
+            fail(QString("Cannot read %1: %2").arg(member.path, file.errorString()));
+            return false;
+        }
+        crc = Crc32::update(crc, reinterpret_cast<const uchar *>(input.constData()), count);
+        consumed += count;
+        bytesRead.fetch_add(count);
+
+        if (!deflating) {
+            if (count == 0) {
+                break;
+            }
+            if (!push(index, input.left(int(count)))) {
+                return false;
+            }
+            produced += count;
+            continue;
+        }
+
+        int flush = count == 0 ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef *>(input.data());
+        stream.avail_in = uInt(count);
+        int status = Z_OK;
+        do {
+            status = deflate(&stream, flush);
+            if (status == Z_STREAM_ERROR) {
+                fail(QString("Cannot compress %1").arg(member.path));
+                return false;
+            }
+            // Handed over in whole chunks, plus the rest at the end
+            if (stream.avail_out == 0 || status == Z_STREAM_END) {
+                qint64 size = output.size() - qint64(stream.avail_out);
+                if (size > 0 && !push(index, output.left(int(size)))) {
+                    return false;
+                }
+                produced += size;
+                stream.next_out = reinterpret_cast<Bytef *>(output.data());
+                stream.avail_out = uInt(output.size());
+            }
+        } while (stream.avail_in > 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+        if (flush == Z_FINISH) {
+            break;
+        }
+    }
+    finishMember(index, crc, consumed, produced);
+    return true;
+}
+
+bool ZipWriter::push(int index, const QByteArray &data) {
+    QMutexLocker locker(&mutex);
+    // The member being written always gets through, so the writer can
+    // drain it; the others wait once they would exceed the budget
+    while (buffered > 0 && buffered + data.size() > bufferBudget && index != writing && !isStopping()) {
+        spaceFreed.wait(&mutex);
+    }
+    if (isStopping()) {
+        return false;
+    }
+    members[index].chunks.append(data);
+    buffered += data.size();
+    dataReady.wakeAll();
+    return true;
+}
+
+void ZipWriter::setMethod(int index, quint16 method) {
+    QMutexLocker locker(&mutex);
+    members[index].method = method;
+}
+
+void ZipWriter::finishMember(int index, quint32 crc, qint64 uncompressedSize, qint64 compressedSize) {
+    QMutexLocker locker(&mutex);
+    Member &member = members[index];
+    member.crc = crc;
+    member.uncompressedSize = uncompressedSize;
+    member.compressedSize = compressedSize;
+    member.done = true;
+    dataReady.wakeAll();
+}
+
+void ZipWriter::writeArchive() {
+    QSaveFile created(archivePath);
+    QFile existing(archivePath);
+    QFileDevice &archive = appending ? static_cast<QFileDevice &>(existing) : created;
+    bool opened = appending ? existing.open(QIODevice::ReadWrite) && existing.seek(appendOffset)
+                            : created.open(QIODevice::WriteOnly);
+    if (!opened) {
+        fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+        return;
+    }
+
+    qint64 offset = appending ? appendOffset : 0;
+    for (int index = 0; index < members.size(); ++index) {
+        if (!writeMember(archive, index, offset)) {
+            created.cancelWriting();
+            return;
+        }
+        filesWritten.fetch_add(1);
+    }
+    if (!writeCentralDirectory(archive, offset) || isStopping()) {
+        created.cancelWriting();
+        return;
+    }
+    // An update may leave the archive shorter than it was
+    bool written = appending ? existing.flush() && existing.resize(existing.pos()) : created.commit();
+    if (!written) {
+        fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+    }
+}
+
+bool ZipWriter::writeMember(QFileDevice &archive, int index, qint64 &offset) {
+    Member &member = members[index];
+    bool complete;
+    quint16 method;
+    quint32 crc = 0;
+    qint64 compressedSize = 0;
+    qint64 uncompressedSize = 0;
+    {
+        QMutexLocker locker(&mutex);
+        writing = index;
+        spaceFreed.wakeAll();
+        while (member.chunks.isEmpty() && !member.done && !isStopping()) {
+            dataReady.wait(&mutex);
+        }
+        if (isStopping()) {
+            return false;
+        }
+        complete = member.done;
+        method = member.method;
+        if (complete) {
+            crc = member.crc;
+            compressedSize = member.compressedSize;
+            uncompressedSize = member.uncompressedSize;
+        }
+    }
+
+    // Members done by now get their final local header right away; the
+    // others are patched afterwards
+    bool zip64 = complete ? needsZip64(uncompressedSize, compressedSize)
+                          : member.size >= ZIP64_RESERVE_SIZE;
+    member.headerOffset = offset;
+    QByteArray header;
+    put32(header, 0x04034b50);
+    put16(header, zip64 ? VERSION_ZIP64 : VERSION_DEFAULT);
+    put16(header, nameFlags(member.name));
+    put16(header, method);
+    put16(header, member.dosTime);
+    put16(header, member.dosDate);
+    put32(header, crc);
+    put32(header, zip64 ? quint32(ZIP64_LIMIT) : quint32(compressedSize));
+    put32(header, zip64 ? quint32(ZIP64_LIMIT) : quint32(uncompressedSize));
+    put16(header, quint16(member.name.size()));
+    put16(header, zip64 ? 20 : 0);
+    header += member.name;
+    if (zip64) {
+        put16(header, 0x0001);
+        put16(header, 16);
+        put64(header, quint64(uncompressedSize));
+        put64(header, quint64(compressedSize));
+    }
+    if (archive.write(header) != header.size()) {
+        fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+        return false;
+    }
+    offset += header.size();
+
+    while (true) {
+        QList<QByteArray> chunks;
+        bool done;
+        {
+            QMutexLocker locker(&mutex);
+            while (member.chunks.isEmpty() && !member.done && !isStopping()) {
+                dataReady.wait(&mutex);
+            }
+            if (isStopping()) {
+                return false;
+            }
+            chunks.swap(member.chunks);
+            done = member.done;
+            for (const QByteArray &chunk : chunks) {
+                buffered -= chunk.size();
+            }
+            spaceFreed.wakeAll();
+        }
+        for (const QByteArray &chunk : chunks) {
+            if (archive.write(chunk) != chunk.size()) {
+                fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+                return false;
+            }
+            offset += chunk.size();
+        }
+        // Chunks are all in before a member is marked done
+        if (done) {
+            break;
+        }
+    }
+
+    if (complete) {
+        return true;
+    }
+    if (!zip64 && needsZip64(member.uncompressedSize, member.compressedSize)) {
+        fail(QString("%1 grew past 4 GiB while being read").arg(member.path));
+        return false;
+    }
+    QByteArray fields;
+    put32(fields, member.crc);
+    put32(fields, zip64 ? quint32(ZIP64_LIMIT) : quint32(member.compressedSize));
+    put32(fields, zip64 ? quint32(ZIP64_LIMIT) : quint32(member.uncompressedSize));
+    QByteArray sizes;
+    put64(sizes, quint64(member.uncompressedSize));
+    put64(sizes, quint64(member.compressedSize));
+    qint64 sizesOffset = member.headerOffset + LOCAL_HEADER_SIZE + member.name.size() + 4;
+    if (!archive.seek(member.headerOffset + CRC_FIELD_OFFSET) || archive.write(fields) != fields.size()
+        || (zip64 && (!archive.seek(sizesOffset) || archive.write(sizes) != sizes.size()))
+        || !archive.seek(offset)) {
+        fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+        return false;
+    }
+    return true;
+}
+
+bool ZipWriter::writeCentralDirectory(QFileDevice &archive, qint64 offset) {
+    qint64 directoryOffset = offset;
+    QByteArray records = keptRecords;
+    for (const Member &member : members) {
+        bool sizes64 = needsZip64(member.uncompressedSize, member.compressedSize);
+        bool offset64 = member.headerOffset >= ZIP64_LIMIT;
+        QByteArray extra;
+        if (sizes64 || offset64) {
+            put16(extra, 0x0001);
+            put16(extra, quint16((sizes64 ? 16 : 0) + (offset64 ? 8 : 0)));
+            if (sizes64) {
+                put64(extra, quint64(member.uncompressedSize));
+                put64(extra, quint64(member.compressedSize));
+            }
+            if (offset64) {
+                put64(extra, quint64(member.headerOffset));
+            }
+        }
+        put32(records, 0x02014b50);
+        put16(records, MADE_BY_UNIX | VERSION_ZIP64);
+        put16(records, extra.isEmpty() ? VERSION_DEFAULT : VERSION_ZIP64);
+        put16(records, nameFlags(member.name));
+        put16(records, member.method);
+        put16(records, member.dosTime);
+        put16(records, member.dosDate);
+        put32(records, member.crc);
+        put32(records, sizes64 ? quint32(ZIP64_LIMIT) : quint32(member.compressedSize));
+        put32(records, sizes64 ? quint32(ZIP64_LIMIT) : quint32(member.uncompressedSize));
+        put16(records, quint16(member.name.size()));
+        put16(records, quint16(extra.size()));
+        put16(records, 0);  // comment
+        put16(records, 0);  // disk
+        put16(records, 0);  // internal attributes
+        // Unix mode in the high half, the MS-DOS directory bit in the low
+        put32(records, (member.mode << 16) | (S_ISDIR(member.mode) ? 0x10 : 0));
+        put32(records, field32(member.headerOffset));
+        records += member.name;
+        records += extra;
+        if (records.size() >= CHUNK_SIZE) {
+            if (archive.write(records) != records.size()) {
+                fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+                return false;
+            }
+            offset += records.size();
+            records.clear();
+        }
+    }
+    offset += records.size();
+
+    qint64 directorySize = offset - directoryOffset;
+    qint64 count = keptCount + members.size();
+    if (count >= 0xFFFF || directorySize >= ZIP64_LIMIT || directoryOffset >= ZIP64_LIMIT) {
+        qint64 recordOffset = offset;
+        put32(records, 0x06064b50);
+        put64(records, 44);  // size of the rest of the record
+        put16(records, MADE_BY_UNIX | VERSION_ZIP64);
+        put16(records, VERSION_ZIP64);
+        put32(records, 0);
+        put32(records, 0);
+        put64(records, quint64(count));
+        put64(records, quint64(count));
+        put64(records, quint64(directorySize));
+        put64(records, quint64(directoryOffset));
+        put32(records, 0x07064b50);
+        put32(records, 0);
+        put64(records, quint64(recordOffset));
+        put32(records, 1);
+    }
+    put32(records, 0x06054b50);
+    put16(records, 0);
+    put16(records, 0);
+    put16(records, quint16(qMin<qint64>(count, 0xFFFF)));
+    put16(records, quint16(qMin<qint64>(count, 0xFFFF)));
+    put32(records, field32(directorySize));
+    put32(records, field32(directoryOffset));
+    put16(records, quint16(comment.size()));
+    records += comment;
+    if (archive.write(records) != records.size()) {
+        fail(QString("Cannot write %1: %2").arg(archivePath, archive.errorString()));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,122 @@
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QSet>
+#include <QByteArray>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+
+struct z_stream_s;
+class QFileDevice;
+
+// Creates a ZIP archive in-process. Worker threads deflate members
+// concurrently, each with its own stream, while one writer thread puts the
+// local headers and data into the archive in member order, followed by the
+// central directory. Compressed data waiting for its turn is held in memory
+// within a fixed budget; the member being written is streamed, and its local
+// header patched once its CRC and sizes are known. ZIP64 records are added
+// where sizes, offsets or the member count need them. A new archive
+// replaces archivePath only once it is complete.
+class ZipWriter {
+public:
+    // compressionLevel as for zip -0 to -9; 0 stores everything
+    ZipWriter(const QString &archivePath, int compressionLevel);
+    ~ZipWriter();
+
+    // Collects files and, recursively, directories as members named by
+    // their path without the leading '/'. Symbolic links are stored as
+    // links. False if one of them cannot be read.
+    bool addFiles(const QStringList &files);
+    qint64 totalBytes() const { return inputBytes; }
+    int totalFiles() const { return members.size(); }
+    const QSet<QByteArray> &memberNames() const { return names; }
+
+    // Updates the existing archive in place instead: the members go into it
+    // from offset on, followed by a central directory of records (taken
+    // from the archive) and theirs, and the file is cut after its end record
+    void appendTo(qint64 offset, const QByteArray &records, qint64 recordCount,
+                  const QByteArray &archiveComment);
+
+    // Starts compressing with up to threads workers and returns at once
+    void start(int threads);
+    // Waits up to msecs; true once the archive is written or abandoned
+    bool wait(int msecs);
+    // Thread-safe: a new archive is not left behind, an update in place
+    // has to be undone by the caller
+    void cancel();
+
+    qint64 bytesDone() const { return bytesRead.load(); }
+    qint64 filesDone() const { return filesWritten.load(); }
+    // Member a worker started on most recently
+    QString currentFile() const;
+    bool hasFailed() const { return failed.load(); }
+    QString getLastError() const;
+
+private:
+    struct Member {
+        QString path;
+        QByteArray name;     // UTF-8, directories end in '/'
+        quint32 mode = 0;    // st_mode
+        qint64 size = 0;     // when collected
+        quint16 dosTime = 0;
+        quint16 dosDate = 0;
+        // Set by the worker under mutex; method before the first chunk
+        quint16 method = 0;
+        quint32 crc = 0;
+        qint64 compressedSize = 0;
+        qint64 uncompressedSize = 0;
+        QList<QByteArray> chunks;
+        bool done = false;
+        // Set by the writer
+        qint64 headerOffset = 0;
+    };
+
+    bool addMember(const QString &path);
+    void work();
+    bool compressMember(z_stream_s &stream, int index, QByteArray &input, QByteArray &output);
+    // Hands compressed data to the writer; blocks while the budget is used
+    // up by members behind the one being written. False when stopping.
+    bool push(int index, const QByteArray &data);
+    void setMethod(int index, quint16 method);
+    void finishMember(int index, quint32 crc, qint64 uncompressedSize, qint64 compressedSize);
+    void writeArchive();
+    bool writeMember(QFileDevice &archive, int index, qint64 &offset);
+    bool writeCentralDirectory(QFileDevice &archive, qint64 offset);
+    bool isStopping() const { return cancelled.load() || failed.load(); }
+    void fail(const QString &message);
+
+    QString archivePath;
+    int level;
+    QVector<Member> members;
+    QSet<QByteArray> names;
+    qint64 inputBytes;
+    qint64 bufferBudget;
+    bool appending;
+    qint64 appendOffset;
+    QByteArray keptRecords;
+    qint64 keptCount;
+    QByteArray comment;
+    QThreadPool pool;
+
+    std::atomic<int> nextIndex;
+    std::atomic<qint64> bytesRead;
+    std::atomic<qint64> filesWritten;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> failed;
+
+    mutable QMutex mutex;
+    QWaitCondition dataReady;
+    QWaitCondition spaceFreed;
+    int writing;         // member the writer is at
+    qint64 buffered;     // compressed bytes not yet written
+    QString current;
+    QString lastError;
+};
+
+#endif // ZIPWRITER_H
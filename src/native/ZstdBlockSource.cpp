@@ -0,0 +1,121 @@
+#include "ZstdBlockSource.h"
+#include <QtEndian>
+#include <zstd.h>
+
+static const qint64 INPUT_SIZE = 256 * 1024;
+static const quint32 SKIPPABLE_MAGIC = 0x184D2A5E;
+static const quint32 SEEKABLE_MAGIC = 0x8F92EAB1;
+static const int SEEK_FOOTER_SIZE = 9;
+static const int SKIPPABLE_HEADER_SIZE = 8;
+// Frames written with --long need more than the default 128 MiB window
+static const int MAX_WINDOW_LOG = 31;
+
+ZstdBlockSource::ZstdBlockSource(const QString &archivePath)
+    : BlockSource(archivePath), context(ZSTD_createDCtx()), inputSize(0), inputPos(0),
+      frameEnded(false) {
+    if (context) {
+        ZSTD_DCtx_setParameter(context, ZSTD_d_windowLogMax, MAX_WINDOW_LOG);
+    }
+}
+
+ZstdBlockSource::~ZstdBlockSource() {
+    ZSTD_freeDCtx(context);
+}
+
+bool ZstdBlockSource::readIndex() {
+    if (!context) {
+        return fail("Out of memory");
+    }
+    qint64 fileSize = file.size();
+    uchar footer[SEEK_FOOTER_SIZE];
+    if (fileSize < SKIPPABLE_HEADER_SIZE + SEEK_FOOTER_SIZE || !file.seek(fileSize - SEEK_FOOTER_SIZE)
+        || file.read(reinterpret_cast<char *>(footer), SEEK_FOOTER_SIZE) != SEEK_FOOTER_SIZE
+        || qFromLittleEndian<quint32>(footer + 5) != SEEKABLE_MAGIC) {
+        return fail("No zstd seek table");
+    }
+    quint32 frames = qFromLittleEndian<quint32>(footer);
+    uchar descriptor = footer[4];
+    // Reserved bits must be clear
+    if (descriptor & 0x7C) {
+        return fail("Unsupported zstd seek table");
+    }
+    qint64 entrySize = (descriptor & 0x80) ? 12 : 8;
+    qint64 tableSize = qint64(frames) * entrySize + SEEK_FOOTER_SIZE;
+    qint64 tableStart = fileSize - tableSize - SKIPPABLE_HEADER_SIZE;
+    if (tableStart < 0 || !file.seek(tableStart)) {
+        return fail("Damaged zstd seek table");
+    }
+    QByteArray table = file.read(tableSize + SKIPPABLE_HEADER_SIZE - SEEK_FOOTER_SIZE);
+    const uchar *data = reinterpret_cast<const uchar *>(table.constData());
+    if (table.size() != tableSize + SKIPPABLE_HEADER_SIZE - SEEK_FOOTER_SIZE
+        || qFromLittleEndian<quint32>(data) != SKIPPABLE_MAGIC
+        || qFromLittleEndian<quint32>(data + 4) != quint32(tableSize)) {
+        return fail("Damaged zstd seek table");
+    }
+
+    qint64 in = 0;
+    qint64 out = 0;
+    for (quint32 i = 0; i < frames; ++i) {
+        const uchar *entry = data + SKIPPABLE_HEADER_SIZE + i * entrySize;
+        Block block;
+        block.in = in;
+        block.packedSize = qFromLittleEndian<quint32>(entry);
+        block.out = out;
+        block.size = qFromLittleEndian<quint32>(entry + 4);
+        blocks.append(block);
+        in += block.packedSize;
+        out += block.size;
+    }
+    // Frames and table have to add up to the whole file
+    if (in != tableStart) {
+        blocks.clear();
+        return fail("Damaged zstd seek table");
+    }
+    input.resize(int(INPUT_SIZE));
+    return true;
+}
+
+bool ZstdBlockSource::startBlock(const Block &block) {
+    Q_UNUSED(block);
+    frameEnded = false;
+    inputSize = 0;
+    inputPos = 0;
+    ZSTD_DCtx_reset(context, ZSTD_reset_session_only);
+    return true;
+}
+
+qint64 ZstdBlockSource::decode(char *buffer, qint64 size) {
+    if (frameEnded) {
+        return 0;
+    }
+    ZSTD_outBuffer output = { buffer, size_t(size), 0 };
+    while (output.pos < output.size) {
+        if (inputPos == inputSize) {
+            qint64 count = readInput(input.data(), input.size());
+            if (count < 0) {
+                return -1;
+            }
+            inputSize = count;
+            inputPos = 0;
+        }
+        // Without input the decoder may still have output to flush
+        ZSTD_inBuffer in = { input.constData(), size_t(inputSize), size_t(inputPos) };
+        size_t produced = output.pos;
+        size_t status = ZSTD_decompressStream(context, &output, &in);
+        inputPos = qint64(in.pos);
+        if (ZSTD_isError(status)) {
+            fail(QString("Corrupt compressed data: %1").arg(ZSTD_getErrorName(status)));
+            return -1;
+        }
+        // 0: the frame is complete and fully flushed
+        if (status == 0) {
+            frameEnded = true;
+            break;
+        }
+        if (in.size == 0 && output.pos == produced) {
+            fail("Unexpected end of compressed data");
+            return -1;
+        }
+    }
+    return qint64(output.pos);
+}
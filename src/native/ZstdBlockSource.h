@@ -0,0 +1,30 @@
+#ifndef ZSTDBLOCKSOURCE_H
+#define ZSTDBLOCKSOURCE_H
+
+#include "BlockSource.h"
+
+struct ZSTD_DCtx_s;
+
+// Block access to .zst files in zstd's seekable format: independent frames
+// followed by a seek table in a skippable frame, as written by the
+// seekable compression API and tools built on it (t2sz and the like).
+// Ordinary zstd output is a single frame and has no such table.
+class ZstdBlockSource : public BlockSource {
+public:
+    explicit ZstdBlockSource(const QString &archivePath);
+    ~ZstdBlockSource() override;
+
+protected:
+    bool readIndex() override;
+    bool startBlock(const Block &block) override;
+    qint64 decode(char *buffer, qint64 size) override;
+
+private:
+    ZSTD_DCtx_s *context;
+    QByteArray input;
+    qint64 inputSize;     // valid bytes in input
+    qint64 inputPos;      // consumed of those
+    bool frameEnded;
+};
+
+#endif // ZSTDBLOCKSOURCE_H
@@ -0,0 +1,151 @@
+#include "ArchiveSource.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWeakPointer>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static QMutex sourcesMutex;
+// Mappings alive somewhere in the process, by absolute path
+static QHash<QString, QWeakPointer<ArchiveSource>> sources;
+
+static QString systemError() {
+    return QString::fromLocal8Bit(std::strerror(errno));
+}
+
+static qint64 modificationTime(const struct stat &status) {
+    return qint64(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+}
+
+QSharedPointer<ArchiveSource> ArchiveSource::open(const QString &path, QString *error) {
+    QString key = QFileInfo(path).absoluteFilePath();
+    QMutexLocker locker(&sourcesMutex);
+    QSharedPointer<ArchiveSource> source = sources.value(key).toStrongRef();
+    if (source && source->isCurrent()) {
+        return source;
+    }
+
+    // Whoever still holds the old mapping keeps it; new readers get this one
+    source.reset(new ArchiveSource(key));
+    QString message;
+    if (!source->map(message)) {
+        if (error) {
+            *error = message;
+        }
+        return QSharedPointer<ArchiveSource>();
+    }
+    for (auto it = sources.begin(); it != sources.end();) {
+        if (it.value().isNull()) {
+            it = sources.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    sources.insert(key, source);
+    return source;
+}
+
+ArchiveSource::ArchiveSource(const QString &path)
+    : path(path), fd(-1), mapping(nullptr), length(0), device(0), inode(0), modified(0) {
+}
+
+ArchiveSource::~ArchiveSource() {
+    if (mapping) {
+        munmap(const_cast<uchar *>(mapping), size_t(length));
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool ArchiveSource::map(QString &error) {
+    fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0) {
+        error = systemError();
+        return false;
+    }
+    if (!S_ISREG(status.st_mode)) {
+        error = "Not a regular file";
+        return false;
+    }
+    length = qint64(status.st_size);
+    device = quint64(status.st_dev);
+    inode = quint64(status.st_ino);
+    modified = modificationTime(status);
+    // mmap refuses empty files; there is nothing to read anyway
+    if (length == 0) {
+        return true;
+    }
+    void *address = mmap(nullptr, size_t(length), PROT_READ, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        error = systemError();
+        return false;
+    }
+    mapping = static_cast<const uchar *>(address);
+    return true;
+}
+
+bool ArchiveSource::isCurrent() const {
+    struct stat status;
+    if (::stat(QFile::encodeName(path).constData(), &status) != 0) {
+        return false;
+    }
+    return quint64(status.st_dev) == device && quint64(status.st_ino) == inode
+        && qint64(status.st_size) == length && modificationTime(status) == modified;
+}
+
+bool ArchiveSource::contains(qint64 offset, qint64 size) const {
+    return offset >= 0 && size >= 0 && offset <= length && size <= length - offset;
+}
+
+ArchiveSpan ArchiveSource::span(qint64 offset, qint64 size) const {
+    ArchiveSpan result;
+    if (offset < 0 || size <= 0 || offset >= length) {
+        return result;
+    }
+    result.data = mapping + offset;
+    result.size = qMin(size, length - offset);
+    return result;
+}
+
+void ArchiveSource::advise(Access access) const {
+    if (!mapping) {
+        return;
+    }
+    int memoryAdvice = MADV_NORMAL;
+    int cacheAdvice = POSIX_FADV_NORMAL;
+    if (access == Sequential) {
+        memoryAdvice = MADV_SEQUENTIAL;
+        cacheAdvice = POSIX_FADV_SEQUENTIAL;
+    } else if (access == Random) {
+        memoryAdvice = MADV_RANDOM;
+        cacheAdvice = POSIX_FADV_RANDOM;
+    }
+    // Hints only; the kernel may ignore them
+    madvise(const_cast<uchar *>(mapping), size_t(length), memoryAdvice);
+    posix_fadvise(fd, 0, 0, cacheAdvice);
+}
+
+void ArchiveSource::release(qint64 offset, qint64 size) const {
+    if (!mapping || !contains(offset, size)) {
+        return;
+    }
+    // Whole pages only; the ones at the ends may still be in use
+    static const qint64 pageSize = qint64(sysconf(_SC_PAGESIZE));
+    qint64 start = (offset + pageSize - 1) / pageSize * pageSize;
+    qint64 end = (offset + size) / pageSize * pageSize;
+    if (end <= start) {
+        return;
+    }
+    // Unmapped from this process first, or the page cache would keep them
+    madvise(const_cast<uchar *>(mapping + start), size_t(end - start), MADV_DONTNEED);
+    posix_fadvise(fd, start, end - start, POSIX_FADV_DONTNEED);
+}
@@ -0,0 +1,73 @@
+#ifndef ARCHIVESOURCE_H
+#define ARCHIVESOURCE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <climits>
+
+// Bytes of an ArchiveSource; valid while the source is held
+struct ArchiveSpan {
+    const uchar *data = nullptr;
+    qint64 size = 0;
+
+    bool isEmpty() const { return size == 0; }
+    // The same bytes without a copy; for headers and other small spans
+    QByteArray bytes() const {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(data), int(qMin<qint64>(size, INT_MAX)));
+    }
+};
+
+// A read-only memory mapping of an archive file, shared by everything in
+// the process that reads the same file: the format detector and the
+// native readers all get the mapping made by whoever opened the file
+// first, for as long as anyone holds it. A file that changed since (size,
+// modification time or inode) gets a new mapping.
+//
+// Access hints go to both the mapping and the page cache. They apply to
+// the whole file, so the last one given wins.
+class ArchiveSource {
+public:
+    enum Access {
+        Normal,
+        Sequential,  // read through once: more readahead, pages dropped behind
+        Random       // hopping between headers: no readahead
+    };
+
+    // The shared mapping of path; null, with error set if given, when the
+    // file cannot be opened or mapped. Thread-safe.
+    static QSharedPointer<ArchiveSource> open(const QString &path, QString *error = nullptr);
+    ~ArchiveSource();
+
+    QString getPath() const { return path; }
+    qint64 size() const { return length; }
+    // The whole file, for parsers that check offsets themselves; nullptr
+    // for an empty file
+    const uchar *data() const { return mapping; }
+    // The bytes at offset, fewer where the file ends first; empty when
+    // offset lies outside the file
+    ArchiveSpan span(qint64 offset, qint64 size) const;
+    bool contains(qint64 offset, qint64 size) const;
+
+    void advise(Access access) const;
+    // Lets the kernel drop the pages wholly inside the range, from this
+    // mapping and the page cache, once they have been read; keeps large
+    // one-off reads from pushing everything else out of memory
+    void release(qint64 offset, qint64 size) const;
+
+private:
+    ArchiveSource(const QString &path);
+    bool map(QString &error);
+    // Whether the file at path is still the one mapped
+    bool isCurrent() const;
+
+    QString path;
+    int fd;
+    const uchar *mapping;
+    qint64 length;
+    quint64 device;
+    quint64 inode;
+    qint64 modified;   // nanoseconds
+};
+
+#endif // ARCHIVESOURCE_H
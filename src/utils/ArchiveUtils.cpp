@@ -1,6 +1,8 @@
 #include "ArchiveUtils.h"
 #include <QFileInfo>
+#include <QFile>
 #include <QDir>
+#include <QDirIterator>
 
 QString ArchiveUtils::sanitizePath(const QString &path) {
     QString sanitized = path;
@@ -82,3 +84,145 @@ QString ArchiveUtils::formatFileSizeString(qint64 bytes) {
     }
     return QString::number(bytes) + " B";
 }
+
+QString ArchiveUtils::formatPermissions(quint32 mode) {
+    QString result;
+    switch (mode & 0170000) {
+        case 0040000: result += 'd'; break;
+        case 0120000: result += 'l'; break;
+        case 0020000: result += 'c'; break;
+        case 0060000: result += 'b'; break;
+        case 0010000: result += 'p'; break;
+        case 0140000: result += 's'; break;
+        default: result += '-';
+    }
+    
+    const char *letters = "rwxrwxrwx";
+    for (int i = 0; i < 9; ++i) {
+        result += (mode & (0400 >> i)) ? QChar(letters[i]) : QChar('-');
+    }
+    return result;
+}
+
+QFileDevice::Permissions ArchiveUtils::toPermissions(quint32 mode) {
+    QFileDevice::Permissions permissions;
+    if (mode & 0400) permissions |= QFileDevice::ReadOwner | QFileDevice::ReadUser;
+    if (mode & 0200) permissions |= QFileDevice::WriteOwner | QFileDevice::WriteUser;
+    if (mode & 0100) permissions |= QFileDevice::ExeOwner | QFileDevice::ExeUser;
+    if (mode & 0040) permissions |= QFileDevice::ReadGroup;
+    if (mode & 0020) permissions |= QFileDevice::WriteGroup;
+    if (mode & 0010) permissions |= QFileDevice::ExeGroup;
+    if (mode & 0004) permissions |= QFileDevice::ReadOther;
+    if (mode & 0002) permissions |= QFileDevice::WriteOther;
+    if (mode & 0001) permissions |= QFileDevice::ExeOther;
+    return permissions;
+}
+
+QString ArchiveUtils::safeRelativePath(const QString &memberName) {
+    // Leading slashes are dropped, like tar and unzip do
+    QString path = memberName;
+    while (path.startsWith('/')) {
+        path.remove(0, 1);
+    }
+    path = QDir::cleanPath(path);
+    if (path.isEmpty() || path == "." || path == ".." || path.startsWith("../")) {
+        return QString();
+    }
+    return path;
+}
+
+bool ArchiveUtils::passesSymLink(const QString &root, const QString &relative, QSet<QString> *checked) {
+    QString path;
+    for (const QString &part : relative.split('/', Qt::SkipEmptyParts)) {
+        path = path.isEmpty() ? part : path + "/" + part;
+        if (checked && checked->contains(path)) {
+            continue;
+        }
+        if (QFileInfo(root + "/" + path).isSymLink()) {
+            return true;
+        }
+        if (checked) {
+            checked->insert(path);
+        }
+    }
+    return false;
+}
+
+QString ArchiveUtils::normalizeMemberName(QString name) {
+    while (name.startsWith("./")) {
+        name.remove(0, 2);
+    }
+    while (name.endsWith('/')) {
+        name.chop(1);
+    }
+    return name;
+}
+
+QString ArchiveUtils::selectedBy(const QString &name, const QSet<QString> &requested) {
+    if (requested.contains(name)) {
+        return name;
+    }
+    for (int slash = name.indexOf('/'); slash > 0; slash = name.indexOf('/', slash + 1)) {
+        QString parent = name.left(slash);
+        if (requested.contains(parent)) {
+            return parent;
+        }
+    }
+    return QString();
+}
+
+qint64 ArchiveUtils::totalSize(const QStringList &paths, qint64 *fileCount) {
+    qint64 bytes = 0;
+    qint64 files = 0;
+    
+    for (const QString &path : paths) {
+        QFileInfo info(path);
+        if (info.isDir() && !info.isSymLink()) {
+            QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System | QDir::NoSymLinks,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                it.next();
+                bytes += it.fileInfo().size();
+                ++files;
+            }
+        } else if (info.exists()) {
+            bytes += info.size();
+            ++files;
+        }
+    }
+    
+    if (fileCount) {
+        *fileCount = files;
+    }
+    return bytes;
+}
+
+bool ArchiveUtils::mergeDirectory(const QString &source, const QString &destination) {
+    QDir sourceDir(source);
+    QDir().mkpath(destination);
+    bool success = true;
+    
+    const QFileInfoList children = sourceDir.entryInfoList(QDir::AllEntries | QDir::Hidden
+                                                           | QDir::System | QDir::NoDotAndDotDot);
+    for (const QFileInfo &child : children) {
+        QString target = destination + "/" + child.fileName();
+        QFileInfo targetInfo(target);
+        
+        if (child.isDir() && !child.isSymLink() && targetInfo.isDir() && !targetInfo.isSymLink()) {
+            success &= mergeDirectory(child.filePath(), target);
+            continue;
+        }
+        if (targetInfo.isSymLink() || targetInfo.isFile()) {
+            QFile::remove(target);
+        } else if (targetInfo.exists()) {
+            // A directory (or anything else) in the way is the user's: the
+            // staged copy stays where it is rather than replacing it
+            success = false;
+            continue;
+        }
+        // Same filesystem, so this is a rename rather than a copy
+        success &= QDir().rename(child.filePath(), target);
+    }
+    
+    return QDir().rmdir(source) && success;
+}
@@ -3,6 +3,8 @@
 
 #include <QString>
 #include <QStringList>
+#include <QFileDevice>
+#include <QSet>
 
 class ArchiveUtils {
 public:
@@ -13,6 +15,31 @@ public:
     static QString getDefaultArchiveName(const QString &basePath);
     static qint64 formatFileSize(qint64 bytes);
     static QString formatFileSizeString(qint64 bytes);
+    // ls-style string such as "drwxr-xr-x" for a Unix st_mode
+    static QString formatPermissions(quint32 mode);
+    // Permission bits of a Unix st_mode as Qt file permissions
+    static QFileDevice::Permissions toPermissions(quint32 mode);
+    // Archive member name as a path relative to the extraction directory;
+    // empty if it would escape it
+    static QString safeRelativePath(const QString &memberName);
+    // Whether root/relative, or a directory on the way to it below root, is
+    // a symbolic link, so writing there could land outside root. checked
+    // remembers the paths found not to be, for callers making many calls
+    // while they create nothing but real directories below root.
+    static bool passesSymLink(const QString &root, const QString &relative,
+                              QSet<QString> *checked = nullptr);
+    // Member name as tools match it: no "./" prefix, no trailing slash
+    static QString normalizeMemberName(QString name);
+    // The requested name that selects member name, empty if none. Selecting
+    // a directory selects everything below it, as with tar -x.
+    static QString selectedBy(const QString &name, const QSet<QString> &requested);
+    // Bytes in the given files and directory trees; fileCount gets the number of files
+    static qint64 totalSize(const QStringList &paths, qint64 *fileCount = nullptr);
+    // Moves the contents of source into destination by renaming, merging
+    // directories and replacing files and links that already exist; source
+    // is removed. Existing directories are never replaced: anything that
+    // clashes with one stays in source, and the result is false.
+    static bool mergeDirectory(const QString &source, const QString &destination);
 };
 
 #endif // ARCHIVEUTILS_H
@@ -1,5 +1,5 @@
 #include "FormatDetector.h"
-#include <QFile>
+#include "ArchiveSource.h"
 #include <QFileInfo>
 
 ArchiveFormat FormatDetector::detectFormat(const QString &filePath) {
@@ -11,13 +11,14 @@ ArchiveFormat FormatDetector::detectFormat(const QString &filePath) {
 }
 
 ArchiveFormat FormatDetector::detectBySignature(const QString &filePath) {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
+    // The mapping the readers will use once the archive is open
+    QSharedPointer<ArchiveSource> source = ArchiveSource::open(filePath);
+    if (!source) {
         return ArchiveFormat::Unknown;
     }
     
-    QByteArray header = file.read(16);
-    file.close();
+    // Enough for the tar magic, which sits at the end of the first header
+    QByteArray header = source->span(0, 512).bytes();
     
     if (header.size() < 4) {
         return ArchiveFormat::Unknown;
@@ -38,18 +39,25 @@ ArchiveFormat FormatDetector::detectBySignature(const QString &filePath) {
         return ArchiveFormat::SevenZip;
     }
     
-    // TAR: ustar or GNU tar magic
-    if (header.size() >= 257 && (header.mid(257, 5) == "ustar" || header.mid(257, 6) == "ustar ")) {
-        // Check extension for compression
-        QString ext = QFileInfo(filePath).suffix().toLower();
-        if (ext == "gz") {
+    // TAR: ustar or GNU tar magic, whatever the name claims
+    if (header.size() >= 263 && header.mid(257, 5) == "ustar") {
+        return ArchiveFormat::Tar;
+    }
+    
+    // Compressed streams carry no hint of a tar inside, so they need the
+    // name too; the magic then wins over a misleading extension
+    if (hasTarballName(filePath)) {
+        if (header.startsWith("\x1f\x8b")) {
             return ArchiveFormat::TarGz;
-        } else if (ext == "bz2") {
+        } else if (header.startsWith("BZh")) {
             return ArchiveFormat::TarBz2;
-        } else if (ext == "xz") {
+        } else if (header.startsWith(QByteArray("\xfd" "7zXZ\x00", 6))) {
             return ArchiveFormat::TarXz;
+        } else if (header.startsWith("\x28\xb5\x2f\xfd")) {
+            return ArchiveFormat::TarZst;
+        } else if (header.startsWith("\x04\x22\x4d\x18")) {
+            return ArchiveFormat::TarLz4;
         }
-        return ArchiveFormat::Tar;
     }
     
     return ArchiveFormat::Unknown;
@@ -68,23 +76,30 @@ ArchiveFormat FormatDetector::detectByExtension(const QString &filePath) {
         return ArchiveFormat::SevenZip;
     } else if (ext == "tar") {
         return ArchiveFormat::Tar;
-    } else if (ext == "gz") {
-        if (baseName.endsWith(".tar")) {
-            return ArchiveFormat::TarGz;
-        }
-    } else if (ext == "bz2") {
-        if (baseName.endsWith(".tar")) {
-            return ArchiveFormat::TarBz2;
-        }
-    } else if (ext == "xz") {
-        if (baseName.endsWith(".tar")) {
-            return ArchiveFormat::TarXz;
-        }
+    } else if (ext == "tgz" || (ext == "gz" && baseName.endsWith(".tar"))) {
+        return ArchiveFormat::TarGz;
+    } else if (ext == "tbz2" || (ext == "bz2" && baseName.endsWith(".tar"))) {
+        return ArchiveFormat::TarBz2;
+    } else if (ext == "txz" || (ext == "xz" && baseName.endsWith(".tar"))) {
+        return ArchiveFormat::TarXz;
+    } else if (ext == "tzst" || (ext == "zst" && baseName.endsWith(".tar"))) {
+        return ArchiveFormat::TarZst;
+    } else if (ext == "tlz4" || (ext == "lz4" && baseName.endsWith(".tar"))) {
+        return ArchiveFormat::TarLz4;
     }
     
     return ArchiveFormat::Unknown;
 }
 
+bool FormatDetector::hasTarballName(const QString &filePath) {
+    QFileInfo info(filePath);
+    QString ext = info.suffix().toLower();
+    if (ext == "tgz" || ext == "tbz2" || ext == "txz" || ext == "tzst" || ext == "tlz4") {
+        return true;
+    }
+    return info.completeBaseName().toLower().endsWith(".tar");
+}
+
 QString FormatDetector::formatExtension(ArchiveFormat format) {
     switch (format) {
         case ArchiveFormat::RAR: return "rar";
@@ -94,6 +109,8 @@ QString FormatDetector::formatExtension(ArchiveFormat format) {
         case ArchiveFormat::TarGz: return "tar.gz";
         case ArchiveFormat::TarBz2: return "tar.bz2";
         case ArchiveFormat::TarXz: return "tar.xz";
+        case ArchiveFormat::TarZst: return "tar.zst";
+        case ArchiveFormat::TarLz4: return "tar.lz4";
         default: return "";
     }
 }
@@ -107,6 +124,8 @@ QString FormatDetector::formatName(ArchiveFormat format) {
         case ArchiveFormat::TarGz: return "TAR.GZ";
         case ArchiveFormat::TarBz2: return "TAR.BZ2";
         case ArchiveFormat::TarXz: return "TAR.XZ";
+        case ArchiveFormat::TarZst: return "TAR.ZST";
+        case ArchiveFormat::TarLz4: return "TAR.LZ4";
         default: return "Unknown";
     }
 }
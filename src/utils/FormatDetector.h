@@ -11,7 +11,9 @@ enum class ArchiveFormat {
     Tar,
     TarGz,
     TarBz2,
-    TarXz
+    TarXz,
+    TarZst,
+    TarLz4
 };
 
 class FormatDetector {
@@ -23,6 +25,8 @@ public:
 private:
     static ArchiveFormat detectBySignature(const QString &filePath);
     static ArchiveFormat detectByExtension(const QString &filePath);
+    // Named like a compressed tarball: *.tar.<ext> or one of the short forms
+    static bool hasTarballName(const QString &filePath);
 };
 
 #endif // FORMATDETECTOR_H
@@ -0,0 +1,86 @@
+#include "OutputBuffer.h"
+#include <QTemporaryFile>
+#include <QDir>
+
+OutputBuffer::OutputBuffer(qint64 memoryLimit, qint64 maximumSize)
+    : totalSize(0), memoryLimit(memoryLimit), maximumSize(maximumSize),
+      truncated(false), spillFile(nullptr) {
+}
+
+OutputBuffer::~OutputBuffer() {
+    delete spillFile;
+}
+
+void OutputBuffer::append(const QByteArray &chunk) {
+    if (chunk.isEmpty() || truncated) {
+        return;
+    }
+    
+    QByteArray data = chunk;
+    if (maximumSize > 0 && totalSize + data.size() > maximumSize) {
+        data.truncate(maximumSize - totalSize);
+        truncated = true;
+    }
+    
+    if (!spillFile && memoryLimit > 0 && totalSize + data.size() > memoryLimit) {
+        spill();
+    }
+    
+    if (spillFile) {
+        spillFile->write(data);
+    } else {
+        // Implicitly shared: no copy of the chunk is made here
+        chunks.append(data);
+    }
+    totalSize += data.size();
+}
+
+bool OutputBuffer::spill() {
+    spillFile = new QTemporaryFile(QDir::tempPath() + "/linrar-output-XXXXXX");
+    if (!spillFile->open()) {
+        // Keep buffering in memory rather than losing output
+        delete spillFile;
+        spillFile = nullptr;
+        memoryLimit = 0;
+        return false;
+    }
+    
+    for (const QByteArray &chunk : chunks) {
+        spillFile->write(chunk);
+    }
+    chunks.clear();
+    return true;
+}
+
+void OutputBuffer::clear() {
+    chunks.clear();
+    delete spillFile;
+    spillFile = nullptr;
+    totalSize = 0;
+    truncated = false;
+}
+
+QByteArray OutputBuffer::toByteArray() const {
+    if (spillFile) {
+        spillFile->flush();
+        spillFile->seek(0);
+        QByteArray data = spillFile->readAll();
+        spillFile->seek(spillFile->size());
+        return data;
+    }
+    
+    if (chunks.size() == 1) {
+        return chunks.first();
+    }
+    
+    QByteArray data;
+    data.reserve(totalSize);
+    for (const QByteArray &chunk : chunks) {
+        data.append(chunk);
+    }
+    return data;
+}
+
+QString OutputBuffer::toString() const {
+    return QString::fromUtf8(toByteArray());
+}
@@ -0,0 +1,48 @@
+#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QTemporaryFile;
+
+// Accumulates raw process output as a list of chunks. Appending never
+// reallocates earlier data; decoding to QString happens once, on demand.
+// Past the memory limit the data spills to a temporary file, and past the
+// maximum size further output is dropped and the buffer marked truncated.
+class OutputBuffer {
+public:
+    OutputBuffer(qint64 memoryLimit = 8 * 1024 * 1024, qint64 maximumSize = 0);
+    ~OutputBuffer();
+
+    void setMemoryLimit(qint64 bytes) { memoryLimit = bytes; }
+    // 0 means unlimited
+    void setMaximumSize(qint64 bytes) { maximumSize = bytes; }
+
+    void append(const QByteArray &chunk);
+    void clear();
+
+    qint64 size() const { return totalSize; }
+    bool isEmpty() const { return totalSize == 0; }
+    bool isTruncated() const { return truncated; }
+    bool isSpilled() const { return spillFile != nullptr; }
+
+    QByteArray toByteArray() const;
+    QString toString() const;
+
+private:
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    bool spill();
+
+    QList<QByteArray> chunks;
+    qint64 totalSize;
+    qint64 memoryLimit;
+    qint64 maximumSize;
+    bool truncated;
+    QTemporaryFile *spillFile;
+};
+
+#endif // OUTPUTBUFFER_H